@@ -40,10 +40,18 @@ typedef struct bs_s
 
     ssize_t  i_left;    /* i_count number of available bits */
     bool     b_read_only;
+    bool     b_ep3b;    /* discards 0x000003 emulation prevention bytes */
 
      /* forward read modifier (p_start, p_end, p_fwpriv, count) */
     uint8_t *(*pf_forward)(uint8_t *, uint8_t *, void *, size_t);
     void    *p_fwpriv;
+
+    /* Read cache, for read only streams without forward modifier.
+     * p then points past the cached bytes, and i_left is unused. */
+    uint64_t i_cache;    /* next bits, msb first, zero padded */
+    uint64_t i_cache_ep; /* bytes of the cache preceded by a discarded one */
+    unsigned i_cached;   /* number of bits in the cache */
+    unsigned i_zeros;    /* zero bytes run before p */
 } bs_t;
 
 static inline void bs_write_init( bs_t *s, void *p_data, size_t i_data )
@@ -53,8 +61,13 @@ static inline void bs_write_init( bs_t *s, void *p_data, size_t i_data )
     s->p_end   = s->p_start + i_data;
     s->i_left  = 8;
     s->b_read_only = false;
+    s->b_ep3b = false;
     s->p_fwpriv = NULL;
     s->pf_forward = NULL;
+    s->i_cache = 0;
+    s->i_cache_ep = 0;
+    s->i_cached = 0;
+    s->i_zeros = 0;
 }
 
 static inline void bs_init( bs_t *s, const void *p_data, size_t i_data )
@@ -63,13 +76,112 @@ static inline void bs_init( bs_t *s, const void *p_data, size_t i_data )
     s->b_read_only = true;
 }
 
+static inline bool bs_cached( const bs_t *s )
+{
+    return s->b_read_only && !s->pf_forward;
+}
+
+/* Emulation prevention byte at p, which would be discarded on next refill */
+static inline bool bs_ep3b_next( const bs_t *s )
+{
+    return s->b_ep3b && s->i_zeros >= 2 && s->p + 1 < s->p_end && *s->p == 0x03;
+}
+
+/* Offset of the reading position from p, in bits */
+static inline int bs_cache_offset( const bs_t *s )
+{
+    if( s->i_cached == 0 )
+        return bs_ep3b_next( s ) ? 8 : 0;
+    /* discarded bytes after the reading position are still ahead */
+    if( likely( !s->i_cache_ep ) )
+        return -(int)s->i_cached;
+    return -(int)s->i_cached - 8 * popcountll( s->i_cache_ep << 1 );
+}
+
+static inline void bs_refill( bs_t *s )
+{
+    /* work on locals, as byte reads may alias the state */
+    const uint8_t *p = s->p;
+    const uint8_t *p_end = s->p_end;
+    uint64_t i_cache = s->i_cache;
+    unsigned i_cached = s->i_cached;
+    const size_t i_avail = p_end - p;
+
+    if( i_cached <= 56 && i_avail > 0 )
+    {
+        unsigned i_bytes = ( 64 - i_cached ) / 8;
+        uint64_t i_word;
+        if( i_avail >= 8 )
+            i_word = GetQWBE( p );
+        else if( p_end - s->p_start >= 8 ) /* tail, from the last whole word */
+            i_word = GetQWBE( p_end - 8 ) << ( 8 * ( 8 - i_avail ) );
+        else
+        {
+            i_word = 0;
+            for( size_t i = 0; i < i_avail; i++ )
+                i_word |= (uint64_t) p[i] << ( 56 - 8 * i );
+        }
+        if( i_bytes > i_avail )
+            i_bytes = i_avail;
+
+        /* no zero byte, no possible emulation prevention */
+        const uint64_t i_tested = i_bytes < 8 ? i_word | ( UINT64_MAX >> ( 8 * i_bytes ) ) : i_word;
+        if( !s->b_ep3b || ( !s->i_zeros &&
+            !((i_tested - UINT64_C(0x0101010101010101)) & ~i_tested & UINT64_C(0x8080808080808080)) ) )
+        {
+            s->i_cache = i_cache | ( i_word >> ( 64 - 8 * i_bytes ) ) << ( 64 - 8 * i_bytes - i_cached );
+            s->i_cached = i_cached + 8 * i_bytes;
+            s->p += i_bytes;
+            return;
+        }
+    }
+
+    if( !s->b_ep3b )
+        return;
+
+    uint64_t i_cache_ep = s->i_cache_ep;
+    unsigned i_zeros = s->i_zeros;
+    while( i_cached <= 56 && p < p_end )
+    {
+        uint8_t i_byte = *p++;
+        if( i_zeros >= 2 && i_byte == 0x03 && p < p_end )
+        {
+            i_byte = *p++;
+            i_cache_ep |= UINT64_C(1) << ( 63 - i_cached );
+            i_zeros = 0;
+        }
+        i_zeros = i_byte ? 0 : i_zeros + 1;
+        i_cache |= (uint64_t) i_byte << ( 56 - i_cached );
+        i_cached += 8;
+    }
+
+    s->p = (uint8_t *) p;
+    s->i_cache = i_cache;
+    s->i_cache_ep = i_cache_ep;
+    s->i_cached = i_cached;
+    s->i_zeros = i_zeros;
+}
+
+static inline void bs_consume( bs_t *s, unsigned i_count )
+{
+    /* i_count < 64 */
+    s->i_cache <<= i_count;
+    if( unlikely( s->i_cache_ep ) )
+        s->i_cache_ep <<= i_count;
+    s->i_cached -= i_count;
+}
+
 static inline int bs_pos( const bs_t *s )
 {
+    if( bs_cached( s ) )
+        return 8 * ( s->p - s->p_start ) + bs_cache_offset( s );
     return( 8 * ( s->p - s->p_start ) + 8 - s->i_left );
 }
 
 static inline int bs_remain( const bs_t *s )
 {
+    if( bs_cached( s ) )
+        return 8 * ( s->p_end - s->p ) - bs_cache_offset( s );
     if( s->p >= s->p_end )
         return 0;
     else
@@ -78,6 +190,8 @@ static inline int bs_remain( const bs_t *s )
 
 static inline int bs_eof( const bs_t *s )
 {
+    if( bs_cached( s ) )
+        return( s->i_cached == 0 && s->p >= s->p_end ? 1 : 0 );
     return( s->p >= s->p_end ? 1: 0 );
 }
 
@@ -99,6 +213,18 @@ static inline uint32_t bs_read( bs_t *s, int i_count )
     int      i_shr;
     uint32_t i_result = 0;
 
+    if( bs_cached( s ) )
+    {
+        if( i_count <= 0 )
+            return 0;
+        if( s->i_cached < (unsigned) i_count )
+            bs_refill( s );
+        /* reads zeros past the end */
+        i_result = s->i_cache >> ( 64 - i_count );
+        bs_consume( s, __MIN( (unsigned) i_count, s->i_cached ) );
+        return i_result;
+    }
+
     while( i_count > 0 )
     {
         if( s->p >= s->p_end )
@@ -133,6 +259,19 @@ static inline uint32_t bs_read( bs_t *s, int i_count )
 
 static inline uint32_t bs_read1( bs_t *s )
 {
+    if( bs_cached( s ) )
+    {
+        if( s->i_cached == 0 )
+        {
+            bs_refill( s );
+            if( s->i_cached == 0 )
+                return 0;
+        }
+        const uint32_t i_result = s->i_cache >> 63;
+        bs_consume( s, 1 );
+        return i_result;
+    }
+
     if( s->p < s->p_end )
     {
         unsigned int i_result;
@@ -158,6 +297,43 @@ static inline uint32_t bs_show( bs_t *s, int i_count )
 
 static inline void bs_skip( bs_t *s, ssize_t i_count )
 {
+    if( bs_cached( s ) )
+    {
+        if( i_count <= 0 )
+            return;
+        if( (size_t) i_count < s->i_cached )
+        {
+            bs_consume( s, i_count );
+            return;
+        }
+
+        i_count -= s->i_cached;
+        s->i_cache = s->i_cache_ep = 0;
+        s->i_cached = 0;
+
+        size_t i_bytes = i_count / 8;
+        if( !s->b_ep3b )
+        {
+            s->p += __MIN( i_bytes, (size_t)( s->p_end - s->p ) );
+        }
+        else while( i_bytes-- > 0 && s->p < s->p_end )
+        {
+            if( bs_ep3b_next( s ) )
+            {
+                s->p++;
+                s->i_zeros = 0;
+            }
+            s->i_zeros = *s->p++ ? 0 : s->i_zeros + 1;
+        }
+
+        if( i_count % 8 )
+        {
+            bs_refill( s );
+            bs_consume( s, __MIN( (unsigned)( i_count % 8 ), s->i_cached ) );
+        }
+        return;
+    }
+
     s->i_left -= i_count;
 
     if( s->i_left <= 0 )
@@ -202,11 +378,19 @@ static inline void bs_write( bs_t *s, int i_count, uint32_t i_bits )
 
 static inline bool bs_aligned( bs_t *s )
 {
+    if( bs_cached( s ) )
+        return s->i_cached % 8 == 0;
     return s->i_left % 8 == 0;
 }
 
 static inline void bs_align( bs_t *s )
 {
+    if( bs_cached( s ) )
+    {
+        bs_consume( s, s->i_cached % 8 );
+        return;
+    }
+
     if( s->i_left != 8 )
     {
         s->i_left = 8;
@@ -233,9 +417,27 @@ static inline void bs_align_1( bs_t *s )
 /* Read unsigned Exp-Golomb code */
 static inline uint32_t bs_read_ue( bs_t * bs )
 {
+    if( bs_cached( bs ) )
+    {
+        /* whole code from the cache: leading zeros, 1, then as many bits */
+        if( bs->i_cached < 32 )
+            bs_refill( bs );
+        const uint32_t i_top = bs->i_cache >> 32;
+        if( i_top )
+        {
+            const unsigned i_length = 2 * clz32( i_top ) + 1;
+            if( i_length <= bs->i_cached )
+            {
+                const uint32_t i_code = bs->i_cache >> ( 64 - i_length );
+                bs_consume( bs, i_length );
+                return i_code - 1;
+            }
+        }
+    }
+
     int32_t i = 0;
 
-    while( bs_read1( bs ) == 0 && bs->p < bs->p_end && i < 31 )
+    while( bs_read1( bs ) == 0 && !bs_eof( bs ) && i < 31 )
         i++;
 
     return (1 << i) - 1 + bs_read( bs, i );
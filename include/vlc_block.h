@@ -146,6 +146,39 @@ VLC_API block_t *block_Alloc(size_t size) VLC_USED VLC_MALLOC;
 
 block_t *block_TryRealloc(block_t *, ssize_t pre, size_t body) VLC_USED;
 
+/**
+ * Enables recycling of blocks allocated with block_Alloc().
+ *
+ * Small blocks are then rounded up to a power of two size and, once
+ * released by any thread, kept in the cache of the thread that allocated
+ * them instead of being freed. Calls are reference counted and must be
+ * paired with vlc_block_cache_Disable().
+ */
+VLC_API void vlc_block_cache_Enable(void);
+
+/**
+ * Disables recycling of blocks.
+ *
+ * The cache of the calling thread is emptied. The caches of other threads
+ * are emptied when these threads exit.
+ */
+VLC_API void vlc_block_cache_Disable(void);
+
+typedef struct
+{
+    uint64_t hits; /**< Allocations served from a cache */
+    uint64_t misses; /**< Allocations served by the heap */
+    uint64_t recycled; /**< Releases put back in a cache */
+    uint64_t dropped; /**< Releases freed because a cache was full */
+} vlc_block_cache_stats_t;
+
+/**
+ * Gets the block recycling counters, accumulated since start-up.
+ *
+ * @note Counters of threads other than the caller are updated lazily.
+ */
+VLC_API void vlc_block_cache_GetStats(vlc_block_cache_stats_t *);
+
 /**
  * Reallocates a block.
  *
@@ -215,6 +248,43 @@ static inline block_t *block_Duplicate( block_t *p_block )
     return p_dup;
 }
 
+/**
+ * Makes the payload of a block shareable.
+ *
+ * Moves the payload of a block into a reference counted buffer, so that
+ * block_Share() can then create more blocks referencing it without copying.
+ * The block properties (flags, timestamps, payload bounds) remain distinct
+ * for each block, but the payload becomes read-only:
+ * use block_Writable() or block_Realloc() before modifying it.
+ *
+ * @param block block to make shareable (cannot be NULL)
+ * @return the shareable block (which may be the input block, including if
+ * memory is lacking); it cannot be NULL.
+ */
+VLC_API block_t *block_Shareable(block_t *block) VLC_USED;
+
+/**
+ * Shares the payload of a block.
+ *
+ * Creates a new block referencing the payload of a block returned by
+ * block_Shareable(). If the payload is not shareable, it is copied as with
+ * block_Duplicate().
+ *
+ * @return the new block on success, NULL on error.
+ */
+VLC_API block_t *block_Share(block_t *block) VLC_USED;
+
+/**
+ * Ensures the payload of a block can be modified.
+ *
+ * If the payload is shared with other blocks, it is copied into a new block
+ * and the given block is released. Otherwise the block is returned as is.
+ *
+ * @return a block with a writeable payload, or NULL on error
+ * (the block is released in that case).
+ */
+VLC_API block_t *block_Writable(block_t *block) VLC_USED;
+
 /**
  * Wraps heap in a block.
  *
@@ -432,6 +502,21 @@ static inline block_t *block_ChainGather( block_t *p_list )
  */
 VLC_API block_fifo_t *block_FifoNew(void) VLC_USED VLC_MALLOC;
 
+/**
+ * Creates a single consumer FIFO queue of blocks.
+ *
+ * This works like block_FifoNew(), but blocks are queued without locking,
+ * and the FIFO lock is only taken by producers if it is held, i.e. if the
+ * consumer may be waiting for data.
+ *
+ * @warning Only one thread at a time may dequeue or peek blocks. Threads
+ * dequeuing with the FIFO lock held are serialized among themselves, but not
+ * against block_FifoGet(), block_FifoShow() or block_FifoEmpty().
+ *
+ * @return the FIFO or NULL on memory error
+ */
+VLC_API block_fifo_t *block_FifoNewSPSC(void) VLC_USED VLC_MALLOC;
+
 /**
  * Destroys a FIFO created by block_FifoNew().
  *
@@ -124,6 +124,13 @@ typedef struct httpd_file_t     httpd_file_t;
 typedef struct httpd_file_sys_t httpd_file_sys_t;
 typedef int (*httpd_file_callback_t)( httpd_file_sys_t *, httpd_file_t *, uint8_t *psz_request, uint8_t **pp_data, int *pi_data );
 VLC_API httpd_file_t * httpd_FileNew( httpd_host_t *, const char *psz_url, const char *psz_mime, const char *psz_user, const char *psz_password, httpd_file_callback_t pf_fill, httpd_file_sys_t * ) VLC_USED;
+/**
+ * Serves a file from disk. The body is sent straight from the file, with
+ * sendfile() where available, and byte range requests are supported.
+ * The file is opened again for each request, so it may be replaced.
+ * Delete with httpd_FileDelete().
+ */
+VLC_API httpd_file_t * httpd_FileNewPath( httpd_host_t *, const char *psz_url, const char *psz_mime, const char *psz_user, const char *psz_password, const char *psz_path ) VLC_USED;
 VLC_API httpd_file_sys_t * httpd_FileDelete( httpd_file_t * );
 
 
@@ -142,7 +149,11 @@ typedef struct httpd_stream_t httpd_stream_t;
 VLC_API httpd_stream_t * httpd_StreamNew( httpd_host_t *, const char *psz_url, const char *psz_mime, const char *psz_user, const char *psz_password ) VLC_USED;
 VLC_API void httpd_StreamDelete( httpd_stream_t * );
 VLC_API int httpd_StreamHeader( httpd_stream_t *, uint8_t *p_data, int i_data );
-VLC_API int httpd_StreamSend( httpd_stream_t *, const block_t *p_block );
+/**
+ * Appends a block to a stream. The block is sent in place to all clients,
+ * and released once none of them needs it anymore.
+ */
+VLC_API int httpd_StreamSend( httpd_stream_t *, block_t *p_block );
 VLC_API int httpd_StreamSetHTTPHeaders(httpd_stream_t *, httpd_header *, size_t);
 
 /* Msg functions facilities */
@@ -419,6 +419,7 @@ struct input_stats_t
     int64_t i_read_bytes;
     float f_input_bitrate;
     float f_average_input_bitrate;
+    int64_t i_lost_packets;
 
     /* Demux */
     int64_t i_demux_read_packets;
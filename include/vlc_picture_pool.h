@@ -148,14 +148,15 @@ VLC_API void picture_pool_Enum( picture_pool_t *,
 /**
  * Forcefully return all pictures in the pool to free/unallocated state.
  *
- * @warning If any picture in the pool is not free, this function will leak
- * and may eventually cause invalid memory accesses.
+ * @warning If any picture in the pool is not free, its pixels will be shared
+ * by the leaked picture and the next one obtained from the pool. Releasing the
+ * leaked picture later on is safe, and does not return it to the pool.
  *
  * @note This function has no effects if all pictures in the pool are free.
  *
  * @return the number of picture references that were freed
  */
-unsigned picture_pool_Reset( picture_pool_t * );
+VLC_API unsigned picture_pool_Reset( picture_pool_t * );
 
 /**
  * Cancel the picture pool.
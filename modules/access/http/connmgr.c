@@ -187,6 +187,8 @@ struct vlc_http_mgr
     vlc_tls_creds_t *creds;
     struct vlc_http_cookie_jar_t *jar;
     struct vlc_http_conn *conn;
+    vlc_mutex_t lock;
+    bool conn_h2;
     bool use_h2c;
 };
 
@@ -206,6 +208,18 @@ static void vlc_http_mgr_release(struct vlc_http_mgr *mgr,
     vlc_http_conn_release(conn);
 }
 
+static void vlc_http_mgr_add(struct vlc_http_mgr *mgr,
+                             struct vlc_http_conn *conn, bool h2)
+{
+    /* Another request may have set up a connection while waiting for its
+     * response, after this one failed to reuse the previous connection. */
+    if (mgr->conn != NULL)
+        vlc_http_mgr_release(mgr, mgr->conn);
+
+    mgr->conn = conn;
+    mgr->conn_h2 = h2;
+}
+
 static
 struct vlc_http_msg *vlc_http_mgr_reuse(struct vlc_http_mgr *mgr,
                                         const char *host, unsigned port,
@@ -216,19 +230,35 @@ struct vlc_http_msg *vlc_http_mgr_reuse(struct vlc_http_mgr *mgr,
         return NULL;
 
     struct vlc_http_stream *stream = vlc_http_stream_open(conn, req);
-    if (stream != NULL)
-    {
-        struct vlc_http_msg *m = vlc_http_msg_get_initial(stream);
-        if (m != NULL)
-            return m;
-
-        /* NOTE: If the request were not idempotent, we would not know if it
-         * was processed by the other end. Thus POST is not used/supported so
-         * far, and CONNECT is treated as if it were idempotent (which works
-         * fine here). */
+    if (stream == NULL)
+    {   /* Get rid of closing or reset connection */
+        vlc_http_mgr_release(mgr, conn);
+        return NULL;
     }
-    /* Get rid of closing or reset connection */
-    vlc_http_mgr_release(mgr, conn);
+
+    /* Do not hold the manager while waiting for a HTTP/2 response, so that
+     * other requests can be multiplexed onto the same connection meanwhile.
+     * A HTTP/1 connection is busy until the response is received anyway. */
+    const bool h2 = mgr->conn_h2;
+
+    if (h2)
+        vlc_mutex_unlock(&mgr->lock);
+    struct vlc_http_msg *m = vlc_http_stream_read_headers(stream);
+    if (h2)
+        vlc_mutex_lock(&mgr->lock);
+    if (m != NULL)
+        return m;
+
+    /* NOTE: If the request were not idempotent, we would not know if it
+     * was processed by the other end. Thus POST is not used/supported so
+     * far, and CONNECT is treated as if it were idempotent (which works
+     * fine here). */
+
+    /* Get rid of closing or reset connection, unless another request has
+     * already done so. The stream keeps the connection alive until then. */
+    if (mgr->conn == conn)
+        vlc_http_mgr_release(mgr, conn);
+    vlc_http_stream_close(stream, false);
     return NULL;
 }
 
@@ -276,7 +306,7 @@ static struct vlc_http_msg *vlc_https_request(struct vlc_http_mgr *mgr,
         return NULL;
     }
 
-    mgr->conn = conn;
+    vlc_http_mgr_add(mgr, conn, http2);
 
     return vlc_http_mgr_reuse(mgr, host, port, req);
 }
@@ -310,7 +340,7 @@ static struct vlc_http_msg *vlc_http_request(struct vlc_http_mgr *mgr,
         return NULL;
     }
 
-    mgr->conn = conn;
+    vlc_http_mgr_add(mgr, conn, mgr->use_h2c);
 
     return vlc_http_mgr_reuse(mgr, host, port, req);
 }
@@ -319,7 +349,12 @@ struct vlc_http_msg *vlc_http_mgr_request(struct vlc_http_mgr *mgr, bool https,
                                           const char *host, unsigned port,
                                           const struct vlc_http_msg *m)
 {
-    return (https ? vlc_https_request : vlc_http_request)(mgr, host, port, m);
+    struct vlc_http_msg *resp;
+
+    vlc_mutex_lock(&mgr->lock);
+    resp = (https ? vlc_https_request : vlc_http_request)(mgr, host, port, m);
+    vlc_mutex_unlock(&mgr->lock);
+    return resp;
 }
 
 struct vlc_http_cookie_jar_t *vlc_http_mgr_get_jar(struct vlc_http_mgr *mgr)
@@ -339,6 +374,8 @@ struct vlc_http_mgr *vlc_http_mgr_create(vlc_object_t *obj,
     mgr->creds = NULL;
     mgr->jar = jar;
     mgr->conn = NULL;
+    vlc_mutex_init(&mgr->lock);
+    mgr->conn_h2 = false;
     mgr->use_h2c = h2c;
     return mgr;
 }
@@ -349,5 +386,6 @@ void vlc_http_mgr_destroy(struct vlc_http_mgr *mgr)
         vlc_http_mgr_release(mgr, mgr->conn);
     if (mgr->creds != NULL)
         vlc_tls_Delete(mgr->creds);
+    vlc_mutex_destroy(&mgr->lock);
     free(mgr);
 }
@@ -39,6 +39,9 @@ struct vlc_http_cookie_jar_t;
  * establishing a new one. If succesful, the initial HTTP response header is
  * returned.
  *
+ * Requests can be sent from several threads at the same time. They then share
+ * the HTTP/2 connection, if any, as concurrent streams.
+ *
  * @param mgr HTTP connection manager
  * @param https whether to use HTTPS (true) or unencrypted HTTP (false)
  * @param host name of authoritative HTTP server to send the request to
@@ -112,6 +112,7 @@ struct vlc_h1_conn
     struct vlc_http_conn conn;
     struct vlc_http_stream stream;
     uintmax_t content_length;
+    vlc_mutex_t lock; /**< Serializes stream closing and connection release */
     bool connection_close;
     bool active;
     bool released;
@@ -148,7 +149,11 @@ static struct vlc_http_stream *vlc_h1_stream_open(struct vlc_http_conn *c,
     size_t len;
     ssize_t val;
 
-    if (conn->active || conn->conn.tls == NULL)
+    vlc_mutex_lock(&conn->lock);
+    bool busy = conn->active;
+    vlc_mutex_unlock(&conn->lock);
+
+    if (busy || conn->conn.tls == NULL)
         return NULL;
 
     char *payload = vlc_http_msg_format(req, &len, conn->proxy);
@@ -278,9 +283,12 @@ static void vlc_h1_stream_close(struct vlc_http_stream *stream, bool abort)
     if (abort)
         vlc_h1_stream_fatal(conn);
 
+    vlc_mutex_lock(&conn->lock);
     conn->active = false;
+    bool destroy = conn->released;
+    vlc_mutex_unlock(&conn->lock);
 
-    if (conn->released)
+    if (destroy)
         vlc_h1_conn_destroy(conn);
 }
 
@@ -301,6 +309,7 @@ static void vlc_h1_conn_destroy(struct vlc_h1_conn *conn)
         vlc_tls_Shutdown(conn->conn.tls, true);
         vlc_tls_Close(conn->conn.tls);
     }
+    vlc_mutex_destroy(&conn->lock);
     free(conn);
 }
 
@@ -308,10 +317,13 @@ static void vlc_h1_conn_release(struct vlc_http_conn *c)
 {
     struct vlc_h1_conn *conn = (struct vlc_h1_conn *)c;
 
+    vlc_mutex_lock(&conn->lock);
     assert(!conn->released);
     conn->released = true;
+    bool destroy = !conn->active;
+    vlc_mutex_unlock(&conn->lock);
 
-    if (!conn->active)
+    if (destroy)
         vlc_h1_conn_destroy(conn);
 }
 
@@ -330,6 +342,7 @@ struct vlc_http_conn *vlc_h1_conn_create(vlc_tls_t *tls, bool proxy)
     conn->conn.cbs = &vlc_h1_conn_callbacks;
     conn->conn.tls = tls;
     conn->stream.cbs = &vlc_h1_stream_callbacks;
+    vlc_mutex_init(&conn->lock);
     conn->active = false;
     conn->released = false;
     conn->proxy = proxy;
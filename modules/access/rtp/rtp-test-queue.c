@@ -0,0 +1,305 @@
+/*
+ * RTP re-ordering queue unit test
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include "rtp.h"
+
+static demux_sys_t sys;
+static demux_t demux;
+
+/* Decoded packets */
+static struct
+{
+    uint16_t seq;
+    bool discontinuity;
+} out[8192];
+static unsigned outc;
+
+static void test_decode (demux_t *d, void *opaque, block_t *block)
+{
+    assert (d == &demux);
+    assert (opaque == NULL);
+    assert (block->i_buffer == 2);
+    assert (outc < ARRAY_SIZE(out));
+
+    out[outc].seq = GetWBE (block->p_buffer);
+    out[outc].discontinuity = (block->i_flags & BLOCK_FLAG_DISCONTINUITY) != 0;
+    outc++;
+    block_Release (block);
+}
+
+static const rtp_pt_t test_pt = {
+    .decode = test_decode,
+    .frequency = 90000,
+    .number = 33,
+};
+
+static rtp_session_t *test_start (unsigned window)
+{
+    memset (&sys, 0, sizeof (sys));
+    sys.timeout = 3600 * CLOCK_FREQ;
+    sys.max_dropout = 3000;
+    sys.max_misorder = 100;
+    sys.max_src = 1;
+    sys.window = window;
+
+    memset (&demux, 0, sizeof (demux));
+    demux.obj.flags = OBJECT_FLAGS_QUIET;
+    demux.p_sys = &sys;
+
+    rtp_session_t *session = rtp_session_create (&demux);
+    assert (session != NULL);
+    assert (rtp_add_type (&demux, session, &test_pt) == 0);
+    outc = 0;
+    return session;
+}
+
+static void test_queue (rtp_session_t *session, uint16_t seq)
+{
+    block_t *block = block_Alloc (14);
+    assert (block != NULL);
+
+    uint8_t *p = block->p_buffer;
+    p[0] = 0x80;
+    p[1] = test_pt.number;
+    SetWBE (p + 2, seq);
+    SetDWBE (p + 4, seq * 3000u);
+    SetDWBE (p + 8, 0x12345678);
+    SetWBE (p + 12, seq);
+
+    rtp_queue (&demux, session, block);
+}
+
+/** Checks that the decoded packets are the expected ones, in order, and
+ * that discontinuities are flagged exactly after gaps */
+static void test_check (uint16_t first, unsigned count, const uint16_t *lost,
+                        unsigned lostc)
+{
+    uint16_t seq = first;
+    bool gap = false;
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < count; i++, seq++)
+    {
+        bool missing = false;
+
+        for (unsigned j = 0; j < lostc; j++)
+            if (lost[j] == seq)
+                missing = true;
+
+        if (missing)
+        {
+            gap = true;
+            continue;
+        }
+
+        assert (n < outc);
+        assert (out[n].seq == seq);
+        assert (out[n].discontinuity == gap);
+        gap = false;
+        n++;
+    }
+    assert (n == outc);
+}
+
+static void test_dequeue (rtp_session_t *session)
+{
+    mtime_t deadline;
+
+    rtp_dequeue (&demux, session, &deadline);
+}
+
+/* Packets in order are decoded right away */
+static void test_in_order (uint16_t first)
+{
+    rtp_session_t *session = test_start (1024);
+    struct rtp_stats stats;
+
+    for (unsigned i = 0; i < 2000; i++)
+    {
+        test_queue (session, first + i);
+        test_dequeue (session);
+        assert (outc == i + 1);
+    }
+
+    test_check (first, 2000, NULL, 0);
+    rtp_get_stats (session, &stats);
+    assert (stats.late == 0 && stats.duplicate == 0 && stats.reordered == 0);
+    assert (stats.lost == 0);
+    rtp_session_destroy (&demux, session);
+}
+
+/* Groups of 16 packets received in reverse order, with duplicates */
+static void test_reordered (uint16_t first)
+{
+    rtp_session_t *session = test_start (1024);
+    struct rtp_stats stats;
+
+    /* Start the source in order */
+    test_queue (session, first - 1);
+    test_dequeue (session);
+    assert (outc == 1);
+    outc = 0;
+
+    for (unsigned i = 0; i < 4096; i += 16)
+    {
+        for (unsigned j = 16; j-- > 0;)
+        {
+            test_queue (session, first + i + j);
+            if (j % 4 == 0)
+                test_queue (session, first + i + j);
+        }
+        test_dequeue (session);
+        /* Each group is complete once its first packet arrives */
+        assert (outc == i + 16);
+    }
+
+    test_check (first, 4096, NULL, 0);
+    rtp_get_stats (session, &stats);
+    assert (stats.late == 0);
+    assert (stats.duplicate == 4096 / 4);
+    assert (stats.reordered == 4096 / 16 * 15);
+    assert (stats.max_depth == 15);
+
+    /* Packets already decoded are late */
+    test_queue (session, first + 4000);
+    test_queue (session, first + 4095);
+    rtp_get_stats (session, &stats);
+    assert (stats.late == 2);
+    assert (outc == 4096);
+    rtp_session_destroy (&demux, session);
+}
+
+/* Lost packets are given up on after the deadline */
+static void test_lost (uint16_t first)
+{
+    static const uint16_t lost[] = { 10, 11, 100, 101, 102 };
+    rtp_session_t *session = test_start (1024);
+    uint16_t lostv[ARRAY_SIZE(lost)];
+
+    for (unsigned i = 0; i < ARRAY_SIZE(lost); i++)
+        lostv[i] = first + lost[i];
+
+    /* Wait for the first missing packets */
+    for (unsigned i = 0; i < 13; i++)
+        if (i != 10 && i != 11)
+            test_queue (session, first + i);
+
+    mtime_t deadline;
+    assert (rtp_dequeue (&demux, session, &deadline));
+    assert (outc == 10);
+    assert (deadline > mdate ());
+
+    mwait (deadline);
+    assert (!rtp_dequeue (&demux, session, &deadline));
+    assert (outc == 11);
+
+    /* Flush the rest */
+    for (unsigned i = 13; i < 1000; i++)
+    {
+        bool missing = false;
+
+        for (unsigned j = 0; j < ARRAY_SIZE(lost); j++)
+            if (lost[j] == i)
+                missing = true;
+        if (!missing)
+            test_queue (session, first + i);
+    }
+    rtp_dequeue_force (&demux, session);
+
+    test_check (first, 1000, lostv, ARRAY_SIZE(lostv));
+    rtp_session_destroy (&demux, session);
+}
+
+/* Packets beyond the window push out the missing ones */
+static void test_window (uint16_t first)
+{
+    static const uint16_t lost[] = { 1, 2, 3 };
+    rtp_session_t *session = test_start (64);
+    uint16_t lostv[ARRAY_SIZE(lost)];
+    struct rtp_stats stats;
+
+    for (unsigned i = 0; i < ARRAY_SIZE(lost); i++)
+        lostv[i] = first + lost[i];
+
+    test_queue (session, first);
+    for (unsigned i = 4; i < 200; i++)
+        test_queue (session, first + i);
+
+    /* Nothing was dequeued, yet the window limited the queue */
+    assert (outc == 200 - 64 - 3);
+    rtp_dequeue_force (&demux, session);
+    test_check (first, 200, lostv, ARRAY_SIZE(lostv));
+
+    /* Packets pushed out of the window are now too late */
+    test_queue (session, first + 130);
+    rtp_get_stats (session, &stats);
+    assert (stats.late == 1);
+    assert (stats.lost == ARRAY_SIZE(lost));
+    rtp_session_destroy (&demux, session);
+}
+
+/* A jump beyond the window with nothing queued */
+static void test_jump (uint16_t first)
+{
+    rtp_session_t *session = test_start (64);
+    struct rtp_stats stats;
+
+    test_queue (session, first);
+    test_dequeue (session);
+    assert (outc == 1);
+
+    /* The packets that still fit in the window can be waited for */
+    test_queue (session, first + 500);
+    test_queue (session, first + 499);
+    test_queue (session, first + 440);
+    assert (outc == 1);
+    rtp_dequeue_force (&demux, session);
+    assert (outc == 4);
+
+    /* All the packets in between are counted lost, once */
+    rtp_get_stats (session, &stats);
+    assert (stats.lost == 499 - 2);
+    rtp_session_destroy (&demux, session);
+}
+
+int main (void)
+{
+    static const uint16_t starts[] = { 0, 1234, 65000 /* wraps around */ };
+
+    for (unsigned i = 0; i < ARRAY_SIZE(starts); i++)
+    {
+        test_in_order (starts[i]);
+        test_reordered (starts[i]);
+        test_lost (starts[i]);
+        test_window (starts[i]);
+        test_jump (starts[i]);
+    }
+    return 0;
+}
@@ -75,6 +75,12 @@
     "RTP packets will be discarded if they are too far behind (i.e. in the " \
     "past) by this many packets from the last received packet." )
 
+#define RTP_WINDOW_TEXT N_("RTP re-ordering window")
+#define RTP_WINDOW_LONGTEXT N_( \
+    "Number of RTP packets that can be buffered while waiting for a " \
+    "missing packet. Packets further ahead cause the missing ones to be " \
+    "given up on." )
+
 #define RTP_DYNAMIC_PT_TEXT N_("RTP payload format assumed for dynamic " \
                                "payloads")
 #define RTP_DYNAMIC_PT_LONGTEXT N_( \
@@ -122,6 +128,9 @@ vlc_module_begin ()
     add_integer ("rtp-max-misorder", 100, RTP_MAX_MISORDER_TEXT,
                  RTP_MAX_MISORDER_LONGTEXT, true)
         change_integer_range (0, 32767)
+    add_integer ("rtp-window", 1024, RTP_WINDOW_TEXT,
+                 RTP_WINDOW_LONGTEXT, true)
+        change_integer_range (16, 16384)
     add_string ("rtp-dynamic-pt", NULL, RTP_DYNAMIC_PT_TEXT,
                 RTP_DYNAMIC_PT_LONGTEXT, true)
         change_string_list (dynamic_pt_list, dynamic_pt_list_text)
@@ -264,6 +273,7 @@ static int Open (vlc_object_t *obj)
                         * CLOCK_FREQ;
     p_sys->max_dropout  = var_CreateGetInteger (obj, "rtp-max-dropout");
     p_sys->max_misorder = var_CreateGetInteger (obj, "rtp-max-misorder");
+    p_sys->window       = var_CreateGetInteger (obj, "rtp-window");
     p_sys->thread_ready = false;
     p_sys->autodetect   = true;
 
@@ -333,7 +343,16 @@ static void Close (vlc_object_t *obj)
         srtp_destroy (p_sys->srtp);
 #endif
     if (p_sys->session)
+    {
+        struct rtp_stats stats;
+
+        rtp_get_stats (p_sys->session, &stats);
+        msg_Dbg (demux, "RTP session: %u late, %u duplicate, %u re-ordered,"
+                 " %u lost packet(s) (max depth: %u)", stats.late,
+                 stats.duplicate, stats.reordered, stats.lost,
+                 stats.max_depth);
         rtp_session_destroy (demux, p_sys->session);
+    }
     if (p_sys->rtcp_fd != -1)
         net_Close (p_sys->rtcp_fd);
     net_Close (p_sys->fd);
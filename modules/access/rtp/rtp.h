@@ -50,12 +50,22 @@ void xiph_destroy (demux_t *demux, void *data);
 void xiph_decode (demux_t *demux, void *data, block_t *block);
 
 /** @section RTP session */
+struct rtp_stats
+{
+    unsigned late; /**< Packets received after their turn */
+    unsigned duplicate; /**< Packets received twice */
+    unsigned reordered; /**< Packets received after a later one */
+    unsigned max_depth; /**< Largest re-ordering distance (packets) */
+    unsigned lost; /**< Packets given up on */
+};
+
 rtp_session_t *rtp_session_create (demux_t *);
 void rtp_session_destroy (demux_t *, rtp_session_t *);
 void rtp_queue (demux_t *, rtp_session_t *, block_t *);
 bool rtp_dequeue (demux_t *, const rtp_session_t *, mtime_t *);
 void rtp_dequeue_force (demux_t *, const rtp_session_t *);
 int rtp_add_type (demux_t *demux, rtp_session_t *ses, const rtp_pt_t *pt);
+void rtp_get_stats (const rtp_session_t *, struct rtp_stats *);
 
 void *rtp_dgram_thread (void *data);
 void *rtp_stream_thread (void *data);
@@ -75,6 +85,7 @@ struct demux_sys_t
     mtime_t       timeout;
     uint16_t      max_dropout; /**< Max packet forward misordering */
     uint16_t      max_misorder; /**< Max packet backward misordering */
+    uint16_t      window; /**< Re-ordering window (packets) */
     uint8_t       max_src; /**< Max simultaneous RTP sources */
     bool          thread_ready;
     bool          autodetect; /**< Payload type autodetection pending */
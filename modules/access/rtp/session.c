@@ -25,6 +25,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <errno.h>
 
@@ -49,6 +50,8 @@ rtp_source_create (demux_t *, const rtp_session_t *, uint32_t, uint16_t);
 static void
 rtp_source_destroy (demux_t *, const rtp_session_t *, rtp_source_t *);
 
+static void rtp_source_flush (rtp_source_t *);
+
 static void rtp_decode (demux_t *, const rtp_session_t *, rtp_source_t *);
 
 /**
@@ -147,8 +150,14 @@ struct rtp_source_t
     uint16_t bad_seq; /* tentatively next expected sequence for resync */
     uint16_t max_seq; /* next expected sequence */
 
-    uint16_t last_seq; /* sequence of the next dequeued packet */
-    block_t *blocks; /* re-ordered blocks queue */
+    uint16_t last_seq; /* sequence of the last dequeued packet */
+    uint16_t first_seq; /* sequence of the first queued packet */
+    uint16_t end_seq; /* sequence after the last queued packet */
+    unsigned count; /* number of queued packets */
+    unsigned window; /* re-ordering window size (power of two) */
+    block_t **ring; /* re-ordered blocks, indexed by sequence modulo window */
+
+    struct rtp_stats stats;
     void    *opaque[]; /* Per-source private payload data */
 };
 
@@ -159,12 +168,23 @@ static rtp_source_t *
 rtp_source_create (demux_t *demux, const rtp_session_t *session,
                    uint32_t ssrc, uint16_t init_seq)
 {
+    demux_sys_t *sys = demux->p_sys;
     rtp_source_t *source;
 
     source = malloc (sizeof (*source) + (sizeof (void *) * session->ptc));
     if (source == NULL)
         return NULL;
 
+    source->window = 1;
+    while (source->window < sys->window)
+        source->window <<= 1;
+    source->ring = calloc (source->window, sizeof (*source->ring));
+    if (source->ring == NULL)
+    {
+        free (source);
+        return NULL;
+    }
+
     source->ssrc = ssrc;
     source->jitter = 0;
     source->ref_rtp = 0;
@@ -172,7 +192,8 @@ rtp_source_create (demux_t *demux, const rtp_session_t *session,
     source->ref_ntp = UINT64_C (1) << 62;
     source->max_seq = source->bad_seq = init_seq;
     source->last_seq = init_seq - 1;
-    source->blocks = NULL;
+    source->count = 0;
+    memset (&source->stats, 0, sizeof (source->stats));
 
     /* Initializes all payload */
     for (unsigned i = 0; i < session->ptc; i++)
@@ -191,13 +212,38 @@ rtp_source_destroy (demux_t *demux, const rtp_session_t *session,
                     rtp_source_t *source)
 {
     msg_Dbg (demux, "removing RTP source (%08x)", source->ssrc);
+    msg_Dbg (demux, " %u late, %u duplicate, %u re-ordered, %u lost"
+             " packet(s) (max depth: %u)", source->stats.late,
+             source->stats.duplicate, source->stats.reordered,
+             source->stats.lost, source->stats.max_depth);
 
     for (unsigned i = 0; i < session->ptc; i++)
         session->ptv[i].destroy (demux, source->opaque[i]);
-    block_ChainRelease (source->blocks);
+    rtp_source_flush (source);
+    free (source->ring);
     free (source);
 }
 
+/**
+ * Sums the re-ordering statistics of all sources of an RTP session.
+ */
+void rtp_get_stats (const rtp_session_t *session, struct rtp_stats *stats)
+{
+    memset (stats, 0, sizeof (*stats));
+
+    for (unsigned i = 0; i < session->srcc; i++)
+    {
+        const struct rtp_stats *src = &session->srcv[i]->stats;
+
+        stats->late += src->late;
+        stats->duplicate += src->duplicate;
+        stats->reordered += src->reordered;
+        stats->lost += src->lost;
+        if (src->max_depth > stats->max_depth)
+            stats->max_depth = src->max_depth;
+    }
+}
+
 static inline uint16_t rtp_seq (const block_t *block)
 {
     assert (block->i_buffer >= 4);
@@ -210,6 +256,39 @@ static inline uint32_t rtp_timestamp (const block_t *block)
     return GetDWBE (block->p_buffer + 4);
 }
 
+/** Returns the first queued packet of a source, or NULL */
+static inline block_t *rtp_source_first (const rtp_source_t *src)
+{
+    if (src->count == 0)
+        return NULL;
+    return src->ring[src->first_seq & (src->window - 1)];
+}
+
+/** Removes the first queued packet of a source */
+static block_t *rtp_source_take (rtp_source_t *src)
+{
+    const unsigned mask = src->window - 1;
+    block_t *block = src->ring[src->first_seq & mask];
+
+    assert (block != NULL);
+    src->ring[src->first_seq & mask] = NULL;
+
+    /* Look for the next queued packet. The first sequence only moves
+     * forward, so the scan is amortized over the queued packets. */
+    if (--src->count > 0)
+        do
+            src->first_seq++;
+        while (src->ring[src->first_seq & mask] == NULL);
+    return block;
+}
+
+/** Discards all queued packets of a source */
+static void rtp_source_flush (rtp_source_t *src)
+{
+    while (src->count > 0)
+        block_Release (rtp_source_take (src));
+}
+
 static const struct rtp_pt_t *
 rtp_find_ptype (const rtp_session_t *session, rtp_source_t *source,
                 const block_t *block, void **pt_data)
@@ -335,10 +414,9 @@ rtp_queue (demux_t *demux, rtp_session_t *session, block_t *block)
         if (seq == src->bad_seq)
         {
             src->max_seq = src->bad_seq = seq + 1;
-            src->last_seq = seq - 0x7fffe; /* hack for rtp_decode() */
+            src->last_seq = seq - 1;
             msg_Warn (demux, "sequence resynchronized");
-            block_ChainRelease (src->blocks);
-            src->blocks = NULL;
+            rtp_source_flush (src);
         }
         else
         {
@@ -352,23 +430,59 @@ rtp_queue (demux_t *demux, rtp_session_t *session, block_t *block)
 
     /* Queues the block in sequence order,
      * hence there is a single queue for all payload types. */
-    block_t **pp = &src->blocks;
-    for (block_t *prev = *pp; prev != NULL; prev = *pp)
+    int16_t offset = seq - src->last_seq;
+    if (offset <= 0)
+    {   /* Trash too late packets (and PIM Assert duplicates) */
+        msg_Dbg (demux, "ignoring late packet (sequence: %"PRIu16")", seq);
+        src->stats.late++;
+        goto drop;
+    }
+
+    /* Make room if the packet is beyond the re-ordering window: the missing
+     * packets before it are given up on. */
+    while ((unsigned)(uint16_t)(seq - src->last_seq) > src->window)
     {
-        int16_t delta_seq = seq - rtp_seq (prev);
-        if (delta_seq < 0)
+        if (src->count == 0)
+        {   /* Skip the missing packets that no longer fit in the window */
+            uint16_t skipped = seq - src->window - src->last_seq;
+
+            msg_Warn (demux, "%"PRIu16" packet(s) lost", skipped);
+            src->stats.lost += skipped;
+            src->last_seq = seq - src->window;
             break;
-        if (delta_seq == 0)
-        {
-            msg_Dbg (demux, "duplicate packet (sequence: %"PRIu16")", seq);
-            goto drop; /* duplicate */
         }
-        pp = &prev->p_next;
+        rtp_decode (demux, session, src);
+    }
+
+    block_t **slot = &src->ring[seq & (src->window - 1)];
+    if (*slot != NULL)
+    {
+        msg_Dbg (demux, "duplicate packet (sequence: %"PRIu16")", seq);
+        src->stats.duplicate++;
+        goto drop; /* duplicate */
     }
-    block->p_next = *pp;
-    *pp = block;
+    *slot = block;
 
-    /*rtp_decode (demux, session, src);*/
+    if (src->count++ == 0)
+    {
+        src->first_seq = seq;
+        src->end_seq = seq + 1;
+    }
+    else
+    {
+        if ((int16_t)(seq - src->first_seq) < 0)
+            src->first_seq = seq;
+
+        int16_t depth = src->end_seq - 1 - seq;
+        if (depth > 0)
+        {   /* Arrived after some packet(s) following it */
+            src->stats.reordered++;
+            if ((unsigned)depth > src->stats.max_depth)
+                src->stats.max_depth = depth;
+        }
+        else
+            src->end_seq = seq + 1;
+    }
     return;
 
 drop:
@@ -419,7 +533,7 @@ bool rtp_dequeue (demux_t *demux, const rtp_session_t *session,
          * LibVLC E/S-out clock synchronization. Here, we need to bother about
          * re-ordering packets, as decoders can't cope with mis-ordered data.
          */
-        while (((block = src->blocks)) != NULL)
+        while (((block = rtp_source_first (src))) != NULL)
         {
             if ((int16_t)(rtp_seq (block) - (src->last_seq + 1)) <= 0)
             {   /* Next (or earlier) block ready, no need to wait */
@@ -470,9 +584,8 @@ void rtp_dequeue_force (demux_t *demux, const rtp_session_t *session)
     for (unsigned i = 0, max = session->srcc; i < max; i++)
     {
         rtp_source_t *src = session->srcv[i];
-        block_t *block;
 
-        while (((block = src->blocks)) != NULL)
+        while (src->count > 0)
             rtp_decode (demux, session, src);
     }
 }
@@ -483,23 +596,15 @@ void rtp_dequeue_force (demux_t *demux, const rtp_session_t *session)
 static void
 rtp_decode (demux_t *demux, const rtp_session_t *session, rtp_source_t *src)
 {
-    block_t *block = src->blocks;
-
-    assert (block);
-    src->blocks = block->p_next;
-    block->p_next = NULL;
+    block_t *block = rtp_source_take (src);
 
     /* Discontinuity detection */
     uint16_t delta_seq = rtp_seq (block) - (src->last_seq + 1);
     if (delta_seq != 0)
     {
-        if (delta_seq >= 0x8000)
-        {   /* Trash too late packets (and PIM Assert duplicates) */
-            msg_Dbg (demux, "ignoring late packet (sequence: %"PRIu16")",
-                      rtp_seq (block));
-            goto drop;
-        }
+        assert (delta_seq < 0x8000); /* late packets are not queued */
         msg_Warn (demux, "%"PRIu16" packet(s) lost", delta_seq);
+        src->stats.lost += delta_seq;
         block->i_flags |= BLOCK_FLAG_DISCONTINUITY;
     }
     src->last_seq = rtp_seq (block);
@@ -43,6 +43,7 @@
 #include <vlc_network.h>
 #include <vlc_block.h>
 #include <vlc_interrupt.h>
+#include <vlc_atomic.h>
 #ifdef HAVE_POLL
 # include <poll.h>
 #endif
@@ -56,6 +57,9 @@ static void Close( vlc_object_t * );
 #define BUFFER_TEXT N_("Receive buffer")
 #define BUFFER_LONGTEXT N_("UDP receive buffer size (bytes)" )
 #define TIMEOUT_TEXT N_("UDP Source timeout (sec)")
+#define BATCH_TEXT N_("Receive batch")
+#define BATCH_LONGTEXT N_("Maximum number of datagrams received at once " \
+    "into preallocated packet buffers (1 to receive one datagram at a time).")
 
 vlc_module_begin ()
     set_shortname( N_("UDP" ) )
@@ -66,6 +70,10 @@ vlc_module_begin ()
     add_obsolete_integer( "server-port" ) /* since 2.0.0 */
     add_obsolete_integer( "udp-buffer" ) /* since 3.0.0 */
     add_integer( "udp-timeout", -1, TIMEOUT_TEXT, NULL, true )
+#ifdef HAVE_RECVMMSG
+    add_integer( "udp-batch", 32, BATCH_TEXT, BATCH_LONGTEXT, true )
+        change_integer_range( 1, 1024 )
+#endif
 
     set_capability( "access", 0 )
     add_shortcut( "udp", "udpstream", "udp4", "udp6" )
@@ -73,17 +81,65 @@ vlc_module_begin ()
     set_callbacks( Open, Close )
 vlc_module_end ()
 
+#ifdef HAVE_RECVMMSG
+/*
+ * Packet ring: a single allocation of MTU-sized slots, each with its own
+ * block header. Slots are handed out to the demuxer as blocks and return to
+ * the ring when released, from any thread. The ring outlives the access
+ * until the last slot is released.
+ */
+typedef struct udp_ring udp_ring_t;
+
+typedef struct
+{
+    block_t     self;
+    udp_ring_t *ring;
+    atomic_bool used;
+} udp_slot_t;
+
+struct udp_ring
+{
+    atomic_uint refs;
+    size_t      mtu;
+    unsigned    count;
+    unsigned    next; /* first slot to try (receiver thread only) */
+    uint8_t    *buffer;
+    udp_slot_t  slots[];
+};
+
+/* Room for the SO_RXQ_OVFL control message */
+typedef union
+{
+    char buf[CMSG_SPACE(sizeof (uint32_t))];
+    struct cmsghdr align;
+} udp_cmsg_t;
+#endif
+
 struct access_sys_t
 {
     int fd;
     int timeout;
     size_t mtu;
+#ifdef HAVE_RECVMMSG
+    unsigned batch;
+    udp_ring_t *ring;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    udp_cmsg_t *cmsgs;
+    block_t **blocks;
+    uint32_t drops; /* last kernel drop counter */
+    uint64_t lost; /* drops not reported yet */
+#endif
 };
 
 /*****************************************************************************
  * Local prototypes
  *****************************************************************************/
 static block_t *BlockUDP( access_t *, bool * );
+#ifdef HAVE_RECVMMSG
+static block_t *BlockUDPBatch( access_t *, bool * );
+static void RingRelease( udp_ring_t * );
+#endif
 static int Control( access_t *, int, va_list );
 
 /*****************************************************************************
@@ -173,6 +229,38 @@ error:
     if( sys->timeout > 0)
         sys->timeout *= 1000;
 
+#ifdef HAVE_RECVMMSG
+    sys->batch = var_InheritInteger( p_access, "udp-batch" );
+    sys->ring = NULL;
+    sys->drops = 0;
+    sys->lost = 0;
+
+    if( sys->batch > 1 )
+    {
+        sys->msgs = calloc( sys->batch, sizeof( *sys->msgs ) );
+        sys->iovs = calloc( sys->batch, sizeof( *sys->iovs ) );
+        sys->cmsgs = calloc( sys->batch, sizeof( *sys->cmsgs ) );
+        sys->blocks = calloc( sys->batch, sizeof( *sys->blocks ) );
+        if( unlikely(sys->msgs == NULL || sys->iovs == NULL
+                  || sys->cmsgs == NULL || sys->blocks == NULL) )
+        {
+            free( sys->blocks );
+            free( sys->cmsgs );
+            free( sys->iovs );
+            free( sys->msgs );
+            net_Close( sys->fd );
+            free( sys );
+            return VLC_ENOMEM;
+        }
+
+#ifdef SO_RXQ_OVFL
+        /* Have the kernel report how many datagrams it dropped */
+        setsockopt( sys->fd, SOL_SOCKET, SO_RXQ_OVFL, &(int){ 1 },
+                    sizeof (int) );
+#endif
+        p_access->pf_block = BlockUDPBatch;
+    }
+#endif
     return VLC_SUCCESS;
 }
 
@@ -185,6 +273,17 @@ static void Close( vlc_object_t *p_this )
     access_sys_t *sys = p_access->p_sys;
 
     net_Close( sys->fd );
+#ifdef HAVE_RECVMMSG
+    if( sys->batch > 1 )
+    {
+        if( sys->ring != NULL )
+            RingRelease( sys->ring );
+        free( sys->blocks );
+        free( sys->cmsgs );
+        free( sys->iovs );
+        free( sys->msgs );
+    }
+#endif
     free( sys );
 }
 
@@ -212,6 +311,17 @@ static int Control( access_t *p_access, int i_query, va_list args )
                    * var_InheritInteger(p_access, "network-caching");
             break;
 
+#ifdef HAVE_RECVMMSG
+        case STREAM_GET_LOST_PACKETS:
+        {
+            access_sys_t *sys = p_access->p_sys;
+
+            *va_arg( args, uint64_t * ) = sys->lost;
+            sys->lost = 0;
+            break;
+        }
+#endif
+
         default:
             return VLC_EGENERIC;
     }
@@ -282,3 +392,196 @@ skip:
 
     return pkt;
 }
+
+#ifdef HAVE_RECVMMSG
+/*****************************************************************************
+ * BlockUDPBatch: receive several datagrams at once into the packet ring
+ *****************************************************************************/
+static udp_ring_t *RingNew(size_t mtu, unsigned count)
+{
+    udp_ring_t *ring = malloc(sizeof (*ring) + count * sizeof (udp_slot_t));
+    if (unlikely(ring == NULL))
+        return NULL;
+
+    ring->buffer = malloc(mtu * count);
+    if (unlikely(ring->buffer == NULL))
+    {
+        free(ring);
+        return NULL;
+    }
+
+    atomic_init(&ring->refs, 1);
+    ring->mtu = mtu;
+    ring->count = count;
+    ring->next = 0;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        ring->slots[i].ring = ring;
+        atomic_init(&ring->slots[i].used, false);
+    }
+    return ring;
+}
+
+static void RingRelease(udp_ring_t *ring)
+{
+    if (atomic_fetch_sub_explicit(&ring->refs, 1, memory_order_acq_rel) > 1)
+        return;
+
+    free(ring->buffer);
+    free(ring);
+}
+
+static void SlotRelease(block_t *block)
+{
+    udp_slot_t *slot = (udp_slot_t *)block;
+    udp_ring_t *ring = slot->ring;
+
+    atomic_store_explicit(&slot->used, false, memory_order_release);
+    RingRelease(ring);
+}
+
+/* Takes a free slot from the ring, or allocates a block if there is none */
+static block_t *RingGet(udp_ring_t *ring)
+{
+    for (unsigned i = 0; i < ring->count; i++)
+    {
+        unsigned index = (ring->next + i) % ring->count;
+        udp_slot_t *slot = &ring->slots[index];
+
+        if (atomic_load_explicit(&slot->used, memory_order_acquire))
+            continue;
+
+        atomic_store_explicit(&slot->used, true, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ring->refs, 1, memory_order_relaxed);
+        ring->next = (index + 1) % ring->count;
+
+        block_Init(&slot->self, ring->buffer + index * ring->mtu, ring->mtu);
+        slot->self.pf_release = SlotRelease;
+        return &slot->self;
+    }
+
+    /* All slots are held downstream */
+    return block_Alloc(ring->mtu);
+}
+
+static block_t *BlockUDPBatch(access_t *access, bool *restrict eof)
+{
+    access_sys_t *sys = access->p_sys;
+
+    if (sys->ring == NULL || sys->ring->mtu != sys->mtu)
+    {   /* (Re)create the ring with the current MTU. Blocks still in use
+         * keep the old ring alive. */
+        udp_ring_t *ring = RingNew(sys->mtu, 4 * sys->batch);
+        if (unlikely(ring == NULL))
+            return BlockUDP(access, eof);
+
+        if (sys->ring != NULL)
+            RingRelease(sys->ring);
+        sys->ring = ring;
+    }
+
+    struct pollfd ufd[1];
+
+    ufd[0].fd = sys->fd;
+    ufd[0].events = POLLIN;
+
+    switch (vlc_poll_i11e(ufd, 1, sys->timeout))
+    {
+        case 0:
+            msg_Err(access, "receive time-out");
+            *eof = true;
+            /* fall through */
+        case -1:
+            return NULL;
+    }
+
+    unsigned count = 0;
+
+    while (count < sys->batch)
+    {
+        block_t *pkt = RingGet(sys->ring);
+        if (unlikely(pkt == NULL))
+            break;
+
+        sys->blocks[count] = pkt;
+        sys->iovs[count].iov_base = pkt->p_buffer;
+        sys->iovs[count].iov_len = sys->mtu;
+        sys->msgs[count].msg_hdr = (struct msghdr) {
+            .msg_iov = &sys->iovs[count],
+            .msg_iovlen = 1,
+            .msg_control = sys->cmsgs[count].buf,
+            .msg_controllen = sizeof (sys->cmsgs[count].buf),
+        };
+        count++;
+    }
+
+    if (unlikely(count == 0))
+    {   /* OOM - dequeue and discard one packet */
+        char dummy;
+        recv(sys->fd, &dummy, 1, 0);
+        return NULL;
+    }
+
+    int val = recvmmsg(sys->fd, sys->msgs, count, MSG_DONTWAIT, NULL);
+    block_t *chain = NULL, **pp = &chain;
+    bool discontinuity = false;
+
+    for (int i = 0; i < val; i++)
+    {
+        const struct msghdr *msg = &sys->msgs[i].msg_hdr;
+        block_t *pkt = sys->blocks[i];
+        size_t len = sys->msgs[i].msg_len;
+
+#ifdef SO_RXQ_OVFL
+        for (const struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+             cmsg != NULL;
+             cmsg = CMSG_NXTHDR((struct msghdr *)msg, (struct cmsghdr *)cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET
+             || cmsg->cmsg_type != SO_RXQ_OVFL)
+                continue;
+
+            uint32_t drops;
+
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof (drops));
+            if (drops != sys->drops)
+            {   /* Cumulative counter of the socket */
+                uint32_t lost = drops - sys->drops;
+
+                msg_Dbg(access, "%"PRIu32" datagram(s) dropped by the kernel",
+                        lost);
+                sys->lost += lost;
+                sys->drops = drops;
+                discontinuity = true;
+            }
+        }
+#endif
+
+        if (msg->msg_flags & MSG_TRUNC)
+        {
+            msg_Err(access, "%zu bytes packet truncated (MTU was %zu)",
+                    len, sys->mtu);
+            pkt->i_flags |= BLOCK_FLAG_CORRUPTED;
+            sys->mtu = len;
+        }
+        else
+            pkt->i_buffer = len;
+
+        if (discontinuity)
+        {
+            pkt->i_flags |= BLOCK_FLAG_DISCONTINUITY;
+            discontinuity = false;
+        }
+
+        *pp = pkt;
+        pp = &pkt->p_next;
+    }
+
+    /* Return the unused slots */
+    for (unsigned i = (val > 0) ? val : 0; i < count; i++)
+        block_Release(sys->blocks[i]);
+
+    return chain;
+}
+#endif
@@ -393,8 +393,6 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
                  * data, so that we get them as a single Metacube header block */
                 httpd_StreamHeader( p_sys->p_httpd_stream, p_hdr_block->p_buffer, p_hdr_block->i_buffer );
                 httpd_StreamSend( p_sys->p_httpd_stream, p_hdr_block );
-
-                block_Release( p_hdr_block );
             }
             else
             {
@@ -443,7 +441,6 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
         /* send data */
         i_err = httpd_StreamSend( p_sys->p_httpd_stream, p_buffer );
 
-        block_Release( p_buffer );
         p_buffer = p_next;
 
         if( i_err < 0 )
@@ -46,11 +46,34 @@
 #else
 #   include <sys/socket.h>
 #endif
+#ifdef __linux__
+#   include <linux/net_tstamp.h>
+#endif
 
 #include <vlc_network.h>
 
 #define MAX_EMPTY_BLOCKS 200
 
+/* Maximum number of packets submitted at once */
+#ifdef HAVE_SENDMMSG
+#   define MAX_BATCH 64
+#else
+#   define MAX_BATCH 16
+#endif
+
+/* How early packets are handed to the kernel with transmit times */
+#define TXTIME_LEAD 2000
+
+/* Packet lateness histogram bounds (us). The first ones measure the jitter,
+ * beyond 20 ms packets are considered sent too late. */
+static const mtime_t pacing_bounds[] = {
+    100, 250, 500, 1000, 2000, 5000, 10000, 20000,
+    50000, 100000, 200000, 500000,
+};
+#define PACING_JITTER_BUCKETS 8
+#define PACING_BUCKETS (ARRAY_SIZE(pacing_bounds) + 1)
+#define PACING_REPORT_PERIOD (CLOCK_FREQ * 10)
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -71,6 +94,12 @@ static void Close( vlc_object_t * );
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
 
+#define TXTIME_TEXT N_("Kernel transmit times")
+#define TXTIME_LONGTEXT N_("Hand packets to the kernel slightly ahead of " \
+                           "time, with their transmit time (SO_TXTIME). " \
+                           "This requires a pacing queuing discipline " \
+                           "such as fq on the output interface." )
+
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
     set_shortname( "UDP" )
@@ -79,6 +108,8 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_bool( SOUT_CFG_PREFIX "txtime", false, TXTIME_TEXT, TXTIME_LONGTEXT,
+              true )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -92,6 +123,7 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "txtime",
     NULL
 };
 
@@ -109,12 +141,21 @@ static int Control( sout_access_out_t *, int, va_list );
 
 static void* ThreadWrite( void * );
 static block_t *NewUDPPacket( sout_access_out_t *, mtime_t );
+static void ReportPacing( sout_access_out_t * );
+
+/* Room for the SCM_TXTIME control message */
+typedef union
+{
+    char buf[CMSG_SPACE(sizeof (uint64_t))];
+    struct cmsghdr align;
+} udp_cmsg_t;
 
 struct sout_access_out_sys_t
 {
     mtime_t       i_caching;
     int           i_handle;
     bool          b_mtu_warning;
+    bool          b_txtime;
     size_t        i_mtu;
 
     block_fifo_t *p_fifo;
@@ -122,6 +163,37 @@ struct sout_access_out_sys_t
     block_t      *p_buffer;
 
     vlc_thread_t  thread;
+
+    /* Pacing (owned by the thread). Packets waiting to be sent carry their
+     * send date in i_pts. */
+    struct
+    {
+        block_t  *p_first;
+        block_t **pp_last;
+        block_t  *p_open; /* first unsent packet after the last PCR */
+        unsigned  i_open_index; /* index of p_open after the last PCR */
+        unsigned  i_open_count; /* packets queued after the last PCR */
+        mtime_t   i_clock_date; /* send date of the last PCR */
+        mtime_t   i_date_last;
+        unsigned  i_dropped;
+    } pacer;
+
+    block_t      *pp_batch[MAX_BATCH];
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec  iovs[MAX_BATCH];
+    udp_cmsg_t    cmsgs[MAX_BATCH];
+#endif
+
+    /* Statistics (owned by the thread until it is joined) */
+    struct
+    {
+        uint64_t  i_packets;
+        uint64_t  i_calls;
+        uint64_t  pi_histogram[PACING_BUCKETS];
+        mtime_t   i_max_late;
+        mtime_t   i_last_report;
+    } stats;
 };
 
 #define DEFAULT_PORT 1234
@@ -214,6 +286,33 @@ static int Open( vlc_object_t *p_this )
     p_sys->p_empty_blocks = block_FifoNew();
     p_sys->p_buffer = NULL;
 
+    p_sys->b_txtime = var_GetBool( p_access, SOUT_CFG_PREFIX "txtime" );
+    if( p_sys->b_txtime )
+    {
+#ifdef SO_TXTIME
+        /* mdate() is based on the monotonic clock */
+        struct sock_txtime cfg = { .clockid = CLOCK_MONOTONIC };
+
+        if( setsockopt( i_handle, SOL_SOCKET, SO_TXTIME,
+                        &cfg, sizeof( cfg ) ) )
+        {
+            msg_Warn( p_access, "cannot enable transmit times: %s",
+                      vlc_strerror_c(errno) );
+            p_sys->b_txtime = false;
+        }
+#else
+        msg_Warn( p_access, "transmit times not supported" );
+        p_sys->b_txtime = false;
+#endif
+    }
+
+    memset( &p_sys->pacer, 0, sizeof( p_sys->pacer ) );
+    p_sys->pacer.pp_last = &p_sys->pacer.p_first;
+    p_sys->pacer.i_clock_date = VLC_TS_INVALID;
+    p_sys->pacer.i_date_last = -1;
+    memset( &p_sys->stats, 0, sizeof( p_sys->stats ) );
+    p_sys->stats.i_last_report = mdate();
+
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
     {
@@ -246,6 +345,10 @@ static void Close( vlc_object_t * p_this )
     block_FifoRelease( p_sys->p_empty_blocks );
 
     if( p_sys->p_buffer ) block_Release( p_sys->p_buffer );
+    block_ChainRelease( p_sys->pacer.p_first );
+
+    if( p_sys->stats.i_packets > 0 )
+        ReportPacing( p_access );
 
     net_Close( p_sys->i_handle );
     free( p_sys );
@@ -392,6 +495,173 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
     return p_buffer;
 }
 
+/*****************************************************************************
+ * ReportPacing: print the packet lateness histograms
+ *****************************************************************************/
+static void ReportPacing( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const uint64_t *pi_histogram = p_sys->stats.pi_histogram;
+    char psz_jitter[256], psz_late[256];
+    size_t i_len = 0;
+    uint64_t i_late = 0;
+
+    psz_jitter[0] = psz_late[0] = '\0';
+
+    for( size_t i = 0; i < PACING_JITTER_BUCKETS && i_len < sizeof( psz_jitter ); i++ )
+        i_len += snprintf( psz_jitter + i_len, sizeof( psz_jitter ) - i_len,
+                           " <%"PRId64"us:%"PRIu64, pacing_bounds[i],
+                           pi_histogram[i] );
+
+    i_len = 0;
+    for( size_t i = PACING_JITTER_BUCKETS; i < PACING_BUCKETS && i_len < sizeof( psz_late ); i++ )
+    {
+        if( i < ARRAY_SIZE(pacing_bounds) )
+            i_len += snprintf( psz_late + i_len, sizeof( psz_late ) - i_len,
+                               " <%"PRId64"ms:%"PRIu64,
+                               pacing_bounds[i] / 1000, pi_histogram[i] );
+        else
+            i_len += snprintf( psz_late + i_len, sizeof( psz_late ) - i_len,
+                               " more:%"PRIu64, pi_histogram[i] );
+        i_late += pi_histogram[i];
+    }
+
+    msg_Dbg( p_access, "sent %"PRIu64" packets in %"PRIu64" calls, "
+             "lateness:%s", p_sys->stats.i_packets, p_sys->stats.i_calls,
+             psz_jitter );
+    if( i_late > 0 )
+        msg_Dbg( p_access, "%"PRIu64" packets sent too late (max %"PRId64
+                 " us):%s", i_late, p_sys->stats.i_max_late, psz_late );
+}
+
+/*****************************************************************************
+ * QueuePacket: assign a send date to a packet and queue it
+ *****************************************************************************
+ * Packets between two PCRs are spread evenly over the PCR interval, so that
+ * the output rate is constant even if the muxer dated them in bursts.
+ * Packets after the last PCR keep their own date until the next PCR shows up.
+ *****************************************************************************/
+static void QueuePacket( sout_access_out_t *p_access, block_t *p_pk )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    mtime_t i_date = p_sys->i_caching + p_pk->i_dts;
+
+    p_pk->p_next = NULL;
+
+    if( p_sys->pacer.i_date_last > 0 )
+    {
+        if( i_date - p_sys->pacer.i_date_last > 2000000 )
+        {
+            if( !p_sys->pacer.i_dropped )
+                msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
+                         i_date - p_sys->pacer.i_date_last );
+
+            block_FifoPut( p_sys->p_empty_blocks, p_pk );
+
+            p_sys->pacer.i_date_last = i_date;
+            p_sys->pacer.i_dropped++;
+            return;
+        }
+        else if( i_date - p_sys->pacer.i_date_last < -1000 )
+        {
+            if( !p_sys->pacer.i_dropped )
+                msg_Dbg( p_access, "mmh, packets in the past (%"PRId64")",
+                         p_sys->pacer.i_date_last - i_date );
+        }
+    }
+    p_sys->pacer.i_date_last = i_date;
+    p_pk->i_pts = i_date;
+
+    if( p_pk->i_flags & BLOCK_FLAG_CLOCK )
+    {
+        mtime_t i_start = p_sys->pacer.i_clock_date;
+        mtime_t i_length = i_date - i_start;
+        unsigned i_count = p_sys->pacer.i_open_count + 1;
+        unsigned i_index = p_sys->pacer.i_open_index + 1;
+
+        if( i_start != VLC_TS_INVALID && i_length > 0 && i_length < 2000000 )
+            for( block_t *p = p_sys->pacer.p_open; p != NULL; p = p->p_next )
+                p->i_pts = i_start + i_length * i_index++ / i_count;
+
+        p_sys->pacer.i_clock_date = i_date;
+        p_sys->pacer.p_open = NULL;
+        p_sys->pacer.i_open_index = 0;
+        p_sys->pacer.i_open_count = 0;
+    }
+    else
+    {
+        if( p_sys->pacer.p_open == NULL )
+        {
+            p_sys->pacer.p_open = p_pk;
+            p_sys->pacer.i_open_index = p_sys->pacer.i_open_count;
+        }
+        p_sys->pacer.i_open_count++;
+    }
+
+    *p_sys->pacer.pp_last = p_pk;
+    p_sys->pacer.pp_last = &p_pk->p_next;
+}
+
+/*****************************************************************************
+ * SendPackets: submit a batch of packets to the kernel
+ *****************************************************************************/
+static void SendPackets( sout_access_out_t *p_access, unsigned i_count )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+#ifdef HAVE_SENDMMSG
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        block_t *p_pk = p_sys->pp_batch[i];
+        struct msghdr *p_msg = &p_sys->msgs[i].msg_hdr;
+
+        p_sys->iovs[i].iov_base = p_pk->p_buffer;
+        p_sys->iovs[i].iov_len = p_pk->i_buffer;
+        memset( p_msg, 0, sizeof( *p_msg ) );
+        p_msg->msg_iov = &p_sys->iovs[i];
+        p_msg->msg_iovlen = 1;
+# ifdef SO_TXTIME
+        if( p_sys->b_txtime )
+        {
+            struct cmsghdr *p_cmsg;
+            uint64_t i_txtime = p_pk->i_pts * UINT64_C(1000);
+
+            p_msg->msg_control = p_sys->cmsgs[i].buf;
+            p_msg->msg_controllen = sizeof( p_sys->cmsgs[i].buf );
+            p_cmsg = CMSG_FIRSTHDR( p_msg );
+            p_cmsg->cmsg_level = SOL_SOCKET;
+            p_cmsg->cmsg_type = SCM_TXTIME;
+            p_cmsg->cmsg_len = CMSG_LEN( sizeof( i_txtime ) );
+            memcpy( CMSG_DATA( p_cmsg ), &i_txtime, sizeof( i_txtime ) );
+        }
+# endif
+    }
+
+    for( unsigned i_sent = 0; i_sent < i_count; )
+    {
+        int i_ret = sendmmsg( p_sys->i_handle, p_sys->msgs + i_sent,
+                              i_count - i_sent, 0 );
+        p_sys->stats.i_calls++;
+        if( i_ret == -1 )
+        {
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+            i_sent++; /* skip the failing packet */
+        }
+        else
+            i_sent += i_ret;
+    }
+#else
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        block_t *p_pk = p_sys->pp_batch[i];
+
+        if( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+        p_sys->stats.i_calls++;
+    }
+#endif
+}
+
 /*****************************************************************************
  * ThreadWrite: Write a packet on the network at the good time.
  *****************************************************************************/
@@ -399,69 +669,98 @@ static void* ThreadWrite( void *data )
 {
     sout_access_out_t *p_access = data;
     sout_access_out_sys_t *p_sys = p_access->p_sys;
-    mtime_t i_date_last = -1;
     const unsigned i_group = var_GetInteger( p_access,
                                              SOUT_CFG_PREFIX "group" );
-    mtime_t i_to_send = i_group;
-    unsigned i_dropped_packets = 0;
+    const mtime_t i_lead = p_sys->b_txtime ? TXTIME_LEAD : 0;
 
     for (;;)
     {
-        block_t *p_pk = block_FifoGet( p_sys->p_fifo );
-        mtime_t       i_date, i_sent;
+        /* Take all the pending packets, and wait if there are none */
+        block_t *p_chain;
+
+        vlc_fifo_Lock( p_sys->p_fifo );
+        vlc_fifo_CleanupPush( p_sys->p_fifo );
+        while( p_sys->pacer.p_first == NULL && vlc_fifo_IsEmpty( p_sys->p_fifo ) )
+            vlc_fifo_Wait( p_sys->p_fifo );
+        p_chain = vlc_fifo_DequeueAllUnlocked( p_sys->p_fifo );
+        vlc_cleanup_pop();
+        vlc_fifo_Unlock( p_sys->p_fifo );
 
-        i_date = p_sys->i_caching + p_pk->i_dts;
-        if( i_date_last > 0 )
+        while( p_chain != NULL )
         {
-            if( i_date - i_date_last > 2000000 )
-            {
-                if( !i_dropped_packets )
-                    msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
-                             i_date - i_date_last );
+            block_t *p_next = p_chain->p_next;
 
-                block_FifoPut( p_sys->p_empty_blocks, p_pk );
-
-                i_date_last = i_date;
-                i_dropped_packets++;
-                continue;
-            }
-            else if( i_date - i_date_last < -1000 )
-            {
-                if( !i_dropped_packets )
-                    msg_Dbg( p_access, "mmh, packets in the past (%"PRId64")",
-                             i_date_last - i_date );
-            }
+            QueuePacket( p_access, p_chain );
+            p_chain = p_next;
         }
 
-        block_cleanup_push( p_pk );
-        i_to_send--;
-        if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
+        if( p_sys->pacer.p_first == NULL )
+            continue; /* all dropped */
+
+        if( p_sys->pacer.i_dropped )
         {
-            mwait( i_date );
-            i_to_send = i_group;
+            msg_Dbg( p_access, "dropped %u packets", p_sys->pacer.i_dropped );
+            p_sys->pacer.i_dropped = 0;
         }
-        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
-            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
-        vlc_cleanup_pop();
 
-        if( i_dropped_packets )
+        mwait( p_sys->pacer.p_first->i_pts - i_lead );
+
+        /* Send what is due (or about to be due with transmit times), and the
+         * rest of the group */
+        mtime_t i_now = mdate();
+        unsigned i_count = 0;
+
+        while( p_sys->pacer.p_first != NULL && i_count < MAX_BATCH )
         {
-            msg_Dbg( p_access, "dropped %i packets", i_dropped_packets );
-            i_dropped_packets = 0;
+            block_t *p_pk = p_sys->pacer.p_first;
+
+            if( p_pk->i_pts > i_now + i_lead && i_count >= i_group )
+                break;
+
+            p_sys->pacer.p_first = p_pk->p_next;
+            if( p_sys->pacer.p_open == p_pk )
+            {
+                p_sys->pacer.p_open = p_pk->p_next;
+                p_sys->pacer.i_open_index++;
+            }
+            p_pk->p_next = NULL;
+            p_sys->pp_batch[i_count++] = p_pk;
         }
+        if( p_sys->pacer.p_first == NULL )
+            p_sys->pacer.pp_last = &p_sys->pacer.p_first;
 
-#if 1
-        i_sent = mdate();
-        if ( i_sent > i_date + 20000 )
+        int canc = vlc_savecancel();
+        SendPackets( p_access, i_count );
+        vlc_restorecancel( canc );
+
+        /* Account for the lateness of each packet */
+        mtime_t i_sent = mdate();
+
+        for( unsigned i = 0; i < i_count; i++ )
         {
-            msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
-                     i_sent - i_date );
+            block_t *p_pk = p_sys->pp_batch[i];
+            mtime_t i_late = i_sent - p_pk->i_pts;
+            size_t i_bucket = 0;
+
+            while( i_bucket < ARRAY_SIZE(pacing_bounds)
+                && i_late >= pacing_bounds[i_bucket] )
+                i_bucket++;
+            p_sys->stats.pi_histogram[i_bucket]++;
+            if( i_late > p_sys->stats.i_max_late )
+                p_sys->stats.i_max_late = i_late;
+
+            block_FifoPut( p_sys->p_empty_blocks, p_pk );
         }
-#endif
+        p_sys->stats.i_packets += i_count;
 
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
-
-        i_date_last = i_date;
+        if( i_sent - p_sys->stats.i_last_report >= PACING_REPORT_PERIOD )
+        {
+            ReportPacing( p_access );
+            memset( p_sys->stats.pi_histogram, 0,
+                    sizeof( p_sys->stats.pi_histogram ) );
+            p_sys->stats.i_max_late = 0;
+            p_sys->stats.i_last_report = i_sent;
+        }
     }
     return NULL;
 }
@@ -1587,6 +1587,10 @@ static int VideoH264_OnNewBlock(decoder_t *p_dec, block_t **pp_block,
 
     if (p_sys->u.video.i_nal_length_size)
     {
+        /* In-place conversion: do not write to a shared payload */
+        p_block = *pp_block = block_Writable(p_block);
+        if (p_block == NULL)
+            return VLC_ENOMEM;
         h264_AVC_to_AnnexB(p_block->p_buffer, p_block->i_buffer,
                                p_sys->u.video.i_nal_length_size);
     } else if (H264SetCSD(p_dec, p_block->p_buffer, p_block->i_buffer,
@@ -1618,6 +1622,10 @@ static int VideoHEVC_OnNewBlock(decoder_t *p_dec, block_t **pp_block,
 
     if (p_sys->u.video.i_nal_length_size)
     {
+        /* In-place conversion: do not write to a shared payload */
+        p_block = *pp_block = block_Writable(p_block);
+        if (p_block == NULL)
+            return VLC_ENOMEM;
         h264_AVC_to_AnnexB(p_block->p_buffer, p_block->i_buffer,
                                p_sys->u.video.i_nal_length_size);
     }
@@ -1451,6 +1451,14 @@ static int DecodeVideoInput( decoder_t *p_dec, OmxPort *p_port, block_t **pp_blo
     OMX_BUFFERHEADERTYPE *p_header;
     block_t *p_block = *pp_block;
 
+    /* In direct mode, the NAL conversion below writes to the block itself */
+    if (p_port->b_direct && p_sys->i_nal_size_length)
+    {
+        p_block = *pp_block = block_Writable(p_block);
+        if (p_block == NULL)
+            return 0;
+    }
+
     /* Send the input buffer to the component */
     OMX_FIFO_GET_TIMEOUT(&p_port->fifo, p_header, 10000);
 
@@ -126,6 +126,7 @@ bool SegmentTracker::segmentsListReady() const
 
 void SegmentTracker::reset()
 {
+    resetPrefetch();
     notify(SegmentTrackerEvent(curRepresentation, NULL));
     curRepresentation = NULL;
     init_sent = false;
@@ -246,7 +247,9 @@ SegmentChunk * SegmentTracker::getNextChunk(bool switch_allowed,
         initializing = false;
     }
 
-    SegmentChunk *chunk = segment->toChunk(next, rep, connManager);
+    SegmentChunk *chunk = getPrefetchedChunk(rep, next);
+    if(!chunk)
+        chunk = segment->toChunk(next, rep, connManager);
 
     /* Notify new segment length for stats / logic */
     if(chunk)
@@ -303,9 +306,66 @@ void SegmentTracker::setPositionByNumber(uint64_t segnumber, bool restarted)
         index_sent = false;
         init_sent = false;
     }
+    resetPrefetch();
     curNumber = next = segnumber;
 }
 
+/* Starts downloading the next media segments of the current representation,
+ * which getNextChunk() will return if they are still what comes next. */
+void SegmentTracker::prefetch(unsigned depth, AbstractConnectionManager *connManager)
+{
+    BaseRepresentation *rep = curRepresentation;
+    if(!rep || initializing)
+        return;
+
+    if(!prefetched.empty() && prefetched.back().rep != rep)
+        resetPrefetch();
+
+    uint64_t number = prefetched.empty() ? next : prefetched.back().number + 1;
+    while(prefetched.size() < depth)
+    {
+        uint64_t segnumber;
+        bool b_gap = false;
+        ISegment *segment = rep->getNextSegment(BaseRepresentation::INFOTYPE_MEDIA,
+                                                number, &segnumber, &b_gap);
+        if(!segment || segnumber != number || b_gap)
+            break;
+
+        PrefetchedChunk entry;
+        entry.rep = rep;
+        entry.number = number;
+        entry.chunk = segment->toChunk(number, rep, connManager);
+        if(!entry.chunk)
+            break;
+        prefetched.push_back(entry);
+        number++;
+    }
+}
+
+SegmentChunk * SegmentTracker::getPrefetchedChunk(const BaseRepresentation *rep,
+                                                  uint64_t number)
+{
+    if(!prefetched.empty() && prefetched.front().rep == rep &&
+       prefetched.front().number == number)
+    {
+        SegmentChunk *chunk = prefetched.front().chunk;
+        prefetched.pop_front();
+        return chunk;
+    }
+    /* Switched, seeked or skipped: drop (and cancel) what was fetched */
+    resetPrefetch();
+    return NULL;
+}
+
+void SegmentTracker::resetPrefetch()
+{
+    while(!prefetched.empty())
+    {
+        delete prefetched.front().chunk;
+        prefetched.pop_front();
+    }
+}
+
 mtime_t SegmentTracker::getPlaybackTime() const
 {
     mtime_t time, duration;
@@ -118,6 +118,7 @@ namespace adaptive
             bool segmentsListReady() const;
             void reset();
             SegmentChunk* getNextChunk(bool, AbstractConnectionManager *);
+            void prefetch(unsigned, AbstractConnectionManager *);
             bool setPositionByTime(mtime_t, bool, bool);
             void setPositionByNumber(uint64_t, bool);
             mtime_t getPlaybackTime() const; /* Current segment start time if selected */
@@ -130,6 +131,8 @@ namespace adaptive
         private:
             void setAdaptationLogic(AbstractAdaptationLogic *);
             void notify(const SegmentTrackerEvent &) const;
+            SegmentChunk * getPrefetchedChunk(const BaseRepresentation *, uint64_t);
+            void resetPrefetch();
             bool first;
             bool initializing;
             bool index_sent;
@@ -141,6 +144,13 @@ namespace adaptive
             BaseAdaptationSet *adaptationSet;
             BaseRepresentation *curRepresentation;
             std::list<SegmentTrackerListenerInterface *> listeners;
+            struct PrefetchedChunk
+            {
+                BaseRepresentation *rep;
+                uint64_t number;
+                SegmentChunk *chunk;
+            };
+            std::list<PrefetchedChunk> prefetched; /* next media chunks, in order */
     };
 }
 
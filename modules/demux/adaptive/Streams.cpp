@@ -48,6 +48,8 @@ AbstractStream::AbstractStream(demux_t * demux_)
     needrestart = false;
     inrestart = false;
     segmentTracker = NULL;
+    connManager = NULL;
+    prefetchDepth = var_InheritInteger(demux_, "adaptive-prefetch");
     demuxersource = NULL;
     commandsqueue = NULL;
     demuxer = NULL;
@@ -431,7 +433,11 @@ AbstractStream::status AbstractStream::dequeue(mtime_t nz_deadline, mtime_t *pi_
 block_t * AbstractStream::readNextBlock()
 {
     if (currentChunk == NULL && !eof)
+    {
         currentChunk = segmentTracker->getNextChunk(!fakeesout->restarting(), connManager);
+        if(currentChunk && prefetchDepth)
+            segmentTracker->prefetch(prefetchDepth, connManager);
+    }
 
     if(discontinuity || needrestart)
     {
@@ -557,6 +563,16 @@ void AbstractStream::trackerEvent(const SegmentTrackerEvent &event)
             {
                 needrestart = true;
             }
+            break;
+
+        case SegmentTrackerEvent::BUFFERING_LEVEL_CHANGE:
+            /* Lets the downloader serve the most starving stream first */
+            if(connManager)
+                connManager->updateBufferingLevel(*event.u.buffering_level.id,
+                                                  event.u.buffering_level.current,
+                                                  event.u.buffering_level.target);
+            break;
+
         default:
             break;
     }
@@ -117,6 +117,7 @@ namespace adaptive
         SegmentTracker *segmentTracker;
 
         SegmentChunk *currentChunk;
+        unsigned prefetchDepth; /* media segments downloaded ahead */
         bool eof;
         std::string language;
         std::string description;
@@ -75,6 +75,15 @@ static void Close   (vlc_object_t *);
 #define ADAPT_ACCESS_TEXT N_("Use regular HTTP modules")
 #define ADAPT_ACCESS_LONGTEXT N_("Connect using http access instead of custom http code")
 
+#define ADAPT_HTTP2_TEXT N_("Force HTTP/2")
+#define ADAPT_HTTP2_LONGTEXT N_("Also use HTTP/2 without TLS for unencrypted HTTP servers")
+
+#define ADAPT_DOWNLOADS_TEXT N_("Parallel downloads")
+#define ADAPT_DOWNLOADS_LONGTEXT N_("Maximum number of segments downloaded at the same time")
+
+#define ADAPT_PREFETCH_TEXT N_("Segments prefetched per stream")
+#define ADAPT_PREFETCH_LONGTEXT N_("Number of segments downloaded ahead of the current one for each stream")
+
 static const AbstractAdaptationLogic::LogicType pi_logics[] = {
                                 AbstractAdaptationLogic::Default,
                                 AbstractAdaptationLogic::Predictive,
@@ -116,6 +125,9 @@ vlc_module_begin ()
         add_integer( "adaptive-height", 0, ADAPT_HEIGHT_TEXT, ADAPT_HEIGHT_TEXT, true )
         add_integer( "adaptive-bw",     250, ADAPT_BW_TEXT,     ADAPT_BW_LONGTEXT,     false )
         add_bool   ( "adaptive-use-access", false, ADAPT_ACCESS_TEXT, ADAPT_ACCESS_LONGTEXT, true );
+        add_bool   ( "adaptive-http2", false, ADAPT_HTTP2_TEXT, ADAPT_HTTP2_LONGTEXT, true );
+        add_integer_with_range( "adaptive-downloads", 3, 1, 16, ADAPT_DOWNLOADS_TEXT, ADAPT_DOWNLOADS_LONGTEXT, true )
+        add_integer_with_range( "adaptive-prefetch", 1, 0, 16, ADAPT_PREFETCH_TEXT, ADAPT_PREFETCH_LONGTEXT, true )
         set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -211,21 +211,37 @@ bool HTTPChunkSource::prepare()
     if(!connManager)
         return false;
 
-    if(!connection)
+    ConnectionParams connparams = params; /* can change on redirection */
+    for(unsigned i = 0; i <= maxRedirects; i++)
     {
-        connection = connManager->getConnection(params);
         if(!connection)
+        {
+            connection = connManager->getConnection(connparams);
+            if(!connection)
+                return false;
+        }
+
+        AbstractConnection::request_status status =
+                connection->request(connparams.getPath(), bytesRange);
+        if(status == AbstractConnection::request_success)
+        {
+            /* Because we don't know Chunk size at start, we need to get size
+               from content length */
+            contentLength = connection->getContentLength();
+            prepared = true;
+            return true;
+        }
+        else if(status != AbstractConnection::request_redirection)
             return false;
-    }
 
-    if( connection->request(params.getPath(), bytesRange) != VLC_SUCCESS )
-        return false;
-    /* Because we don't know Chunk size at start, we need to get size
-           from content length */
-    contentLength = connection->getContentLength();
-    prepared = true;
+        connparams = connection->getRedirection();
+        connection->setUsed(false);
+        connection = NULL;
+        if(connparams.getScheme() != "http" && connparams.getScheme() != "https")
+            return false;
+    }
 
-    return true;
+    return false;
 }
 
 block_t * HTTPChunkSource::readBlock()
@@ -244,7 +260,7 @@ HTTPChunkBufferedSource::HTTPChunkBufferedSource(const std::string& url, Abstrac
     vlc_cond_init(&avail);
     done = false;
     eof = false;
-    downloadstart = 0;
+    downloadtime = 0;
 }
 
 HTTPChunkBufferedSource::~HTTPChunkBufferedSource()
@@ -275,8 +291,13 @@ bool HTTPChunkBufferedSource::isDone() const
     return b_done;
 }
 
-void HTTPChunkBufferedSource::bufferize(size_t readsize)
+/* sharing is the count of sources read at the same time, which got an equal
+ * share of the bandwidth: only that share of the time is accounted, so that
+ * the rate reflects the link capacity and not the per stream throughput. */
+void HTTPChunkBufferedSource::bufferize(size_t readsize, unsigned sharing)
 {
+    const mtime_t start = mdate();
+
     vlc_mutex_lock(&lock);
     if(!prepare())
     {
@@ -314,9 +335,9 @@ void HTTPChunkBufferedSource::bufferize(size_t readsize)
         block_Release(p_block);
         vlc_mutex_lock(&lock);
         done = true;
+        downloadtime += (mdate() - start) / sharing;
         rate.size = buffered + consumed;
-        rate.time = mdate() - downloadstart;
-        downloadstart = 0;
+        rate.time = downloadtime;
         vlc_mutex_unlock(&lock);
     }
     else
@@ -325,12 +346,12 @@ void HTTPChunkBufferedSource::bufferize(size_t readsize)
         vlc_mutex_lock(&lock);
         buffered += p_block->i_buffer;
         block_ChainLastAppend(&pp_tail, p_block);
+        downloadtime += (mdate() - start) / sharing;
         if((size_t) ret < readsize)
         {
             done = true;
             rate.size = buffered + consumed;
-            rate.time = mdate() - downloadstart;
-            downloadstart = 0;
+            rate.time = downloadtime;
         }
         vlc_mutex_unlock(&lock);
     }
@@ -343,16 +364,6 @@ void HTTPChunkBufferedSource::bufferize(size_t readsize)
     vlc_cond_signal(&avail);
 }
 
-bool HTTPChunkBufferedSource::prepare()
-{
-    if(!prepared)
-    {
-        downloadstart = mdate();
-        return HTTPChunkSource::prepare();
-    }
-    return true;
-}
-
 bool HTTPChunkBufferedSource::hasMoreData() const
 {
     bool b_hasdata;
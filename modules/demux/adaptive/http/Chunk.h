@@ -92,6 +92,7 @@ namespace adaptive
                 virtual bool        hasMoreData     () const; /* impl */
 
                 static const size_t CHUNK_SIZE = 32768;
+                static const unsigned maxRedirects = 3;
 
             protected:
                 virtual bool      prepare();
@@ -120,8 +121,7 @@ namespace adaptive
                 virtual bool       hasMoreData     () const; /* impl */
 
             protected:
-                virtual bool       prepare(); /* reimpl */
-                void               bufferize(size_t);
+                void               bufferize(size_t, unsigned);
                 bool               isDone() const;
 
             private:
@@ -130,7 +130,7 @@ namespace adaptive
                 size_t              buffered; /* read cache size */
                 bool                done;
                 bool                eof;
-                mtime_t             downloadstart;
+                mtime_t             downloadtime; /* share of time spent reading */
                 vlc_mutex_t         lock;
                 vlc_cond_t          avail;
         };
@@ -26,36 +26,43 @@
 #include <vlc_threads.h>
 #include <vlc_atomic.h>
 
+#include <algorithm>
+
 using namespace adaptive::http;
 
-Downloader::Downloader()
+Downloader::Downloader(unsigned workers_)
 {
     vlc_mutex_init(&lock);
     vlc_cond_init(&waitcond);
+    vlc_cond_init(&donecond);
     killed = false;
-    thread_handle_valid = false;
+    workers = workers_ ? workers_ : 1;
 }
 
 bool Downloader::start()
 {
-    if(!thread_handle_valid &&
-       vlc_clone(&thread_handle, downloaderThread,
-                 reinterpret_cast<void *>(this), VLC_THREAD_PRIORITY_INPUT))
+    while(threads.size() < workers)
     {
-        return false;
+        vlc_thread_t thread_handle;
+        if(vlc_clone(&thread_handle, downloaderThread,
+                     reinterpret_cast<void *>(this), VLC_THREAD_PRIORITY_INPUT))
+            break;
+        threads.push_back(thread_handle);
     }
-    thread_handle_valid = true;
-    return true;
+    return !threads.empty();
 }
 
 Downloader::~Downloader()
 {
+    vlc_mutex_lock(&lock);
     killed = true;
-    vlc_cond_signal(&waitcond);
-    if(thread_handle_valid)
-        vlc_join(thread_handle, NULL);
+    vlc_cond_broadcast(&waitcond);
+    vlc_mutex_unlock(&lock);
+    for(size_t i=0; i<threads.size(); i++)
+        vlc_join(threads[i], NULL);
     vlc_mutex_destroy(&lock);
     vlc_cond_destroy(&waitcond);
+    vlc_cond_destroy(&donecond);
 }
 void Downloader::schedule(HTTPChunkBufferedSource *source)
 {
@@ -69,6 +76,19 @@ void Downloader::cancel(HTTPChunkBufferedSource *source)
 {
     vlc_mutex_lock(&lock);
     chunks.remove(source);
+    /* Wait for the worker reading it, as the source is going away */
+    while(std::find(active.begin(), active.end(), source) != active.end())
+        vlc_cond_wait(&donecond, &lock);
+    vlc_mutex_unlock(&lock);
+}
+
+void Downloader::updateBufferingLevel(const ID &id, mtime_t current, mtime_t target)
+{
+    unsigned level = 1000;
+    if(target > 0 && current < target)
+        level = current * 1000 / target;
+    vlc_mutex_lock(&lock);
+    bufferingLevels[id] = level;
     vlc_mutex_unlock(&lock);
 }
 
@@ -81,37 +101,71 @@ void * Downloader::downloaderThread(void *opaque)
     return NULL;
 }
 
-void Downloader::DownloadSource(HTTPChunkBufferedSource *source)
+void Downloader::DownloadSource(HTTPChunkBufferedSource *source, unsigned sharing)
 {
     if(!source->isDone())
-        source->bufferize(HTTPChunkSource::CHUNK_SIZE);
+        source->bufferize(HTTPChunkSource::CHUNK_SIZE, sharing);
 }
 
-void Downloader::Run()
+/* Picks the source to read next, lock held.
+ * Sources are ranked by their position among the queued sources of their
+ * stream, so the next segment of every stream goes before the segments
+ * prefetched ahead of it, and the stream with the lowest buffering level
+ * goes first among equal ranks. Segments of a stream are started in order,
+ * but with several downloads, a prefetched one can be read while the
+ * previous one is still being read. */
+HTTPChunkBufferedSource * Downloader::getNextSource() const
 {
-    while(1)
+    HTTPChunkBufferedSource *best = NULL;
+    unsigned bestrank = 0, bestlevel = 0;
+    std::map<ID, unsigned> ranks;
+
+    std::list<HTTPChunkBufferedSource *>::const_iterator it;
+    for(it = chunks.begin(); it != chunks.end(); ++it)
     {
-        vlc_mutex_lock(&lock);
-        if(killed)
-            break;
+        HTTPChunkBufferedSource *source = *it;
+        const unsigned rank = ranks[source->sourceid]++;
+        if(std::find(active.begin(), active.end(), source) != active.end())
+            continue;
 
-        while(chunks.empty() && !killed)
+        std::map<ID, unsigned>::const_iterator lit = bufferingLevels.find(source->sourceid);
+        const unsigned level = (lit != bufferingLevels.end()) ? lit->second : 0;
+        if(!best || rank < bestrank || (rank == bestrank && level < bestlevel))
         {
-            vlc_cond_wait(&waitcond, &lock);
+            best = source;
+            bestrank = rank;
+            bestlevel = level;
         }
+    }
+    return best;
+}
+
+void Downloader::Run()
+{
+    vlc_mutex_lock(&lock);
+    while(1)
+    {
+        HTTPChunkBufferedSource *source;
+        while(!killed && (source = getNextSource()) == NULL)
+            vlc_cond_wait(&waitcond, &lock);
 
         if(killed)
             break;
 
-        if(!chunks.empty())
-        {
-            HTTPChunkBufferedSource *source = chunks.front();
-            DownloadSource(source);
-            if(source->isDone())
-                chunks.pop_front();
-        }
-
+        /* Read without the lock, so that other workers can proceed */
+        active.push_back(source);
+        const unsigned sharing = active.size();
         vlc_mutex_unlock(&lock);
+
+        DownloadSource(source, sharing);
+
+        vlc_mutex_lock(&lock);
+        active.remove(source);
+        if(source->isDone())
+            chunks.remove(source);
+        else
+            vlc_cond_signal(&waitcond); /* it can be picked up again */
+        vlc_cond_broadcast(&donecond);
     }
     vlc_mutex_unlock(&lock);
 }
@@ -21,9 +21,12 @@
 #define DOWNLOADER_HPP
 
 #include "Chunk.h"
+#include "../ID.hpp"
 
 #include <vlc_common.h>
 #include <list>
+#include <map>
+#include <vector>
 
 namespace adaptive
 {
@@ -34,23 +37,27 @@ namespace adaptive
         class Downloader
         {
             public:
-                Downloader();
+                Downloader(unsigned = 1);
                 ~Downloader();
                 bool start();
                 void schedule(HTTPChunkBufferedSource *);
                 void cancel(HTTPChunkBufferedSource *);
+                void updateBufferingLevel(const ID &, mtime_t, mtime_t);
 
             private:
                 static void * downloaderThread(void *);
                 void Run();
-                void DownloadSource(HTTPChunkBufferedSource *);
-                vlc_thread_t thread_handle;
+                HTTPChunkBufferedSource * getNextSource() const;
+                void DownloadSource(HTTPChunkBufferedSource *, unsigned);
+                std::vector<vlc_thread_t> threads;
+                unsigned     workers;
                 vlc_mutex_t  lock;
                 vlc_cond_t   waitcond;
-                vlc_mutex_t  processlock;
-                bool         thread_handle_valid;
+                vlc_cond_t   donecond; /* a worker released a source */
                 bool         killed;
                 std::list<HTTPChunkBufferedSource *> chunks;
+                std::list<HTTPChunkBufferedSource *> active; /* being read by workers */
+                std::map<ID, unsigned> bufferingLevels; /* per mille of target */
         };
 
     }
@@ -27,7 +27,16 @@
 #include "../adaptive/tools/Helper.h"
 
 #include <sstream>
+#include <cstdio>
 #include <vlc_stream.h>
+#include <vlc_block.h>
+
+extern "C"
+{
+    #include "../../../access/http/message.h"
+    #include "../../../access/http/resource.h"
+    #include "../../../access/http/connmgr.h"
+}
 
 using namespace adaptive::http;
 
@@ -58,6 +67,11 @@ size_t AbstractConnection::getContentLength() const
     return contentLength;
 }
 
+const ConnectionParams & AbstractConnection::getRedirection() const
+{
+    return locationparams;
+}
+
 HTTPConnection::HTTPConnection(vlc_object_t *p_object_, Socket *socket_, bool persistent)
     : AbstractConnection( p_object_ )
 {
@@ -102,7 +116,7 @@ void HTTPConnection::disconnect()
     socket->disconnect();
 }
 
-int HTTPConnection::request(const std::string &path, const BytesRange &range)
+AbstractConnection::request_status HTTPConnection::request(const std::string &path, const BytesRange &range)
 {
     queryOk = false;
 
@@ -113,7 +127,7 @@ int HTTPConnection::request(const std::string &path, const BytesRange &range)
                        range.isValid() ? range.getStartByte() : 0);
 
     if(!connected() && ( params.getHostname().empty() || !connect() ))
-        return VLC_EGENERIC;
+        return request_error;
 
     bytesRange = range;
     if(range.isValid() && range.getEndByte() > 0)
@@ -133,7 +147,7 @@ int HTTPConnection::request(const std::string &path, const BytesRange &range)
             connectionClose = true;
             return request(path, range);
         }
-        return VLC_EGENERIC;
+        return request_error;
     }
 
     int i_ret = parseReply();
@@ -151,7 +165,7 @@ int HTTPConnection::request(const std::string &path, const BytesRange &range)
         }
     }
 
-    return i_ret;
+    return (i_ret == VLC_SUCCESS) ? request_success : request_error;
 }
 
 ssize_t HTTPConnection::read(void *p_buffer, size_t len)
@@ -328,7 +342,7 @@ bool StreamUrlConnection::canReuse(const ConnectionParams &) const
     return available;
 }
 
-int StreamUrlConnection::request(const std::string &path, const BytesRange &range)
+AbstractConnection::request_status StreamUrlConnection::request(const std::string &path, const BytesRange &range)
 {
     reset();
 
@@ -340,14 +354,14 @@ int StreamUrlConnection::request(const std::string &path, const BytesRange &rang
 
     p_streamurl = vlc_stream_NewMRL(p_object, params.getUrl().c_str());
     if(!p_streamurl)
-        return VLC_EGENERIC;
+        return request_error;
 
     if(range.isValid() && range.getEndByte() > 0)
     {
         if(vlc_stream_Seek(p_streamurl, range.getStartByte()) != VLC_SUCCESS)
         {
             vlc_stream_Delete(p_streamurl);
-            return VLC_EGENERIC;
+            return request_error;
         }
         bytesRange = range;
         contentLength = range.getEndByte() - range.getStartByte() + 1;
@@ -359,7 +373,7 @@ int StreamUrlConnection::request(const std::string &path, const BytesRange &rang
         if(!range.isValid() || contentLength > (size_t) i_size)
             contentLength = (size_t) i_size;
     }
-    return VLC_SUCCESS;
+    return request_success;
 }
 
 ssize_t StreamUrlConnection::read(void *p_buffer, size_t len)
@@ -398,6 +412,216 @@ void StreamUrlConnection::setUsed( bool b )
        reset();
 }
 
+/* libvlc_http resource requesting a single bytes range */
+struct vlc_http_range_resource
+{
+    struct vlc_http_resource resource;
+    bool   ranged;
+    size_t start;
+    size_t end;
+};
+
+static int vlc_http_range_req(const struct vlc_http_resource *res,
+                              struct vlc_http_msg *req, void *)
+{
+    const struct vlc_http_range_resource *range =
+            (const struct vlc_http_range_resource *) res;
+
+    if(!range->ranged)
+        return 0;
+    if(range->end)
+        return vlc_http_msg_add_header(req, "Range", "bytes=%zu-%zu",
+                                       range->start, range->end);
+    return vlc_http_msg_add_header(req, "Range", "bytes=%zu-", range->start);
+}
+
+static int vlc_http_range_resp(const struct vlc_http_resource *res,
+                               const struct vlc_http_msg *resp, void *)
+{
+    const struct vlc_http_range_resource *range =
+            (const struct vlc_http_range_resource *) res;
+
+    if(vlc_http_msg_get_status(resp) == 206)
+    {
+        const char *str = vlc_http_msg_get_header(resp, "Content-Range");
+        uintmax_t start, end;
+        /* Multipart or misplaced ranges are not what we asked for */
+        if(str == NULL || sscanf(str, "bytes %ju-%ju", &start, &end) != 2 ||
+           !range->ranged || start != range->start)
+            return -1;
+    }
+    else if(range->ranged && range->start > 0 &&
+            vlc_http_msg_get_status(resp) / 100 == 2)
+        return -1; /* range was ignored */
+
+    return 0;
+}
+
+static const struct vlc_http_resource_cbs vlc_http_range_callbacks =
+{
+    vlc_http_range_req,
+    vlc_http_range_resp,
+};
+
+LibVLCHTTPConnection::LibVLCHTTPConnection(vlc_object_t *p_object_,
+                                           struct vlc_http_mgr *mgr)
+    : AbstractConnection(p_object_)
+{
+    http_mgr = mgr;
+    source = NULL;
+    p_pending = NULL;
+    psz_useragent = var_InheritString(p_object_, "http-user-agent");
+}
+
+LibVLCHTTPConnection::~LibVLCHTTPConnection()
+{
+    reset();
+    free(psz_useragent);
+}
+
+void LibVLCHTTPConnection::reset()
+{
+    if(p_pending)
+        block_Release(p_pending);
+    p_pending = NULL;
+    if(source)
+        vlc_http_res_destroy(source);
+    source = NULL;
+    bytesRead = 0;
+    contentLength = 0;
+    bytesRange = BytesRange();
+}
+
+bool LibVLCHTTPConnection::canReuse(const ConnectionParams &params_) const
+{
+    return ( available &&
+             params.getHostname() == params_.getHostname() &&
+             params.getScheme() == params_.getScheme() &&
+             params.getPort() == params_.getPort() );
+}
+
+AbstractConnection::request_status LibVLCHTTPConnection::request(const std::string &path, const BytesRange &range)
+{
+    reset();
+
+    /* Set new path for this query */
+    params.setPath(path);
+
+    msg_Dbg(p_object, "Retrieving %s @%zu", params.getUrl().c_str(),
+                      range.isValid() ? range.getStartByte() : 0);
+
+    struct vlc_http_range_resource *res =
+            (struct vlc_http_range_resource *) malloc(sizeof(*res));
+    if(unlikely(!res))
+        return request_error;
+
+    res->ranged = range.isValid();
+    res->start = range.getStartByte();
+    res->end = range.getEndByte();
+    if(vlc_http_res_init(&res->resource, &vlc_http_range_callbacks, http_mgr,
+                         params.getUrl().c_str(), psz_useragent, NULL))
+    {
+        free(res);
+        return request_error;
+    }
+    source = &res->resource;
+
+    /* Sends the request, and waits for the response header */
+    int status = vlc_http_res_get_status(source);
+    if(status >= 300 && status < 400)
+    {
+        /* Redirection, to be followed by the caller as it can change
+         * origin and thus connection */
+        char *psz_location = vlc_http_res_get_redirect(source);
+        reset();
+        if(psz_location == NULL)
+            return request_error;
+        msg_Dbg(p_object, "redirected to %s", psz_location);
+        locationparams = ConnectionParams(std::string(psz_location));
+        free(psz_location);
+        return request_redirection;
+    }
+    else if(status < 200 || status >= 300)
+    {
+        reset();
+        return request_error;
+    }
+
+    bytesRange = range;
+    uintmax_t size = vlc_http_msg_get_size(source->response);
+    if(size != (uintmax_t) -1)
+        contentLength = size;
+    else if(range.isValid() && range.getEndByte() > 0)
+        contentLength = range.getEndByte() - range.getStartByte() + 1;
+
+    return request_success;
+}
+
+ssize_t LibVLCHTTPConnection::read(void *p_buffer, size_t len)
+{
+    if( !source )
+        return VLC_EGENERIC;
+
+    if(len == 0)
+        return VLC_SUCCESS;
+
+    const size_t toRead = (contentLength) ? contentLength - bytesRead : len;
+    if (toRead == 0)
+        return VLC_SUCCESS;
+
+    if(len > toRead)
+        len = toRead;
+
+    /* Payload comes as one block per received frame or socket read */
+    uint8_t *p_dst = (uint8_t *) p_buffer;
+    size_t copied = 0;
+    bool error = false;
+    while(copied < len)
+    {
+        if(!p_pending)
+        {
+            block_t *p_block = vlc_http_res_read(source);
+            if(p_block == NULL || p_block == vlc_http_error)
+            {
+                error = (p_block != NULL);
+                break;
+            }
+            p_pending = p_block;
+        }
+
+        size_t i_copy = len - copied;
+        if(i_copy > p_pending->i_buffer)
+            i_copy = p_pending->i_buffer;
+        memcpy(&p_dst[copied], p_pending->p_buffer, i_copy);
+        copied += i_copy;
+        p_pending->p_buffer += i_copy;
+        p_pending->i_buffer -= i_copy;
+        if(p_pending->i_buffer == 0)
+        {
+            block_Release(p_pending);
+            p_pending = NULL;
+        }
+    }
+    bytesRead += copied;
+
+    if(copied < len || /* set EOF */
+       contentLength == bytesRead )
+    {
+        reset();
+        if(error && copied == 0)
+            return VLC_EGENERIC;
+    }
+
+    return copied;
+}
+
+void LibVLCHTTPConnection::setUsed( bool b )
+{
+    available = !b;
+    if(available && contentLength == bytesRead)
+       reset();
+}
+
 ConnectionFactory::ConnectionFactory()
 {
 }
@@ -435,3 +659,50 @@ AbstractConnection * StreamUrlConnectionFactory::createConnection(vlc_object_t *
 {
     return new (std::nothrow) StreamUrlConnection(p_object);
 }
+
+LibVLCHTTPConnectionFactory::LibVLCHTTPConnectionFactory(bool h2c_)
+    : ConnectionFactory()
+{
+    h2c = h2c_;
+}
+
+LibVLCHTTPConnectionFactory::~LibVLCHTTPConnectionFactory()
+{
+    std::map<std::string, struct vlc_http_mgr *>::const_iterator it;
+    for(it = managers.begin(); it != managers.end(); ++it)
+        vlc_http_mgr_destroy((*it).second);
+}
+
+AbstractConnection * LibVLCHTTPConnectionFactory::createConnection(vlc_object_t *p_object,
+                                                                   const ConnectionParams &params)
+{
+    /* Without TLS ALPN, only talk HTTP/2 to servers known to support it */
+    if(params.getScheme() != "https" && !(h2c && params.getScheme() == "http"))
+        return ConnectionFactory::createConnection(p_object, params);
+
+    if(params.getHostname().empty())
+        return NULL;
+
+    std::stringstream origin;
+    origin.imbue(std::locale("C"));
+    origin << params.getScheme() << "://" << params.getHostname() << ":" << params.getPort();
+
+    struct vlc_http_mgr *mgr;
+    std::map<std::string, struct vlc_http_mgr *>::const_iterator it = managers.find(origin.str());
+    if(it == managers.end())
+    {
+        /* Share the cookies of the input, as the http access does */
+        struct vlc_http_cookie_jar_t *jar = NULL;
+        if(var_InheritBool(p_object, "http-forward-cookies"))
+            jar = (struct vlc_http_cookie_jar_t *)
+                  var_InheritAddress(p_object, "http-cookies");
+        mgr = vlc_http_mgr_create(p_object, jar, h2c);
+        if(!mgr)
+            return NULL;
+        managers.insert(std::pair<std::string, struct vlc_http_mgr *>(origin.str(), mgr));
+    }
+    else
+        mgr = (*it).second;
+
+    return new (std::nothrow) LibVLCHTTPConnection(p_object, mgr);
+}
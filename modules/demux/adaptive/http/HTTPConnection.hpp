@@ -29,6 +29,10 @@
 #include "BytesRange.hpp"
 #include <vlc_common.h>
 #include <string>
+#include <map>
+
+struct vlc_http_mgr;
+struct vlc_http_resource;
 
 namespace adaptive
 {
@@ -45,15 +49,22 @@ namespace adaptive
                 virtual bool    prepare     (const ConnectionParams &);
                 virtual bool    canReuse     (const ConnectionParams &) const = 0;
 
-                virtual int     request     (const std::string& path, const BytesRange & = BytesRange()) = 0;
+                typedef enum {
+                    request_success = 0,
+                    request_redirection, /* see getRedirection() */
+                    request_error,
+                } request_status;
+                virtual request_status request(const std::string& path, const BytesRange & = BytesRange()) = 0;
                 virtual ssize_t read        (void *p_buffer, size_t len) = 0;
 
                 virtual size_t  getContentLength() const;
+                virtual const ConnectionParams & getRedirection() const;
                 virtual void    setUsed( bool ) = 0;
 
             protected:
                 vlc_object_t      *p_object;
                 ConnectionParams   params;
+                ConnectionParams   locationparams;
                 bool               available;
                 size_t             contentLength;
                 BytesRange         bytesRange;
@@ -67,7 +78,7 @@ namespace adaptive
                 virtual ~HTTPConnection();
 
                 virtual bool    canReuse     (const ConnectionParams &) const;
-                virtual int     request     (const std::string& path, const BytesRange & = BytesRange());
+                virtual request_status request(const std::string& path, const BytesRange & = BytesRange());
                 virtual ssize_t read        (void *p_buffer, size_t len);
 
                 void setUsed( bool );
@@ -105,7 +116,7 @@ namespace adaptive
 
                 virtual bool    canReuse     (const ConnectionParams &) const;
 
-                virtual int     request     (const std::string& path, const BytesRange & = BytesRange());
+                virtual request_status request(const std::string& path, const BytesRange & = BytesRange());
                 virtual ssize_t read        (void *p_buffer, size_t len);
 
                 virtual void    setUsed( bool );
@@ -115,6 +126,27 @@ namespace adaptive
                 stream_t *p_streamurl;
        };
 
+       class LibVLCHTTPConnection : public AbstractConnection
+       {
+            public:
+                LibVLCHTTPConnection(vlc_object_t *, struct vlc_http_mgr *);
+                virtual ~LibVLCHTTPConnection();
+
+                virtual bool    canReuse     (const ConnectionParams &) const;
+
+                virtual request_status request(const std::string& path, const BytesRange & = BytesRange());
+                virtual ssize_t read        (void *p_buffer, size_t len);
+
+                virtual void    setUsed( bool );
+
+            protected:
+                void reset();
+                struct vlc_http_mgr *http_mgr;
+                struct vlc_http_resource *source;
+                block_t *p_pending;
+                char *psz_useragent;
+       };
+
        class ConnectionFactory
        {
            public:
@@ -128,6 +160,20 @@ namespace adaptive
            public:
                virtual AbstractConnection * createConnection(vlc_object_t *, const ConnectionParams &);
        };
+
+       /* Shares one connection manager per origin between all connections,
+        * so that concurrent requests get multiplexed over HTTP/2 */
+       class LibVLCHTTPConnectionFactory : public ConnectionFactory
+       {
+           public:
+               LibVLCHTTPConnectionFactory(bool = false);
+               virtual ~LibVLCHTTPConnectionFactory();
+               virtual AbstractConnection * createConnection(vlc_object_t *, const ConnectionParams &);
+
+           private:
+               std::map<std::string, struct vlc_http_mgr *> managers;
+               bool h2c;
+       };
     }
 }
 
@@ -61,14 +61,19 @@ HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *p_object_, Connec
     : AbstractConnectionManager( p_object_ )
 {
     vlc_mutex_init(&lock);
-    downloader = new (std::nothrow) Downloader();
-    downloader->start();
+    downloader = new (std::nothrow) Downloader(var_InheritInteger(p_object, "adaptive-downloads"));
+    if(downloader && !downloader->start())
+    {
+        delete downloader;
+        downloader = NULL;
+    }
     if(!factory_)
     {
         if(var_InheritBool(p_object, "adaptive-use-access"))
             factory = new (std::nothrow) StreamUrlConnectionFactory();
         else
-            factory = new (std::nothrow) ConnectionFactory();
+            factory = new (std::nothrow)
+                    LibVLCHTTPConnectionFactory(var_InheritBool(p_object, "adaptive-http2"));
     }
     else
         factory = factory_;
@@ -76,8 +81,8 @@ HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *p_object_, Connec
 HTTPConnectionManager::~HTTPConnectionManager   ()
 {
     delete downloader;
-    delete factory;
     this->closeAllConnections();
+    delete factory;
     vlc_mutex_destroy(&lock);
 }
 
@@ -141,13 +146,19 @@ AbstractConnection * HTTPConnectionManager::getConnection(ConnectionParams &para
 void HTTPConnectionManager::start(AbstractChunkSource *source)
 {
     HTTPChunkBufferedSource *src = dynamic_cast<HTTPChunkBufferedSource *>(source);
-    if(src)
+    if(src && downloader)
         downloader->schedule(src);
 }
 
 void HTTPConnectionManager::cancel(AbstractChunkSource *source)
 {
     HTTPChunkBufferedSource *src = dynamic_cast<HTTPChunkBufferedSource *>(source);
-    if(src)
+    if(src && downloader)
         downloader->cancel(src);
 }
+
+void HTTPConnectionManager::updateBufferingLevel(const adaptive::ID &id, mtime_t current, mtime_t target)
+{
+    if(downloader)
+        downloader->updateBufferingLevel(id, current, target);
+}
@@ -50,6 +50,7 @@ namespace adaptive
                 virtual AbstractConnection * getConnection(ConnectionParams &) = 0;
                 virtual void start(AbstractChunkSource *) = 0;
                 virtual void cancel(AbstractChunkSource *) = 0;
+                virtual void updateBufferingLevel(const ID &, mtime_t, mtime_t) = 0;
 
                 virtual void updateDownloadRate(const ID &, size_t, mtime_t); /* impl */
                 void setDownloadRateObserver(IDownloadRateObserver *);
@@ -72,6 +73,7 @@ namespace adaptive
 
                 virtual void start(AbstractChunkSource *) /* impl */;
                 virtual void cancel(AbstractChunkSource *) /* impl */;
+                virtual void updateBufferingLevel(const ID &, mtime_t, mtime_t); /* impl */
 
             private:
                 void    releaseAllConnections ();
@@ -513,6 +513,16 @@ void SegmentInformation::setSegmentList(SegmentList *list)
     }
 }
 
+SegmentList * SegmentInformation::getSegmentList() const
+{
+    return segmentList;
+}
+
+MediaSegmentTemplate * SegmentInformation::getSegmentTemplate() const
+{
+    return mediaSegmentTemplate;
+}
+
 void SegmentInformation::setSegmentBase(SegmentBase *base)
 {
     if(segmentBase)
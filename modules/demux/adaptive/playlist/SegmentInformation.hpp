@@ -99,6 +99,8 @@ namespace adaptive
                 void setSegmentBase(SegmentBase *);
                 void setSegmentTemplate(MediaSegmentTemplate *);
                 void setSwitchPolicy(SwitchPolicy);
+                SegmentList * getSegmentList() const; /* own, not inherited */
+                MediaSegmentTemplate * getSegmentTemplate() const; /* own, not inherited */
                 virtual Url getUrlSegment() const; /* impl */
                 Property<Url *> baseUrl;
 
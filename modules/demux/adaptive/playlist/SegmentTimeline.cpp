@@ -88,31 +88,28 @@ mtime_t SegmentTimeline::getMinAheadScaledTime(uint64_t number) const
 
 uint64_t SegmentTimeline::getElementNumberByScaledPlaybackTime(stime_t scaled) const
 {
-    uint64_t prevnumber = 0;
     std::list<Element *>::const_iterator it;
     for(it = elements.begin(); it != elements.end(); ++it)
     {
         const Element *el = *it;
         if(it == elements.begin())
-        {
             scaled -= el->t;
-            prevnumber = el->number;
-        }
+
+        /* might have been discontinuity */
+        uint64_t number = el->number;
 
         for(uint64_t repeat = 1 + el->r; repeat; repeat--)
         {
             if(el->d >= scaled)
-                return prevnumber;
+                return number;
 
             scaled -= el->d;
-            prevnumber++;
+            number++;
         }
-
-        /* might have been discontinuity */
-        prevnumber = el->number;
     }
 
-    return prevnumber;
+    /* past the end, stick to the last one */
+    return maxElementNumber();
 }
 
 bool SegmentTimeline::getScaledPlaybackTimeDurationBySegmentNumber(uint64_t number,
@@ -223,31 +220,52 @@ void SegmentTimeline::mergeWith(SegmentTimeline &other)
         return;
     }
 
-    Element *last = elements.back();
     while(other.elements.size())
     {
         Element *el = other.elements.front();
         other.elements.pop_front();
 
-        if(last->contains(el->t)) /* Same element, but prev could have been middle of repeat */
-        {
-            const uint64_t count = (el->t - last->t) / last->d;
-            last->r = std::max(last->r, el->r + count);
-            delete el;
-        }
-        else if(el->t < last->t)
+        if(absorbElement(el->t, el->r))
         {
             delete el;
         }
         else /* Did not exist in previous list */
         {
-            elements.push_back(el);
+            const Element *last = elements.back();
             el->number = last->number + last->r + 1;
-            last = el;
+            elements.push_back(el);
         }
     }
 }
 
+/* Merges a single element from a refreshed manifest, only allocating
+ * when it was not already known */
+void SegmentTimeline::mergeElement(uint64_t number, stime_t d, uint64_t r, stime_t t)
+{
+    if(elements.empty())
+    {
+        addElement(number, d, r, t);
+    }
+    else if(!absorbElement(t, r))
+    {
+        const Element *last = elements.back();
+        addElement(last->number + last->r + 1, d, r, t);
+    }
+}
+
+bool SegmentTimeline::absorbElement(stime_t t, uint64_t r)
+{
+    Element *last = elements.back();
+    if(last->contains(t)) /* Same element, but prev could have been middle of repeat */
+    {
+        const uint64_t count = (t - last->t) / last->d;
+        last->r = std::max(last->r, r + count);
+        return true;
+    }
+    /* older elements are dropped */
+    return (t < last->t);
+}
+
 mtime_t SegmentTimeline::start() const
 {
     if(elements.empty())
@@ -50,11 +50,13 @@ namespace adaptive
                 void pruneByPlaybackTime(mtime_t);
                 size_t pruneBySequenceNumber(uint64_t);
                 void mergeWith(SegmentTimeline &);
+                void mergeElement(uint64_t, stime_t d, uint64_t r, stime_t t);
                 mtime_t start() const;
                 mtime_t end() const;
                 void debug(vlc_object_t *, int = 0) const;
 
             private:
+                bool absorbElement(stime_t, uint64_t);
                 std::list<Element *> elements;
 
                 class Element
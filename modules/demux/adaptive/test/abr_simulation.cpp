@@ -0,0 +1,670 @@
+/*****************************************************************************
+ * abr_simulation.cpp: offline adaptive bitrate simulation
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Plays a multi bitrate HLS presentation against a file backed stand-in
+ * CDN, with each adaptation logic, through the same segment tracker,
+ * chunks and connection manager as the playlist manager does.
+ *
+ * Time is simulated: the transfer time of every segment is computed from a
+ * scripted bandwidth and latency trace, and is what gets reported to the
+ * logic, so results are reproducible and don't depend on the host.
+ * The player drains its buffer in simulated time too, starting once the
+ * playlist minimum buffering is reached, and stalling when it runs dry.
+ *
+ * Without arguments, checks the built-in traces. Otherwise reports start-up
+ * time, rebuffering, switches and average bitrate for each logic:
+ *   adaptive-abr-simulation-test -v               built-in traces
+ *   adaptive-abr-simulation-test <trace file>...  looped trace steps, one
+ *                                   "<seconds> <kbps> <latency ms>" per line
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_stream.h>
+#include "../../../../lib/libvlc_internal.h"
+
+#include "../SegmentTracker.hpp"
+#include "../ID.hpp"
+#include "../http/HTTPConnection.hpp"
+#include "../http/HTTPConnectionManager.h"
+#include "../logic/AlwaysBestAdaptationLogic.h"
+#include "../logic/AlwaysLowestAdaptationLogic.hpp"
+#include "../logic/PredictiveAdaptationLogic.hpp"
+#include "../logic/RateBasedAdaptationLogic.h"
+#include "../playlist/BasePeriod.h"
+#include "../playlist/BaseAdaptationSet.h"
+#include "../playlist/BaseRepresentation.h"
+#include "../playlist/SegmentChunk.hpp"
+#include "../../hls/playlist/Parser.hpp"
+#include "../../hls/playlist/M3U8.hpp"
+#include "../../hls/playlist/Representation.hpp"
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+using namespace adaptive;
+using namespace adaptive::http;
+using namespace adaptive::logic;
+using namespace adaptive::playlist;
+
+#define SEGMENT_DURATION 4 /* seconds */
+#define SEGMENT_COUNT    60
+
+static const unsigned bitrates[] = { 350, 700, 1500, 3000, 6000 }; /* kbps */
+
+static vlc_object_t *obj;
+
+/*** Network ***/
+class Trace
+{
+    public:
+        class Step
+        {
+            public:
+                Step(mtime_t d, unsigned k, mtime_t l)
+                    : duration(d), kbps(k), latency(l) {}
+                mtime_t duration;
+                unsigned kbps;
+                mtime_t latency;
+        };
+
+        Trace(const std::string &name_) : name(name_), length(0) {}
+
+        void add(unsigned seconds, unsigned kbps, unsigned latency_ms)
+        {
+            steps.push_back(Step(seconds * CLOCK_FREQ, kbps, latency_ms * CLOCK_FREQ / 1000));
+            length += seconds * CLOCK_FREQ;
+        }
+
+        bool isValid() const
+        {
+            for(size_t i = 0; i < steps.size(); i++)
+                if(steps[i].kbps == 0)
+                    return false;
+            return length > 0;
+        }
+
+        /* Time to fetch a resource requested at time start */
+        mtime_t transferTime(mtime_t start, size_t size) const
+        {
+            size_t i;
+            mtime_t offset;
+            find(start, &i, &offset);
+
+            mtime_t time = steps[i].latency;
+            offset += time;
+            uint64_t bits = (uint64_t) size * 8;
+            for(;;)
+            {
+                while(offset >= steps[i].duration)
+                {
+                    offset -= steps[i].duration;
+                    i = (i + 1) % steps.size();
+                }
+                const uint64_t bps = steps[i].kbps * UINT64_C(1000);
+                const mtime_t remain = steps[i].duration - offset;
+                const uint64_t capacity = bps * remain / CLOCK_FREQ;
+                if(bits <= capacity)
+                    return time + (bits * CLOCK_FREQ + bps - 1) / bps;
+                bits -= capacity;
+                time += remain;
+                offset += remain;
+            }
+        }
+
+        std::string name;
+
+    private:
+        void find(mtime_t t, size_t *index, mtime_t *offset) const
+        {
+            t %= length;
+            size_t i = 0;
+            while(t >= steps[i].duration)
+                t -= steps[i++].duration;
+            *index = i;
+            *offset = t;
+        }
+
+        std::vector<Step> steps;
+        mtime_t length;
+};
+
+/* Serves the segments from local files, but accounts transfers with the
+ * simulated time of the trace instead of the wall clock */
+class SimulatedConnectionManager : public HTTPConnectionManager
+{
+    public:
+        SimulatedConnectionManager(const Trace &trace_)
+            : HTTPConnectionManager(obj, new StreamUrlConnectionFactory()),
+              trace(trace_)
+        {
+            vlc_mutex_init(&lock);
+            vlc_cond_init(&cond);
+            requestTime = 0;
+            reported = false;
+        }
+
+        virtual ~SimulatedConnectionManager()
+        {
+            vlc_cond_destroy(&cond);
+            vlc_mutex_destroy(&lock);
+        }
+
+        void request(mtime_t now)
+        {
+            vlc_mutex_lock(&lock);
+            requestTime = now;
+            reported = false;
+            vlc_mutex_unlock(&lock);
+        }
+
+        /* Ensures the logic got the rate before its next decision */
+        void waitReport()
+        {
+            vlc_mutex_lock(&lock);
+            while(!reported)
+                vlc_cond_wait(&cond, &lock);
+            vlc_mutex_unlock(&lock);
+        }
+
+        virtual void updateDownloadRate(const ID &id, size_t size, mtime_t) /* reimpl */
+        {
+            vlc_mutex_lock(&lock);
+            const mtime_t time = trace.transferTime(requestTime, size);
+            AbstractConnectionManager::updateDownloadRate(id, size, time);
+            reported = true;
+            vlc_cond_signal(&cond);
+            vlc_mutex_unlock(&lock);
+        }
+
+    private:
+        const Trace &trace;
+        vlc_mutex_t lock;
+        vlc_cond_t cond;
+        mtime_t requestTime;
+        bool reported;
+};
+
+/*** Content ***/
+class Content
+{
+    public:
+        Content() : playlist(NULL) {}
+
+        ~Content()
+        {
+            delete playlist;
+            for(size_t i = 0; i < ARRAY_SIZE(bitrates); i++)
+            {
+                std::string path = dir + "/" + filename(i, ".ts");
+                unlink(path.c_str());
+            }
+            if(!dir.empty())
+                rmdir(dir.c_str());
+        }
+
+        bool create()
+        {
+            const char *tmp = getenv("TMPDIR");
+            std::string pattern = std::string(tmp ? tmp : "/tmp") + "/vlc-abr-XXXXXX";
+            std::vector<char> buf(pattern.begin(), pattern.end());
+            buf.push_back('\0');
+            if(!mkdtemp(&buf[0]))
+                return false;
+            dir = &buf[0];
+
+            /* Constant bitrate: all segments of a variant are the same file */
+            for(size_t i = 0; i < ARRAY_SIZE(bitrates); i++)
+            {
+                std::string path = dir + "/" + filename(i, ".ts");
+                FILE *f = fopen(path.c_str(), "wb");
+                if(!f)
+                    return false;
+                std::vector<char> data(bitrates[i] * 1000 / 8 * SEGMENT_DURATION);
+                memset(&data[0], 0x47, data.size());
+                bool ok = fwrite(&data[0], 1, data.size(), f) == data.size();
+                fclose(f);
+                if(!ok)
+                    return false;
+            }
+
+            return load();
+        }
+
+        AbstractPlaylist *playlist;
+
+    private:
+        static std::string filename(size_t i, const char *ext)
+        {
+            std::stringstream ss;
+            ss << "v" << bitrates[i] << ext;
+            return ss.str();
+        }
+
+        bool load()
+        {
+            std::stringstream ss;
+            ss.imbue(std::locale("C"));
+            ss << "#EXTM3U\n";
+            for(size_t i = 0; i < ARRAY_SIZE(bitrates); i++)
+                ss << "#EXT-X-STREAM-INF:BANDWIDTH=" << bitrates[i] * 1000 << "\n"
+                   << filename(i, ".m3u8") << "\n";
+
+            hls::playlist::M3U8Parser parser;
+            const std::string master = ss.str();
+            stream_t *s = vlc_stream_MemoryNew(obj, (uint8_t *) master.data(),
+                                               master.size(), true);
+            assert(s != NULL);
+            playlist = parser.parse(obj, s, "file://" + dir + "/master.m3u8");
+            vlc_stream_Delete(s);
+            if(!playlist)
+                return false;
+
+            /* Media playlists don't need to go through the CDN */
+            BaseAdaptationSet *set = playlist->getPeriods().front()->getAdaptationSets().front();
+            const std::vector<BaseRepresentation *> &reps = set->getRepresentations();
+            assert(reps.size() == ARRAY_SIZE(bitrates));
+            for(size_t i = 0; i < reps.size(); i++)
+            {
+                std::stringstream media;
+                media.imbue(std::locale("C"));
+                media << "#EXTM3U\n#EXT-X-TARGETDURATION:" << SEGMENT_DURATION << "\n"
+                      << "#EXT-X-PLAYLIST-TYPE:VOD\n";
+                const std::string uri = filename(i, ".ts");
+                for(unsigned j = 0; j < SEGMENT_COUNT; j++)
+                    media << "#EXTINF:" << SEGMENT_DURATION << ",\n" << uri << "\n";
+                media << "#EXT-X-ENDLIST\n";
+
+                const std::string text = media.str();
+                s = vlc_stream_MemoryNew(obj, (uint8_t *) text.data(), text.size(), true);
+                assert(s != NULL);
+                /* reps are sorted by bandwidth */
+                assert(reps[i]->getBandwidth() == bitrates[i] * 1000);
+                parser.appendSegments(obj, static_cast<hls::playlist::Representation *>(reps[i]), s);
+                vlc_stream_Delete(s);
+            }
+            return true;
+        }
+
+        std::string dir;
+};
+
+/*** Player ***/
+enum
+{
+    LOGIC_LOWEST,
+    LOGIC_BEST,
+    LOGIC_RATEBASED,
+    LOGIC_PREDICTIVE,
+};
+
+static const char *const logic_names[] =
+{
+    "lowest", "best", "ratebased", "predictive",
+};
+
+static AbstractAdaptationLogic *createLogic(int type, AbstractConnectionManager *conn)
+{
+    /* same setup as PlaylistManager */
+    switch(type)
+    {
+        case LOGIC_LOWEST:
+            return new AlwaysLowestAdaptationLogic();
+        case LOGIC_BEST:
+            return new AlwaysBestAdaptationLogic();
+        case LOGIC_RATEBASED:
+        {
+            RateBasedAdaptationLogic *logic = new RateBasedAdaptationLogic(obj, 0, 0);
+            conn->setDownloadRateObserver(logic);
+            return logic;
+        }
+        case LOGIC_PREDICTIVE:
+        {
+            PredictiveAdaptationLogic *logic = new PredictiveAdaptationLogic(obj);
+            conn->setDownloadRateObserver(logic);
+            return logic;
+        }
+        default:
+            return NULL;
+    }
+}
+
+class Results
+{
+    public:
+        Results()
+        {
+            startup = stalled = 0;
+            rebuffers = switches = 0;
+            bytes = 0;
+            avgkbps = 0;
+        }
+
+        bool operator==(const Results &other) const
+        {
+            return startup == other.startup && stalled == other.stalled &&
+                   rebuffers == other.rebuffers && switches == other.switches &&
+                   bytes == other.bytes && avgkbps == other.avgkbps;
+        }
+
+        mtime_t startup;
+        mtime_t stalled;
+        unsigned rebuffers;
+        unsigned switches;
+        uint64_t bytes;
+        unsigned avgkbps;
+};
+
+class Player : public SegmentTrackerListenerInterface
+{
+    public:
+        Player()
+        {
+            duration = 0;
+            played = 0;
+            weighted = 0;
+            bandwidth = 0;
+            switches = 0;
+        }
+
+        virtual void trackerEvent(const SegmentTrackerEvent &event) /* impl */
+        {
+            switch(event.type)
+            {
+                case SegmentTrackerEvent::SWITCHING:
+                    if(event.u.switching.prev && event.u.switching.next)
+                        switches++;
+                    if(event.u.switching.next)
+                        bandwidth = event.u.switching.next->getBandwidth();
+                    break;
+                case SegmentTrackerEvent::SEGMENT_CHANGE:
+                    duration = event.u.segment.duration;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        bool play(AbstractPlaylist *playlist, const Trace &trace, int type, Results *res)
+        {
+            BaseAdaptationSet *set = playlist->getPeriods().front()->getAdaptationSets().front();
+            SimulatedConnectionManager conn(trace);
+            AbstractAdaptationLogic *logic = createLogic(type, &conn);
+            SegmentTracker *tracker = new SegmentTracker(logic, set);
+            tracker->registerListener(this);
+            tracker->notifyBufferingState(true);
+
+            const mtime_t minbuffering = playlist->getMinBuffering();
+            const mtime_t maxbuffering = playlist->getMaxBuffering();
+            mtime_t now = 0;
+            mtime_t buffered = 0;
+            bool playing = false;
+            bool started = false;
+            bool ok = true;
+
+            for(;;)
+            {
+                /* Only refill below the target, as the stream buffering does */
+                if(playing && buffered > maxbuffering)
+                {
+                    now += buffered - maxbuffering;
+                    buffered = maxbuffering;
+                }
+                tracker->notifyBufferingLevel(buffered, maxbuffering);
+
+                conn.request(now);
+                duration = 0;
+                SegmentChunk *chunk = tracker->getNextChunk(true, &conn);
+                if(!chunk)
+                    break;
+
+                size_t size = 0;
+                block_t *block;
+                while((block = chunk->readBlock()))
+                {
+                    size += block->i_buffer;
+                    block_Release(block);
+                }
+                delete chunk;
+                if(size == 0) /* no access to our CDN */
+                {
+                    ok = false;
+                    break;
+                }
+                conn.waitReport();
+
+                const mtime_t transfer = trace.transferTime(now, size);
+                now += transfer;
+                res->bytes += size;
+                if(playing)
+                {
+                    if(transfer > buffered)
+                    {
+                        res->rebuffers++;
+                        res->stalled += transfer - buffered;
+                        buffered = 0;
+                        playing = false;
+                    }
+                    else buffered -= transfer;
+                }
+
+                buffered += duration;
+                played += duration;
+                weighted += (uint64_t) bandwidth / 1000 * duration;
+
+                if(!playing && buffered >= minbuffering)
+                {
+                    if(!started)
+                        res->startup = now;
+                    started = playing = true;
+                }
+            }
+
+            tracker->notifyBufferingState(false);
+            delete tracker;
+            delete logic;
+
+            res->switches = switches;
+            res->avgkbps = played ? weighted / played : 0;
+            return ok && played > 0;
+        }
+
+    private:
+        mtime_t duration;
+        mtime_t played;
+        uint64_t weighted;
+        uint64_t bandwidth;
+        unsigned switches;
+};
+
+static bool simulate(Content &content, const Trace &trace, Results *results)
+{
+    for(size_t i = 0; i < ARRAY_SIZE(logic_names); i++)
+    {
+        Player player;
+        if(!player.play(content.playlist, trace, i, &results[i]))
+            return false;
+    }
+    return true;
+}
+
+static void report(const Trace &trace, const Results *results)
+{
+    printf("trace %s\n", trace.name.c_str());
+    printf("  %-12s %9s %9s %9s %9s %9s\n", "logic",
+           "startup", "rebuffers", "stalled", "switches", "avg kbps");
+    for(size_t i = 0; i < ARRAY_SIZE(logic_names); i++)
+    {
+        const Results &r = results[i];
+        printf("  %-12s %8.2fs %9u %8.2fs %9u %9u\n", logic_names[i],
+               (double) r.startup / CLOCK_FREQ, r.rebuffers,
+               (double) r.stalled / CLOCK_FREQ, r.switches, r.avgkbps);
+    }
+}
+
+static bool load_trace(const char *path, Trace *trace)
+{
+    FILE *f = fopen(path, "r");
+    if(!f)
+        return false;
+
+    char line[256];
+    while(fgets(line, sizeof(line), f))
+    {
+        unsigned seconds, kbps, latency;
+        if(line[0] == '#')
+            continue;
+        if(sscanf(line, "%u %u %u", &seconds, &kbps, &latency) == 3)
+            trace->add(seconds, kbps, latency);
+    }
+    fclose(f);
+    return trace->isValid();
+}
+
+static std::vector<Trace> builtin_traces()
+{
+    std::vector<Trace> traces;
+
+    traces.push_back(Trace("steady"));
+    traces.back().add(60, 20000, 20);
+
+    traces.push_back(Trace("congested"));
+    traces.back().add(60, 1000, 150);
+
+    traces.push_back(Trace("step"));
+    traces.back().add(60, 8000, 30);
+    traces.back().add(60, 1200, 60);
+    traces.back().add(60, 4000, 30);
+
+    traces.push_back(Trace("fluctuating"));
+    traces.back().add(10, 5000, 40);
+    traces.back().add(10, 800, 120);
+
+    return traces;
+}
+
+static void check(const Trace &trace, const Results *r)
+{
+    const unsigned lowest = bitrates[0];
+    const unsigned highest = bitrates[ARRAY_SIZE(bitrates) - 1];
+
+    assert(r[LOGIC_LOWEST].switches == 0 && r[LOGIC_LOWEST].avgkbps == lowest);
+    assert(r[LOGIC_BEST].switches == 0 && r[LOGIC_BEST].avgkbps == highest);
+    for(size_t i = 0; i < ARRAY_SIZE(logic_names); i++)
+    {
+        assert(r[i].avgkbps >= lowest && r[i].avgkbps <= highest);
+        assert(r[i].startup > 0);
+    }
+
+    if(trace.name == "steady")
+    {
+        /* plenty of bandwidth for everyone */
+        for(size_t i = 0; i < ARRAY_SIZE(logic_names); i++)
+            assert(r[i].rebuffers == 0);
+        assert(r[LOGIC_RATEBASED].avgkbps > bitrates[ARRAY_SIZE(bitrates) - 2]);
+    }
+    else if(trace.name == "congested")
+    {
+        /* can only sustain the lowest bitrates */
+        assert(r[LOGIC_LOWEST].rebuffers == 0);
+        assert(r[LOGIC_BEST].rebuffers > 0);
+        assert(r[LOGIC_RATEBASED].rebuffers < r[LOGIC_BEST].rebuffers);
+        assert(r[LOGIC_PREDICTIVE].rebuffers < r[LOGIC_BEST].rebuffers);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *const args[] = { "--quiet" };
+    setenv("VLC_PLUGIN_PATH", ".", 0);
+    libvlc_int_t *libvlc = libvlc_InternalCreate();
+    assert(libvlc != NULL);
+    if(libvlc_InternalInit(libvlc, ARRAY_SIZE(args), (const char **) args))
+    {
+        libvlc_InternalDestroy(libvlc);
+        return 77;
+    }
+    obj = VLC_OBJECT(libvlc);
+
+    int ret = 0;
+    {
+        Content content;
+        assert(content.create());
+
+        std::vector<Trace> traces;
+        if(argc > 1 && strcmp(argv[1], "-v"))
+        {
+            for(int i = 1; i < argc; i++)
+            {
+                traces.push_back(Trace(argv[i]));
+                if(!load_trace(argv[i], &traces.back()))
+                {
+                    fprintf(stderr, "invalid trace %s\n", argv[i]);
+                    ret = 1;
+                    traces.clear();
+                    break;
+                }
+            }
+        }
+        else traces = builtin_traces();
+
+        for(size_t i = 0; i < traces.size(); i++)
+        {
+            Results results[ARRAY_SIZE(logic_names)];
+            if(!simulate(content, traces[i], results))
+            {
+                ret = 77; /* segments can't be read without the file access */
+                break;
+            }
+
+            if(argc > 1)
+            {
+                report(traces[i], results);
+            }
+            else
+            {
+                check(traces[i], results);
+                /* and the same again */
+                Results again[ARRAY_SIZE(logic_names)];
+                assert(simulate(content, traces[i], again));
+                for(size_t j = 0; j < ARRAY_SIZE(logic_names); j++)
+                    assert(results[j] == again[j]);
+            }
+        }
+    }
+
+    libvlc_InternalCleanup(libvlc);
+    libvlc_InternalDestroy(libvlc);
+    return ret;
+}
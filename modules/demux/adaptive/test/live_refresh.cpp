@@ -0,0 +1,327 @@
+/*****************************************************************************
+ * live_refresh.cpp: live manifest refresh test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Replays a live manifest with a sliding DVR window: each refresh adds new
+ * entries at the live edge while the oldest ones expire.
+ *
+ * The HLS playlist is refreshed in place, and checked against a full parse
+ * of the last playlist. The MPD is refreshed both through the streaming
+ * updater and through the DOM parser and playlist merge, and both results
+ * are compared. With arguments, also reports the time spent per refresh:
+ *   live_refresh_test <window entries> <refreshes>
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+#include "../../../../lib/libvlc_internal.h"
+
+#include "../playlist/BasePeriod.h"
+#include "../playlist/BaseAdaptationSet.h"
+#include "../playlist/BaseRepresentation.h"
+#include "../playlist/SegmentList.h"
+#include "../playlist/SegmentTemplate.h"
+#include "../playlist/SegmentTimeline.h"
+#include "../playlist/Segment.h"
+#include "../xml/DOMParser.h"
+#include "../../hls/playlist/Parser.hpp"
+#include "../../hls/playlist/M3U8.hpp"
+#include "../../hls/playlist/Representation.hpp"
+#include "../../dash/mpd/IsoffMainParser.h"
+#include "../../dash/mpd/MPDUpdater.h"
+#include "../../dash/mpd/MPD.h"
+
+#include <string>
+#include <sstream>
+
+using namespace adaptive;
+using namespace adaptive::playlist;
+
+#define SEGMENTS_PER_REFRESH 2
+
+static vlc_object_t *obj;
+
+/* the string must outlive the stream */
+static stream_t *stream_from_string(const std::string &str)
+{
+    stream_t *s = vlc_stream_MemoryNew(obj, (uint8_t *) str.data(),
+                                       str.size(), true);
+    assert(s != NULL);
+    return s;
+}
+
+static BaseRepresentation *first_representation(AbstractPlaylist *playlist)
+{
+    BasePeriod *period = playlist->getPeriods().front();
+    BaseAdaptationSet *set = period->getAdaptationSets().front();
+    return set->getRepresentations().front();
+}
+
+/*** HLS ***/
+/* Durations alternate, as encoders output them */
+static double hls_duration(uint64_t i)
+{
+    return (i % 2) ? 2.5 : 2.0;
+}
+
+static std::string hls_playlist(uint64_t first, unsigned count)
+{
+    std::stringstream ss;
+    ss.imbue(std::locale("C"));
+    ss << "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:3\n"
+       << "#EXT-X-MEDIA-SEQUENCE:" << first << "\n";
+    for(uint64_t i = first; i < first + count; i++)
+        ss << "#EXTINF:" << hls_duration(i) << ",\n"
+           << "segment" << i << ".ts\n";
+    return ss.str();
+}
+
+static mtime_t test_hls(unsigned window, unsigned refreshes)
+{
+    hls::playlist::M3U8Parser parser;
+    const std::string url("http://127.0.0.1/live.m3u8");
+
+    const std::string initial = hls_playlist(0, window);
+    stream_t *s = stream_from_string(initial);
+    AbstractPlaylist *playlist = parser.parse(obj, s, url);
+    vlc_stream_Delete(s);
+    assert(playlist != NULL);
+    hls::playlist::Representation *rep =
+        static_cast<hls::playlist::Representation *>(first_representation(playlist));
+
+    /* segment numbers are offset from the playlist sequence numbers */
+    const uint64_t base = rep->getSegmentList()->getSegments().front()->getSequenceNumber();
+
+    mtime_t elapsed = 0;
+    uint64_t first = 0;
+    for(unsigned i = 0; i < refreshes; i++)
+    {
+        first += SEGMENTS_PER_REFRESH;
+        const std::string text = hls_playlist(first, window);
+        s = stream_from_string(text);
+
+        mtime_t start = mdate();
+        parser.appendSegments(obj, rep, s);
+        rep->pruneBySegmentNumber(base + first);
+        elapsed += mdate() - start;
+
+        vlc_stream_Delete(s);
+    }
+
+    /* Same segments as the last playlist, with a continuous timeline */
+    const std::vector<ISegment *> &segments = rep->getSegmentList()->getSegments();
+    assert(segments.size() == window);
+    stime_t expected = 0;
+    for(uint64_t i = 0; i < first + window; i++)
+    {
+        const ISegment *seg = (i >= first) ? segments.at(i - first) : NULL;
+        if(seg)
+        {
+            assert(seg->getSequenceNumber() == base + i);
+            assert(seg->startTime.Get() == expected);
+            assert(seg->duration.Get() == (stime_t)(hls_duration(i) * 100));
+        }
+        expected += hls_duration(i) * 100;
+    }
+
+    delete playlist;
+    return elapsed;
+}
+
+/*** DASH ***/
+#define DASH_TIMESCALE 1000
+
+static stime_t dash_duration(uint64_t i)
+{
+    return (i % 2) ? 2001 : 1999;
+}
+
+static std::string dash_mpd(uint64_t first, unsigned count,
+                            stime_t *firsttime, stime_t *endtime)
+{
+    stime_t t = 0;
+    for(uint64_t i = 0; i < first; i++)
+        t += dash_duration(i);
+    *firsttime = t;
+
+    std::stringstream ss;
+    ss.imbue(std::locale("C"));
+    ss << "<?xml version=\"1.0\"?>\n"
+          "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"dynamic\""
+          " profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+          " availabilityStartTime=\"2017-01-01T00:00:00Z\""
+          " minimumUpdatePeriod=\"PT2S\" timeShiftBufferDepth=\"PT24H\""
+          " minBufferTime=\"PT2S\">\n"
+          "<Period id=\"p0\" start=\"PT0S\">\n"
+          "<AdaptationSet mimeType=\"video/mp4\" segmentAlignment=\"true\">\n"
+          "<SegmentTemplate timescale=\"" << DASH_TIMESCALE << "\""
+          " media=\"v$Number$.m4s\" initialization=\"v-init.mp4\""
+          " startNumber=\"" << first << "\">\n"
+          "<SegmentTimeline>\n";
+    for(uint64_t i = first; i < first + count; i++)
+    {
+        ss << "<S t=\"" << t << "\" d=\"" << dash_duration(i) << "\"/>\n";
+        t += dash_duration(i);
+    }
+    ss << "</SegmentTimeline>\n</SegmentTemplate>\n"
+          "<Representation id=\"v1\" bandwidth=\"800000\" codecs=\"avc1.4d401f\"/>\n"
+          "<Representation id=\"v2\" bandwidth=\"2400000\" codecs=\"avc1.4d401f\"/>\n"
+          "</AdaptationSet>\n</Period>\n</MPD>\n";
+    *endtime = t;
+    return ss.str();
+}
+
+static dash::mpd::MPD *dash_parse(const std::string &text, stream_t **ps)
+{
+    stream_t *s = stream_from_string(text);
+    xml::DOMParser domparser(s);
+    if(!domparser.parse(true))
+    {
+        vlc_stream_Delete(s);
+        return NULL;
+    }
+    dash::mpd::IsoffMainParser parser(domparser.getRootNode(), obj, s,
+                                      "http://127.0.0.1/");
+    dash::mpd::MPD *mpd = parser.parse();
+    *ps = s;
+    return mpd;
+}
+
+static SegmentTimeline *dash_timeline(AbstractPlaylist *playlist)
+{
+    BaseAdaptationSet *set = playlist->getPeriods().front()->getAdaptationSets().front();
+    MediaSegmentTemplate *templ = set->getSegmentTemplate();
+    assert(templ != NULL && templ->segmentTimeline.Get() != NULL);
+    return templ->segmentTimeline.Get();
+}
+
+static void test_dash(unsigned window, unsigned refreshes,
+                      mtime_t *streamed, mtime_t *merged)
+{
+    stream_t *s;
+    stime_t t, end;
+
+    /* Without an XML parser, nothing to test */
+    const std::string initial = dash_mpd(0, window, &t, &end);
+    dash::mpd::MPD *live = dash_parse(initial, &s);
+    if(live == NULL)
+        return;
+    vlc_stream_Delete(s);
+    dash::mpd::MPD *reference = dash_parse(initial, &s);
+    assert(reference != NULL);
+    vlc_stream_Delete(s);
+
+    *streamed = *merged = 0;
+    uint64_t first = 0;
+    for(unsigned i = 0; i < refreshes; i++)
+    {
+        first += SEGMENTS_PER_REFRESH;
+        const std::string text = dash_mpd(first, window, &t, &end);
+        /* expire everything before the new window start */
+        const mtime_t barrier = CLOCK_FREQ * (t + 1) / DASH_TIMESCALE;
+
+        s = stream_from_string(text);
+        mtime_t start = mdate();
+        dash::mpd::MPDUpdater updater(live, barrier);
+        assert(updater.update(s));
+        *streamed += mdate() - start;
+        vlc_stream_Delete(s);
+
+        start = mdate();
+        dash::mpd::MPD *updated = dash_parse(text, &s);
+        assert(updated != NULL);
+        reference->mergeWith(updated, barrier);
+        delete updated;
+        *merged += mdate() - start;
+        vlc_stream_Delete(s);
+    }
+
+    /* Both ways end with the last window */
+    SegmentTimeline *a = dash_timeline(live), *b = dash_timeline(reference);
+    assert(a->minElementNumber() == b->minElementNumber());
+    assert(a->maxElementNumber() == b->maxElementNumber());
+    assert(a->start() == b->start());
+    assert(a->end() == b->end());
+    assert(a->maxElementNumber() == first + window - 1);
+    assert(a->minElementNumber() == first);
+    assert(a->start() == CLOCK_FREQ * t / DASH_TIMESCALE);
+    assert(a->end() == CLOCK_FREQ * end / DASH_TIMESCALE);
+
+    /* A list based refresh can't be streamed */
+    const std::string listmpd =
+        "<?xml version=\"1.0\"?>\n"
+        "<MPD type=\"dynamic\"><Period><AdaptationSet>"
+        "<SegmentList duration=\"2\"><SegmentURL media=\"a.ts\"/></SegmentList>"
+        "</AdaptationSet></Period></MPD>";
+    s = stream_from_string(listmpd);
+    dash::mpd::MPDUpdater updater(live, 0);
+    assert(!updater.update(s));
+    vlc_stream_Delete(s);
+
+    delete live;
+    delete reference;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned window = (argc > 1) ? strtoul(argv[1], NULL, 0) : 500;
+    unsigned refreshes = (argc > 2) ? strtoul(argv[2], NULL, 0) : 10;
+    assert(window > SEGMENTS_PER_REFRESH);
+
+    static const char *const args[] = { "--quiet" };
+    setenv("VLC_PLUGIN_PATH", ".", 0);
+    libvlc_int_t *libvlc = libvlc_InternalCreate();
+    assert(libvlc != NULL);
+    if(libvlc_InternalInit(libvlc, ARRAY_SIZE(args), (const char **) args))
+    {
+        libvlc_InternalDestroy(libvlc);
+        return 77;
+    }
+    obj = VLC_OBJECT(libvlc);
+
+    mtime_t hls = test_hls(window, refreshes);
+    mtime_t streamed = -1, merged = -1;
+    test_dash(window, refreshes, &streamed, &merged);
+
+    if(argc > 1)
+    {
+        printf("%u refreshes of %u entries\n", refreshes, window);
+        printf("HLS: %" PRId64 " us per refresh\n", hls / refreshes);
+        if(streamed >= 0)
+            printf("DASH: streamed %" PRId64 " us, parsed and merged %" PRId64
+                   " us per refresh\n", streamed / refreshes, merged / refreshes);
+        else
+            printf("DASH: no XML parser available\n");
+    }
+
+    libvlc_InternalCleanup(libvlc);
+    libvlc_InternalDestroy(libvlc);
+    return 0;
+}
@@ -32,6 +32,7 @@
 #include "DASHManager.h"
 #include "mpd/ProgramInformation.h"
 #include "mpd/IsoffMainParser.h"
+#include "mpd/MPDUpdater.h"
 #include "xml/DOMParser.h"
 #include "xml/Node.h"
 #include "../adaptive/tools/Helper.h"
@@ -114,14 +115,6 @@ bool DASHManager::updatePlaylist()
             return false;
         }
 
-        xml::DOMParser parser(mpdstream);
-        if(!parser.parse(true))
-        {
-            vlc_stream_Delete(mpdstream);
-            block_Release(p_block);
-            return false;
-        }
-
         mtime_t minsegmentTime = 0;
         std::vector<AbstractStream *>::iterator it;
         for(it=streams.begin(); it!=streams.end(); it++)
@@ -131,13 +124,28 @@ bool DASHManager::updatePlaylist()
                 minsegmentTime = segmentTime;
         }
 
-        IsoffMainParser mpdparser(parser.getRootNode(), VLC_OBJECT(p_demux),
-                                  mpdstream, Helper::getDirectoryPath(url).append("/"));
-        MPD *newmpd = mpdparser.parse();
-        if(newmpd)
+        /* Merge new timeline entries while reading, and only
+         * fall back to a full parse for unsupported updates */
+        MPDUpdater updater(playlist, minsegmentTime);
+        if(!updater.update(mpdstream) &&
+           vlc_stream_Seek(mpdstream, 0) == VLC_SUCCESS)
         {
-            playlist->mergeWith(newmpd, minsegmentTime);
-            delete newmpd;
+            xml::DOMParser parser(mpdstream);
+            if(!parser.parse(true))
+            {
+                vlc_stream_Delete(mpdstream);
+                block_Release(p_block);
+                return false;
+            }
+
+            IsoffMainParser mpdparser(parser.getRootNode(), VLC_OBJECT(p_demux),
+                                      mpdstream, Helper::getDirectoryPath(url).append("/"));
+            MPD *newmpd = mpdparser.parse();
+            if(newmpd)
+            {
+                playlist->mergeWith(newmpd, minsegmentTime);
+                delete newmpd;
+            }
         }
         vlc_stream_Delete(mpdstream);
         block_Release(p_block);
@@ -0,0 +1,307 @@
+/*
+ * MPDUpdater.cpp
+ *****************************************************************************
+ * Copyright (C) 2017 - VideoLAN and VLC Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "MPDUpdater.h"
+#include "../adaptive/playlist/AbstractPlaylist.hpp"
+#include "../adaptive/playlist/BasePeriod.h"
+#include "../adaptive/playlist/BaseAdaptationSet.h"
+#include "../adaptive/playlist/BaseRepresentation.h"
+#include "../adaptive/playlist/SegmentTemplate.h"
+#include "../adaptive/playlist/SegmentTimeline.h"
+
+#include <vlc_stream.h>
+#include <vlc_xml.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace dash::mpd;
+using namespace adaptive;
+
+enum
+{
+    ELEM_OTHER = 0,
+    ELEM_MPD,
+    ELEM_PERIOD,
+    ELEM_ADAPTATIONSET,
+    ELEM_REPRESENTATION,
+    ELEM_SEGMENTTEMPLATE,
+    ELEM_SEGMENTTIMELINE,
+};
+
+MPDUpdater::Element::Element(int type_, SegmentInformation *info_)
+{
+    type = type_;
+    info = info_;
+    timeline = NULL;
+    nextid = 0;
+    startNumber = 1;
+    b_childseen = false;
+}
+
+MPDUpdater::MPDUpdater(AbstractPlaylist *playlist_, mtime_t prunebarrier_)
+{
+    playlist = playlist_;
+    prunebarrier = prunebarrier_;
+    periodindex = 0;
+    b_fallback = false;
+    timeline = NULL;
+    number = 0;
+    nextTime = 0;
+    b_firstelement = true;
+}
+
+MPDUpdater::~MPDUpdater()
+{
+}
+
+bool MPDUpdater::update(stream_t *stream)
+{
+    xml_reader_t *reader = xml_ReaderCreate(stream, stream);
+    if(!reader)
+        return false;
+
+    const char *data;
+    int type;
+    bool b_done = false;
+
+    while(!b_done && !b_fallback && (type = xml_ReaderNextNode(reader, &data)) > 0)
+    {
+        switch(type)
+        {
+            case XML_READER_STARTELEM:
+            {
+                const bool empty = xml_ReaderIsEmptyElement(reader);
+                startElement(reader, data);
+                if(empty)
+                    b_done = endElement();
+                break;
+            }
+
+            case XML_READER_ENDELEM:
+                b_done = endElement();
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    xml_ReaderDelete(reader);
+    elements.clear();
+
+    /* Merging is idempotent, so a fallback can safely merge again */
+    return b_done && !b_fallback;
+}
+
+/* Mirrors the IsoffMainParser naming of the elements without id */
+static ID getElementID(xml_reader_t *reader, uint64_t *nextid)
+{
+    const char *name, *value;
+    while((name = xml_ReaderNextAttr(reader, &value)))
+    {
+        if(!strcmp(name, "id"))
+            return ID(std::string(value));
+    }
+    return ID((*nextid)++);
+}
+
+void MPDUpdater::startElement(xml_reader_t *reader, const char *name)
+{
+    if(elements.empty())
+    {
+        if(strcmp(name, "MPD"))
+            b_fallback = true;
+        elements.push_back(Element(ELEM_MPD));
+        return;
+    }
+
+    Element &parent = elements.back();
+    Element element(ELEM_OTHER);
+
+    switch(parent.type)
+    {
+        case ELEM_MPD:
+            if(!strcmp(name, "Period"))
+            {
+                const std::vector<BasePeriod *> &periods = playlist->getPeriods();
+                element.type = ELEM_PERIOD;
+                if(periodindex < periods.size())
+                    element.info = periods.at(periodindex);
+                periodindex++;
+            }
+            break;
+
+        case ELEM_PERIOD:
+        case ELEM_ADAPTATIONSET:
+        case ELEM_REPRESENTATION:
+            if(parent.type == ELEM_PERIOD && !strcmp(name, "AdaptationSet"))
+            {
+                const ID id = getElementID(reader, &parent.nextid);
+                element.type = ELEM_ADAPTATIONSET;
+                if(parent.info)
+                    element.info = static_cast<BasePeriod *>(parent.info)->getAdaptationSetByID(id);
+            }
+            else if(parent.type == ELEM_ADAPTATIONSET && !strcmp(name, "Representation"))
+            {
+                const ID id = getElementID(reader, &parent.nextid);
+                element.type = ELEM_REPRESENTATION;
+                if(parent.info)
+                    element.info = static_cast<BaseAdaptationSet *>(parent.info)->getRepresentationByID(id);
+            }
+            else if(!strcmp(name, "SegmentTemplate"))
+            {
+                element.type = ELEM_SEGMENTTEMPLATE;
+                /* only the first one is ever parsed */
+                if(!parent.b_childseen)
+                    startTemplate(reader, element);
+                parent.b_childseen = true;
+            }
+            else if(!strcmp(name, "SegmentList"))
+            {
+                /* no incremental merging for lists */
+                b_fallback = true;
+            }
+            break;
+
+        case ELEM_SEGMENTTEMPLATE:
+            if(!strcmp(name, "SegmentTimeline"))
+            {
+                element.type = ELEM_SEGMENTTIMELINE;
+                if(!parent.b_childseen)
+                    startTimeline(reader, parent);
+                parent.b_childseen = true;
+            }
+            break;
+
+        case ELEM_SEGMENTTIMELINE:
+            if(timeline && !strcmp(name, "S"))
+                mergeTimelineElement(reader);
+            break;
+
+        default:
+            break;
+    }
+
+    elements.push_back(element);
+}
+
+bool MPDUpdater::endElement()
+{
+    if(elements.empty())
+    {
+        b_fallback = true;
+        return true;
+    }
+
+    if(elements.back().type == ELEM_SEGMENTTIMELINE && timeline)
+    {
+        if(prunebarrier)
+        {
+            const Timescale timescale = timeline->inheritTimescale();
+            const uint64_t num =
+                    timeline->getElementNumberByScaledPlaybackTime(timescale.ToScaled(prunebarrier));
+            timeline->pruneBySequenceNumber(num);
+        }
+        timeline = NULL;
+    }
+
+    elements.pop_back();
+    return elements.empty();
+}
+
+void MPDUpdater::startTemplate(xml_reader_t *reader, Element &element)
+{
+    const Element &parent = elements.back();
+    bool b_media = false;
+
+    const char *name, *value;
+    while((name = xml_ReaderNextAttr(reader, &value)))
+    {
+        if(!strcmp(name, "media"))
+            b_media = *value;
+        else if(!strcmp(name, "startNumber"))
+            element.startNumber = strtoull(value, NULL, 10);
+    }
+
+    /* Same as the parser: without media, there's no template to merge */
+    MediaSegmentTemplate *templ;
+    if(b_media && parent.info && (templ = parent.info->getSegmentTemplate()))
+        element.timeline = templ->segmentTimeline.Get();
+}
+
+void MPDUpdater::startTimeline(xml_reader_t *reader, Element &templ)
+{
+    number = templ.startNumber;
+
+    const char *name, *value;
+    while((name = xml_ReaderNextAttr(reader, &value)))
+    {
+        if(!strcmp(name, "startNumber"))
+            number = strtoull(value, NULL, 10);
+    }
+
+    timeline = templ.timeline;
+    nextTime = 0;
+    b_firstelement = true;
+}
+
+void MPDUpdater::mergeTimelineElement(xml_reader_t *reader)
+{
+    stime_t t = 0, d = 0;
+    uint64_t r = 0; /* never repeats by default */
+    bool b_duration = false;
+
+    const char *name, *value;
+    while((name = xml_ReaderNextAttr(reader, &value)))
+    {
+        if(name[0] == '\0' || name[1] != '\0')
+            continue;
+        switch(name[0])
+        {
+            case 't':
+                t = strtoll(value, NULL, 10);
+                break;
+            case 'd':
+                d = strtoll(value, NULL, 10);
+                b_duration = true;
+                break;
+            case 'r':
+                r = strtoull(value, NULL, 10);
+                break;
+        }
+    }
+
+    if(!b_duration) /* Mandatory */
+        return;
+
+    /* Missing time continues from previous element, as in SegmentTimeline::addElement */
+    if(!t && !b_firstelement)
+        t = nextTime;
+
+    timeline->mergeElement(number, d, r, t);
+
+    number += (1 + r);
+    nextTime = t + d * (r + 1);
+    b_firstelement = false;
+}
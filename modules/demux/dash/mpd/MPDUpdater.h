@@ -0,0 +1,91 @@
+/*
+ * MPDUpdater.h
+ *****************************************************************************
+ * Copyright (C) 2017 - VideoLAN and VLC Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef MPDUPDATER_H_
+#define MPDUPDATER_H_
+
+#include "../adaptive/Time.hpp"
+
+#include <vlc_common.h>
+#include <vector>
+
+typedef struct xml_reader_t xml_reader_t;
+
+namespace adaptive
+{
+    namespace playlist
+    {
+        class AbstractPlaylist;
+        class SegmentInformation;
+        class SegmentTimeline;
+    }
+}
+
+namespace dash
+{
+    namespace mpd
+    {
+        using namespace adaptive::playlist;
+
+        /* Merges a refreshed MPD into the current playlist while reading it,
+         * without building the DOM tree nor a temporary playlist: only new
+         * SegmentTimeline entries get allocated. Refreshes which can't be
+         * merged that way (SegmentList...) have to go through the parser. */
+        class MPDUpdater
+        {
+            public:
+                MPDUpdater(AbstractPlaylist *, mtime_t);
+                ~MPDUpdater();
+                bool update(stream_t *);
+
+            private:
+                class Element
+                {
+                    public:
+                        Element(int, SegmentInformation * = NULL);
+                        int type;
+                        SegmentInformation *info;
+                        SegmentTimeline *timeline;
+                        uint64_t nextid;
+                        uint64_t startNumber;
+                        bool b_childseen;
+                };
+
+                void startElement(xml_reader_t *, const char *);
+                bool endElement();
+                void startTemplate(xml_reader_t *, Element &);
+                void startTimeline(xml_reader_t *, Element &);
+                void mergeTimelineElement(xml_reader_t *);
+
+                AbstractPlaylist *playlist;
+                mtime_t prunebarrier;
+                std::vector<Element> elements;
+                size_t periodindex;
+                bool b_fallback;
+
+                /* current SegmentTimeline being merged */
+                SegmentTimeline *timeline;
+                uint64_t number;
+                stime_t nextTime;
+                bool b_firstelement;
+        };
+    }
+}
+
+#endif /* MPDUPDATER_H_ */
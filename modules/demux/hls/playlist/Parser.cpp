@@ -158,6 +158,64 @@ void M3U8Parser::createAndFillRepresentation(vlc_object_t *p_obj, BaseAdaptation
     }
 }
 
+/* Media playlist reading state. Values are copied out of the tags,
+ * so that tags can be released as soon as they have been read */
+class M3U8Parser::SegmentsContext
+{
+    public:
+        SegmentsContext(Representation *rep)
+        {
+            rep->setTimescale(100);
+            segmentList = new (std::nothrow) SegmentList(rep);
+            totalduration = 0;
+            nzStartTime = 0;
+            absReferenceTime = VLC_TS_INVALID;
+            sequenceNumber = 0;
+            discontinuity = false;
+            prevbyterangeoffset = 0;
+            b_byterange = false;
+            b_extinf = false;
+            extinfDuration = 0.0;
+            b_keypending = false;
+
+            /* On refresh, segments up to the last known one are only
+             * accounted, and new ones continue its timeline */
+            b_refresh = false;
+            lastKnownNumber = 0;
+            const SegmentList *current = rep->getSegmentList();
+            if(current && !current->getSegments().empty())
+            {
+                const ISegment *last = current->getSegments().back();
+                b_refresh = true;
+                lastKnownNumber = last->getSequenceNumber();
+                nzStartTime = rep->getTimescale().ToTime(last->startTime.Get() +
+                                                         last->duration.Get());
+            }
+        }
+
+        ~SegmentsContext()
+        {
+            delete segmentList;
+        }
+
+        SegmentList *segmentList;
+        mtime_t totalduration;
+        mtime_t nzStartTime;
+        mtime_t absReferenceTime;
+        uint64_t sequenceNumber;
+        bool discontinuity;
+        std::size_t prevbyterangeoffset;
+        bool b_byterange;
+        std::pair<std::size_t,std::size_t> byterange;
+        bool b_extinf;
+        double extinfDuration;
+        SegmentEncryption encryption;
+        bool b_keypending;
+        std::string keyUrl;
+        bool b_refresh;
+        uint64_t lastKnownNumber;
+};
+
 bool M3U8Parser::appendSegmentsFromPlaylistURI(vlc_object_t *p_obj, Representation *rep)
 {
     block_t *p_block = Retrieve::HTTP(p_obj, rep->getPlaylistUrl().toString());
@@ -166,12 +224,8 @@ bool M3U8Parser::appendSegmentsFromPlaylistURI(vlc_object_t *p_obj, Representati
         stream_t *substream = vlc_stream_MemoryNew(p_obj, p_block->p_buffer, p_block->i_buffer, true);
         if(substream)
         {
-            std::list<Tag *> tagslist = parseEntries(substream);
+            appendSegments(p_obj, rep, substream);
             vlc_stream_Delete(substream);
-
-            parseSegments(p_obj, rep, tagslist);
-
-            releaseTagsList(tagslist);
         }
         block_Release(p_block);
         return true;
@@ -179,207 +233,259 @@ bool M3U8Parser::appendSegmentsFromPlaylistURI(vlc_object_t *p_obj, Representati
     return false;
 }
 
-void M3U8Parser::parseSegments(vlc_object_t *p_obj, Representation *rep, const std::list<Tag *> &tagslist)
+void M3U8Parser::appendSegments(vlc_object_t *p_obj, Representation *rep, stream_t *stream)
 {
-    SegmentList *segmentList = new (std::nothrow) SegmentList(rep);
+    /* Media playlists are applied line by line, without
+     * building the whole tags list first */
+    SegmentsContext ctx(rep);
+    char *psz_line;
+    while((psz_line = vlc_stream_ReadLine(stream)))
+    {
+        Tag *tag = parseEntry(psz_line);
+        free(psz_line);
+        if(tag)
+        {
+            parseSegmentTag(p_obj, rep, ctx, tag);
+            delete tag;
+        }
+    }
 
-    rep->setTimescale(100);
-    rep->b_loaded = true;
+    commitSegments(rep, ctx);
+}
 
-    mtime_t totalduration = 0;
-    mtime_t nzStartTime = 0;
-    mtime_t absReferenceTime = VLC_TS_INVALID;
-    uint64_t sequenceNumber = 0;
-    bool discontinuity = false;
-    std::size_t prevbyterangeoffset = 0;
-    const SingleValueTag *ctx_byterange = NULL;
-    SegmentEncryption encryption;
-    const ValuesListTag *ctx_extinf = NULL;
+void M3U8Parser::parseSegments(vlc_object_t *p_obj, Representation *rep, const std::list<Tag *> &tagslist)
+{
+    SegmentsContext ctx(rep);
 
     std::list<Tag *>::const_iterator it;
     for(it = tagslist.begin(); it != tagslist.end(); ++it)
+        parseSegmentTag(p_obj, rep, ctx, *it);
+
+    commitSegments(rep, ctx);
+}
+
+void M3U8Parser::parseSegmentTag(vlc_object_t *p_obj, Representation *rep,
+                                 SegmentsContext &ctx, const Tag *tag)
+{
+    switch(tag->getType())
     {
-        const Tag *tag = *it;
-        switch(tag->getType())
+        /* using static cast as attribute type permits avoiding class check */
+        case SingleValueTag::EXTXMEDIASEQUENCE:
         {
-            /* using static cast as attribute type permits avoiding class check */
-            case SingleValueTag::EXTXMEDIASEQUENCE:
+            ctx.sequenceNumber = (static_cast<const SingleValueTag*>(tag))->getValue().decimal();
+        }
+        break;
+
+        case ValuesListTag::EXTINF:
+        {
+            const Attribute *durationAttr =
+                    static_cast<const ValuesListTag *>(tag)->getAttributeByName("DURATION");
+            ctx.b_extinf = !!durationAttr;
+            if(durationAttr)
+                ctx.extinfDuration = durationAttr->floatingPoint();
+        }
+        break;
+
+        case SingleValueTag::URI:
+        {
+            const SingleValueTag *uritag = static_cast<const SingleValueTag *>(tag);
+            if(uritag->getValue().value.empty())
             {
-                sequenceNumber = (static_cast<const SingleValueTag*>(tag))->getValue().decimal();
+                ctx.b_extinf = false;
+                ctx.b_byterange = false;
+                break;
             }
-            break;
 
-            case ValuesListTag::EXTINF:
+            const uint64_t sequenceNumber = ctx.sequenceNumber++;
+            const mtime_t nzDuration = (ctx.b_extinf) ? CLOCK_FREQ * ctx.extinfDuration : 0;
+            ctx.totalduration += nzDuration;
+
+            std::size_t rangeStart = 0;
+            if(ctx.b_byterange)
             {
-                ctx_extinf = static_cast<const ValuesListTag *>(tag);
+                std::pair<std::size_t,std::size_t> range = ctx.byterange;
+                if(range.first == 0) /* first == size, second = offset */
+                    range.first = ctx.prevbyterangeoffset;
+                rangeStart = range.first;
+                ctx.prevbyterangeoffset = range.first + range.second;
             }
-            break;
 
-            case SingleValueTag::URI:
+            /* Already in the playlist from a previous load */
+            if(ctx.b_refresh && HLSSegment::SEQUENCE_FIRST + sequenceNumber <= ctx.lastKnownNumber)
             {
-                const SingleValueTag *uritag = static_cast<const SingleValueTag *>(tag);
-                if(uritag->getValue().value.empty())
-                {
-                    ctx_extinf = NULL;
-                    ctx_byterange = NULL;
-                    break;
-                }
-
-                HLSSegment *segment = new (std::nothrow) HLSSegment(rep, sequenceNumber++);
-                if(!segment)
-                    break;
-
-                segment->setSourceUrl(uritag->getValue().value);
-                if((unsigned)rep->getStreamFormat() == StreamFormat::UNKNOWN)
-                    setFormatFromExtension(rep, uritag->getValue().value);
-
-                if(ctx_extinf)
-                {
-                    if(ctx_extinf->getAttributeByName("DURATION"))
-                    {
-                        const mtime_t nzDuration = CLOCK_FREQ * ctx_extinf->getAttributeByName("DURATION")->floatingPoint();
-                        segment->duration.Set(ctx_extinf->getAttributeByName("DURATION")->floatingPoint() * (uint64_t) rep->getTimescale());
-                        segment->startTime.Set(rep->getTimescale().ToScaled(nzStartTime));
-                        nzStartTime += nzDuration;
-                        totalduration += nzDuration;
+                if(ctx.b_extinf && ctx.absReferenceTime > VLC_TS_INVALID)
+                    ctx.absReferenceTime += nzDuration;
+                ctx.b_extinf = false;
+                ctx.b_byterange = false;
+                ctx.discontinuity = false;
+                break;
+            }
 
-                        if(absReferenceTime > VLC_TS_INVALID)
-                        {
-                            segment->utcTime = absReferenceTime;
-                            absReferenceTime += nzDuration;
-                        }
-                    }
-                    ctx_extinf = NULL;
-                }
+            HLSSegment *segment = new (std::nothrow) HLSSegment(rep, sequenceNumber);
+            if(!segment)
+                break;
 
-                segmentList->addSegment(segment);
+            segment->setSourceUrl(uritag->getValue().value);
+            if((unsigned)rep->getStreamFormat() == StreamFormat::UNKNOWN)
+                setFormatFromExtension(rep, uritag->getValue().value);
 
-                if(ctx_byterange)
-                {
-                    std::pair<std::size_t,std::size_t> range = ctx_byterange->getValue().getByteRange();
-                    if(range.first == 0) /* first == size, second = offset */
-                        range.first = prevbyterangeoffset;
-                    prevbyterangeoffset = range.first + range.second;
-                    segment->setByteRange(range.first, prevbyterangeoffset - 1);
-                    ctx_byterange = NULL;
-                }
+            if(ctx.b_extinf)
+            {
+                segment->duration.Set(ctx.extinfDuration * (uint64_t) rep->getTimescale());
+                segment->startTime.Set(rep->getTimescale().ToScaled(ctx.nzStartTime));
+                ctx.nzStartTime += nzDuration;
 
-                if(discontinuity)
+                if(ctx.absReferenceTime > VLC_TS_INVALID)
                 {
-                    segment->discontinuity = true;
-                    discontinuity = false;
+                    segment->utcTime = ctx.absReferenceTime;
+                    ctx.absReferenceTime += nzDuration;
                 }
-
-                if(encryption.method != SegmentEncryption::NONE)
-                    segment->setEncryption(encryption);
+                ctx.b_extinf = false;
             }
-            break;
 
-            case SingleValueTag::EXTXTARGETDURATION:
-                rep->targetDuration = static_cast<const SingleValueTag *>(tag)->getValue().decimal();
-                break;
+            ctx.segmentList->addSegment(segment);
 
-            case SingleValueTag::EXTXPLAYLISTTYPE:
-                rep->b_live = (static_cast<const SingleValueTag *>(tag)->getValue().value != "VOD");
-                break;
-
-            case SingleValueTag::EXTXBYTERANGE:
-                ctx_byterange = static_cast<const SingleValueTag *>(tag);
-                break;
+            if(ctx.b_byterange)
+            {
+                segment->setByteRange(rangeStart, ctx.prevbyterangeoffset - 1);
+                ctx.b_byterange = false;
+            }
 
-            case SingleValueTag::EXTXPROGRAMDATETIME:
-                rep->b_consistent = false;
-                absReferenceTime = VLC_TS_0 +
-                        UTCTime(static_cast<const SingleValueTag *>(tag)->getValue().value).mtime();
-                break;
+            if(ctx.discontinuity)
+            {
+                segment->discontinuity = true;
+                ctx.discontinuity = false;
+            }
 
-            case AttributesTag::EXTXKEY:
+            if(ctx.encryption.method != SegmentEncryption::NONE)
             {
-                const AttributesTag *keytag = static_cast<const AttributesTag *>(tag);
-                if( keytag->getAttributeByName("METHOD") &&
-                    keytag->getAttributeByName("METHOD")->value == "AES-128" &&
-                    keytag->getAttributeByName("URI") )
+                /* keys are only retrieved once a segment needs them */
+                if(ctx.b_keypending)
                 {
-                    encryption.method = SegmentEncryption::AES_128;
-                    encryption.key.clear();
-
-                    Url keyurl(keytag->getAttributeByName("URI")->quotedString());
-                    if(!keyurl.hasScheme())
-                    {
-                        keyurl.prepend(Helper::getDirectoryPath(rep->getPlaylistUrl().toString()).append("/"));
-                    }
-
-                    block_t *p_block = Retrieve::HTTP(p_obj, keyurl.toString());
+                    ctx.b_keypending = false;
+                    block_t *p_block = Retrieve::HTTP(p_obj, ctx.keyUrl);
                     if(p_block)
                     {
                         if(p_block->i_buffer == 16)
                         {
-                            encryption.key.resize(16);
-                            memcpy(&encryption.key[0], p_block->p_buffer, 16);
+                            ctx.encryption.key.resize(16);
+                            memcpy(&ctx.encryption.key[0], p_block->p_buffer, 16);
                         }
                         block_Release(p_block);
                     }
+                }
+                segment->setEncryption(ctx.encryption);
+            }
+        }
+        break;
 
-                    if(keytag->getAttributeByName("IV"))
-                    {
-                        encryption.iv.clear();
-                        encryption.iv = keytag->getAttributeByName("IV")->hexSequence();
-                    }
+        case SingleValueTag::EXTXTARGETDURATION:
+            rep->targetDuration = static_cast<const SingleValueTag *>(tag)->getValue().decimal();
+            break;
+
+        case SingleValueTag::EXTXPLAYLISTTYPE:
+            rep->b_live = (static_cast<const SingleValueTag *>(tag)->getValue().value != "VOD");
+            break;
+
+        case SingleValueTag::EXTXBYTERANGE:
+            ctx.byterange = static_cast<const SingleValueTag *>(tag)->getValue().getByteRange();
+            ctx.b_byterange = true;
+            break;
+
+        case SingleValueTag::EXTXPROGRAMDATETIME:
+            rep->b_consistent = false;
+            ctx.absReferenceTime = VLC_TS_0 +
+                    UTCTime(static_cast<const SingleValueTag *>(tag)->getValue().value).mtime();
+            break;
+
+        case AttributesTag::EXTXKEY:
+        {
+            const AttributesTag *keytag = static_cast<const AttributesTag *>(tag);
+            if( keytag->getAttributeByName("METHOD") &&
+                keytag->getAttributeByName("METHOD")->value == "AES-128" &&
+                keytag->getAttributeByName("URI") )
+            {
+                ctx.encryption.method = SegmentEncryption::AES_128;
+                ctx.encryption.key.clear();
+
+                Url keyurl(keytag->getAttributeByName("URI")->quotedString());
+                if(!keyurl.hasScheme())
+                {
+                    keyurl.prepend(Helper::getDirectoryPath(rep->getPlaylistUrl().toString()).append("/"));
                 }
-                else
+                ctx.keyUrl = keyurl.toString();
+                ctx.b_keypending = true;
+
+                if(keytag->getAttributeByName("IV"))
                 {
-                    /* unsupported or invalid */
-                    encryption.method = SegmentEncryption::NONE;
-                    encryption.key.clear();
-                    encryption.iv.clear();
+                    ctx.encryption.iv.clear();
+                    ctx.encryption.iv = keytag->getAttributeByName("IV")->hexSequence();
                 }
             }
-            break;
+            else
+            {
+                /* unsupported or invalid */
+                ctx.encryption.method = SegmentEncryption::NONE;
+                ctx.encryption.key.clear();
+                ctx.encryption.iv.clear();
+                ctx.b_keypending = false;
+            }
+        }
+        break;
 
-            case AttributesTag::EXTXMAP:
+        case AttributesTag::EXTXMAP:
+        {
+            const AttributesTag *keytag = static_cast<const AttributesTag *>(tag);
+            const Attribute *uriAttr;
+            if(keytag && !ctx.b_refresh && (uriAttr = keytag->getAttributeByName("URI")) &&
+               !ctx.segmentList->initialisationSegment.Get()) /* FIXME: handle discontinuities */
             {
-                const AttributesTag *keytag = static_cast<const AttributesTag *>(tag);
-                const Attribute *uriAttr;
-                if(keytag && (uriAttr = keytag->getAttributeByName("URI")) &&
-                   !segmentList->initialisationSegment.Get()) /* FIXME: handle discontinuities */
+                InitSegment *initSegment = new (std::nothrow) InitSegment(rep);
+                if(initSegment)
                 {
-                    InitSegment *initSegment = new (std::nothrow) InitSegment(rep);
-                    if(initSegment)
+                    initSegment->setSourceUrl(uriAttr->quotedString());
+                    const Attribute *byterangeAttr = keytag->getAttributeByName("BYTERANGE");
+                    if(byterangeAttr)
                     {
-                        initSegment->setSourceUrl(uriAttr->quotedString());
-                        const Attribute *byterangeAttr = keytag->getAttributeByName("BYTERANGE");
-                        if(byterangeAttr)
-                        {
-                            const std::pair<std::size_t,std::size_t> range = byterangeAttr->unescapeQuotes().getByteRange();
-                            initSegment->setByteRange(range.first, range.first + range.second - 1);
-                        }
-                        segmentList->initialisationSegment.Set(initSegment);
+                        const std::pair<std::size_t,std::size_t> range = byterangeAttr->unescapeQuotes().getByteRange();
+                        initSegment->setByteRange(range.first, range.first + range.second - 1);
                     }
+                    ctx.segmentList->initialisationSegment.Set(initSegment);
                 }
             }
-            break;
+        }
+        break;
 
-            case Tag::EXTXDISCONTINUITY:
-                discontinuity  = true;
-                break;
+        case Tag::EXTXDISCONTINUITY:
+            ctx.discontinuity  = true;
+            break;
 
-            case Tag::EXTXENDLIST:
-                rep->b_live = false;
-                break;
-        }
+        case Tag::EXTXENDLIST:
+            rep->b_live = false;
+            break;
     }
+}
+
+void M3U8Parser::commitSegments(Representation *rep, SegmentsContext &ctx)
+{
+    rep->b_loaded = true;
 
     if(rep->isLive())
     {
         rep->getPlaylist()->duration.Set(0);
     }
-    else if(totalduration > rep->getPlaylist()->duration.Get())
+    else if(ctx.totalduration > rep->getPlaylist()->duration.Get())
     {
-        rep->getPlaylist()->duration.Set(totalduration);
+        rep->getPlaylist()->duration.Set(ctx.totalduration);
     }
 
-    rep->setSegmentList(segmentList);
+    if(ctx.segmentList)
+    {
+        rep->setSegmentList(ctx.segmentList);
+        ctx.segmentList = NULL;
+    }
 }
+
 M3U8 * M3U8Parser::parse(vlc_object_t *p_object, stream_t *p_stream, const std::string &playlisturl)
 {
     char *psz_line = vlc_stream_ReadLine(p_stream);
@@ -519,54 +625,24 @@ std::list<Tag *> M3U8Parser::parseEntries(stream_t *stream)
 
     while((psz_line = vlc_stream_ReadLine(stream)))
     {
-        if(*psz_line == '#')
-        {
-            if(!strncmp(psz_line, "#EXT", 4)) //tag
-            {
-                std::string key;
-                std::string attributes;
-                const char *split = strchr(psz_line, ':');
-                if(split)
-                {
-                    key = std::string(psz_line + 1, split - psz_line - 1);
-                    attributes = std::string(split + 1);
-                }
-                else
-                {
-                    key = std::string(psz_line + 1);
-                }
-
-                if(!key.empty())
-                {
-                    Tag *tag = TagFactory::createTagByName(key, attributes);
-                    if(tag)
-                        entrieslist.push_back(tag);
-                    lastTag = tag;
-                }
-            }
-        }
-        else if(*psz_line)
+        if(*psz_line && *psz_line != '#' &&
+           lastTag && lastTag->getType() == AttributesTag::EXTXSTREAMINF)
         {
-            /* URI */
-            if(lastTag && lastTag->getType() == AttributesTag::EXTXSTREAMINF)
-            {
-                AttributesTag *streaminftag = static_cast<AttributesTag *>(lastTag);
-                /* master playlist uri, merge as attribute */
-                Attribute *uriAttr = new (std::nothrow) Attribute("URI", std::string(psz_line));
-                if(uriAttr)
-                    streaminftag->addAttribute(uriAttr);
-            }
-            else /* playlist tag, will take modifiers */
-            {
-                Tag *tag = TagFactory::createTagByName("", std::string(psz_line));
-                if(tag)
-                    entrieslist.push_back(tag);
-            }
+            AttributesTag *streaminftag = static_cast<AttributesTag *>(lastTag);
+            /* master playlist uri, merge as attribute */
+            Attribute *uriAttr = new (std::nothrow) Attribute("URI", std::string(psz_line));
+            if(uriAttr)
+                streaminftag->addAttribute(uriAttr);
             lastTag = NULL;
         }
-        else // drop
+        else
         {
-            lastTag = NULL;
+            Tag *tag = parseEntry(psz_line);
+            if(tag)
+                entrieslist.push_back(tag);
+            /* comments do not reset the tag the next uri applies to */
+            if(*psz_line != '#' || !strncmp(psz_line, "#EXT", 4))
+                lastTag = tag;
         }
 
         free(psz_line);
@@ -574,3 +650,35 @@ std::list<Tag *> M3U8Parser::parseEntries(stream_t *stream)
 
     return entrieslist;
 }
+
+Tag * M3U8Parser::parseEntry(const char *psz_line)
+{
+    if(*psz_line == '#')
+    {
+        if(!strncmp(psz_line, "#EXT", 4)) //tag
+        {
+            std::string key;
+            std::string attributes;
+            const char *split = strchr(psz_line, ':');
+            if(split)
+            {
+                key = std::string(psz_line + 1, split - psz_line - 1);
+                attributes = std::string(split + 1);
+            }
+            else
+            {
+                key = std::string(psz_line + 1);
+            }
+
+            if(!key.empty())
+                return TagFactory::createTagByName(key, attributes);
+        }
+    }
+    else if(*psz_line)
+    {
+        /* URI, playlist tag, will take modifiers */
+        return TagFactory::createTagByName("", std::string(psz_line));
+    }
+
+    return NULL;
+}
@@ -57,14 +57,20 @@ namespace hls
 
                 M3U8 *             parse  (vlc_object_t *p_obj, stream_t *p_stream, const std::string &);
                 bool appendSegmentsFromPlaylistURI(vlc_object_t *, Representation *);
+                void appendSegments(vlc_object_t *, Representation *, stream_t *);
 
             private:
+                class SegmentsContext;
+
                 Representation * createRepresentation(BaseAdaptationSet *, const AttributesTag *);
                 void createAndFillRepresentation(vlc_object_t *, BaseAdaptationSet *,
                                                  const AttributesTag *, const std::list<Tag *>&);
                 void parseSegments(vlc_object_t *, Representation *, const std::list<Tag *>&);
+                void parseSegmentTag(vlc_object_t *, Representation *, SegmentsContext &, const Tag *);
+                void commitSegments(Representation *, SegmentsContext &);
                 void setFormatFromExtension(Representation *rep, const std::string &);
                 std::list<Tag *> parseEntries(stream_t *);
+                Tag * parseEntry(const char *);
         };
     }
 }
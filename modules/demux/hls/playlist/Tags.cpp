@@ -26,6 +26,8 @@
 #include <stack>
 
 #include <vlc_common.h>
+#include <vlc_charset.h>
+#include <cstdlib>
 
 using namespace hls::playlist;
 
@@ -35,22 +37,15 @@ Attribute::Attribute(const std::string &name_, const std::string &value_)
     value = value_;
 }
 
+/* No stream nor locale construction: these run for every playlist entry */
 uint64_t Attribute::decimal() const
 {
-    std::istringstream is(value);
-    is.imbue(std::locale("C"));
-    uint64_t ret;
-    is >> ret;
-    return ret;
+    return strtoull(value.c_str(), NULL, 10);
 }
 
 double Attribute::floatingPoint() const
 {
-    std::istringstream is(value);
-    is.imbue(std::locale("C"));
-    double ret;
-    is >> ret;
-    return ret;
+    return us_strtod(value.c_str(), NULL);
 }
 
 std::vector<uint8_t> Attribute::hexSequence() const
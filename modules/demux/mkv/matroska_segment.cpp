@@ -60,11 +60,15 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
     ,ep(NULL)
     ,b_preloaded(false)
     ,b_ref_external_segments(false)
+    ,p_indexer(NULL)
 {
 }
 
 matroska_segment_c::~matroska_segment_c()
 {
+    /* stop indexing before anything it uses goes away */
+    delete p_indexer;
+
     for( tracks_map_t::iterator it = tracks.begin(); it != tracks.end(); ++it)
     {
         tracks_map_t::mapped_type& track = it->second;
@@ -689,9 +693,46 @@ bool matroska_segment_c::Preload( )
     if( cluster == NULL || cluster->IsFiniteSize() )
         EnsureDuration();
 
+    if( !b_cues && cluster != NULL )
+        StartIndexer();
+
     return true;
 }
 
+/* Without cues, seeking has to search for key frames in the clusters it
+ * goes through, so index them ahead in the background instead */
+void matroska_segment_c::StartIndexer()
+{
+    if( !var_InheritBool( &sys.demuxer, "mkv-background-index" ) )
+        return;
+
+    /* the indexer needs to open the file again on its own */
+    const char *psz_url = sys.demuxer.s->psz_url;
+    if( psz_url == NULL || strncasecmp( psz_url, "file:", 5 ) ||
+        sys.streams.empty() || sys.streams[0]->p_estream != &es )
+        return;
+
+    uint64_t i_end;
+    if( segment->IsFiniteSize() )
+        i_end = segment->GetEndPosition();
+    else if( vlc_stream_GetSize( sys.demuxer.s, &i_end ) )
+        return;
+
+    SegmentSeeker::track_ids_t track_ids;
+    for( tracks_map_t::const_iterator it = tracks.begin(); it != tracks.end(); ++it )
+        track_ids.push_back( it->first );
+
+    p_indexer = new (std::nothrow) SegmentIndexer( &sys.demuxer, psz_url, p_segment_uid,
+                                                   i_timescale, track_ids,
+                                                   cluster->GetElementPosition(), i_end );
+
+    if( p_indexer != NULL && !p_indexer->Start() )
+    {
+        delete p_indexer;
+        p_indexer = NULL;
+    }
+}
+
 /* Here we try to load elements that were found in Seek Heads, but not yet parsed */
 bool matroska_segment_c::LoadSeekHeadItem( const EbmlCallbacks & ClassInfos, int64_t i_element_position )
 {
@@ -819,6 +860,9 @@ void matroska_segment_c::Seek( mtime_t i_absolute_mk_date, mtime_t i_mk_time_off
 
     // find appropriate seekpoints //
 
+    if( p_indexer != NULL )
+        p_indexer->Merge( _seeker );
+
     try {
         seekpoints = _seeker.get_seekpoints( *this, i_mk_date, priority_tracks );
     }
@@ -27,6 +27,7 @@
 
 #include "mkv.hpp"
 #include "matroska_segment_seeker.hpp"
+#include "matroska_segment_indexer.hpp"
 #include <vector>
 #include <string>
 
@@ -170,8 +171,10 @@ private:
     int32_t TrackInit( mkv_track_t * p_tk );
     void ComputeTrackPriority();
     void EnsureDuration();
+    void StartIndexer();
 
-    SegmentSeeker _seeker;
+    SegmentSeeker   _seeker;
+    SegmentIndexer *p_indexer;
 
     friend SegmentSeeker;
 };
@@ -0,0 +1,613 @@
+/*****************************************************************************
+ * matroska_segment_indexer.cpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "matroska_segment_indexer.hpp"
+
+#include <vlc_fs.h>
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <utility>
+
+/* The indexer only walks element headers, reading the few bytes it needs
+ * from the blocks, so it doesn't go through libebml */
+namespace {
+    enum
+    {
+        ID_EBML             = 0x1A45DFA3,
+        ID_SEGMENT          = 0x18538067,
+        ID_SEEKHEAD         = 0x114D9B74,
+        ID_INFO             = 0x1549A966,
+        ID_TRACKS           = 0x1654AE6B,
+        ID_CUES             = 0x1C53BB6B,
+        ID_CHAPTERS         = 0x1043A770,
+        ID_ATTACHMENTS      = 0x1941A469,
+        ID_TAGS             = 0x1254C367,
+        ID_CLUSTER          = 0x1F43B675,
+        ID_CLUSTER_TIMECODE = 0xE7,
+        ID_SIMPLEBLOCK      = 0xA3,
+        ID_BLOCKGROUP       = 0xA0,
+        ID_BLOCK            = 0xA1,
+        ID_REFERENCEBLOCK   = 0xFB,
+    };
+
+    /* elements ending a cluster of unknown size */
+    bool IsTopLevel( uint32_t i_id )
+    {
+        switch( i_id )
+        {
+            case ID_EBML:
+            case ID_SEGMENT:
+            case ID_SEEKHEAD:
+            case ID_INFO:
+            case ID_TRACKS:
+            case ID_CUES:
+            case ID_CHAPTERS:
+            case ID_ATTACHMENTS:
+            case ID_TAGS:
+            case ID_CLUSTER:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /* EBML variable size integer: IDs keep their length marker, sizes
+     * with all their value bits set are unknown */
+    int ReadVint( stream_t *s, uint64_t *pi_value, bool b_marker, bool *pb_unknown = NULL )
+    {
+        uint8_t p_buf[8];
+
+        if( vlc_stream_Read( s, p_buf, 1 ) != 1 || p_buf[0] == 0 )
+            return -1;
+
+        int i_len = 1;
+        while( !( p_buf[0] & ( 0x80 >> ( i_len - 1 ) ) ) )
+            i_len++;
+
+        if( i_len > 1 && vlc_stream_Read( s, &p_buf[1], i_len - 1 ) != i_len - 1 )
+            return -1;
+
+        const uint8_t i_mask = 0xff >> i_len;
+        uint64_t i_value = b_marker ? p_buf[0] : p_buf[0] & i_mask;
+        bool b_unknown = ( p_buf[0] & i_mask ) == i_mask;
+
+        for( int i = 1; i < i_len; i++ )
+        {
+            i_value = ( i_value << 8 ) | p_buf[i];
+            b_unknown &= p_buf[i] == 0xff;
+        }
+
+        *pi_value = i_value;
+        if( pb_unknown )
+            *pb_unknown = b_unknown;
+        return i_len;
+    }
+
+    bool ReadUInt( stream_t *s, uint64_t i_size, uint64_t *pi_value )
+    {
+        uint8_t p_buf[8];
+
+        if( i_size > 8 || vlc_stream_Read( s, p_buf, i_size ) != (ssize_t) i_size )
+            return false;
+
+        *pi_value = 0;
+        for( uint64_t i = 0; i < i_size; i++ )
+            *pi_value = ( *pi_value << 8 ) | p_buf[i];
+        return true;
+    }
+
+    bool ReadBlockHeader( stream_t *s, uint64_t *pi_track, int16_t *pi_timecode, uint8_t *pi_flags )
+    {
+        uint8_t p_buf[3];
+
+        if( ReadVint( s, pi_track, false ) < 0 || vlc_stream_Read( s, p_buf, 3 ) != 3 )
+            return false;
+
+        *pi_timecode = GetWBE( p_buf );
+        *pi_flags = p_buf[2];
+        return true;
+    }
+}
+
+SegmentIndexer::SegmentIndexer( demux_t *p_demux_, const char *psz_url_, const EbmlBinary *p_uid,
+                                uint64_t i_timescale_, SegmentSeeker::track_ids_t const& track_ids_,
+                                fptr_t i_start_, fptr_t i_end_ )
+    :p_demux(p_demux_)
+    ,psz_url(strdup(psz_url_))
+    ,psz_cache_dir(NULL)
+    ,psz_cache(NULL)
+    ,i_timescale(i_timescale_)
+    ,track_ids(track_ids_)
+    ,i_start(i_start_)
+    ,i_end(i_end_)
+    ,b_thread(false)
+    ,b_abort(false)
+    ,i_indexed_end(i_start_)
+    ,i_merged_clusters(0)
+    ,i_merged_keyframes(0)
+    ,i_merged_end(i_start_)
+{
+    vlc_mutex_init( &lock );
+
+    /* the cache is keyed by the segment UID, so it needs one */
+    if( p_uid == NULL || p_uid->GetSize() == 0 )
+        return;
+
+    char *psz_dir = config_GetUserDir( VLC_CACHE_DIR );
+    if( psz_dir == NULL )
+        return;
+
+    if( asprintf( &psz_cache_dir, "%s" DIR_SEP "mkv", psz_dir ) == -1 )
+        psz_cache_dir = NULL;
+    free( psz_dir );
+    if( psz_cache_dir == NULL )
+        return;
+
+    const binary *p_buf = p_uid->GetBuffer();
+    const size_t i_size = std::min<size_t>( p_uid->GetSize(), 32 );
+    char psz_uid[2 * 32 + 1];
+
+    for( size_t i = 0; i < i_size; i++ )
+        snprintf( &psz_uid[2 * i], 3, "%02x", p_buf[i] );
+
+    if( asprintf( &psz_cache, "%s" DIR_SEP "%s.idx", psz_cache_dir, psz_uid ) == -1 )
+        psz_cache = NULL;
+}
+
+SegmentIndexer::~SegmentIndexer()
+{
+    if( b_thread )
+    {
+        vlc_mutex_lock( &lock );
+        b_abort = true;
+        vlc_mutex_unlock( &lock );
+
+        vlc_join( thread, NULL );
+    }
+
+    vlc_mutex_destroy( &lock );
+    free( psz_cache );
+    free( psz_cache_dir );
+    free( psz_url );
+}
+
+bool SegmentIndexer::Start()
+{
+    if( psz_url == NULL )
+        return false;
+
+    if( LoadCache() )
+    {
+        msg_Dbg( p_demux, "loaded %zu clusters and %zu key frames from the index cache",
+                 clusters.size(), keyframes.size() );
+        return true;
+    }
+
+    b_thread = !vlc_clone( &thread, Thread, this, VLC_THREAD_PRIORITY_LOW );
+    return b_thread;
+}
+
+void SegmentIndexer::Merge( SegmentSeeker& seeker )
+{
+    vlc_mutex_locker l( &lock );
+
+    for( ; i_merged_clusters < clusters.size(); i_merged_clusters++ )
+        seeker.add_cluster( clusters[i_merged_clusters] );
+
+    for( ; i_merged_keyframes < keyframes.size(); i_merged_keyframes++ )
+    {
+        Keyframe const& keyframe = keyframes[i_merged_keyframes];
+        seeker.add_seekpoint( keyframe.track_id, SegmentSeeker::Seekpoint::TRUSTED,
+                              keyframe.fpos, keyframe.pts );
+    }
+
+    /* everything found in there is known now, don't search it again */
+    if( i_merged_end < i_indexed_end )
+    {
+        seeker.mark_range_as_searched( SegmentSeeker::Range( i_start, i_indexed_end ) );
+        i_merged_end = i_indexed_end;
+    }
+}
+
+void *SegmentIndexer::Thread( void *data )
+{
+    static_cast<SegmentIndexer *>( data )->Run();
+    return NULL;
+}
+
+bool SegmentIndexer::IsAborted()
+{
+    vlc_mutex_locker l( &lock );
+    return b_abort;
+}
+
+bool SegmentIndexer::IsIndexedTrack( track_id_t track_id ) const
+{
+    return std::find( track_ids.begin(), track_ids.end(), track_id ) != track_ids.end();
+}
+
+mtime_t SegmentIndexer::ToPts( int64_t i_timecode ) const
+{
+    /* the seeker works with the libmatroska global timecodes, in us */
+    return mtime_t( i_timecode * int64_t( i_timescale ) / 1000 );
+}
+
+void SegmentIndexer::Run()
+{
+    stream_t *s = vlc_stream_NewMRL( VLC_OBJECT( p_demux ), psz_url );
+    if( s == NULL )
+    {
+        msg_Warn( p_demux, "cannot open %s for indexing", psz_url );
+        return;
+    }
+
+    const mtime_t i_start_time = mdate();
+    fptr_t i_pos = i_start;
+    bool b_complete = false;
+
+    while( !IsAborted() )
+    {
+        if( i_pos >= i_end )
+        {
+            b_complete = true;
+            break;
+        }
+
+        Element el;
+        el.i_pos = i_pos;
+
+        uint64_t i_id;
+        if( vlc_stream_Seek( s, i_pos ) ||
+            ReadVint( s, &i_id, true ) < 0 || i_id > UINT32_MAX ||
+            ReadVint( s, &el.i_size, false, &el.b_unknown_size ) < 0 )
+            break;
+        el.i_id = i_id;
+        el.i_data = vlc_stream_Tell( s );
+
+        if( el.i_id == ID_CLUSTER )
+        {
+            if( !IndexCluster( s, el, &i_pos ) )
+                break;
+        }
+        else if( el.b_unknown_size )
+            break;
+        else
+            i_pos = el.i_data + el.i_size;
+    }
+
+    vlc_stream_Delete( s );
+
+    vlc_mutex_lock( &lock );
+    const size_t i_clusters = clusters.size();
+    const size_t i_keyframes = keyframes.size();
+    vlc_mutex_unlock( &lock );
+
+    msg_Dbg( p_demux, "indexed %zu clusters and %zu key frames up to %" PRIu64 " in %" PRId64 " ms%s",
+             i_clusters, i_keyframes, i_pos, ( mdate() - i_start_time ) / 1000,
+             b_complete ? "" : " (incomplete)" );
+
+    /* the lists are only ever modified by this thread, no need to lock */
+    if( b_complete )
+        StoreCache();
+}
+
+bool SegmentIndexer::IndexCluster( stream_t *s, Element const& cluster, fptr_t *pi_next )
+{
+    fptr_t i_cluster_end = cluster.b_unknown_size ? i_end : cluster.i_data + cluster.i_size;
+    fptr_t i_pos = cluster.i_data;
+
+    std::vector<Keyframe> found;
+    int64_t i_timecode = -1;
+
+    while( i_pos < i_cluster_end )
+    {
+        Element el;
+        el.i_pos = i_pos;
+
+        uint64_t i_id;
+        if( vlc_stream_Seek( s, i_pos ) ||
+            ReadVint( s, &i_id, true ) < 0 || i_id > UINT32_MAX ||
+            ReadVint( s, &el.i_size, false, &el.b_unknown_size ) < 0 )
+            return false;
+        el.i_id = i_id;
+        el.i_data = vlc_stream_Tell( s );
+
+        if( cluster.b_unknown_size && IsTopLevel( el.i_id ) )
+        {
+            i_cluster_end = el.i_pos;
+            break;
+        }
+
+        if( el.b_unknown_size )
+            return false;
+
+        switch( el.i_id )
+        {
+            case ID_CLUSTER_TIMECODE:
+            {
+                uint64_t i_value;
+                if( !ReadUInt( s, el.i_size, &i_value ) )
+                    return false;
+                i_timecode = i_value;
+                break;
+            }
+
+            case ID_SIMPLEBLOCK:
+            {
+                uint64_t i_track;
+                int16_t  i_block_timecode;
+                uint8_t  i_flags;
+
+                if( i_timecode < 0 || el.i_size < 4 )
+                    break;
+                if( !ReadBlockHeader( s, &i_track, &i_block_timecode, &i_flags ) )
+                    return false;
+
+                if( ( i_flags & 0x80 ) && IsIndexedTrack( i_track ) )
+                {
+                    Keyframe keyframe = { track_id_t( i_track ), el.i_pos,
+                                          ToPts( i_timecode + i_block_timecode ) };
+                    found.push_back( keyframe );
+                }
+                break;
+            }
+
+            case ID_BLOCKGROUP:
+            {
+                Keyframe keyframe;
+
+                if( i_timecode < 0 )
+                    break;
+                if( !IndexBlockGroup( s, el, &keyframe ) )
+                    break;
+
+                keyframe.pts += ToPts( i_timecode );
+                found.push_back( keyframe );
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        i_pos = el.i_data + el.i_size;
+    }
+
+    if( i_pos < i_cluster_end )
+        i_cluster_end = i_pos;
+
+    *pi_next = i_cluster_end;
+
+    if( i_timecode < 0 )
+        return true;
+
+    SegmentSeeker::Cluster const info = {
+        /* fpos     */ cluster.i_pos,
+        /* pts      */ ToPts( i_timecode ),
+        /* duration */ mtime_t( -1 ),
+        /* size     */ i_cluster_end - cluster.i_pos
+    };
+
+    vlc_mutex_locker l( &lock );
+
+    clusters.push_back( info );
+    keyframes.insert( keyframes.end(), found.begin(), found.end() );
+    i_indexed_end = i_cluster_end;
+
+    return true;
+}
+
+/* Returns whether the group holds a key frame (a block without references),
+ * with its pts relative to the cluster */
+bool SegmentIndexer::IndexBlockGroup( stream_t *s, Element const& group, Keyframe *p_keyframe )
+{
+    const fptr_t i_group_end = group.i_data + group.i_size;
+    fptr_t i_pos = group.i_data;
+    bool b_block = false;
+
+    while( i_pos < i_group_end )
+    {
+        uint64_t i_id, i_size;
+        bool b_unknown_size;
+
+        if( vlc_stream_Seek( s, i_pos ) ||
+            ReadVint( s, &i_id, true ) < 0 ||
+            ReadVint( s, &i_size, false, &b_unknown_size ) < 0 || b_unknown_size )
+            return false;
+
+        const fptr_t i_next = vlc_stream_Tell( s ) + i_size;
+
+        if( i_id == ID_REFERENCEBLOCK )
+            return false;
+
+        if( i_id == ID_BLOCK && !b_block && i_size >= 4 )
+        {
+            uint64_t i_track;
+            int16_t  i_block_timecode;
+            uint8_t  i_flags;
+
+            if( !ReadBlockHeader( s, &i_track, &i_block_timecode, &i_flags ) ||
+                !IsIndexedTrack( i_track ) )
+                return false;
+
+            /* the seeker uses the position of the block itself */
+            p_keyframe->track_id = i_track;
+            p_keyframe->fpos     = i_pos;
+            p_keyframe->pts      = ToPts( i_block_timecode );
+            b_block = true;
+        }
+
+        i_pos = i_next;
+    }
+
+    return b_block;
+}
+
+bool SegmentIndexer::LoadCache()
+{
+    if( psz_cache == NULL )
+        return false;
+
+    FILE *file = vlc_fopen( psz_cache, "rt" );
+    if( file == NULL )
+        return false;
+
+    std::vector<SegmentSeeker::Cluster> cached_clusters;
+    std::vector<Keyframe>               cached_keyframes;
+    unsigned i_version;
+    uint64_t i_cached_start, i_cached_end, i_cached_timescale;
+    bool b_valid = false;
+
+    /* the segment must not have changed (e.g. a capture still growing) */
+    if( fscanf( file, "VLC MKV index %u %" SCNu64 " %" SCNu64 " %" SCNu64,
+                &i_version, &i_cached_start, &i_cached_end, &i_cached_timescale ) == 4 &&
+        i_version == 1 && i_cached_start == i_start && i_cached_end == i_end &&
+        i_cached_timescale == i_timescale )
+    {
+        char type;
+
+        b_valid = true;
+        while( b_valid && fscanf( file, " %c", &type ) == 1 )
+        {
+            if( type == 'c' )
+            {
+                SegmentSeeker::Cluster cluster;
+                cluster.duration = -1;
+                b_valid = fscanf( file, "%" SCNu64 " %" SCNd64 " %" SCNu64,
+                                  &cluster.fpos, &cluster.pts, &cluster.size ) == 3;
+                cached_clusters.push_back( cluster );
+            }
+            else if( type == 'k' )
+            {
+                Keyframe keyframe;
+                b_valid = fscanf( file, "%u %" SCNu64 " %" SCNd64,
+                                  &keyframe.track_id, &keyframe.fpos, &keyframe.pts ) == 3;
+                cached_keyframes.push_back( keyframe );
+            }
+            else
+                b_valid = false;
+        }
+    }
+
+    fclose( file );
+
+    if( !b_valid )
+    {
+        msg_Dbg( p_demux, "ignoring outdated index cache %s", psz_cache );
+        return false;
+    }
+
+    vlc_mutex_locker l( &lock );
+
+    clusters.swap( cached_clusters );
+    keyframes.swap( cached_keyframes );
+    i_indexed_end = i_end;
+
+    return true;
+}
+
+void SegmentIndexer::StoreCache()
+{
+    if( psz_cache == NULL )
+        return;
+
+    /* the parent cache directory might not exist yet either */
+    char *psz_parent = strdup( psz_cache_dir );
+    if( psz_parent == NULL )
+        return;
+    char *psz_sep = strrchr( psz_parent, DIR_SEP_CHAR );
+    if( psz_sep != NULL )
+    {
+        *psz_sep = '\0';
+        vlc_mkdir( psz_parent, 0700 );
+    }
+    free( psz_parent );
+    vlc_mkdir( psz_cache_dir, 0700 );
+
+    char *psz_tmp;
+    if( asprintf( &psz_tmp, "%s.part", psz_cache ) == -1 )
+        return;
+
+    FILE *file = vlc_fopen( psz_tmp, "wt" );
+    if( file == NULL )
+    {
+        msg_Warn( p_demux, "cannot write index cache %s", psz_tmp );
+        free( psz_tmp );
+        return;
+    }
+
+    fprintf( file, "VLC MKV index 1 %" PRIu64 " %" PRIu64 " %" PRIu64 "\n",
+             i_start, i_end, i_timescale );
+
+    for( size_t i = 0; i < clusters.size(); i++ )
+        fprintf( file, "c %" PRIu64 " %" PRId64 " %" PRIu64 "\n",
+                 clusters[i].fpos, clusters[i].pts, clusters[i].size );
+
+    for( size_t i = 0; i < keyframes.size(); i++ )
+        fprintf( file, "k %u %" PRIu64 " %" PRId64 "\n",
+                 keyframes[i].track_id, keyframes[i].fpos, keyframes[i].pts );
+
+    if( fclose( file ) || vlc_rename( psz_tmp, psz_cache ) )
+    {
+        msg_Warn( p_demux, "cannot write index cache %s", psz_cache );
+        vlc_unlink( psz_tmp );
+    }
+    else
+        PruneCache();
+
+    free( psz_tmp );
+}
+
+/* Removes the oldest cache files, so that the directory does not grow
+ * with every file ever played */
+void SegmentIndexer::PruneCache()
+{
+    DIR *dir = vlc_opendir( psz_cache_dir );
+    if( dir == NULL )
+        return;
+
+    std::vector<std::pair<time_t, std::string> > files;
+    const char *psz_name;
+
+    while( ( psz_name = vlc_readdir( dir ) ) != NULL )
+    {
+        const size_t i_len = strlen( psz_name );
+        if( i_len < 4 || strcmp( psz_name + i_len - 4, ".idx" ) )
+            continue;
+
+        std::string path = std::string( psz_cache_dir ) + DIR_SEP + psz_name;
+        struct stat st;
+        if( vlc_stat( path.c_str(), &st ) == 0 )
+            files.push_back( std::make_pair( st.st_mtime, path ) );
+    }
+    closedir( dir );
+
+    if( files.size() <= CACHE_MAX_FILES )
+        return;
+
+    /* from the oldest */
+    std::sort( files.begin(), files.end() );
+    for( size_t i = 0; i < files.size() - CACHE_MAX_FILES; i++ )
+    {
+        msg_Dbg( p_demux, "removing old index cache %s", files[i].second.c_str() );
+        vlc_unlink( files[i].second.c_str() );
+    }
+}
@@ -0,0 +1,105 @@
+/*****************************************************************************
+ * matroska_segment_indexer.hpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef MKV_MATROSKA_SEGMENT_INDEXER_HPP_
+#define MKV_MATROSKA_SEGMENT_INDEXER_HPP_
+
+#include "mkv.hpp"
+#include "matroska_segment_seeker.hpp"
+
+#include <vector>
+
+/* Indexes the clusters and key frames of a segment without cues, ahead of
+ * playback, from its own stream in a background thread. The results are
+ * handed over to the SegmentSeeker by Merge(), and stored in a cache file
+ * named after the segment UID, to be reused on the next opening. Only the
+ * most recently written cache files are kept (see CACHE_MAX_FILES). */
+class SegmentIndexer
+{
+    public:
+        typedef SegmentSeeker::fptr_t fptr_t;
+        typedef SegmentSeeker::track_id_t track_id_t;
+
+        SegmentIndexer( demux_t *, const char *psz_url, const EbmlBinary *p_uid,
+                        uint64_t i_timescale, SegmentSeeker::track_ids_t const&,
+                        fptr_t i_start, fptr_t i_end );
+        ~SegmentIndexer();
+
+        bool Start();
+        void Merge( SegmentSeeker& );
+
+    private:
+        struct Keyframe
+        {
+            track_id_t track_id;
+            fptr_t     fpos;
+            mtime_t    pts;
+        };
+
+        struct Element
+        {
+            uint32_t i_id;
+            fptr_t   i_pos;
+            fptr_t   i_data;
+            uint64_t i_size;
+            bool     b_unknown_size;
+        };
+
+        static void *Thread( void * );
+        void Run();
+        bool IsAborted();
+        bool IndexCluster( stream_t *, Element const&, fptr_t *pi_next );
+        bool IndexBlockGroup( stream_t *, Element const&, Keyframe * );
+        bool IsIndexedTrack( track_id_t ) const;
+        mtime_t ToPts( int64_t i_timecode ) const;
+
+        bool LoadCache();
+        void StoreCache();
+        void PruneCache();
+
+        static const size_t CACHE_MAX_FILES = 200;
+
+        demux_t     *p_demux;
+        char        *psz_url;
+        char        *psz_cache_dir;
+        char        *psz_cache;
+        uint64_t     i_timescale;
+        SegmentSeeker::track_ids_t track_ids;
+        fptr_t       i_start;
+        fptr_t       i_end;
+
+        vlc_thread_t thread;
+        bool         b_thread;
+
+        /* everything below is protected by lock */
+        vlc_mutex_t  lock;
+        bool         b_abort;
+
+        std::vector<SegmentSeeker::Cluster> clusters;
+        std::vector<Keyframe>               keyframes;
+        fptr_t                              i_indexed_end;
+
+        /* what was already handed over to the seeker */
+        size_t                              i_merged_clusters;
+        size_t                              i_merged_keyframes;
+        fptr_t                              i_merged_end;
+};
+
+#endif /* include-guard */
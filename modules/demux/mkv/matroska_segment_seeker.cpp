@@ -73,6 +73,12 @@ SegmentSeeker::add_cluster( KaxCluster * const p_cluster )
             : UINT64_MAX
     };
 
+    return add_cluster( cinfo );
+}
+
+SegmentSeeker::cluster_map_t::iterator
+SegmentSeeker::add_cluster( Cluster const& cinfo )
+{
     add_cluster_position( cinfo.fpos );
 
     cluster_map_t::iterator it = _clusters.lower_bound( cinfo.pts );
@@ -107,6 +107,7 @@ class SegmentSeeker
 
         cluster_positions_t::iterator add_cluster_position( fptr_t pos );
         cluster_map_t      ::iterator add_cluster( KaxCluster * const );
+        cluster_map_t      ::iterator add_cluster( Cluster const& );
 
         void mkv_jump_to( matroska_segment_c&, fptr_t );
 
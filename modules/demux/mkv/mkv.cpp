@@ -80,6 +80,12 @@ vlc_module_begin ()
             N_("Preload clusters"),
             N_("Find all cluster positions by jumping cluster-to-cluster before playback"), true );
 
+    add_bool( "mkv-background-index", false,
+            N_("Index clusters in the background"),
+            N_("Find the key frames of local files without cues in a background thread, "
+               "and keep the result in the cache directory for the next playback "
+               "(for the most recent files only)."), true );
+
     add_shortcut( "mka", "mkv" )
 vlc_module_end ()
 
@@ -75,6 +75,7 @@ static MP4_Box_t *MP4_ReadBox( stream_t *p_stream, MP4_Box_t *p_father );
 static int MP4_Box_Read_Specific( stream_t *p_stream, MP4_Box_t *p_box, MP4_Box_t *p_father );
 static void MP4_Box_Clean_Specific( MP4_Box_t *p_box );
 static int MP4_PeekBoxHeader( stream_t *p_stream, MP4_Box_t *p_box );
+static bool MP4_BoxIsLazy( stream_t *p_stream, const MP4_Box_t *p_box );
 
 static int MP4_Seek( stream_t *p_stream, uint64_t i_pos )
 {
@@ -260,7 +261,12 @@ static MP4_Box_t *MP4_ReadBoxRestricted( stream_t *p_stream, MP4_Box_t *p_father
 
     const uint64_t i_next = p_box->i_pos + p_box->i_size;
     p_box->p_father = p_father;
-    if( MP4_Box_Read_Specific( p_stream, p_box, p_father ) != VLC_SUCCESS )
+    if( MP4_BoxIsLazy( p_stream, p_box ) )
+    {
+        /* only index it, MP4_BoxGet() will parse it */
+        p_box->e_flags |= BOX_FLAG_LAZY;
+    }
+    else if( MP4_Box_Read_Specific( p_stream, p_box, p_father ) != VLC_SUCCESS )
     {
         msg_Warn( p_stream, "Failed reading box %4.4s", (char*) &peekbox.i_type );
         MP4_BoxFree( p_box );
@@ -4425,6 +4431,91 @@ static void MP4_Box_Clean_Specific( MP4_Box_t *p_box )
         p_box->pf_free( p_box );
 }
 
+/* Boxes only indexed in lazy mode, as the demuxer needs them for seeking or
+ * metadata, if ever */
+static const struct
+{
+    uint32_t i_type;
+    uint32_t i_parent;
+} MP4_Box_Lazy[] =
+{
+    { ATOM_stss,    ATOM_stbl },
+    { ATOM_stsh,    ATOM_stbl },
+    { ATOM_sdtp,    ATOM_stbl },
+    { ATOM_sbgp,    ATOM_stbl },
+    { ATOM_sgpd,    ATOM_stbl },
+    { ATOM_meta,    ATOM_moov },
+    { ATOM_meta,    ATOM_udta },
+    { ATOM_covr,    ATOM_ilst },
+};
+
+static const MP4_Box_t *MP4_BoxGetTreeRoot( const MP4_Box_t *p_box )
+{
+    while( p_box->p_father )
+        p_box = p_box->p_father;
+    return p_box;
+}
+
+static bool MP4_BoxIsLazy( stream_t *p_stream, const MP4_Box_t *p_box )
+{
+    if( !p_box->p_father )
+        return false;
+
+    size_t i;
+    for( i = 0; i < ARRAY_SIZE(MP4_Box_Lazy); i++ )
+    {
+        if( MP4_Box_Lazy[i].i_type == p_box->i_type &&
+            MP4_Box_Lazy[i].i_parent == p_box->p_father->i_type )
+            break;
+    }
+    if( i == ARRAY_SIZE(MP4_Box_Lazy) )
+        return false;
+
+    /* Only boxes from the stream of a lazy root, not from in memory boxes */
+    const MP4_Box_t *p_root = MP4_BoxGetTreeRoot( p_box->p_father );
+    return p_root->i_type == ATOM_root && p_root->data.p_root &&
+           p_root->data.p_root->p_stream == p_stream;
+}
+
+/* Parses a box that was only indexed, restoring the stream position */
+static void MP4_BoxParseLazy( MP4_Box_t *p_box )
+{
+    stream_t *p_stream = MP4_BoxGetTreeRoot( p_box )->data.p_root->p_stream;
+    const uint64_t i_pos = vlc_stream_Tell( p_stream );
+
+    p_box->e_flags &= ~BOX_FLAG_LAZY;
+
+    if( MP4_Seek( p_stream, p_box->i_pos ) ||
+        MP4_Box_Read_Specific( p_stream, p_box, p_box->p_father ) != VLC_SUCCESS )
+    {
+        msg_Warn( p_stream, "Failed reading box %4.4s", (char*) &p_box->i_type );
+
+        /* Keep it in the tree, but without any content */
+        while( p_box->p_first )
+        {
+            MP4_Box_t *p_child = p_box->p_first;
+            p_box->p_first = p_child->p_next;
+            MP4_BoxFree( p_child );
+        }
+        p_box->p_last = NULL;
+        MP4_Box_Clean_Specific( p_box );
+        FREENULL( p_box->data.p_payload );
+        p_box->pf_free = NULL;
+        p_box->e_flags |= BOX_FLAG_FAILED;
+    }
+
+    MP4_Seek( p_stream, i_pos );
+}
+
+/* Parses the box if it was only indexed and b_load is set,
+ * returns false if unusable (not parsed, or failed to) */
+static bool MP4_BoxUsable( MP4_Box_t *p_box, bool b_load )
+{
+    if( b_load && ( p_box->e_flags & BOX_FLAG_LAZY ) )
+        MP4_BoxParseLazy( p_box );
+    return !( p_box->e_flags & ( BOX_FLAG_LAZY | BOX_FLAG_FAILED ) );
+}
+
 /*****************************************************************************
  * MP4_ReadBox : parse the actual box and the children
  *  XXX : Do not go to the next box
@@ -4524,7 +4615,8 @@ MP4_Box_t *MP4_BoxGetNextChunk( stream_t *s )
     if( p_tmp_box->i_type == ATOM_ftyp )
     {
         MP4_BoxFree( p_tmp_box );
-        return MP4_BoxGetRoot( s );
+        /* not lazy: the boxes are moved to another tree */
+        return MP4_BoxGetRoot( s, false );
     }
     MP4_BoxFree( p_tmp_box );
 
@@ -4552,7 +4644,7 @@ MP4_Box_t *MP4_BoxGetNextChunk( stream_t *s )
  *  The first box is a virtual box "root" and is the father for all first
  *  level boxes for the file, a sort of virtual contener
  *****************************************************************************/
-MP4_Box_t *MP4_BoxGetRoot( stream_t *p_stream )
+MP4_Box_t *MP4_BoxGetRoot( stream_t *p_stream, bool b_lazy )
 {
     int i_result;
 
@@ -4565,6 +4657,17 @@ MP4_Box_t *MP4_BoxGetRoot( stream_t *p_stream )
     if( i_size > 0 )
         p_vroot->i_size = i_size;
 
+    /* Lazy boxes will need to seek back */
+    bool b_seekable;
+    if( b_lazy &&
+        vlc_stream_Control( p_stream, STREAM_CAN_SEEK, &b_seekable ) == VLC_SUCCESS &&
+        b_seekable )
+    {
+        p_vroot->data.p_root = malloc( sizeof( MP4_Box_data_root_t ) );
+        if( p_vroot->data.p_root )
+            p_vroot->data.p_root->p_stream = p_stream;
+    }
+
     /* First get the moov */
     const uint32_t stoplist[] = { ATOM_moov, ATOM_mdat, 0 };
     i_result = MP4_ReadBoxContainerChildren( p_stream, p_vroot, stoplist );
@@ -4665,10 +4768,11 @@ static void MP4_BoxDumpStructure_Internal( stream_t *s, const MP4_Box_t *p_box,
         }
 
         snprintf( &str[i_level * 4], sizeof(str) - 4*i_level,
-                  "+ %4.4s size %"PRIu64" offset %" PRIuMAX "%s",
+                  "+ %4.4s size %"PRIu64" offset %" PRIuMAX "%s%s",
                     (char*)&i_displayedtype, p_box->i_size,
                   (uintmax_t)p_box->i_pos,
-                p_box->e_flags & BOX_FLAG_INCOMPLETE ? " (\?\?\?\?)" : "" );
+                p_box->e_flags & BOX_FLAG_INCOMPLETE ? " (\?\?\?\?)" : "",
+                p_box->e_flags & BOX_FLAG_LAZY ? " (not loaded)" : "" );
         msg_Dbg( s, "%s", str );
     }
     p_child = p_box->p_first;
@@ -4740,8 +4844,8 @@ static bool get_token( char **ppsz_path, char **ppsz_token, int *pi_number )
     return true;
 }
 
-static void MP4_BoxGet_Internal( const MP4_Box_t **pp_result, const MP4_Box_t *p_box,
-                                 const char *psz_fmt, va_list args)
+static void MP4_BoxGet_Internal( MP4_Box_t **pp_result, MP4_Box_t *p_box,
+                                 bool b_load, const char *psz_fmt, va_list args)
 {
     char *psz_dup;
     char *psz_path;
@@ -4776,7 +4880,7 @@ static void MP4_BoxGet_Internal( const MP4_Box_t **pp_result, const MP4_Box_t *p
         if( !psz_token )
         {
             free( psz_dup );
-            *pp_result = p_box;
+            *pp_result = MP4_BoxUsable( p_box, b_load ) ? p_box : NULL;
             return;
         }
         else
@@ -4812,6 +4916,8 @@ static void MP4_BoxGet_Internal( const MP4_Box_t **pp_result, const MP4_Box_t *p
             uint32_t i_fourcc;
             i_fourcc = VLC_FOURCC( psz_token[0], psz_token[1],
                                    psz_token[2], psz_token[3] );
+            if( !MP4_BoxUsable( p_box, b_load ) )
+                goto error_box;
             p_box = p_box->p_first;
             for( ; ; )
             {
@@ -4819,7 +4925,7 @@ static void MP4_BoxGet_Internal( const MP4_Box_t **pp_result, const MP4_Box_t *p
                 {
                     goto error_box;
                 }
-                if( p_box->i_type == i_fourcc )
+                if( p_box->i_type == i_fourcc && MP4_BoxUsable( p_box, b_load ) )
                 {
                     if( !i_number )
                     {
@@ -4833,6 +4939,8 @@ static void MP4_BoxGet_Internal( const MP4_Box_t **pp_result, const MP4_Box_t *p
         else
         if( *psz_token == '\0' )
         {
+            if( !MP4_BoxUsable( p_box, b_load ) )
+                goto error_box;
             p_box = p_box->p_first;
             for( ; ; )
             {
@@ -4840,11 +4948,14 @@ static void MP4_BoxGet_Internal( const MP4_Box_t **pp_result, const MP4_Box_t *p
                 {
                     goto error_box;
                 }
-                if( !i_number )
+                if( MP4_BoxUsable( p_box, b_load ) )
                 {
-                    break;
+                    if( !i_number )
+                    {
+                        break;
+                    }
+                    i_number--;
                 }
-                i_number--;
                 p_box = p_box->p_next;
             }
         }
@@ -4878,13 +4989,30 @@ error_box:
 MP4_Box_t *MP4_BoxGet( const MP4_Box_t *p_box, const char *psz_fmt, ... )
 {
     va_list args;
-    const MP4_Box_t *p_result;
+    MP4_Box_t *p_result;
+
+    /* Without loading, the tree is only walked, not modified */
+    va_start( args, psz_fmt );
+    MP4_BoxGet_Internal( &p_result, (MP4_Box_t *) p_box, false, psz_fmt, args );
+    va_end( args );
+
+    return( p_result );
+}
+
+/*****************************************************************************
+ * MP4_BoxLoad: find a box given a path relative to p_box, parsing the boxes
+ * only indexed along the path
+ *****************************************************************************/
+MP4_Box_t *MP4_BoxLoad( MP4_Box_t *p_box, const char *psz_fmt, ... )
+{
+    va_list args;
+    MP4_Box_t *p_result;
 
     va_start( args, psz_fmt );
-    MP4_BoxGet_Internal( &p_result, p_box, psz_fmt, args );
+    MP4_BoxGet_Internal( &p_result, p_box, true, psz_fmt, args );
     va_end( args );
 
-    return( (MP4_Box_t *) p_result );
+    return( p_result );
 }
 
 /*****************************************************************************
@@ -4900,10 +5028,10 @@ unsigned MP4_BoxCount( const MP4_Box_t *p_box, const char *psz_fmt, ... )
 {
     va_list args;
     unsigned i_count;
-    const MP4_Box_t *p_result, *p_next;
+    MP4_Box_t *p_result, *p_next;
 
     va_start( args, psz_fmt );
-    MP4_BoxGet_Internal( &p_result, p_box, psz_fmt, args );
+    MP4_BoxGet_Internal( &p_result, (MP4_Box_t *) p_box, false, psz_fmt, args );
     va_end( args );
     if( !p_result )
     {
@@ -4913,7 +5041,8 @@ unsigned MP4_BoxCount( const MP4_Box_t *p_box, const char *psz_fmt, ... )
     i_count = 1;
     for( p_next = p_result->p_next; p_next != NULL; p_next = p_next->p_next)
     {
-        if( p_next->i_type == p_result->i_type)
+        if( p_next->i_type == p_result->i_type &&
+            MP4_BoxUsable( p_next, false ) )
         {
             i_count++;
         }
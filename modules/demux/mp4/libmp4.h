@@ -1538,6 +1538,11 @@ typedef struct
     uint32_t i_blob;
 } MP4_Box_data_data_t;
 
+typedef struct
+{
+    stream_t *p_stream; /* parses the boxes only indexed in lazy mode */
+} MP4_Box_data_root_t;
+
 /*
 typedef struct MP4_Box_data__s
 {
@@ -1648,6 +1653,8 @@ typedef union MP4_Box_data_s
     MP4_Box_data_binary_t *p_binary;
     MP4_Box_data_data_t *p_data;
 
+    MP4_Box_data_root_t *p_root;
+
     void                *p_payload; /* for unknown type */
 } MP4_Box_data_t;
 
@@ -1667,7 +1674,9 @@ struct MP4_Box_s
     enum
     {
         BOX_FLAG_NONE = 0,
-        BOX_FLAG_INCOMPLETE,
+        BOX_FLAG_INCOMPLETE = 1 << 0,
+        BOX_FLAG_LAZY = 1 << 1,   /* only indexed, parsed by MP4_BoxLoad() */
+        BOX_FLAG_FAILED = 1 << 2, /* lazy parsing failed, box is unusable */
     }            e_flags;
 
     UUID_t       i_uuid;  /* Set if i_type == "uuid" */
@@ -1814,8 +1823,12 @@ MP4_Box_t *MP4_BoxGetNextChunk( stream_t * );
  *****************************************************************************
  *  The first box is a virtual box "root" and is the father for all first
  *  level boxes
+ *  In lazy mode, with a seekable stream, boxes seldom needed at opening
+ *  (seek tables, metadata) are only indexed, and parsed from the stream
+ *  by MP4_BoxLoad(). Until then, other accessors ignore them. The stream
+ *  must then outlive the boxes tree.
  *****************************************************************************/
-MP4_Box_t *MP4_BoxGetRoot( stream_t * );
+MP4_Box_t *MP4_BoxGetRoot( stream_t *, bool b_lazy );
 
 /*****************************************************************************
  * MP4_BoxNew : Allocates a new MP4 Box with its atom type
@@ -1850,6 +1863,14 @@ void MP4_BoxDumpStructure( stream_t *p_input, const MP4_Box_t *p_box );
  *****************************************************************************/
 MP4_Box_t *MP4_BoxGet( const MP4_Box_t *p_box, const char *psz_fmt, ... );
 
+/*****************************************************************************
+ * MP4_BoxLoad: same as MP4_BoxGet, but parses the boxes only indexed by a
+ * lazy MP4_BoxGetRoot() along the path
+ *****************************************************************************
+ * This reads from the stream, restoring its position afterwards.
+ *****************************************************************************/
+MP4_Box_t *MP4_BoxLoad( MP4_Box_t *p_box, const char *psz_fmt, ... );
+
 /*****************************************************************************
  * MP4_BoxCount: find number of box given a path relative to p_box
  *****************************************************************************
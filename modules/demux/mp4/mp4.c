@@ -213,34 +213,177 @@ static es_out_id_t * MP4_AddTrackES( es_out_t *out, mp4_track_t *p_track )
     return p_es;
 }
 
-/* Return time in microsecond of a track */
-static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
+static int MP4_SampleRunsInit( mp4_sample_runs_t *p_runs, uint32_t i_entry_count,
+                               const uint32_t *pi_sample_count,
+                               const int32_t *pi_value )
 {
-    demux_sys_t *p_sys = p_demux->p_sys;
-    const mp4_chunk_t *p_chunk;
+    uint32_t i_steps = i_entry_count / MP4_SAMPLE_RUNS_STEP + 1;
 
-    p_chunk = ( p_track->cchunk ) ? p_track->cchunk /* DemuxFrg */
-                                  : &p_track->chunk[p_track->i_chunk];
+    p_runs->pi_step_sample = calloc( i_steps, sizeof( uint32_t ) );
+    p_runs->pi_step_time = calloc( i_steps, sizeof( int64_t ) );
+    if( !p_runs->pi_step_sample || !p_runs->pi_step_time )
+    {
+        free( p_runs->pi_step_sample );
+        free( p_runs->pi_step_time );
+        p_runs->pi_step_sample = NULL;
+        p_runs->pi_step_time = NULL;
+        return VLC_ENOMEM;
+    }
 
-    unsigned int i_index = 0;
-    unsigned int i_sample = p_track->i_sample - p_chunk->i_sample_first;
-    int64_t i_dts = p_chunk->i_first_dts;
+    uint32_t i_sample = 0;
+    int64_t i_time = 0;
+    uint32_t i_entry;
+    for( i_entry = 0; i_entry < i_entry_count; i_entry++ )
+    {
+        if( i_entry % MP4_SAMPLE_RUNS_STEP == 0 )
+        {
+            p_runs->pi_step_sample[i_entry / MP4_SAMPLE_RUNS_STEP] = i_sample;
+            p_runs->pi_step_time[i_entry / MP4_SAMPLE_RUNS_STEP] = i_time;
+        }
+        if( UINT32_MAX - i_sample < pi_sample_count[i_entry] )
+            break; /* corrupted, ignore the remaining entries */
+        i_sample += pi_sample_count[i_entry];
+        i_time += (int64_t) pi_sample_count[i_entry] * pi_value[i_entry];
+    }
+
+    p_runs->i_entry_count = i_entry;
+    p_runs->pi_sample_count = pi_sample_count;
+    p_runs->pi_value = pi_value;
+    p_runs->i_entry = 0;
+    p_runs->i_entry_sample = 0;
+    p_runs->i_entry_time = 0;
+    return VLC_SUCCESS;
+}
+
+static void MP4_SampleRunsClean( mp4_sample_runs_t *p_runs )
+{
+    free( p_runs->pi_step_sample );
+    free( p_runs->pi_step_time );
+}
+
+static void MP4_SampleRunsSetStep( mp4_sample_runs_t *p_runs, uint32_t i_step )
+{
+    p_runs->i_entry = i_step * MP4_SAMPLE_RUNS_STEP;
+    p_runs->i_entry_sample = p_runs->pi_step_sample[i_step];
+    p_runs->i_entry_time = p_runs->pi_step_time[i_step];
+}
+
+static void MP4_SampleRunsNextEntry( mp4_sample_runs_t *p_runs )
+{
+    uint32_t i_count = p_runs->pi_sample_count[p_runs->i_entry];
+    p_runs->i_entry_sample += i_count;
+    p_runs->i_entry_time += (int64_t) i_count * p_runs->pi_value[p_runs->i_entry];
+    p_runs->i_entry++;
+}
+
+/* Moves the cursor to the entry of i_sample,
+ * returns false (cursor at the end) if the table is too short */
+static bool MP4_SampleRunsSeek( mp4_sample_runs_t *p_runs, uint32_t i_sample )
+{
+    if( p_runs->i_entry_count == 0 )
+        return false;
+
+    const uint32_t i_steps = (p_runs->i_entry_count - 1) / MP4_SAMPLE_RUNS_STEP + 1;
+    const uint32_t i_next = p_runs->i_entry / MP4_SAMPLE_RUNS_STEP + 1;
 
-    while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
+    /* random access: restart from the nearest checkpoint */
+    if( i_sample < p_runs->i_entry_sample ||
+        ( i_next < i_steps && i_sample >= p_runs->pi_step_sample[i_next] ) )
     {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+        uint32_t i_lo = 0, i_hi = i_steps - 1;
+        while( i_lo < i_hi )
         {
-            i_dts += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
-            i_index++;
+            uint32_t i_mid = i_lo + (i_hi - i_lo + 1) / 2;
+            if( p_runs->pi_step_sample[i_mid] <= i_sample )
+                i_lo = i_mid;
+            else
+                i_hi = i_mid - 1;
         }
+        MP4_SampleRunsSetStep( p_runs, i_lo );
+    }
+
+    while( p_runs->i_entry < p_runs->i_entry_count &&
+           i_sample - p_runs->i_entry_sample >=
+           p_runs->pi_sample_count[p_runs->i_entry] )
+        MP4_SampleRunsNextEntry( p_runs );
+
+    return p_runs->i_entry < p_runs->i_entry_count;
+}
+
+/* Returns the time of the start of i_sample, or of the end of the table */
+static int64_t MP4_SampleRunsGetTime( mp4_sample_runs_t *p_runs, uint32_t i_sample )
+{
+    if( !MP4_SampleRunsSeek( p_runs, i_sample ) )
+        return p_runs->i_entry_time;
+
+    return p_runs->i_entry_time + (int64_t)( i_sample - p_runs->i_entry_sample ) *
+                                  p_runs->pi_value[p_runs->i_entry];
+}
+
+/* Returns the sample at i_time, or the sample count if after the table */
+static uint32_t MP4_SampleRunsGetSample( mp4_sample_runs_t *p_runs, int64_t i_time )
+{
+    if( p_runs->i_entry_count == 0 )
+        return 0;
+
+    const uint32_t i_steps = (p_runs->i_entry_count - 1) / MP4_SAMPLE_RUNS_STEP + 1;
+    uint32_t i_lo = 0, i_hi = i_steps - 1;
+    while( i_lo < i_hi )
+    {
+        uint32_t i_mid = i_lo + (i_hi - i_lo + 1) / 2;
+        if( p_runs->pi_step_time[i_mid] <= i_time )
+            i_lo = i_mid;
         else
+            i_hi = i_mid - 1;
+    }
+    MP4_SampleRunsSetStep( p_runs, i_lo );
+
+    while( p_runs->i_entry < p_runs->i_entry_count &&
+           p_runs->i_entry_time + (int64_t) p_runs->pi_sample_count[p_runs->i_entry] *
+                                  p_runs->pi_value[p_runs->i_entry] <= i_time )
+        MP4_SampleRunsNextEntry( p_runs );
+
+    if( p_runs->i_entry == p_runs->i_entry_count )
+        return p_runs->i_entry_sample;
+
+    const int32_t i_delta = p_runs->pi_value[p_runs->i_entry];
+    if( i_delta <= 0 || i_time <= p_runs->i_entry_time )
+        return p_runs->i_entry_sample;
+
+    return p_runs->i_entry_sample + ( i_time - p_runs->i_entry_time ) / i_delta;
+}
+
+/* Return time in microsecond of a track */
+static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    int64_t i_dts;
+
+    if( p_track->cchunk ) /* DemuxFrg */
+    {
+        const mp4_chunk_t *p_chunk = p_track->cchunk;
+        unsigned int i_index = 0;
+        unsigned int i_sample = p_track->i_sample - p_chunk->i_sample_first;
+
+        i_dts = p_chunk->i_first_dts;
+        while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
         {
-            i_dts += i_sample * p_chunk->p_sample_delta_dts[i_index];
-            break;
+            if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+            {
+                i_dts += p_chunk->p_sample_count_dts[i_index] *
+                    p_chunk->p_sample_delta_dts[i_index];
+                i_sample -= p_chunk->p_sample_count_dts[i_index];
+                i_index++;
+            }
+            else
+            {
+                i_dts += i_sample * p_chunk->p_sample_delta_dts[i_index];
+                break;
+            }
         }
     }
+    else
+        i_dts = MP4_SampleRunsGetTime( &p_track->dts_runs, p_track->i_sample );
 
     /* now handle elst */
     if( p_track->p_elst )
@@ -269,10 +412,19 @@ static inline bool MP4_TrackGetPTSDelta( demux_t *p_demux, mp4_track_t *p_track,
                                          int64_t *pi_delta )
 {
     VLC_UNUSED( p_demux );
-    mp4_chunk_t *ck;
-    ck = ( p_track->cchunk ) ? p_track->cchunk /* DemuxFrg */
-                             : &p_track->chunk[p_track->i_chunk];
 
+    if( p_track->cchunk == NULL )
+    {
+        mp4_sample_runs_t *p_runs = &p_track->pts_runs;
+        if( !MP4_SampleRunsSeek( p_runs, p_track->i_sample ) )
+            return false;
+
+        *pi_delta = p_runs->pi_value[p_runs->i_entry] * CLOCK_FREQ /
+                    (int64_t)p_track->i_timescale;
+        return true;
+    }
+
+    mp4_chunk_t *ck = p_track->cchunk; /* DemuxFrg */
     unsigned int i_index = 0;
     unsigned int i_sample = p_track->i_sample - ck->i_sample_first;
 
@@ -305,7 +457,7 @@ static int LoadInitFrag( demux_t *p_demux )
     demux_sys_t *p_sys = p_demux->p_sys;
 
     /* Load all boxes ( except raw data ) */
-    if( ( p_sys->p_root = MP4_BoxGetRoot( p_demux->s ) ) == NULL )
+    if( ( p_sys->p_root = MP4_BoxGetRoot( p_demux->s, true ) ) == NULL )
     {
         goto LoadInitFragError;
     }
@@ -1635,8 +1787,8 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
             /* Count number of total attachments */
             for( ; psz_roots[i_index] && !p_udta; i_index++ )
             {
-                p_udta = MP4_BoxGet( p_sys->p_root, psz_roots[i_index] );
-                if ( p_udta )
+                p_udta = MP4_BoxLoad( p_sys->p_root, psz_roots[i_index] );
+                if ( p_udta && MP4_BoxLoad( p_udta, "covr" ) )
                     i_count += MP4_BoxCount( p_udta, "covr/data" );
             }
 
@@ -1747,10 +1899,10 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
             for( int i_index = 0; psz_roots[i_index] && !p_udta; i_index++ )
             {
-                p_udta = MP4_BoxGet( p_sys->p_root, psz_roots[i_index] );
+                p_udta = MP4_BoxLoad( p_sys->p_root, psz_roots[i_index] );
                 if ( p_udta )
                 {
-                    p_data = MP4_BoxGet( p_udta, "covr/data" );
+                    p_data = MP4_BoxLoad( p_udta, "covr/data" );
                     if ( p_data && imageTypeCompatible( BOXDATA(p_data) ) )
                     {
                         char *psz_attachment;
@@ -2055,14 +2207,6 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
         mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
 
         ck->i_offset = BOXDATA(p_co64)->i_chunk_offset[i_chunk];
-
-        ck->i_first_dts = 0;
-        ck->i_entries_dts = 0;
-        ck->p_sample_count_dts = NULL;
-        ck->p_sample_delta_dts = NULL;
-        ck->i_entries_pts = 0;
-        ck->p_sample_count_pts = NULL;
-        ck->p_sample_offset_pts = NULL;
     }
 
     /* now we read index for SampleEntry( soun vide mp4a mp4v ...)
@@ -2114,54 +2258,6 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
     return VLC_SUCCESS;
 }
 
-static int xTTS_CountEntries( demux_t *p_demux, uint32_t *pi_entry /* out */,
-                              const uint32_t i_index,
-                              uint32_t i_index_samples_left,
-                              uint32_t i_sample_count,
-                              const uint32_t *pi_index_sample_count,
-                              const uint32_t i_table_count )
-{
-    uint32_t i_array_offset;
-    while( i_sample_count > 0 )
-    {
-        if ( likely((UINT32_MAX - i_index) >= *pi_entry) )
-            i_array_offset = i_index + *pi_entry;
-        else
-            return VLC_EGENERIC;
-
-        if ( i_array_offset >= i_table_count )
-        {
-            msg_Err( p_demux, "invalid index counting total samples %u %u", i_array_offset,  i_table_count );
-            return VLC_ENOVAR;
-        }
-
-        if ( i_index_samples_left )
-        {
-            if ( i_index_samples_left > i_sample_count )
-            {
-                i_index_samples_left -= i_sample_count;
-                i_sample_count = 0;
-                *pi_entry +=1; /* No samples left, go copy */
-                break;
-            }
-            else
-            {
-                i_sample_count -= i_index_samples_left;
-                i_index_samples_left = 0;
-                *pi_entry += 1;
-                continue;
-            }
-        }
-        else
-        {
-            i_sample_count -= __MIN( i_sample_count, pi_index_sample_count[i_array_offset] );
-            *pi_entry += 1;
-        }
-    }
-
-    return VLC_SUCCESS;
-}
-
 static int TrackCreateSamplesIndex( demux_t *p_demux,
                                     mp4_track_t *p_demux_track )
 {
@@ -2184,29 +2280,20 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     }
     stsz = p_box->data.p_stsz;
 
-    /* Use stsz table to create a sample number -> sample size table */
+    /* Use stsz table as sample number -> sample size table */
     p_demux_track->i_sample_count = stsz->i_sample_count;
+    p_demux_track->i_sample_size = stsz->i_sample_size;
     if( stsz->i_sample_size )
     {
-        /* 1: all sample have the same size, so no need to construct a table */
-        p_demux_track->i_sample_size = stsz->i_sample_size;
+        /* 1: all sample have the same size, so no need for a table */
         p_demux_track->p_sample_size = NULL;
     }
     else
     {
         /* 2: each sample can have a different size */
-        p_demux_track->i_sample_size = 0;
-        p_demux_track->p_sample_size =
-            calloc( p_demux_track->i_sample_count, sizeof( uint32_t ) );
-        if( p_demux_track->p_sample_size == NULL )
-            return VLC_ENOMEM;
-
-        for( uint32_t i_sample = 0; i_sample < p_demux_track->i_sample_count; i_sample++ )
-        {
-            p_demux_track->p_sample_size[i_sample] =
-                    stsz->i_entry_size[i_sample];
-        }
+        p_demux_track->p_sample_size = stsz->i_entry_size;
     }
+    p_demux_track->pos.i_chunk = UINT32_MAX;
 
     if ( p_demux_track->i_chunk_count )
     {
@@ -2236,16 +2323,11 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
             MP4_Fragment_Moov( &p_sys->fragments )->i_chunk_range_max_offset = i_total_size;
     }
 
-    /* Use stts table to create a sample number -> dts table.
-     * XXX: if we don't want to waste too much memory, we can't expand
-     *  the box! so each chunk will contain an "extract" of this table
-     *  for fast research (problem with raw stream where a sample is sometime
-     *  just channels*bits_per_sample/8 */
+    /* Use stts table as sample number -> dts table.
+     * Neither it nor the ctts table are expanded: samples are looked up in
+     * the run length coded box data, and each chunk only keeps its first
+     * dts and duration */
 
-     /* FIXME: refactor STTS & CTTS, STTS having now only few extra lines and
-      *        differing in 2/2 fields and 1 signedness */
-
-    mtime_t i_next_dts = 0;
     /* Find stts
      *  Gives mapping between sample and decoding time
      */
@@ -2255,106 +2337,26 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
         msg_Warn( p_demux, "cannot find STTS box" );
         return VLC_EGENERIC;
     }
-    else
-    {
-        MP4_Box_data_stts_t *stts = p_box->data.p_stts;
-
-        msg_Warn( p_demux, "STTS table of %"PRIu32" entries", stts->i_entry_count );
-
-        /* Create sample -> dts table per chunk */
-        uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
-
-        for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
-        {
-            mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
-
-            /* save first dts */
-            ck->i_first_dts = i_next_dts;
-
-            /* count how many entries are needed for this chunk
-             * for p_sample_delta_dts and p_sample_count_dts */
-            ck->i_entries_dts = 0;
 
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_dts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           stts->pi_sample_count,
-                                           stts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
+    MP4_Box_data_stts_t *stts = p_box->data.p_stts;
+    mp4_sample_runs_t *p_runs = &p_demux_track->dts_runs;
 
-            /* allocate them */
-            ck->p_sample_count_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            ck->p_sample_delta_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            if( !ck->p_sample_count_dts || !ck->p_sample_delta_dts )
-            {
-                free( ck->p_sample_count_dts );
-                free( ck->p_sample_delta_dts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_dts );
-                ck->i_entries_dts = 0;
-                return VLC_ENOMEM;
-            }
+    msg_Warn( p_demux, "STTS table of %"PRIu32" entries", stts->i_entry_count );
 
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
+    if( MP4_SampleRunsInit( p_runs, stts->i_entry_count,
+                            stts->pi_sample_count, stts->pi_sample_delta ) )
+        return VLC_ENOMEM;
 
-            for( uint32_t i = 0; i < ck->i_entries_dts; i++ )
-            {
-                if ( i_current_index_samples_left )
-                {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( i_sample_count ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        ck->p_sample_count_dts[i] = i_current_index_samples_left;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( i_current_index_samples_left ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
-                }
-                else
-                {
-                    if ( stts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( i_sample_count ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_current_index_samples_left = stts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        ck->p_sample_count_dts[i] = stts->pi_sample_count[i_index];
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        if ( stts->pi_sample_count[i_index] ) ck->i_duration = i_next_dts - ck->i_first_dts;
-                        i_sample_count -= stts->pi_sample_count[i_index];
-                        i_index++;
-                    }
-                }
+    for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
+    {
+        mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
+        uint32_t i_last = ck->i_sample_first + __MIN( ck->i_sample_count,
+                                                      UINT32_MAX - ck->i_sample_first );
 
-            }
-        }
+        ck->i_first_dts = MP4_SampleRunsGetTime( p_runs, ck->i_sample_first );
+        ck->i_duration = MP4_SampleRunsGetTime( p_runs, i_last ) - ck->i_first_dts;
     }
 
-
     /* Find ctts
      *  Gives the delta between decoding time (dts) and composition table (pts)
      */
@@ -2365,91 +2367,15 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
         msg_Warn( p_demux, "CTTS table of %"PRIu32" entries", ctts->i_entry_count );
 
-        /* Create pts-dts table per chunk */
-        uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
-
-        for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
-        {
-            mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
-
-            /* count how many entries are needed for this chunk
-             * for p_sample_offset_pts and p_sample_count_pts */
-            ck->i_entries_pts = 0;
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_pts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           ctts->pi_sample_count,
-                                           ctts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
-
-            /* allocate them */
-            ck->p_sample_count_pts = calloc( ck->i_entries_pts, sizeof( uint32_t ) );
-            ck->p_sample_offset_pts = calloc( ck->i_entries_pts, sizeof( int32_t ) );
-            if( !ck->p_sample_count_pts || !ck->p_sample_offset_pts )
-            {
-                free( ck->p_sample_count_pts );
-                free( ck->p_sample_offset_pts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_pts );
-                ck->i_entries_pts = 0;
-                return VLC_ENOMEM;
-            }
-
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
-
-            for( uint32_t i = 0; i < ck->i_entries_pts; i++ )
-            {
-                if ( i_current_index_samples_left )
-                {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = i_current_index_samples_left;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
-                }
-                else
-                {
-                    if ( ctts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_current_index_samples_left = ctts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = ctts->pi_sample_count[i_index];
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_sample_count -= ctts->pi_sample_count[i_index];
-                        i_index++;
-                    }
-                }
-
-
-            }
-        }
+        if( MP4_SampleRunsInit( &p_demux_track->pts_runs, ctts->i_entry_count,
+                                ctts->pi_sample_count, ctts->pi_sample_offset ) )
+            return VLC_ENOMEM;
     }
 
     msg_Dbg( p_demux, "track[Id 0x%x] read %"PRIu32" samples length:%"PRId64"s",
              p_demux_track->i_track_ID, p_demux_track->i_sample_count,
-             i_next_dts / p_demux_track->i_timescale );
+             MP4_SampleRunsGetTime( p_runs, p_demux_track->i_sample_count ) /
+             p_demux_track->i_timescale );
 
     return VLC_SUCCESS;
 }
@@ -2609,7 +2535,7 @@ static int TrackGetNearestSeekPoint( demux_t *p_demux, mp4_track_t *p_track,
     *pi_sync_sample = 0;
 
     const MP4_Box_t *p_stss;
-    if( ( p_stss = MP4_BoxGet( p_track->p_stbl, "stss" ) ) )
+    if( ( p_stss = MP4_BoxLoad( p_track->p_stbl, "stss" ) ) )
     {
         const MP4_Box_data_stss_t *p_stss_data = BOXDATA(p_stss);
         msg_Dbg( p_demux, "track[Id 0x%x] using Sync Sample Box (stss)",
@@ -2629,11 +2555,12 @@ static int TrackGetNearestSeekPoint( demux_t *p_demux, mp4_track_t *p_track,
     }
 
     /* try rap samples groups */
-    const MP4_Box_t *p_sbgp = MP4_BoxGet( p_track->p_stbl, "sbgp" );
-    for( ; p_sbgp; p_sbgp = p_sbgp->p_next )
+    const MP4_Box_t *p_sbgp;
+    for( unsigned i_sbgp = 0;
+         ( p_sbgp = MP4_BoxLoad( p_track->p_stbl, "sbgp[%u]", i_sbgp ) ); i_sbgp++ )
     {
         const MP4_Box_data_sbgp_t *p_sbgp_data = BOXDATA(p_sbgp);
-        if( p_sbgp->i_type != ATOM_sbgp || !p_sbgp_data )
+        if( !p_sbgp_data )
             continue;
 
         if( p_sbgp_data->i_grouping_type == SAMPLEGROUP_rap )
@@ -2671,6 +2598,22 @@ static int TrackGetNearestSeekPoint( demux_t *p_demux, mp4_track_t *p_track,
     return i_ret;
 }
 
+/* Returns the chunk containing i_sample, or the last one */
+static uint32_t TrackSampleToChunk( const mp4_track_t *p_track, uint32_t i_sample )
+{
+    uint32_t i_lo = 0, i_hi = p_track->i_chunk_count - 1;
+
+    while( i_lo < i_hi )
+    {
+        uint32_t i_mid = i_lo + (i_hi - i_lo + 1) / 2;
+        if( p_track->chunk[i_mid].i_sample_first <= i_sample )
+            i_lo = i_mid;
+        else
+            i_hi = i_mid - 1;
+    }
+    return i_lo;
+}
+
 /* given a time it return sample/chunk
  * it also update elst field of the track
  */
@@ -2679,10 +2622,8 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
                                    uint32_t *pi_sample )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    uint64_t     i_dts;
-    unsigned int i_sample;
-    unsigned int i_chunk;
-    int          i_index;
+    uint32_t     i_sample;
+    uint32_t     i_chunk;
 
     /* FIXME see if it's needed to check p_track->i_chunk_count */
     if( p_track->i_chunk_count == 0 )
@@ -2726,52 +2667,9 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         i_start = i_start * p_track->i_timescale / CLOCK_FREQ;
     }
 
-    /* we start from sample 0/chunk 0, hope it won't take too much time */
-    /* *** find good chunk *** */
-    for( i_chunk = 0; ; i_chunk++ )
-    {
-        if( i_chunk + 1 >= p_track->i_chunk_count )
-        {
-            /* at the end and can't check if i_start in this chunk,
-               it will be check while searching i_sample */
-            i_chunk = p_track->i_chunk_count - 1;
-            break;
-        }
-
-        if( (uint64_t)i_start >= p_track->chunk[i_chunk].i_first_dts &&
-            (uint64_t)i_start <  p_track->chunk[i_chunk + 1].i_first_dts )
-        {
-            break;
-        }
-    }
-
-    /* *** find sample in the chunk *** */
-    i_sample = p_track->chunk[i_chunk].i_sample_first;
-    i_dts    = p_track->chunk[i_chunk].i_first_dts;
-    for( i_index = 0; i_sample < p_track->chunk[i_chunk].i_sample_count; )
-    {
-        if( i_dts +
-            p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-            p_track->chunk[i_chunk].p_sample_delta_dts[i_index] < (uint64_t)i_start )
-        {
-            i_dts    +=
-                p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
-
-            i_sample += p_track->chunk[i_chunk].p_sample_count_dts[i_index];
-            i_index++;
-        }
-        else
-        {
-            if( p_track->chunk[i_chunk].p_sample_delta_dts[i_index] <= 0 )
-            {
-                break;
-            }
-            i_sample += ( i_start - i_dts ) /
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
-            break;
-        }
-    }
+    /* *** find sample, then its chunk *** */
+    i_sample = MP4_SampleRunsGetSample( &p_track->dts_runs, i_start );
+    i_chunk = TrackSampleToChunk( p_track, i_sample );
 
     if( i_sample >= p_track->i_sample_count )
     {
@@ -2788,19 +2686,7 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         TrackGetNearestSeekPoint( p_demux, p_track, i_sample, &i_sync_sample ) )
     {
         /* Go to chunk */
-        if( i_sync_sample <= i_sample )
-        {
-            while( i_chunk > 0 &&
-                   i_sync_sample < p_track->chunk[i_chunk].i_sample_first )
-                i_chunk--;
-        }
-        else
-        {
-            while( i_chunk < p_track->i_chunk_count - 1 &&
-                   i_sync_sample >= p_track->chunk[i_chunk].i_sample_first +
-                                    p_track->chunk[i_chunk].i_sample_count )
-                i_chunk++;
-        }
+        i_chunk = TrackSampleToChunk( p_track, i_sync_sample );
         i_sample = i_sync_sample;
     }
 
@@ -3240,8 +3126,8 @@ static void MP4_TrackDestroy( demux_t *p_demux, mp4_track_t *p_track )
         free( p_track->cchunk );
     }
 
-    if( !p_track->i_sample_size )
-        free( p_track->p_sample_size );
+    MP4_SampleRunsClean( &p_track->dts_runs );
+    MP4_SampleRunsClean( &p_track->pts_runs );
 
     if ( p_track->asfinfo.p_frame )
         block_ChainRelease( p_track->asfinfo.p_frame );
@@ -3549,11 +3435,22 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
     }
     else
     {
-        for( i_sample = p_track->chunk[p_track->i_chunk].i_sample_first;
-             i_sample < p_track->i_sample; i_sample++ )
+        i_sample = p_track->chunk[p_track->i_chunk].i_sample_first;
+
+        /* continue from the previous sample of the same chunk */
+        if( p_track->pos.i_chunk == p_track->i_chunk &&
+            p_track->pos.i_sample <= p_track->i_sample )
         {
-            i_pos += p_track->p_sample_size[i_sample];
+            i_sample = p_track->pos.i_sample;
+            i_pos = p_track->pos.i_pos;
         }
+
+        for( ; i_sample < p_track->i_sample; i_sample++ )
+            i_pos += p_track->p_sample_size[i_sample];
+
+        p_track->pos.i_chunk = p_track->i_chunk;
+        p_track->pos.i_sample = i_sample;
+        p_track->pos.i_pos = i_pos;
     }
 
     return i_pos;
@@ -4654,30 +4551,6 @@ static int LeafMOOVGetSamplesSize( const mp4_track_t *p_track, const uint32_t i_
     return VLC_SUCCESS;
 }
 
-static inline mtime_t LeafGetMOOVTimeInChunk( const mp4_chunk_t *p_chunk, uint32_t i_sample )
-{
-    mtime_t i_time = 0;
-    uint32_t i_index = 0;
-
-    while( i_sample > 0 )
-    {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
-        {
-            i_time += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
-            i_index++;
-        }
-        else
-        {
-            i_time += i_sample * p_chunk->p_sample_delta_dts[i_index];
-            break;
-        }
-    }
-
-    return i_time;
-}
-
 static int LeafParseMDATwithMOOV( demux_t *p_demux )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -4768,8 +4641,8 @@ static int LeafParseMDATwithMOOV( demux_t *p_demux )
                 p_sys->context.i_mdatbytesleft -= i_samplessize;
 
                 /* dts */
-                mtime_t i_time = LeafGetMOOVTimeInChunk( p_chunk, i_nb_samples );
-                i_time += p_chunk->i_first_dts;
+                mtime_t i_time = MP4_SampleRunsGetTime( &p_track->dts_runs,
+                                                        i_nb_samples_at_chunk_start + i_nb_samples );
                 p_track->i_time = i_time;
                 p_block->i_dts = VLC_TS_0 + CLOCK_FREQ * i_time / p_track->i_timescale;
 
@@ -47,6 +47,8 @@ typedef struct
     uint64_t     i_first_dts;   /* DTS of the first sample */
     uint64_t     i_duration;    /* total duration of all samples */
 
+    /* per chunk tables, only set for fragments (cchunk): moov chunks
+       use the sample runs of the track */
     uint32_t     i_entries_dts;
     uint32_t     *p_sample_count_dts;
     uint32_t     *p_sample_delta_dts;   /* dts delta */
@@ -62,6 +64,25 @@ typedef struct
 
 } mp4_chunk_t;
 
+/* Run length coded sample table (stts or ctts) read in place from the box.
+   Checkpoints every MP4_SAMPLE_RUNS_STEP entries allow random access without
+   expanding the table, and a cursor makes sequential access constant time */
+#define MP4_SAMPLE_RUNS_STEP 64
+typedef struct
+{
+    uint32_t        i_entry_count;
+    const uint32_t *pi_sample_count;
+    const int32_t  *pi_value;       /* sample delta or composition offset */
+
+    uint32_t       *pi_step_sample; /* first sample of each checkpoint */
+    int64_t        *pi_step_time;   /* sum of the values up to it */
+
+    /* cursor */
+    uint32_t        i_entry;
+    uint32_t        i_entry_sample; /* first sample of i_entry */
+    int64_t         i_entry_time;   /* sum of the values up to i_entry */
+} mp4_sample_runs_t;
+
 typedef enum RTP_timstamp_synchronization_s
 {
     UNKNOWN_SYNC = 0, UNSYNCHRONIZED = 1, SYNCHRONIZED = 2, RESERVED = 3
@@ -115,8 +136,19 @@ typedef struct
     /* sample size, p_sample_size defined only if i_sample_size == 0
         else i_sample_size is size for all sample */
     uint32_t         i_sample_size;
-    uint32_t         *p_sample_size; /* XXX perhaps add file offset if take
-                                    too much time to do sumations each time*/
+    const uint32_t   *p_sample_size; /* stsz table */
+
+    /* last computed sample position, so that sizes are not summed
+       from the start of the chunk for each sample */
+    struct
+    {
+        uint32_t     i_chunk;
+        uint32_t     i_sample;
+        uint64_t     i_pos;
+    } pos;
+
+    mp4_sample_runs_t dts_runs;  /* stts */
+    mp4_sample_runs_t pts_runs;  /* ctts, empty if none */
 
     uint32_t     i_sample_first; /* i_sample_first value
                                                    of the next chunk */
@@ -124,7 +156,7 @@ typedef struct
                                                    of the next chunk */
 
     const MP4_Box_t *p_track;
-    const MP4_Box_t *p_stbl;  /* will contain all timing information */
+    MP4_Box_t *p_stbl;  /* will contain all timing information */
     const MP4_Box_t *p_stsd;  /* will contain all data to initialize decoder */
     const MP4_Box_t *p_sample;/* point on actual sdsd */
 
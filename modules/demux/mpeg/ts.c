@@ -34,6 +34,8 @@
 #include <vlc_plugin.h>
 #include <vlc_access.h>    /* DVB-specific things */
 #include <vlc_demux.h>
+#include <vlc_fs.h>
+#include <vlc_md5.h>
 
 #include "ts_pid.h"
 #include "ts_streams.h"
@@ -43,6 +45,7 @@
 #include "ts_psip.h"
 
 #include "ts_hotfixes.h"
+#include "ts_index.h"
 #include "ts_sl.h"
 #include "ts_metadata.h"
 #include "sections.h"
@@ -110,6 +113,22 @@ static void Close ( vlc_object_t * );
     "Seek and position based on a percent byte position, not a PCR generated " \
     "time position. If seeking doesn't work property, turn on this option." )
 
+#define BATCH_TEXT N_("TS packets read at once")
+#define BATCH_LONGTEXT N_( \
+    "Number of TS packets read from the input in one go and demuxed in " \
+    "place. Only payload going to elementary streams is copied. " \
+    "Set to 0 to read packets one by one." )
+
+#define SEEK_INDEX_TEXT N_("Build a seek index")
+#define SEEK_INDEX_LONGTEXT N_( \
+    "Remember the position of PCRs while playing and searching, so that " \
+    "seeking does not need to search the whole file again." )
+
+#define SEEK_INDEX_CACHE_TEXT N_("Keep the seek index")
+#define SEEK_INDEX_CACHE_LONGTEXT N_( \
+    "Store the seek index in the cache directory, and reuse it when the " \
+    "same recording is opened again." )
+
 #define PCR_TEXT N_("Trust in-stream PCR")
 #define PCR_LONGTEXT N_("Use the stream PCR as a reference.")
 
@@ -147,6 +166,11 @@ vlc_module_begin ()
 
     add_bool( "ts-split-es", true, SPLIT_ES_TEXT, SPLIT_ES_LONGTEXT, false )
     add_bool( "ts-seek-percent", false, SEEK_PERCENT_TEXT, SEEK_PERCENT_LONGTEXT, true )
+    add_bool( "ts-seek-index", true, SEEK_INDEX_TEXT, SEEK_INDEX_LONGTEXT, true )
+    add_bool( "ts-seek-index-cache", false, SEEK_INDEX_CACHE_TEXT,
+              SEEK_INDEX_CACHE_LONGTEXT, true )
+    add_integer_with_range( "ts-read-batch", 256, 0, 4096,
+                            BATCH_TEXT, BATCH_LONGTEXT, true )
 
     add_obsolete_bool( "ts-silent" );
 
@@ -168,21 +192,27 @@ static bool PIDReferencedByProgram( const ts_pmt_t *, uint16_t );
 void UpdatePESFilters( demux_t *p_demux, bool b_all );
 static inline void FlushESBuffer( ts_pes_t *p_pes );
 static void UpdatePIDScrambledState( demux_t *p_demux, ts_pid_t *p_pid, bool );
-static inline int PIDGet( block_t *p )
+static inline int PIDGet( const uint8_t *p )
 {
-    return ( (p->p_buffer[1]&0x1f)<<8 )|p->p_buffer[2];
+    return ( (p[1]&0x1f)<<8 )|p[2];
 }
-static mtime_t GetPCR( const block_t * );
+static mtime_t GetPCR( const uint8_t *, size_t );
 
 static bool ProcessTSPacket( demux_t *p_demux, ts_pid_t *pid, block_t *p_pkt );
 static bool GatherPESData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk, size_t, bool );
 static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_prg, mtime_t i_pcr );
 
 static block_t* ReadTSPacket( demux_t *p_demux );
+static const uint8_t *ReadBatchedTSPacket( demux_t *p_demux );
+static void FlushTSBatch( demux_sys_t *p_sys );
+static void DescrambleTSBatch( demux_t *p_demux, const uint8_t *p_buf );
 static int SeekToTime( demux_t *p_demux, const ts_pmt_t *, int64_t time );
 static void ReadyQueuesPostSeek( demux_t *p_demux );
 static void PCRHandle( demux_t *p_demux, ts_pid_t *, mtime_t );
 static void PCRFixHandle( demux_t *, ts_pmt_t *, block_t * );
+static void SeekIndexAddPCR( demux_t *, const ts_pid_t *, const uint8_t *, mtime_t );
+static void SeekIndexLoad( demux_t * );
+static void SeekIndexSave( demux_t * );
 
 #define TS_PACKET_SIZE_188 188
 #define TS_PACKET_SIZE_192 192
@@ -384,6 +414,15 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_packet_size = i_packet_size;
     p_sys->i_packet_header_size = i_packet_header_size;
     p_sys->i_ts_read = 50;
+    p_sys->batch.p_buffer = NULL;
+    p_sys->batch.i_buffer = 0;
+    p_sys->batch.i_offset = 0;
+    p_sys->batch.pp_descrambled = NULL;
+    p_sys->batch.i_descrambled = 0;
+    p_sys->batch.i_descrambled_next = 0;
+    p_sys->batch.i_packets = var_InheritInteger( p_demux, "ts-read-batch" );
+    if( p_sys->batch.i_packets == 1 ) /* need two packets to resync in place */
+        p_sys->batch.i_packets = 2;
     p_sys->csa = NULL;
     p_sys->b_start_record = false;
 
@@ -506,6 +545,15 @@ static int Open( vlc_object_t *p_this )
     vlc_stream_Control( p_sys->stream, STREAM_CAN_FASTSEEK,
                         &p_sys->b_canfastseek );
 
+    p_sys->p_index = NULL;
+    p_sys->psz_index_file = NULL;
+    if( p_sys->b_canfastseek && var_InheritBool( p_demux, "ts-seek-index" ) )
+    {
+        p_sys->p_index = ts_index_New();
+        if( p_sys->p_index && var_InheritBool( p_demux, "ts-seek-index-cache" ) )
+            SeekIndexLoad( p_demux );
+    }
+
     /* Preparse time */
     if( p_sys->b_canseek )
     {
@@ -558,6 +606,16 @@ static void Close( vlc_object_t *p_this )
     /* Release all non default pids */
     ts_pid_list_Release( p_demux, &p_sys->pids );
 
+    if( p_sys->p_index )
+    {
+        if( p_sys->psz_index_file && ts_index_IsDirty( p_sys->p_index ) )
+            SeekIndexSave( p_demux );
+        ts_index_Delete( p_sys->p_index );
+    }
+    free( p_sys->psz_index_file );
+
+    vlc_free( p_sys->batch.p_buffer );
+    free( p_sys->batch.pp_descrambled );
     free( p_sys );
 }
 
@@ -598,14 +656,40 @@ static int Demux( demux_t *p_demux )
         p_sys->patfix.status = PAT_FIXTRIED;
     }
 
+    stream_t *p_stream = p_sys->stream;
+
     /* We read at most 100 TS packet or until a frame is completed */
     for( unsigned i_pkt = 0; i_pkt < p_sys->i_ts_read; i_pkt++ )
     {
         bool         b_frame = false;
-        block_t     *p_pkt;
-        if( !(p_pkt = ReadTSPacket( p_demux )) )
+        block_t     *p_pkt = NULL;
+        const uint8_t *p_buf;
+        size_t       i_buf;
+
+        if( unlikely(p_stream != p_sys->stream) )
         {
-            return VLC_DEMUXER_EOF;
+            /* Stream has been replaced by a descrambling filter: hand the
+             * packets read ahead back to it */
+            size_t i_pending = p_sys->batch.i_buffer - p_sys->batch.i_offset;
+            if( i_pending > 0 &&
+                vlc_stream_Seek( p_stream, vlc_stream_Tell( p_stream ) - i_pending ) )
+                msg_Warn( p_demux, "dropping %zu bytes read ahead", i_pending );
+            FlushTSBatch( p_sys );
+            p_stream = p_sys->stream;
+        }
+
+        if( p_sys->batch.i_packets > 0 )
+        {
+            if( !(p_buf = ReadBatchedTSPacket( p_demux )) )
+                return VLC_DEMUXER_EOF;
+            i_buf = p_sys->i_packet_size - p_sys->i_packet_header_size;
+        }
+        else
+        {
+            if( !(p_pkt = ReadTSPacket( p_demux )) )
+                return VLC_DEMUXER_EOF;
+            p_buf = p_pkt->p_buffer;
+            i_buf = p_pkt->i_buffer;
         }
 
         if( p_sys->b_start_record )
@@ -617,12 +701,21 @@ static int Demux( demux_t *p_demux )
         }
 
         /* Parse the TS packet */
-        ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p_pkt ) );
+        ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p_buf ) );
+        bool b_scrambled = p_buf[3] & 0x80;
+
+        if( p_sys->batch.i_descrambled_next < p_sys->batch.i_descrambled &&
+            p_sys->batch.pp_descrambled[p_sys->batch.i_descrambled_next] == p_buf )
+        {
+            /* Already descrambled along with a previous packet */
+            p_sys->batch.i_descrambled_next++;
+            b_scrambled = true;
+        }
 
-        if( (p_pkt->p_buffer[1] & 0x40) && (p_pkt->p_buffer[3] & 0x10) &&
-            !SCRAMBLED(*p_pid) != !(p_pkt->p_buffer[3] & 0x80) )
+        if( (p_buf[1] & 0x40) && (p_buf[3] & 0x10) &&
+            !SCRAMBLED(*p_pid) != !b_scrambled )
         {
-            UpdatePIDScrambledState( p_demux, p_pid, p_pkt->p_buffer[3] & 0x80 );
+            UpdatePIDScrambledState( p_demux, p_pid, b_scrambled );
         }
 
         if( !SEEN(p_pid) )
@@ -635,32 +728,36 @@ static int Demux( demux_t *p_demux )
         }
 
         /* Adaptation field cannot be scrambled */
-        mtime_t i_pcr = GetPCR( p_pkt );
+        mtime_t i_pcr = GetPCR( p_buf, i_buf );
         if( i_pcr > VLC_TS_INVALID )
+        {
             PCRHandle( p_demux, p_pid, i_pcr );
+            if( p_sys->p_index )
+                SeekIndexAddPCR( p_demux, p_pid, p_buf, i_pcr );
+        }
 
         if ( SCRAMBLED(*p_pid) && !p_demux->p_sys->csa && p_sys->b_valid_scrambling )
         {
-            block_Release( p_pkt );
+            if( p_pkt )
+                block_Release( p_pkt );
             continue;
         }
 
         /* Probe streams to build PAT/PMT after MIN_PAT_INTERVAL in case we don't see any PAT */
         if( !SEEN( GetPID( p_sys, 0 ) ) &&
             (p_pid->probed.i_type == 0 || p_pid->i_pid == p_sys->patfix.i_timesourcepid) &&
-            (p_pkt->p_buffer[1] & 0xC0) == 0x40 && /* Payload start but not corrupt */
-            (p_pkt->p_buffer[3] & 0xD0) == 0x10 )  /* Has payload but is not encrypted */
+            (p_buf[1] & 0xC0) == 0x40 && /* Payload start but not corrupt */
+            (p_buf[3] & 0xD0) == 0x10 )  /* Has payload but is not encrypted */
         {
-            ProbePES( p_demux, p_pid, p_pkt->p_buffer + TS_HEADER_SIZE,
-                      p_pkt->i_buffer - TS_HEADER_SIZE, p_pkt->p_buffer[3] & 0x20 /* Adaptation field */);
+            ProbePES( p_demux, p_pid, p_buf + TS_HEADER_SIZE,
+                      i_buf - TS_HEADER_SIZE, p_buf[3] & 0x20 /* Adaptation field */);
         }
 
         switch( p_pid->type )
         {
         case TYPE_PAT:
         case TYPE_PMT:
-            ts_psi_Packet_Push( p_pid, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_psi_Packet_Push( p_pid, p_buf );
             break;
 
         case TYPE_PES:
@@ -676,30 +773,42 @@ static int Demux( demux_t *p_demux )
             if( !p_sys->b_access_control && !(p_pid->i_flags & FLAG_FILTERED) )
             {
                 /* That packet is for an unselected ES, don't waste time/memory gathering its data */
-                block_Release( p_pkt );
-                continue;
+                break;
+            }
+
+            if( p_pkt == NULL )
+            {
+                if( p_sys->csa && SCRAMBLED(*p_pid) && (p_buf[3] & 0x80) )
+                    DescrambleTSBatch( p_demux, p_buf );
+
+                /* Only now copy out of the batch what will be kept */
+                p_pkt = block_Alloc( TS_PACKET_SIZE_188 );
+                if( unlikely(p_pkt == NULL) )
+                    break;
+                memcpy( p_pkt->p_buffer, p_buf, TS_PACKET_SIZE_188 );
             }
 
             b_frame = ProcessTSPacket( p_demux, p_pid, p_pkt );
+            p_pkt = NULL;
             break;
 
         case TYPE_SI:
-            ts_si_Packet_Push( p_pid, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_si_Packet_Push( p_pid, p_buf );
             break;
 
         case TYPE_PSIP:
-            ts_psip_Packet_Push( p_pid, p_pkt->p_buffer );
-            block_Release( p_pkt );
+            ts_psip_Packet_Push( p_pid, p_buf );
             break;
 
         case TYPE_CAT:
         default:
             /* We have to handle PCR if present */
-            block_Release( p_pkt );
             break;
         }
 
+        if( p_pkt )
+            block_Release( p_pkt );
+
         if( b_frame || ( b_wait_es && p_sys->i_pmt_es > 0 ) )
             break;
     }
@@ -881,7 +990,8 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         if( (i64 = stream_Size( p_sys->stream) ) > 0 )
         {
-            int64_t offset = vlc_stream_Tell( p_sys->stream );
+            int64_t offset = vlc_stream_Tell( p_sys->stream ) -
+                             ( p_sys->batch.i_buffer - p_sys->batch.i_offset );
             *pf = (double)offset / (double)i64;
             return VLC_SUCCESS;
         }
@@ -1058,9 +1168,11 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     }
 
     case DEMUX_SET_TITLE:
+        FlushTSBatch( p_sys );
         return vlc_stream_vaControl( p_sys->stream, STREAM_SET_TITLE, args );
 
     case DEMUX_SET_SEEKPOINT:
+        FlushTSBatch( p_sys );
         return vlc_stream_vaControl( p_sys->stream, STREAM_SET_SEEKPOINT,
                                      args );
 
@@ -1666,13 +1778,153 @@ static block_t* ReadTSPacket( demux_t *p_demux )
     return p_pkt;
 }
 
-static mtime_t GetPCR( const block_t *p_pkt )
+static void FlushTSBatch( demux_sys_t *p_sys )
 {
-    const uint8_t *p = p_pkt->p_buffer;
+    p_sys->batch.i_buffer = 0;
+    p_sys->batch.i_offset = 0;
+    p_sys->batch.i_descrambled = 0;
+    p_sys->batch.i_descrambled_next = 0;
+}
+
+/* Descrambles the given packet, together with the scrambled packets of
+ * selected ES read ahead in the batch, all at once */
+static void DescrambleTSBatch( demux_t *p_demux, const uint8_t *p_buf )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const size_t i_size = p_sys->i_packet_size;
+    const size_t i_min = i_size - p_sys->i_packet_header_size;
+    const uint8_t *p_end = &p_sys->batch.p_buffer[p_sys->batch.i_buffer];
+    unsigned n = 0;
+
+    /* Let packets of a newly selected ES be descrambled one by one, until the
+     * previous look ahead has been demuxed */
+    if( p_sys->batch.i_descrambled_next < p_sys->batch.i_descrambled )
+        return;
+
+    if( p_sys->batch.pp_descrambled == NULL )
+    {
+        p_sys->batch.pp_descrambled =
+            malloc( p_sys->batch.i_packets * sizeof(uint8_t *) );
+        if( unlikely(p_sys->batch.pp_descrambled == NULL) )
+            return;
+    }
+
+    /* Only look ahead at whole packets while in sync, as packets will be
+     * demuxed in order, and incomplete ones are read again after a refill */
+    for( uint8_t *p = (uint8_t *)p_buf;
+         (size_t)(p_end - p) >= i_min && p[0] == 0x47 &&
+         n < p_sys->batch.i_packets; p += i_size )
+    {
+        if( !(p[3] & 0x80) )
+            continue;
+
+        ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p ) );
+        if( p_pid->type != TYPE_PES || !SCRAMBLED(*p_pid) ||
+            ( !p_sys->b_access_control && !(p_pid->i_flags & FLAG_FILTERED) ) )
+            continue;
+
+        p_sys->batch.pp_descrambled[n++] = p;
+    }
+
+    vlc_mutex_lock( &p_sys->csa_lock );
+    csa_DecryptBatch( p_sys->csa, p_sys->batch.pp_descrambled, n,
+                      p_sys->i_csa_pkt_size );
+    vlc_mutex_unlock( &p_sys->csa_lock );
+
+    /* The current packet has been demuxed already */
+    p_sys->batch.i_descrambled = n;
+    p_sys->batch.i_descrambled_next = 1;
+}
+
+static bool FillTSBatch( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const size_t i_max = p_sys->batch.i_packets * p_sys->i_packet_size;
+
+    if( p_sys->batch.p_buffer == NULL )
+    {
+        p_sys->batch.p_buffer = vlc_memalign( 64, i_max );
+        if( unlikely(p_sys->batch.p_buffer == NULL) )
+            return false;
+    }
+
+    /* Packets descrambled ahead have all been demuxed by now */
+    p_sys->batch.i_descrambled = 0;
+    p_sys->batch.i_descrambled_next = 0;
+
+    /* Keep the incomplete packet, if any */
+    size_t i_left = p_sys->batch.i_buffer - p_sys->batch.i_offset;
+    memmove( p_sys->batch.p_buffer,
+             &p_sys->batch.p_buffer[p_sys->batch.i_offset], i_left );
+    p_sys->batch.i_buffer = i_left;
+    p_sys->batch.i_offset = 0;
+
+    for( ;; )
+    {
+        /* Only wait for what the input has, not for the whole batch */
+        ssize_t i_read = vlc_stream_ReadPartial( p_sys->stream,
+                                                 &p_sys->batch.p_buffer[i_left],
+                                                 i_max - i_left );
+        if( i_read > 0 )
+        {
+            p_sys->batch.i_buffer += i_read;
+            return true;
+        }
+        if( i_read == 0 )
+        {
+            msg_Dbg( p_demux, "EOF at %"PRId64, vlc_stream_Tell( p_sys->stream ) );
+            return false;
+        }
+    }
+}
+
+static const uint8_t *ReadBatchedTSPacket( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const size_t i_size = p_sys->i_packet_size;
+    const size_t i_header = p_sys->i_packet_header_size;
+
+    for( ;; )
+    {
+        const uint8_t *p = &p_sys->batch.p_buffer[p_sys->batch.i_offset];
+        size_t i_avail = p_sys->batch.i_buffer - p_sys->batch.i_offset;
+
+        if( i_avail >= i_size && p[i_header] == 0x47 )
+        {
+            p_sys->batch.i_offset += i_size;
+            return &p[i_header];
+        }
+
+        /* Check sync byte and re-sync in place if needed */
+        if( i_avail > i_header + i_size )
+        {
+            size_t i_skip = 1;
 
+            msg_Warn( p_demux, "lost synchro" );
+            while( i_skip + i_header + i_size < i_avail &&
+                   ( p[i_skip + i_header] != 0x47 ||
+                     p[i_skip + i_header + i_size] != 0x47 ) )
+                i_skip++;
+
+            msg_Dbg( p_demux, "skipping %zu bytes of garbage", i_skip );
+            p_sys->batch.i_offset += i_skip;
+            /* Packets are no longer where they were looked ahead at */
+            p_sys->batch.i_descrambled = 0;
+            p_sys->batch.i_descrambled_next = 0;
+            if( i_skip + i_header + i_size < i_avail )
+                continue;
+        }
+
+        if( !FillTSBatch( p_demux ) )
+            return NULL;
+    }
+}
+
+static mtime_t GetPCR( const uint8_t *p, size_t i_buffer )
+{
     mtime_t i_pcr = -1;
 
-    if( likely(p_pkt->i_buffer > 11) &&
+    if( likely(i_buffer > 11) &&
         ( p[3]&0x20 ) && /* adaptation */
         ( p[5]&0x10 ) &&
         ( p[4] >= 7 ) )
@@ -1737,6 +1989,9 @@ static void ReadyQueuesPostSeek( demux_t *p_demux )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
 
+    /* Packets read ahead belong to the previous position */
+    FlushTSBatch( p_sys );
+
     ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
     for( int i=0; i< p_pat->programs.i_size; i++ )
     {
@@ -1778,6 +2033,92 @@ static void ReadyQueuesPostSeek( demux_t *p_demux )
     }
 }
 
+static void SeekIndexAddPCR( demux_t *p_demux, const ts_pid_t *p_pid,
+                             const uint8_t *p_buf, mtime_t i_pcr )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->i_pmt_es <= 0 || GetPID(p_sys, 0)->type != TYPE_PAT )
+        return;
+
+    /* Position of the current packet, read ahead data excluded */
+    const uint64_t i_offset = vlc_stream_Tell( p_sys->stream ) -
+                              ( p_sys->batch.i_buffer - p_sys->batch.i_offset ) -
+                              p_sys->i_packet_size;
+    const bool b_rap = p_buf[4] > 0 && (p_buf[5] & 0x40);
+
+    ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
+    for( int i = 0; i < p_pat->programs.i_size; i++ )
+    {
+        const ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
+        if( p_pmt->pcr.i_first == -1 )
+            continue;
+
+        if( p_pmt->i_pid_pcr == p_pid->i_pid ||
+            ( p_pmt->i_pid_pcr == 0x1FFF && PIDReferencedByProgram( p_pmt, p_pid->i_pid ) ) )
+        {
+            ts_index_Add( p_sys->p_index, p_pmt->i_number,
+                          TimeStampWrapAround( p_pmt->pcr.i_first, i_pcr ),
+                          i_offset, b_rap );
+        }
+    }
+}
+
+static char * SeekIndexPath( demux_t *p_demux )
+{
+    if( !p_demux->psz_location || !*p_demux->psz_location )
+        return NULL;
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, p_demux->psz_access, strlen( p_demux->psz_access ) );
+    AddMD5( &md5, "://", 3 );
+    AddMD5( &md5, p_demux->psz_location, strlen( p_demux->psz_location ) );
+    EndMD5( &md5 );
+
+    char *psz_hash = psz_md5_hash( &md5 );
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_path = NULL;
+    if( psz_hash && psz_cachedir &&
+        asprintf( &psz_path, "%s" DIR_SEP "tsindex" DIR_SEP "%s",
+                  psz_cachedir, psz_hash ) == -1 )
+        psz_path = NULL;
+    free( psz_cachedir );
+    free( psz_hash );
+    return psz_path;
+}
+
+static void SeekIndexLoad( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    p_sys->psz_index_file = SeekIndexPath( p_demux );
+    if( p_sys->psz_index_file &&
+        ts_index_Load( p_sys->p_index, VLC_OBJECT(p_demux), p_sys->psz_index_file,
+                       stream_Size( p_sys->stream ), p_sys->i_packet_size ) == VLC_SUCCESS )
+        msg_Dbg( p_demux, "using seek index %s", p_sys->psz_index_file );
+}
+
+static void SeekIndexSave( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    char *psz_dir = strdup( p_sys->psz_index_file );
+    if( psz_dir )
+    {
+        char *psz_sep = strrchr( psz_dir, DIR_SEP_CHAR );
+        if( psz_sep )
+        {
+            *psz_sep = '\0';
+            vlc_mkdir( psz_dir, 0700 );
+        }
+        free( psz_dir );
+    }
+
+    ts_index_Save( p_sys->p_index, VLC_OBJECT(p_demux), p_sys->psz_index_file,
+                   stream_Size( p_sys->stream ), p_sys->i_packet_size );
+}
+
 static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaledtime )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -1794,6 +2135,24 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
     /* Find the time position by using binary search algorithm. */
     int64_t i_head_pos = 0;
     int64_t i_tail_pos = stream_Size( p_sys->stream ) - p_sys->i_packet_size;
+
+    if( p_sys->p_index )
+    {
+        /* Go straight to a known position, or at least narrow the search */
+        const ts_index_point_t *p_next;
+        const ts_index_point_t *p_point = ts_index_Lookup( p_sys->p_index,
+                                                           p_pmt->i_number,
+                                                           i_scaledtime, &p_next );
+        if( p_point && i_scaledtime - p_point->i_time < TO_SCALE(VLC_TS_0 + CLOCK_FREQ / 2) &&
+            vlc_stream_Seek( p_sys->stream, p_point->i_offset ) == VLC_SUCCESS )
+            return VLC_SUCCESS;
+
+        if( p_point )
+            i_head_pos = p_point->i_offset;
+        if( p_next && (int64_t) p_next->i_offset < i_tail_pos )
+            i_tail_pos = p_next->i_offset;
+    }
+
     if( i_head_pos >= i_tail_pos )
         return VLC_EGENERIC;
 
@@ -1821,7 +2180,7 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
             else
                 i_pos = vlc_stream_Tell( p_sys->stream );
 
-            int i_pid = PIDGet( p_pkt );
+            int i_pid = PIDGet( p_pkt->p_buffer );
             ts_pid_t *p_pid = GetPID(p_sys, i_pid);
             if( i_pid != 0x1FFF && p_pid->type == TYPE_PES &&
                 ts_pes_Find_es( p_pid->u.p_pes, p_pmt ) &&
@@ -1834,7 +2193,7 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
                 {
                     if( p_pkt->i_buffer >= 4 + 2 + 5 )
                     {
-                        i_pcr = GetPCR( p_pkt );
+                        i_pcr = GetPCR( p_pkt->p_buffer, p_pkt->i_buffer );
                         i_skip += 1 + p_pkt->p_buffer[4];
                     }
                 }
@@ -1856,6 +2215,11 @@ static int SeekToTime( demux_t *p_demux, const ts_pmt_t *p_pmt, int64_t i_scaled
 
             if( i_pcr != -1 )
             {
+                if( p_sys->p_index )
+                    ts_index_Add( p_sys->p_index, p_pmt->i_number,
+                                  TimeStampWrapAround( p_pmt->pcr.i_first, i_pcr ),
+                                  i_pos - p_sys->i_packet_size, false );
+
                 int64_t i_diff = i_scaledtime - TimeStampWrapAround( p_pmt->pcr.i_first, i_pcr );
                 if ( i_diff < 0 )
                     i_tail_pos = i_splitpos - p_sys->i_packet_size;
@@ -1897,7 +2261,7 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
             break;
         }
 
-        const int i_pid = PIDGet( p_pkt );
+        const int i_pid = PIDGet( p_pkt->p_buffer );
         ts_pid_t *p_pid = GetPID(p_sys, i_pid);
 
         p_pid->i_flags |= FLAG_SEEN;
@@ -1908,7 +2272,7 @@ static int ProbeChunk( demux_t *p_demux, int i_program, bool b_end, int64_t *pi_
             bool b_adaptfield = p_pkt->p_buffer[3] & 0x20;
 
             if( b_adaptfield && p_pkt->i_buffer >= 4 + 2 + 5 )
-                *pi_pcr = GetPCR( p_pkt );
+                *pi_pcr = GetPCR( p_pkt->p_buffer, p_pkt->i_buffer );
 
             if( *pi_pcr == -1 &&
                 (p_pkt->p_buffer[1] & 0xC0) == 0x40 && /* payload start */
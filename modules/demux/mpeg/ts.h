@@ -24,6 +24,7 @@
     typedef struct arib_instance_t arib_instance_t;
 #endif
 typedef struct csa_t csa_t;
+typedef struct ts_index_t ts_index_t;
 
 #define TS_USER_PMT_NUMBER (0)
 
@@ -60,8 +61,25 @@ struct demux_sys_t
     /* how many TS packet we read at once */
     unsigned    i_ts_read;
 
+    /* Packets read ahead from the stream and demuxed in place */
+    struct
+    {
+        uint8_t *p_buffer;
+        size_t   i_buffer;  /* bytes read into p_buffer */
+        size_t   i_offset;  /* bytes already demuxed */
+        unsigned i_packets; /* capacity in packets, 0 if disabled */
+        /* packets descrambled ahead, in stream order */
+        uint8_t **pp_descrambled;
+        unsigned  i_descrambled;
+        unsigned  i_descrambled_next;
+    } batch;
+
     bool        b_force_seek_per_percent;
 
+    /* PCR to offset index, NULL if disabled */
+    ts_index_t *p_index;
+    char       *psz_index_file;
+
     ts_standards_e standard;
 
     struct
@@ -0,0 +1,301 @@
+/*****************************************************************************
+ * ts_index.c : PCR to byte offset seek index for TS demuxer
+ *****************************************************************************
+ * Copyright (C) 2017 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_fs.h>
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "ts_index.h"
+
+/* Sidecar file layout, all little endian:
+ *   "VLCTSIX1", u64 stream size, u32 packet size, u32 program count
+ *   per program: u16 number, u32 point count,
+ *                points as s64 time, u64 offset, u8 flags */
+#define TS_INDEX_MAGIC "VLCTSIX1"
+#define TS_INDEX_POINT_SIZE (8 + 8 + 1)
+
+typedef struct
+{
+    uint16_t i_program;
+    size_t   i_points;
+    size_t   i_alloc;
+    ts_index_point_t *p_points; /* ordered by time, thus by offset */
+} ts_index_program_t;
+
+struct ts_index_t
+{
+    DECL_ARRAY(ts_index_program_t *) programs;
+    bool b_dirty;
+};
+
+ts_index_t * ts_index_New( void )
+{
+    ts_index_t *p_index = malloc( sizeof(*p_index) );
+    if( likely(p_index) )
+    {
+        ARRAY_INIT( p_index->programs );
+        p_index->b_dirty = false;
+    }
+    return p_index;
+}
+
+static void ts_index_Reset( ts_index_t *p_index )
+{
+    for( int i=0; i<p_index->programs.i_size; i++ )
+    {
+        free( p_index->programs.p_elems[i]->p_points );
+        free( p_index->programs.p_elems[i] );
+    }
+    ARRAY_RESET( p_index->programs );
+}
+
+void ts_index_Delete( ts_index_t *p_index )
+{
+    ts_index_Reset( p_index );
+    free( p_index );
+}
+
+static ts_index_program_t * GetProgram( const ts_index_t *p_index, uint16_t i_program )
+{
+    for( int i=0; i<p_index->programs.i_size; i++ )
+    {
+        if( p_index->programs.p_elems[i]->i_program == i_program )
+            return p_index->programs.p_elems[i];
+    }
+    return NULL;
+}
+
+static ts_index_program_t * AddProgram( ts_index_t *p_index, uint16_t i_program )
+{
+    ts_index_program_t *p_prog = malloc( sizeof(*p_prog) );
+    if( likely(p_prog) )
+    {
+        p_prog->i_program = i_program;
+        p_prog->i_points = 0;
+        p_prog->i_alloc = 0;
+        p_prog->p_points = NULL;
+        ARRAY_APPEND( p_index->programs, p_prog );
+    }
+    return p_prog;
+}
+
+/* Returns the index of the first point later than i_time */
+static size_t UpperBound( const ts_index_program_t *p_prog, int64_t i_time )
+{
+    size_t i_low = 0, i_high = p_prog->i_points;
+    while( i_low < i_high )
+    {
+        size_t i_mid = i_low + (i_high - i_low) / 2;
+        if( p_prog->p_points[i_mid].i_time <= i_time )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    return i_low;
+}
+
+void ts_index_Add( ts_index_t *p_index, uint16_t i_program, int64_t i_time,
+                   uint64_t i_offset, bool b_rap )
+{
+    ts_index_program_t *p_prog = GetProgram( p_index, i_program );
+    if( !p_prog && !(p_prog = AddProgram( p_index, i_program )) )
+        return;
+
+    size_t i_pos = UpperBound( p_prog, i_time );
+    ts_index_point_t *p_prev = i_pos > 0 ? &p_prog->p_points[i_pos - 1] : NULL;
+    ts_index_point_t *p_next = i_pos < p_prog->i_points ? &p_prog->p_points[i_pos] : NULL;
+
+    /* Keep it sparse, but prefer random access points */
+    ts_index_point_t *p_near = NULL;
+    if( p_prev && i_time - p_prev->i_time < TS_INDEX_INTERVAL )
+        p_near = p_prev;
+    else if( p_next && p_next->i_time - i_time < TS_INDEX_INTERVAL )
+        p_near = p_next;
+
+    if( p_near )
+    {
+        /* Replacing must not break offset ordering */
+        if( b_rap && !p_near->b_rap &&
+            (!p_prev || p_prev == p_near || p_prev->i_offset < i_offset) &&
+            (!p_next || p_next == p_near || p_next->i_offset > i_offset) )
+        {
+            p_near->i_time = i_time;
+            p_near->i_offset = i_offset;
+            p_near->b_rap = true;
+            p_index->b_dirty = true;
+        }
+        return;
+    }
+
+    /* Discard points contradicting the byte order (discontinuities) */
+    if( (p_prev && p_prev->i_offset >= i_offset) ||
+        (p_next && p_next->i_offset <= i_offset) )
+        return;
+
+    if( p_prog->i_points == p_prog->i_alloc )
+    {
+        size_t i_alloc = p_prog->i_alloc ? p_prog->i_alloc * 2 : 256;
+        ts_index_point_t *p_realloc = realloc( p_prog->p_points,
+                                               i_alloc * sizeof(*p_realloc) );
+        if( unlikely(!p_realloc) )
+            return;
+        p_prog->p_points = p_realloc;
+        p_prog->i_alloc = i_alloc;
+    }
+
+    memmove( &p_prog->p_points[i_pos + 1], &p_prog->p_points[i_pos],
+             (p_prog->i_points - i_pos) * sizeof(ts_index_point_t) );
+    p_prog->p_points[i_pos].i_time = i_time;
+    p_prog->p_points[i_pos].i_offset = i_offset;
+    p_prog->p_points[i_pos].b_rap = b_rap;
+    p_prog->i_points++;
+    p_index->b_dirty = true;
+}
+
+const ts_index_point_t * ts_index_Lookup( const ts_index_t *p_index, uint16_t i_program,
+                                          int64_t i_time,
+                                          const ts_index_point_t **pp_next )
+{
+    *pp_next = NULL;
+
+    const ts_index_program_t *p_prog = GetProgram( p_index, i_program );
+    if( !p_prog || p_prog->i_points == 0 )
+        return NULL;
+
+    size_t i_pos = UpperBound( p_prog, i_time );
+    if( i_pos < p_prog->i_points )
+        *pp_next = &p_prog->p_points[i_pos];
+    return i_pos > 0 ? &p_prog->p_points[i_pos - 1] : NULL;
+}
+
+bool ts_index_IsDirty( const ts_index_t *p_index )
+{
+    return p_index->b_dirty;
+}
+
+int ts_index_Load( ts_index_t *p_index, vlc_object_t *p_obj, const char *psz_file,
+                   uint64_t i_stream_size, unsigned i_packet_size )
+{
+    FILE *p_file = vlc_fopen( psz_file, "rb" );
+    if( !p_file )
+        return VLC_EGENERIC;
+
+    uint8_t header[8 + 8 + 4 + 4];
+    if( fread( header, sizeof(header), 1, p_file ) != 1 ||
+        memcmp( header, TS_INDEX_MAGIC, 8 ) ||
+        GetQWLE( &header[8] ) != i_stream_size ||
+        GetDWLE( &header[16] ) != i_packet_size )
+    {
+        msg_Dbg( p_obj, "ignoring stale seek index %s", psz_file );
+        fclose( p_file );
+        return VLC_EGENERIC;
+    }
+
+    uint32_t i_programs = GetDWLE( &header[20] );
+    for( uint32_t i=0; i<i_programs; i++ )
+    {
+        uint8_t proghdr[2 + 4];
+        if( fread( proghdr, sizeof(proghdr), 1, p_file ) != 1 )
+            goto error;
+
+        const uint16_t i_program = GetWLE( &proghdr[0] );
+        const uint32_t i_points = GetDWLE( &proghdr[2] );
+        if( i_points > i_stream_size / i_packet_size )
+            goto error;
+
+        ts_index_program_t *p_prog = GetProgram( p_index, i_program );
+        if( !p_prog && !(p_prog = AddProgram( p_index, i_program )) )
+            goto error;
+
+        for( uint32_t j=0; j<i_points; j++ )
+        {
+            uint8_t point[TS_INDEX_POINT_SIZE];
+            if( fread( point, sizeof(point), 1, p_file ) != 1 )
+                goto error;
+            uint64_t i_offset = GetQWLE( &point[8] );
+            if( i_offset >= i_stream_size )
+                goto error;
+            ts_index_Add( p_index, i_program, (int64_t) GetQWLE( &point[0] ),
+                          i_offset, point[16] & 0x01 );
+        }
+    }
+
+    fclose( p_file );
+    p_index->b_dirty = false;
+    return VLC_SUCCESS;
+
+error:
+    msg_Warn( p_obj, "corrupted seek index %s", psz_file );
+    fclose( p_file );
+    ts_index_Reset( p_index );
+    return VLC_EGENERIC;
+}
+
+int ts_index_Save( ts_index_t *p_index, vlc_object_t *p_obj, const char *psz_file,
+                   uint64_t i_stream_size, unsigned i_packet_size )
+{
+    FILE *p_file = vlc_fopen( psz_file, "wb" );
+    if( !p_file )
+    {
+        msg_Warn( p_obj, "cannot write seek index %s: %s", psz_file,
+                  vlc_strerror_c(errno) );
+        return VLC_EGENERIC;
+    }
+
+    uint8_t header[8 + 8 + 4 + 4];
+    memcpy( header, TS_INDEX_MAGIC, 8 );
+    SetQWLE( &header[8], i_stream_size );
+    SetDWLE( &header[16], i_packet_size );
+    SetDWLE( &header[20], p_index->programs.i_size );
+    bool b_error = fwrite( header, sizeof(header), 1, p_file ) != 1;
+
+    for( int i=0; i<p_index->programs.i_size && !b_error; i++ )
+    {
+        const ts_index_program_t *p_prog = p_index->programs.p_elems[i];
+        uint8_t proghdr[2 + 4];
+        SetWLE( &proghdr[0], p_prog->i_program );
+        SetDWLE( &proghdr[2], p_prog->i_points );
+        b_error = fwrite( proghdr, sizeof(proghdr), 1, p_file ) != 1;
+
+        for( size_t j=0; j<p_prog->i_points && !b_error; j++ )
+        {
+            uint8_t point[TS_INDEX_POINT_SIZE];
+            SetQWLE( &point[0], p_prog->p_points[j].i_time );
+            SetQWLE( &point[8], p_prog->p_points[j].i_offset );
+            point[16] = p_prog->p_points[j].b_rap ? 0x01 : 0x00;
+            b_error = fwrite( point, sizeof(point), 1, p_file ) != 1;
+        }
+    }
+
+    if( fclose( p_file ) || b_error )
+    {
+        msg_Warn( p_obj, "cannot write seek index %s", psz_file );
+        vlc_unlink( psz_file );
+        return VLC_EGENERIC;
+    }
+
+    p_index->b_dirty = false;
+    return VLC_SUCCESS;
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ * ts_index.h : PCR to byte offset seek index for TS demuxer
+ *****************************************************************************
+ * Copyright (C) 2017 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_TS_INDEX_H
+#define VLC_TS_INDEX_H
+
+/* Minimum distance between two points of a program, 90kHz units */
+#define TS_INDEX_INTERVAL (90000 / 2)
+
+typedef struct
+{
+    int64_t  i_time;   /* PCR/DTS, wrapped against the program first PCR */
+    uint64_t i_offset; /* of the packet carrying it */
+    bool     b_rap;    /* random_access_indicator set */
+} ts_index_point_t;
+
+typedef struct ts_index_t ts_index_t;
+
+ts_index_t * ts_index_New( void );
+void ts_index_Delete( ts_index_t * );
+
+void ts_index_Add( ts_index_t *, uint16_t i_program, int64_t i_time,
+                   uint64_t i_offset, bool b_rap );
+
+/* Returns the last point at or before i_time, or NULL.
+ * *pp_next is set to the first point after i_time, or NULL. */
+const ts_index_point_t * ts_index_Lookup( const ts_index_t *, uint16_t i_program,
+                                          int64_t i_time,
+                                          const ts_index_point_t **pp_next );
+
+bool ts_index_IsDirty( const ts_index_t * );
+int ts_index_Load( ts_index_t *, vlc_object_t *, const char *psz_file,
+                   uint64_t i_stream_size, unsigned i_packet_size );
+int ts_index_Save( ts_index_t *, vlc_object_t *, const char *psz_file,
+                   uint64_t i_stream_size, unsigned i_packet_size );
+
+#endif
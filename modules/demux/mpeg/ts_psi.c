@@ -794,16 +794,16 @@ static void OpusSetup(demux_t *demux, uint8_t *p, size_t len, es_format_t *p_fmt
             stream_count = 1;
             if (channels) {
                 int bits = vlc_ceil_log2(channels);
-                if (s.i_left < bits)
+                if (bs_remain(&s) < bits)
                     goto explicit_config_too_short;
                 stream_count = bs_read(&s, bits) + 1;
                 bits = vlc_ceil_log2(stream_count + 1);
-                if (s.i_left < bits)
+                if (bs_remain(&s) < bits)
                     goto explicit_config_too_short;
                 csc = bs_read(&s, bits);
             }
             int channel_bits = vlc_ceil_log2(stream_count + csc + 1);
-            if (s.i_left < channels * channel_bits)
+            if (bs_remain(&s) < channels * channel_bits)
                 goto explicit_config_too_short;
 
             unsigned char silence = (1U << (stream_count + csc + 1)) - 1;
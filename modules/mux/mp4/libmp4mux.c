@@ -578,9 +578,7 @@ static void hevcParseVPS(uint8_t * p_buffer, size_t i_buffer, uint8_t *general,
 
     bs_t bs;
     bs_init(&bs, p_buffer, i_buffer);
-    unsigned i_bitflow = 0;
-    bs.p_fwpriv = &i_bitflow;
-    bs.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */
+    bs.b_ep3b = true;  /* Does the emulated 3bytes conversion to rbsp */
 
     /* first two bytes are the NAL header, 3rd and 4th are:
         vps_video_parameter_set_id(4)
@@ -634,9 +632,7 @@ static void hevcParseSPS(uint8_t * p_buffer, size_t i_buffer, uint8_t * chroma_i
 
     bs_t bs;
     bs_init(&bs, p_buffer + 2, i_buffer - 2);
-    unsigned i_bitflow = 0;
-    bs.p_fwpriv = &i_bitflow;
-    bs.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */
+    bs.b_ep3b = true;  /* Does the emulated 3bytes conversion to rbsp */
 
     /* skip vps id */
     bs_skip(&bs, 4);
@@ -0,0 +1,224 @@
+/*****************************************************************************
+ * csa-test.c: CSA descrambler test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Checks the batch descrambler against known answers and against the scalar
+ * descrambler. With an argument, also compares the throughput of both on
+ * that many packets.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include "csa.h"
+#include "../../../test/libvlc/test.h"
+
+#define TS_SIZE 188
+
+static vlc_object_t obj;
+
+/* Builds a packet with an adaptation field of i_af bytes (-1 for none) */
+static void make_packet(uint8_t *pkt, int i_af, unsigned *seed)
+{
+    pkt[0] = 0x47;
+    pkt[1] = 0x01;
+    pkt[2] = 0x00;
+    pkt[3] = 0x10;
+
+    int i_hdr = 4;
+    if (i_af >= 0)
+    {
+        pkt[3] |= 0x20;
+        pkt[4] = i_af;
+        memset(&pkt[5], 0xff, i_af);
+        i_hdr += i_af + 1;
+    }
+
+    for (int i = i_hdr; i < TS_SIZE; i++)
+        pkt[i] = test_rand(seed);
+}
+
+/* Known answers, for the even key 0123456789abcdef and the odd key
+ * fedcba9876543210, plain text bytes counting from 0 */
+static const struct
+{
+    bool odd;
+    int af;
+    uint8_t ciphertext[16];
+} kat[] = {
+    { false, -1, { 0x12, 0x7d, 0xeb, 0x94, 0xac, 0x72, 0xa4, 0x53,
+                   0x85, 0x44, 0x40, 0x3f, 0x37, 0x0a, 0x8c, 0x79 } },
+    { true, 10, { 0x9e, 0x11, 0x79, 0x45, 0xaf, 0x11, 0x6d, 0x41,
+                  0x4d, 0x29, 0x69, 0x75, 0xbf, 0x33, 0xc9, 0xc5 } },
+};
+
+static void make_kat(uint8_t *pkt, bool odd, int i_af)
+{
+    unsigned seed = 0;
+    make_packet(pkt, i_af, &seed);
+
+    int i_hdr = (i_af >= 0) ? 5 + i_af : 4;
+    for (int i = i_hdr; i < TS_SIZE; i++)
+        pkt[i] = i - i_hdr;
+    pkt[3] |= odd ? 0xc0 : 0x80;
+}
+
+static void test_kat(csa_t *csa)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(kat); i++)
+    {
+        uint8_t pkts[64][TS_SIZE], plain[TS_SIZE];
+        uint8_t *ptrs[64];
+        int i_hdr = (kat[i].af >= 0) ? 5 + kat[i].af : 4;
+
+        make_kat(plain, kat[i].odd, kat[i].af);
+        plain[3] &= 0x3f;
+
+        for (size_t j = 0; j < ARRAY_SIZE(pkts); j++)
+        {
+            make_kat(pkts[j], kat[i].odd, kat[i].af);
+            csa_UseKey(&obj, csa, kat[i].odd);
+            csa_Encrypt(csa, pkts[j], TS_SIZE);
+            assert(!memcmp(&pkts[j][i_hdr], kat[i].ciphertext,
+                           sizeof (kat[i].ciphertext)));
+            ptrs[j] = pkts[j];
+        }
+
+        csa_DecryptBatch(csa, ptrs, ARRAY_SIZE(ptrs), TS_SIZE);
+        for (size_t j = 0; j < ARRAY_SIZE(pkts); j++)
+            assert(!memcmp(pkts[j], plain, TS_SIZE));
+    }
+}
+
+/* Scrambles n random packets, with both keys, some left in the clear */
+static void make_packets(csa_t *csa, uint8_t (*pkts)[TS_SIZE], unsigned n,
+                         int i_pkt_size, unsigned *seed)
+{
+    for (unsigned i = 0; i < n; i++)
+    {
+        unsigned r = test_rand(seed);
+        /* mostly payload only, sometimes up to the whole packet */
+        int i_af = (r % 4) ? -1 : (int)(test_rand(seed) % 184);
+
+        make_packet(pkts[i], i_af, seed);
+        if (r % 16 == 1)
+            continue;
+
+        csa_UseKey(&obj, csa, r % 3 == 0);
+        csa_Encrypt(csa, pkts[i], i_pkt_size);
+    }
+}
+
+static void test_batch(csa_t *csa, unsigned n, int i_pkt_size,
+                       unsigned *seed)
+{
+    uint8_t (*pkts)[TS_SIZE] = malloc(2 * n * TS_SIZE);
+    uint8_t **ptrs = malloc(n * sizeof (*ptrs));
+    assert(pkts != NULL && ptrs != NULL);
+
+    make_packets(csa, pkts, n, i_pkt_size, seed);
+    memcpy(pkts + n, pkts, n * TS_SIZE);
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        csa_Decrypt(csa, pkts[n + i], i_pkt_size);
+        ptrs[i] = pkts[i];
+    }
+    csa_DecryptBatch(csa, ptrs, n, i_pkt_size);
+
+    assert(!memcmp(pkts, pkts + n, n * TS_SIZE));
+    free(ptrs);
+    free(pkts);
+}
+
+static void bench(csa_t *csa, unsigned n)
+{
+    uint8_t (*pkts)[TS_SIZE] = malloc(2 * n * TS_SIZE);
+    uint8_t **ptrs = malloc(n * sizeof (*ptrs));
+    unsigned seed = 1;
+    assert(pkts != NULL && ptrs != NULL);
+
+    make_packets(csa, pkts, n, TS_SIZE, &seed);
+    for (unsigned i = 0; i < n; i++)
+        pkts[i][3] |= 0x80; /* all scrambled */
+    memcpy(pkts + n, pkts, n * TS_SIZE);
+
+    mtime_t start = mdate();
+    for (unsigned i = 0; i < n; i++)
+        csa_Decrypt(csa, pkts[i], TS_SIZE);
+    mtime_t scalar = mdate() - start;
+
+    for (unsigned batch = 32; batch <= 256; batch *= 2)
+    {
+        for (unsigned i = 0; i < n; i++)
+        {
+            memcpy(pkts[i], pkts[n + i], TS_SIZE);
+            ptrs[i] = pkts[i];
+        }
+
+        start = mdate();
+        for (unsigned i = 0; i < n; i += batch)
+            csa_DecryptBatch(csa, ptrs + i, __MIN(batch, n - i), TS_SIZE);
+        mtime_t batched = mdate() - start;
+
+        printf("%u packets: scalar %"PRId64" ms, batches of %u %"PRId64
+               " ms (x%.2f)\n", n, scalar / 1000, batch, batched / 1000,
+               (double)scalar / batched);
+    }
+
+    free(ptrs);
+    free(pkts);
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned sizes[] = { 1, 23, 24, 100, 256, 257, 700 };
+    static const int pkt_sizes[] = { 188, 184, 100, 13, 4 };
+    static char even[] = "0123456789abcdef", odd[] = "0xfedcba9876543210";
+    unsigned seed = 42;
+
+    obj.obj.flags = OBJECT_FLAGS_QUIET;
+
+    csa_t *csa = csa_New();
+    assert(csa != NULL);
+    assert(csa_SetCW(&obj, csa, even, false) == VLC_SUCCESS);
+    assert(csa_SetCW(&obj, csa, odd, true) == VLC_SUCCESS);
+
+    test_kat(csa);
+
+    for (size_t i = 0; i < ARRAY_SIZE(pkt_sizes); i++)
+        for (size_t j = 0; j < ARRAY_SIZE(sizes); j++)
+            test_batch(csa, sizes[j], pkt_sizes[i], &seed);
+
+    if (argc > 1)
+        bench(csa, strtoul(argv[1], NULL, 0));
+
+    csa_Delete(csa);
+    return 0;
+}
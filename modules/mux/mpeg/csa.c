@@ -27,9 +27,12 @@
 #endif
 
 #include <vlc_common.h>
+#include <vlc_cpu.h>
 
 #include "csa.h"
 
+typedef struct csa_batch_t csa_batch_t;
+
 struct csa_t
 {
     /* odd and even keys */
@@ -47,6 +50,9 @@ struct csa_t
     int     p, q, r;
 
     bool    use_odd;
+
+    /* batch descrambling scratch, allocated on first use */
+    csa_batch_t *batch;
 };
 
 static void csa_ComputeKey( uint8_t kk[57], uint8_t ck[8] );
@@ -69,6 +75,7 @@ csa_t *csa_New( void )
  *****************************************************************************/
 void csa_Delete( csa_t *c )
 {
+    free( c->batch );
     free( c );
 }
 
@@ -610,3 +617,649 @@ static void csa_BlockCypher( uint8_t kk[57], uint8_t bd[8], uint8_t ib[8] )
     }
 }
 
+
+/*****************************************************************************
+ * Batch descrambling
+ *****************************************************************************
+ * The stream cypher is bitsliced: each bit of its state is held in a word
+ * whose bits belong to up to CSA_BS_LANES packets, so that all of them are
+ * clocked with a few logical operations. The s-boxes are turned into boolean
+ * circuits for that purpose.
+ *
+ * Once all the stream bytes of a packet are known, the inputs of all its
+ * blocks are known too, and the blocks are decyphered independently. The
+ * block cypher is byte sliced: each byte of its state is held in a vector
+ * whose bytes belong to CSA_BB_LANES blocks.
+ *****************************************************************************/
+#if defined(__GNUC__) || defined(__clang__)
+# define CSA_BITSLICE 1
+#endif
+
+/* below this number of packets, the scalar path is faster */
+#define CSA_BS_MIN 2
+
+#ifdef CSA_BITSLICE
+#define CSA_BS_LANES 256
+#define CSA_BB_LANES 32
+
+typedef uint64_t csa_bs_t __attribute__((vector_size(CSA_BS_LANES / 8)));
+typedef uint8_t  csa_bb_t __attribute__((vector_size(CSA_BB_LANES)));
+
+/* The kernels are inlined into each instruction set variant */
+#define CSA_BS_INLINE static inline __attribute__((always_inline))
+
+struct csa_batch_t
+{
+    struct
+    {
+        uint8_t *pkt;
+        uint8_t  i_hdr;
+        uint8_t  i_blocks;
+        uint8_t  i_residue;
+        bool     b_odd;
+    } lane[CSA_BS_LANES];
+    unsigned i_lanes;
+
+    /* stream cypher output, then block cypher input, of each lane */
+    uint8_t  stream[CSA_BS_LANES][184];
+    uint8_t  ib[CSA_BS_LANES][184];
+};
+
+typedef struct
+{
+    csa_bs_t A[11][4];
+    csa_bs_t B[11][4];
+    csa_bs_t X[4], Y[4], Z[4];
+    csa_bs_t D[4], E[4], F[4];
+    csa_bs_t p, q, r;
+} csa_bs_state_t;
+
+CSA_BS_INLINE void csa_bs_sbox1( csa_bs_t *o1, csa_bs_t *o0,
+                                 const csa_bs_t *p4, const csa_bs_t *p3,
+                                 const csa_bs_t *p2, const csa_bs_t *p1,
+                                 const csa_bs_t *p0 )
+{
+    const csa_bs_t x4 = *p4, x3 = *p3, x2 = *p2, x1 = *p1, x0 = *p0;
+    const csa_bs_t t0 = x2 ^ x4;
+    const csa_bs_t t1 = x0 & t0;
+    const csa_bs_t t2 = x1 ^ t1;
+    const csa_bs_t t3 = x1 | ~x0;
+    const csa_bs_t t4 = x0 | ~x2;
+    const csa_bs_t t5 = x1 ^ t4;
+    const csa_bs_t t6 = x4 & t5;
+    const csa_bs_t t7 = t3 ^ t6;
+    const csa_bs_t t8 = x3 & t7;
+    const csa_bs_t t9 = t2 ^ t8;
+    const csa_bs_t t10 = ~x4;
+    const csa_bs_t t11 = x0 ^ t10;
+    const csa_bs_t t12 = x3 | t11;
+    const csa_bs_t t13 = x4 | ~x3;
+    const csa_bs_t t14 = x3 | ~x4;
+    const csa_bs_t t15 = x0 & t14;
+    const csa_bs_t t16 = t13 ^ t15;
+    const csa_bs_t t17 = x1 & t16;
+    const csa_bs_t t18 = t12 ^ t17;
+    const csa_bs_t t19 = x1 | x4;
+    const csa_bs_t t20 = x0 ^ t19;
+    const csa_bs_t t21 = x3 | t20;
+    const csa_bs_t t22 = x2 & t21;
+    const csa_bs_t t23 = t18 ^ t22;
+    *o1 = t23;
+    *o0 = t9;
+}
+
+CSA_BS_INLINE void csa_bs_sbox2( csa_bs_t *o1, csa_bs_t *o0,
+                                 const csa_bs_t *p4, const csa_bs_t *p3,
+                                 const csa_bs_t *p2, const csa_bs_t *p1,
+                                 const csa_bs_t *p0 )
+{
+    const csa_bs_t x4 = *p4, x3 = *p3, x2 = *p2, x1 = *p1, x0 = *p0;
+    const csa_bs_t t0 = x4 | ~x2;
+    const csa_bs_t t1 = x3 & x4;
+    const csa_bs_t t2 = t0 ^ t1;
+    const csa_bs_t t3 = x1 ^ t2;
+    const csa_bs_t t4 = x4 | ~x3;
+    const csa_bs_t t5 = x2 & t4;
+    const csa_bs_t t6 = x3 | x4;
+    const csa_bs_t t7 = x1 & t6;
+    const csa_bs_t t8 = t5 ^ t7;
+    const csa_bs_t t9 = x0 & t8;
+    const csa_bs_t t10 = t3 ^ t9;
+    const csa_bs_t t11 = x2 & ~x4;
+    const csa_bs_t t12 = t11 | ~x1;
+    const csa_bs_t t13 = x1 | ~x2;
+    const csa_bs_t t14 = x0 & t13;
+    const csa_bs_t t15 = t12 ^ t14;
+    const csa_bs_t t16 = ~x1;
+    const csa_bs_t t17 = t16 & ~x0;
+    const csa_bs_t t18 = x2 ^ t17;
+    const csa_bs_t t19 = t18 | ~x4;
+    const csa_bs_t t20 = x3 & t19;
+    const csa_bs_t t21 = t15 ^ t20;
+    *o1 = t21;
+    *o0 = t10;
+}
+
+CSA_BS_INLINE void csa_bs_sbox3( csa_bs_t *o1, csa_bs_t *o0,
+                                 const csa_bs_t *p4, const csa_bs_t *p3,
+                                 const csa_bs_t *p2, const csa_bs_t *p1,
+                                 const csa_bs_t *p0 )
+{
+    const csa_bs_t x4 = *p4, x3 = *p3, x2 = *p2, x1 = *p1, x0 = *p0;
+    const csa_bs_t t0 = x3 ^ x4;
+    const csa_bs_t t1 = x1 ^ t0;
+    const csa_bs_t t2 = x1 ^ x2;
+    const csa_bs_t t3 = x0 & t2;
+    const csa_bs_t t4 = t1 ^ t3;
+    const csa_bs_t t5 = ~x4;
+    const csa_bs_t t6 = x3 ^ t5;
+    const csa_bs_t t7 = t6 & ~x1;
+    const csa_bs_t t8 = x4 & ~x3;
+    const csa_bs_t t9 = x1 ^ t8;
+    const csa_bs_t t10 = t7 ^ ((t7 ^ t9) & x0);
+    const csa_bs_t t11 = x0 ^ x3;
+    const csa_bs_t t12 = x4 | t11;
+    const csa_bs_t t13 = x1 | t12;
+    const csa_bs_t t14 = x2 & t13;
+    const csa_bs_t t15 = t10 ^ t14;
+    *o1 = t15;
+    *o0 = t4;
+}
+
+CSA_BS_INLINE void csa_bs_sbox4( csa_bs_t *o1, csa_bs_t *o0,
+                                 const csa_bs_t *p4, const csa_bs_t *p3,
+                                 const csa_bs_t *p2, const csa_bs_t *p1,
+                                 const csa_bs_t *p0 )
+{
+    const csa_bs_t x4 = *p4, x3 = *p3, x2 = *p2, x1 = *p1, x0 = *p0;
+    const csa_bs_t t0 = x4 | ~x1;
+    const csa_bs_t t1 = x3 & x4;
+    const csa_bs_t t2 = t0 ^ t1;
+    const csa_bs_t t3 = x4 & ~x1;
+    const csa_bs_t t4 = t3 | ~x3;
+    const csa_bs_t t5 = x2 & t4;
+    const csa_bs_t t6 = t2 ^ t5;
+    const csa_bs_t t7 = x3 | x4;
+    const csa_bs_t t8 = x2 | ~x4;
+    const csa_bs_t t9 = t7 ^ ((t7 ^ t8) & x1);
+    const csa_bs_t t10 = x0 & t9;
+    const csa_bs_t t11 = t6 ^ t10;
+    const csa_bs_t t12 = x1 | ~x4;
+    const csa_bs_t t13 = x2 ^ t12;
+    const csa_bs_t t14 = x1 & ~x4;
+    const csa_bs_t t15 = x2 | t14;
+    const csa_bs_t t16 = t13 ^ ((t13 ^ t15) & x0);
+    const csa_bs_t t17 = x0 & ~x1;
+    const csa_bs_t t18 = t17 | ~x4;
+    const csa_bs_t t19 = x1 | x4;
+    const csa_bs_t t20 = x2 & t19;
+    const csa_bs_t t21 = t18 ^ t20;
+    const csa_bs_t t22 = x3 & t21;
+    const csa_bs_t t23 = t16 ^ t22;
+    *o1 = t23;
+    *o0 = t11;
+}
+
+CSA_BS_INLINE void csa_bs_sbox5( csa_bs_t *o1, csa_bs_t *o0,
+                                 const csa_bs_t *p4, const csa_bs_t *p3,
+                                 const csa_bs_t *p2, const csa_bs_t *p1,
+                                 const csa_bs_t *p0 )
+{
+    const csa_bs_t x4 = *p4, x3 = *p3, x2 = *p2, x1 = *p1, x0 = *p0;
+    const csa_bs_t t0 = x1 & x3;
+    const csa_bs_t t1 = x2 ^ t0;
+    const csa_bs_t t2 = x1 ^ x3;
+    const csa_bs_t t3 = x2 | t2;
+    const csa_bs_t t4 = x0 & t3;
+    const csa_bs_t t5 = t1 ^ t4;
+    const csa_bs_t t6 = x2 ^ x3;
+    const csa_bs_t t7 = t6 & ~x1;
+    const csa_bs_t t8 = x0 | t7;
+    const csa_bs_t t9 = x4 & t8;
+    const csa_bs_t t10 = t5 ^ t9;
+    const csa_bs_t t11 = x4 | ~x0;
+    const csa_bs_t t12 = t11 & ~x3;
+    const csa_bs_t t13 = x4 & ~x0;
+    const csa_bs_t t14 = x3 | t13;
+    const csa_bs_t t15 = t12 ^ ((t12 ^ t14) & x1);
+    const csa_bs_t t16 = x0 & ~x1;
+    const csa_bs_t t17 = t16 | ~x4;
+    const csa_bs_t t18 = x0 | ~x1;
+    const csa_bs_t t19 = x3 & t18;
+    const csa_bs_t t20 = t17 ^ t19;
+    const csa_bs_t t21 = t15 ^ ((t15 ^ t20) & x2);
+    *o1 = t21;
+    *o0 = t10;
+}
+
+CSA_BS_INLINE void csa_bs_sbox6( csa_bs_t *o1, csa_bs_t *o0,
+                                 const csa_bs_t *p4, const csa_bs_t *p3,
+                                 const csa_bs_t *p2, const csa_bs_t *p1,
+                                 const csa_bs_t *p0 )
+{
+    const csa_bs_t x4 = *p4, x3 = *p3, x2 = *p2, x1 = *p1, x0 = *p0;
+    const csa_bs_t t0 = x2 & ~x3;
+    const csa_bs_t t1 = x0 ^ t0;
+    const csa_bs_t t2 = x2 & ~x4;
+    const csa_bs_t t3 = x3 | t2;
+    const csa_bs_t t4 = x3 & ~x2;
+    const csa_bs_t t5 = x4 | t4;
+    const csa_bs_t t6 = t3 ^ ((t3 ^ t5) & x0);
+    const csa_bs_t t7 = x1 & t6;
+    const csa_bs_t t8 = t1 ^ t7;
+    const csa_bs_t t9 = x1 ^ x4;
+    const csa_bs_t t10 = x3 & x4;
+    const csa_bs_t t11 = x3 ^ x4;
+    const csa_bs_t t12 = x1 & t11;
+    const csa_bs_t t13 = t10 ^ t12;
+    const csa_bs_t t14 = x0 & t13;
+    const csa_bs_t t15 = t9 ^ t14;
+    const csa_bs_t t16 = x0 | x3;
+    const csa_bs_t t17 = x2 & t16;
+    const csa_bs_t t18 = t15 ^ t17;
+    *o1 = t18;
+    *o0 = t8;
+}
+
+CSA_BS_INLINE void csa_bs_sbox7( csa_bs_t *o1, csa_bs_t *o0,
+                                 const csa_bs_t *p4, const csa_bs_t *p3,
+                                 const csa_bs_t *p2, const csa_bs_t *p1,
+                                 const csa_bs_t *p0 )
+{
+    const csa_bs_t x4 = *p4, x3 = *p3, x2 = *p2, x1 = *p1, x0 = *p0;
+    const csa_bs_t t0 = x2 | x3;
+    const csa_bs_t t1 = x4 ^ t0;
+    const csa_bs_t t2 = x0 ^ t1;
+    const csa_bs_t t3 = x3 & x4;
+    const csa_bs_t t4 = x2 ^ t3;
+    const csa_bs_t t5 = x0 | t4;
+    const csa_bs_t t6 = x1 & t5;
+    const csa_bs_t t7 = t2 ^ t6;
+    const csa_bs_t t8 = x0 ^ x2;
+    const csa_bs_t t9 = t8 & ~x4;
+    const csa_bs_t t10 = x3 ^ t9;
+    const csa_bs_t t11 = x3 | ~x0;
+    const csa_bs_t t12 = x0 ^ x3;
+    const csa_bs_t t13 = t12 | ~x2;
+    const csa_bs_t t14 = t11 ^ ((t11 ^ t13) & x4);
+    const csa_bs_t t15 = x1 & t14;
+    const csa_bs_t t16 = t10 ^ t15;
+    *o1 = t16;
+    *o0 = t7;
+}
+
+/* Clocks the stream cypher of all lanes once. During initialisation, in1 and
+ * in2 are the planes of the nibbles fed in (NULL otherwise). Returns the
+ * planes of the two output bits. */
+CSA_BS_INLINE void csa_bs_Clock( csa_bs_state_t *c, const csa_bs_t *in1,
+                                 const csa_bs_t *in2, csa_bs_t *o1,
+                                 csa_bs_t *o0 )
+{
+    csa_bs_t (*A)[4] = c->A, (*B)[4] = c->B;
+    csa_bs_t s[8][2];
+    csa_bs_t extra_B[4], next_A1[4], next_B1[4], next_E[4];
+
+    csa_bs_sbox1( &s[1][1], &s[1][0], &A[4][0], &A[1][2], &A[6][1], &A[7][3], &A[9][0] );
+    csa_bs_sbox2( &s[2][1], &s[2][0], &A[2][1], &A[3][2], &A[6][3], &A[7][0], &A[9][1] );
+    csa_bs_sbox3( &s[3][1], &s[3][0], &A[1][3], &A[2][0], &A[5][1], &A[5][3], &A[6][2] );
+    csa_bs_sbox4( &s[4][1], &s[4][0], &A[3][3], &A[1][1], &A[2][3], &A[4][2], &A[8][0] );
+    csa_bs_sbox5( &s[5][1], &s[5][0], &A[5][2], &A[4][3], &A[6][0], &A[8][1], &A[9][2] );
+    csa_bs_sbox6( &s[6][1], &s[6][0], &A[3][1], &A[4][1], &A[5][0], &A[7][2], &A[9][3] );
+    csa_bs_sbox7( &s[7][1], &s[7][0], &A[2][2], &A[3][0], &A[7][1], &A[8][2], &A[8][3] );
+
+    extra_B[3] = B[3][0] ^ B[6][1] ^ B[7][2] ^ B[9][3];
+    extra_B[2] = B[6][0] ^ B[8][1] ^ B[3][3] ^ B[4][2];
+    extra_B[1] = B[5][3] ^ B[8][2] ^ B[4][0] ^ B[5][1];
+    extra_B[0] = B[9][2] ^ B[6][3] ^ B[3][1] ^ B[8][0];
+
+    for( int i = 0; i < 4; i++ )
+    {
+        next_A1[i] = A[10][i] ^ c->X[i];
+        next_B1[i] = B[7][i] ^ B[10][i] ^ c->Y[i];
+        if( in1 != NULL )
+        {
+            next_A1[i] ^= c->D[i] ^ in1[i];
+            next_B1[i] ^= in2[i];
+        }
+    }
+
+    /* if p=1, rotate left */
+    const csa_bs_t b3 = next_B1[3];
+    next_B1[3] ^= ( next_B1[3] ^ next_B1[2] ) & c->p;
+    next_B1[2] ^= ( next_B1[2] ^ next_B1[1] ) & c->p;
+    next_B1[1] ^= ( next_B1[1] ^ next_B1[0] ) & c->p;
+    next_B1[0] ^= ( next_B1[0] ^ b3 ) & c->p;
+
+    /* T3, then T4 = sum, carry of Z + E + r if q=1 */
+    csa_bs_t carry = c->r;
+    for( int i = 0; i < 4; i++ )
+    {
+        const csa_bs_t ze = c->Z[i] ^ c->E[i];
+        const csa_bs_t sum = ze ^ carry;
+
+        carry = ( c->Z[i] & c->E[i] ) | ( carry & ze );
+        c->D[i] = ze ^ extra_B[i];
+        next_E[i] = c->F[i];
+        c->F[i] = c->E[i] ^ ( ( c->E[i] ^ sum ) & c->q );
+        c->E[i] = next_E[i];
+    }
+    c->r ^= ( c->r ^ carry ) & c->q;
+
+    memmove( &A[2], &A[1], 9 * sizeof( A[1] ) );
+    memmove( &B[2], &B[1], 9 * sizeof( B[1] ) );
+    memcpy( A[1], next_A1, sizeof( next_A1 ) );
+    memcpy( B[1], next_B1, sizeof( next_B1 ) );
+
+    c->X[3] = s[4][0]; c->X[2] = s[3][0]; c->X[1] = s[2][1]; c->X[0] = s[1][1];
+    c->Y[3] = s[6][0]; c->Y[2] = s[5][0]; c->Y[1] = s[4][1]; c->Y[0] = s[3][1];
+    c->Z[3] = s[2][0]; c->Z[2] = s[1][0]; c->Z[1] = s[6][1]; c->Z[0] = s[5][1];
+    c->p = s[7][1];
+    c->q = s[7][0];
+
+    *o1 = c->D[3] ^ c->D[2];
+    *o0 = c->D[1] ^ c->D[0];
+}
+
+/* Transposes an 8x8 bit matrix, one row per byte */
+static inline uint64_t csa_bs_Transpose8( uint64_t x )
+{
+    uint64_t t;
+
+    t = ( x ^ ( x >> 7 ) ) & UINT64_C(0x00AA00AA00AA00AA);
+    x ^= t ^ ( t << 7 );
+    t = ( x ^ ( x >> 14 ) ) & UINT64_C(0x0000CCCC0000CCCC);
+    x ^= t ^ ( t << 14 );
+    t = ( x ^ ( x >> 28 ) ) & UINT64_C(0x00000000F0F0F0F0);
+    x ^= t ^ ( t << 28 );
+    return x;
+}
+
+/* Loads byte i of each lane into the 8 bit planes of p */
+static void csa_bs_Load( csa_bs_t p[8], const uint8_t *const *src, unsigned i,
+                         unsigned i_lanes )
+{
+    memset( p, 0, 8 * sizeof( *p ) );
+
+    for( unsigned l = 0; l < i_lanes; l += 8 )
+    {
+        uint64_t x = 0;
+
+        for( unsigned k = 0; k < 8 && l + k < i_lanes; k++ )
+            x |= (uint64_t)src[l + k][i] << ( 8 * k );
+        x = csa_bs_Transpose8( x );
+
+        for( unsigned b = 0; b < 8; b++ )
+            p[b][l / 64] |= ( ( x >> ( 8 * b ) ) & 0xff ) << ( l % 64 );
+    }
+}
+
+/* Stores the 8 bit planes of p into byte i of each lane */
+static void csa_bs_Store( const csa_bs_t p[8], uint8_t (*dst)[184], unsigned i,
+                          unsigned i_lanes )
+{
+    for( unsigned l = 0; l < i_lanes; l += 8 )
+    {
+        uint64_t x = 0;
+
+        for( unsigned b = 0; b < 8; b++ )
+            x |= ( ( p[b][l / 64] >> ( l % 64 ) ) & 0xff ) << ( 8 * b );
+        x = csa_bs_Transpose8( x );
+
+        for( unsigned k = 0; k < 8 && l + k < i_lanes; k++ )
+            dst[l + k][i] = x >> ( 8 * k );
+    }
+}
+
+/* Computes i_bytes bytes of stream cypher output for all the lanes */
+CSA_BS_INLINE void csa_bs_StreamCypher( const csa_t *c, csa_batch_t *b,
+                                        unsigned i_bytes )
+{
+    const uint8_t *ck[CSA_BS_LANES], *sb[CSA_BS_LANES];
+    csa_bs_state_t st;
+    csa_bs_t p[8];
+
+    for( unsigned l = 0; l < b->i_lanes; l++ )
+    {
+        ck[l] = b->lane[l].b_odd ? c->o_ck : c->e_ck;
+        sb[l] = &b->lane[l].pkt[b->lane[l].i_hdr];
+    }
+
+    /* load the key into A and B, all other registers are zero */
+    memset( &st, 0, sizeof( st ) );
+    for( unsigned i = 0; i < 4; i++ )
+    {
+        csa_bs_Load( p, ck, i, b->i_lanes );
+        memcpy( st.A[1 + 2 * i], &p[4], 4 * sizeof( *p ) );
+        memcpy( st.A[2 + 2 * i], &p[0], 4 * sizeof( *p ) );
+
+        csa_bs_Load( p, ck, 4 + i, b->i_lanes );
+        memcpy( st.B[1 + 2 * i], &p[4], 4 * sizeof( *p ) );
+        memcpy( st.B[2 + 2 * i], &p[0], 4 * sizeof( *p ) );
+    }
+
+    /* feed in the first block */
+    for( unsigned i = 0; i < 8; i++ )
+    {
+        csa_bs_t o1, o0;
+
+        csa_bs_Load( p, sb, i, b->i_lanes );
+        for( unsigned j = 0; j < 4; j++ )
+        {
+            if( j % 2 )
+                csa_bs_Clock( &st, &p[0], &p[4], &o1, &o0 );
+            else
+                csa_bs_Clock( &st, &p[4], &p[0], &o1, &o0 );
+        }
+    }
+
+    for( unsigned i = 0; i < i_bytes; i++ )
+    {
+        for( unsigned j = 0; j < 4; j++ )
+            csa_bs_Clock( &st, NULL, NULL, &p[7 - 2 * j], &p[6 - 2 * j] );
+        csa_bs_Store( p, b->stream, i, b->i_lanes );
+    }
+}
+
+/* Decyphers CSA_BB_LANES blocks, R[i] holding byte i of each */
+CSA_BS_INLINE void csa_bb_BlockDecypher( const uint8_t kk[57], csa_bb_t R[8] )
+{
+    for( int i = 56; i > 0; i-- )
+    {
+        const csa_bb_t in = R[6] ^ kk[i];
+        csa_bb_t sbox_out;
+
+        for( unsigned l = 0; l < CSA_BB_LANES; l++ )
+            sbox_out[l] = block_sbox[in[l]];
+
+        const csa_bb_t perm_out = ( ( sbox_out & 0x29 ) << 1 ) |
+                                  ( ( sbox_out & 0x02 ) << 6 ) |
+                                  ( ( sbox_out & 0x04 ) << 3 ) |
+                                  ( ( sbox_out & 0x10 ) >> 2 ) |
+                                  ( ( sbox_out & 0x40 ) >> 6 ) |
+                                  ( ( sbox_out & 0x80 ) >> 4 );
+        const csa_bb_t R8 = R[7] ^ sbox_out;
+
+        R[7] = R[6];
+        R[6] = R[5] ^ perm_out;
+        R[5] = R[4];
+        R[4] = R[3] ^ R8;
+        R[3] = R[2] ^ R8;
+        R[2] = R[1] ^ R8;
+        R[1] = R[0];
+        R[0] = R8;
+    }
+}
+
+/* Decyphers the given blocks and writes out the plain text */
+CSA_BS_INLINE void csa_bb_Flush( const uint8_t kk[57], csa_batch_t *b,
+                                 const uint8_t (*blocks)[2], unsigned i_blocks )
+{
+    csa_bb_t R[8];
+
+    for( unsigned n = 0; n < i_blocks; n++ )
+        for( unsigned j = 0; j < 8; j++ )
+            R[j][n] = b->ib[blocks[n][0]][8 * blocks[n][1] + j];
+
+    csa_bb_BlockDecypher( kk, R );
+
+    for( unsigned n = 0; n < i_blocks; n++ )
+    {
+        const unsigned l = blocks[n][0], k = blocks[n][1];
+        uint8_t *out = &b->lane[l].pkt[b->lane[l].i_hdr + 8 * k];
+
+        /* xor with the next block input, 0 after the last block */
+        if( k + 1 < b->lane[l].i_blocks )
+            for( unsigned j = 0; j < 8; j++ )
+                out[j] = R[j][n] ^ b->ib[l][8 * k + 8 + j];
+        else
+            for( unsigned j = 0; j < 8; j++ )
+                out[j] = R[j][n];
+    }
+}
+
+/* Decyphers the blocks of all the lanes using the given key */
+CSA_BS_INLINE void csa_bb_Decrypt( const csa_t *c, csa_batch_t *b, bool b_odd )
+{
+    const uint8_t *kk = b_odd ? c->o_kk : c->e_kk;
+    uint8_t blocks[CSA_BB_LANES][2];
+    unsigned i_blocks = 0;
+
+    for( unsigned l = 0; l < b->i_lanes; l++ )
+    {
+        if( b->lane[l].b_odd != b_odd )
+            continue;
+
+        for( unsigned k = 0; k < b->lane[l].i_blocks; k++ )
+        {
+            blocks[i_blocks][0] = l;
+            blocks[i_blocks][1] = k;
+            if( ++i_blocks == CSA_BB_LANES )
+            {
+                csa_bb_Flush( kk, b, blocks, i_blocks );
+                i_blocks = 0;
+            }
+        }
+    }
+    if( i_blocks > 0 )
+        csa_bb_Flush( kk, b, blocks, i_blocks );
+}
+
+CSA_BS_INLINE void csa_bs_Decrypt( const csa_t *c, csa_batch_t *b )
+{
+    unsigned i_bytes = 0;
+
+    for( unsigned l = 0; l < b->i_lanes; l++ )
+    {
+        unsigned i_need = 8 * ( b->lane[l].i_blocks - 1 );
+        if( b->lane[l].i_residue > 0 )
+            i_need += 8;
+        if( i_need > i_bytes )
+            i_bytes = i_need;
+    }
+
+    csa_bs_StreamCypher( c, b, i_bytes );
+
+    /* the first block is the stream cypher input, the next ones are xored
+     * with its output */
+    for( unsigned l = 0; l < b->i_lanes; l++ )
+    {
+        const uint8_t *pkt = &b->lane[l].pkt[b->lane[l].i_hdr];
+
+        memcpy( b->ib[l], pkt, 8 );
+        for( unsigned j = 8; j < 8u * b->lane[l].i_blocks; j++ )
+            b->ib[l][j] = pkt[j] ^ b->stream[l][j - 8];
+    }
+
+    csa_bb_Decrypt( c, b, true );
+    csa_bb_Decrypt( c, b, false );
+
+    for( unsigned l = 0; l < b->i_lanes; l++ )
+    {
+        const unsigned i_blocks = b->lane[l].i_blocks;
+        uint8_t *pkt = &b->lane[l].pkt[b->lane[l].i_hdr + 8 * i_blocks];
+
+        for( unsigned j = 0; j < b->lane[l].i_residue; j++ )
+            pkt[j] ^= b->stream[l][8 * ( i_blocks - 1 ) + j];
+
+        /* clear transport scrambling control */
+        b->lane[l].pkt[3] &= 0x3f;
+    }
+}
+
+static void csa_bs_Decrypt_c( const csa_t *c, csa_batch_t *b )
+{
+    csa_bs_Decrypt( c, b );
+}
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+# define CSA_BS_AVX2 1
+__attribute__ ((__target__ ("avx2")))
+static void csa_bs_Decrypt_avx2( const csa_t *c, csa_batch_t *b )
+{
+    csa_bs_Decrypt( c, b );
+}
+#endif
+#endif /* CSA_BITSLICE */
+
+/*****************************************************************************
+ * csa_DecryptBatch:
+ *****************************************************************************/
+void csa_DecryptBatch( csa_t *c, uint8_t *const *pkts, unsigned n,
+                       int i_pkt_size )
+{
+#ifdef CSA_BITSLICE
+    if( n >= CSA_BS_MIN && c->batch == NULL )
+        c->batch = malloc( sizeof( *c->batch ) );
+
+    if( n >= CSA_BS_MIN && c->batch != NULL )
+    {
+        csa_batch_t *b = c->batch;
+        void (*decrypt)( const csa_t *, csa_batch_t * ) = csa_bs_Decrypt_c;
+
+#ifdef CSA_BS_AVX2
+        if( vlc_CPU_AVX2() )
+            decrypt = csa_bs_Decrypt_avx2;
+#endif
+        b->i_lanes = 0;
+        for( unsigned i = 0; i < n; i++ )
+        {
+            uint8_t *pkt = pkts[i];
+
+            if( (pkt[3]&0x80) == 0 )
+                continue;
+
+            int i_hdr = 4;
+            if( pkt[3]&0x20 )
+                i_hdr += pkt[4] + 1;
+
+            /* leave the odd cases to the scalar path */
+            if( 188 - i_hdr < 8 || i_pkt_size - i_hdr < 8 )
+            {
+                csa_Decrypt( c, pkt, i_pkt_size );
+                continue;
+            }
+
+            b->lane[b->i_lanes].pkt = pkt;
+            b->lane[b->i_lanes].i_hdr = i_hdr;
+            b->lane[b->i_lanes].i_blocks = ( i_pkt_size - i_hdr ) / 8;
+            b->lane[b->i_lanes].i_residue = ( i_pkt_size - i_hdr ) % 8;
+            b->lane[b->i_lanes].b_odd = pkt[3]&0x40;
+            if( ++b->i_lanes == CSA_BS_LANES )
+            {
+                decrypt( c, b );
+                b->i_lanes = 0;
+            }
+        }
+
+        if( b->i_lanes >= CSA_BS_MIN )
+            decrypt( c, b );
+        else
+            for( unsigned l = 0; l < b->i_lanes; l++ )
+                csa_Decrypt( c, b->lane[l].pkt, i_pkt_size );
+        return;
+    }
+#endif
+    for( unsigned i = 0; i < n; i++ )
+        csa_Decrypt( c, pkts[i], i_pkt_size );
+}
@@ -490,13 +490,7 @@ static bool h264_parse_picture_parameter_set_rbsp( bs_t *p_bs,
         { \
             bs_t bs; \
             bs_init( &bs, p_buf, i_buf ); \
-            unsigned i_bitflow = 0; \
-            if( b_escaped ) \
-            { \
-                bs.p_fwpriv = &i_bitflow; \
-                bs.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */ \
-            } \
-            else (void) i_bitflow;\
+            bs.b_ep3b = b_escaped;  /* Does the emulated 3bytes conversion to rbsp */ \
             bs_skip( &bs, 8 ); /* Skip nal_unit_header */ \
             if( !decode( &bs, p_h264type ) ) \
             { \
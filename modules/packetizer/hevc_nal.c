@@ -680,13 +680,7 @@ void hevc_rbsp_release_vps( hevc_video_parameter_set_t *p_vps )
         { \
             bs_t bs; \
             bs_init( &bs, p_buf, i_buf ); \
-            unsigned i_bitflow = 0; \
-            if( b_escaped ) \
-            { \
-                bs.p_fwpriv = &i_bitflow; \
-                bs.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */ \
-            } \
-            else (void) i_bitflow;\
+            bs.b_ep3b = b_escaped;  /* Does the emulated 3bytes conversion to rbsp */ \
             bs_skip( &bs, 7 ); /* nal_unit_header */ \
             uint8_t i_nuh_layer_id = bs_read( &bs, 6 ); \
             bs_skip( &bs, 3 ); /* !nal_unit_header */ \
@@ -1172,13 +1166,7 @@ hevc_slice_segment_header_t * hevc_decode_slice_header( const uint8_t *p_buf, si
         uint8_t i_nal_type = hevc_getNALType(p_buf);
         bs_t bs;
         bs_init( &bs, p_buf, i_buf );
-        unsigned i_bitflow = 0;
-        if( b_escaped )
-        {
-            bs.p_fwpriv = &i_bitflow;
-            bs.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */
-        }
-        else (void) i_bitflow;
+        bs.b_ep3b = b_escaped;  /* Does the emulated 3bytes conversion to rbsp */
         bs_skip( &bs, 7 ); /* nal_unit_header */
         uint8_t i_nuh_layer_id = bs_read( &bs, 6 );
         bs_skip( &bs, 3 ); /* !nal_unit_header */
@@ -115,6 +115,7 @@ block_t *hxxx_AnnexB_to_xVC( block_t *p_block, uint8_t i_nal_length_size )
     }
 
     block_t *p_release = NULL;
+    const uint8_t *p_former = p_block->p_buffer;
     const uint8_t *p_source = NULL;
     const uint8_t *p_sourceend = NULL;
     uint8_t *p_dest = NULL;
@@ -150,6 +151,14 @@ block_t *hxxx_AnnexB_to_xVC( block_t *p_block, uint8_t i_nal_length_size )
     }
     else
     {
+        /* Start codes are rewritten in place */
+        block_t *p_newblock = block_Writable( p_block );
+        if( unlikely(!p_newblock) )
+        {
+            free( p_list );
+            return NULL;
+        }
+        p_block = p_newblock;
         p_source = p_dest = p_block->p_buffer;
         p_sourceend = &p_block->p_buffer[p_block->i_buffer];
     }
@@ -157,6 +166,13 @@ block_t *hxxx_AnnexB_to_xVC( block_t *p_block, uint8_t i_nal_length_size )
     if(!p_dest)
         goto error;
 
+    /* A shared payload was copied: NAL pointers refer to the former one */
+    if( p_source != p_former )
+    {
+        for( unsigned i = 0; i < i_nalcount; i++ )
+            p_list[i].p = p_source + (p_list[i].p - p_former);
+    }
+
     /* Do reverse order moves, so we never overlap when growing only */
     for( unsigned i=i_nalcount; i!=0; i-- )
     {
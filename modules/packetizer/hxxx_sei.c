@@ -39,15 +39,13 @@ void HxxxParseSEI(const uint8_t *p_buf, size_t i_buf,
                   uint8_t i_header, pf_hxxx_sei_callback pf_callback, void *cbdata)
 {
     bs_t s;
-    unsigned i_bitflow = 0;
     bool b_continue = true;
 
     if( i_buf <= i_header )
         return;
 
     bs_init( &s, &p_buf[i_header], i_buf - i_header ); /* skip nal unit header */
-    s.p_fwpriv = &i_bitflow;
-    s.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */
+    s.b_ep3b = true;  /* Does the emulated 3bytes conversion to rbsp */
 
     while( bs_remain( &s ) >= 8 && bs_aligned( &s ) && b_continue )
     {
@@ -438,7 +438,6 @@ static block_t *ParseIDU( decoder_t *p_dec, bool *pb_ts_used, block_t *p_frag )
     {
         es_format_t *p_es = &p_dec->fmt_out;
         bs_t s;
-        unsigned i_bitflow = 0;
         int i_profile;
 
         /* */
@@ -474,8 +473,7 @@ static block_t *ParseIDU( decoder_t *p_dec, bool *pb_ts_used, block_t *p_frag )
 
         /* Parse it */
         bs_init( &s, &p_frag->p_buffer[4], p_frag->i_buffer - 4 );
-        s.p_fwpriv = &i_bitflow;
-        s.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */
+        s.b_ep3b = true;  /* Does the emulated 3bytes conversion to rbsp */
 
         i_profile = bs_read( &s, 2 );
         if( i_profile == 3 )
@@ -615,12 +613,10 @@ static block_t *ParseIDU( decoder_t *p_dec, bool *pb_ts_used, block_t *p_frag )
     else if( idu == IDU_TYPE_FRAME )
     {
         bs_t s;
-        unsigned i_bitflow = 0;
 
         /* Parse it + interpolate pts/dts if possible */
         bs_init( &s, &p_frag->p_buffer[4], p_frag->i_buffer - 4 );
-        s.p_fwpriv = &i_bitflow;
-        s.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */
+        s.b_ep3b = true;  /* Does the emulated 3bytes conversion to rbsp */
 
         if( p_sys->sh.b_advanced_profile )
         {
@@ -694,11 +690,9 @@ static block_t *ParseIDU( decoder_t *p_dec, bool *pb_ts_used, block_t *p_frag )
     else if( idu == IDU_TYPE_FRAME_USER_DATA )
     {
         bs_t s;
-        unsigned i_bitflow = 0;
         const size_t i_size = p_frag->i_buffer - 4;
         bs_init( &s, &p_frag->p_buffer[4], i_size );
-        s.p_fwpriv = &i_bitflow;
-        s.pf_forward = hxxx_bsfw_ep3b_to_rbsp;  /* Does the emulated 3bytes conversion to rbsp */
+        s.b_ep3b = true;  /* Does the emulated 3bytes conversion to rbsp */
 
         unsigned i_data;
         uint8_t *p_data = malloc( i_size );
@@ -40,15 +40,17 @@
  * Complex scheme using mutliple track to avoid seeking
  */
 
-/* How many tracks we have, currently only used for stream mode */
+/* Memory budget for all tracks, and how many tracks we start with and have
+ * at most (more tracks help demuxers seeking back and forth, e.g. MP4 or MKV
+ * files with badly interleaved tracks) */
 #ifdef OPTIMIZE_MEMORY
-#   define STREAM_CACHE_TRACK 1
-    /* Max size of our cache 128Ko per track */
-#   define STREAM_CACHE_SIZE  (STREAM_CACHE_TRACK*1024*128)
+#   define STREAM_CACHE_SIZE      (1024*128)
+#   define STREAM_CACHE_TRACK     1
+#   define STREAM_CACHE_TRACK_MAX 1
 #else
-#   define STREAM_CACHE_TRACK 3
-    /* Max size of our cache 4Mo per track */
-#   define STREAM_CACHE_SIZE  (4*STREAM_CACHE_TRACK*1024*1024)
+#   define STREAM_CACHE_SIZE      (12*1024*1024)
+#   define STREAM_CACHE_TRACK     3
+#   define STREAM_CACHE_TRACK_MAX 16
 #endif
 
 /* How many data we try to prebuffer
@@ -62,23 +64,34 @@
  *      yes: switch to it, seek the access to match the end of the ring
  *      no: search the ring with i_end the closer to i_pos,
  *          if close enough, read data and use this ring
- *          else use the oldest ring, seek and use it.
+ *          else use the least recently used ring, seek and use it.
+ *  - Rings evicted recently are remembered. If the demuxer comes back to
+ *    one of them, there are too few rings for its seeking pattern, and a new
+ *    ring is added if the memory budget permits.
+ *  - The size of (re)started rings follows the average amount of data read
+ *    between two seeks, so that seeking demuxers get more, smaller rings.
+ *  - The read size follows the measured access throughput, bounded by the
+ *    average amount of data read between two seeks.
  *
  *  TODO: - with access non seekable: use all space available for only one ring, but
  *          we have to support seekable/non-seekable switch on the fly.
- *        - compute a good value for i_read_size
  *        - ?
  */
 #define STREAM_READ_ATONCE 1024
+#define STREAM_READ_ATONCE_MAX (128*1024)
+/* Target duration of a single read from the access */
+#define STREAM_READ_DURATION (CLOCK_FREQ/50)
 #define STREAM_CACHE_TRACK_SIZE (STREAM_CACHE_SIZE/STREAM_CACHE_TRACK)
+#define STREAM_CACHE_TRACK_SIZE_MIN (STREAM_CACHE_SIZE/STREAM_CACHE_TRACK_MAX)
 
 typedef struct
 {
-    mtime_t date;
+    uint64_t date; /* Last use (LRU stamp) */
 
     uint64_t i_start;
     uint64_t i_end;
 
+    size_t   i_size; /* Ring buffer size */
     uint8_t *p_buffer;
 
 } stream_track_t;
@@ -89,10 +102,23 @@ struct stream_sys_t
 
     unsigned     i_offset;   /* Buffer offset in the current track */
     int          i_tk;       /* Current track */
-    stream_track_t tk[STREAM_CACHE_TRACK];
+    int          i_tk_count; /* Tracks in use */
+    stream_track_t tk[STREAM_CACHE_TRACK_MAX];
+    size_t       i_tk_size;  /* Size of new tracks */
+    size_t       i_cache_size; /* Allocated track buffers */
+    uint64_t     i_date;
 
-    /* Global buffer */
-    uint8_t     *p_buffer;
+    /* Recently evicted tracks */
+    struct
+    {
+        uint64_t i_start;
+        uint64_t i_end;
+    } ghost[STREAM_CACHE_TRACK_MAX];
+    unsigned     i_ghost;
+
+    /* Seek pattern */
+    uint64_t     i_run_start; /* Offset of the last seek */
+    uint64_t     i_run_avg;   /* Average data read between seeks */
 
     /* */
     unsigned     i_used; /* Used since last read */
@@ -104,9 +130,114 @@ struct stream_sys_t
         uint64_t i_read_count;
         uint64_t i_bytes;
         uint64_t i_read_time;
+        uint64_t i_seek_count;
     } stat;
 };
 
+/* Computes the read size from the access throughput and the seek pattern */
+static void AStreamUpdateReadSize(stream_t *s)
+{
+    stream_sys_t *sys = s->p_sys;
+    uint64_t i_size = STREAM_READ_ATONCE_MAX;
+
+    /* Do not block the demuxer for too long on slow accesses */
+    if (sys->stat.i_read_time > 0)
+        i_size = sys->stat.i_bytes * STREAM_READ_DURATION
+                 / sys->stat.i_read_time;
+
+    /* Do not read much more than is used before the next seek */
+    if (sys->i_run_avg > 0 && i_size > sys->i_run_avg)
+        i_size = sys->i_run_avg;
+
+    sys->i_read_size = VLC_CLIP(i_size, STREAM_READ_ATONCE,
+                                STREAM_READ_ATONCE_MAX);
+}
+
+/* Accounts for a discontinuity in the reading offset */
+static void AStreamUpdateSeekPattern(stream_t *s, uint64_t i_pos)
+{
+    stream_sys_t *sys = s->p_sys;
+    uint64_t i_run = sys->i_pos - sys->i_run_start;
+
+    if (sys->i_run_avg == 0)
+        sys->i_run_avg = i_run;
+    else
+        sys->i_run_avg = (3 * sys->i_run_avg + i_run) / 4;
+    sys->i_run_start = i_pos;
+    sys->stat.i_seek_count++;
+
+    /* Tracks a few times bigger than the runs, rounded up to 64 KiB */
+    uint64_t i_size = (4 * sys->i_run_avg + 0xffff) & ~UINT64_C(0xffff);
+    sys->i_tk_size = VLC_CLIP(i_size, STREAM_CACHE_TRACK_SIZE_MIN,
+                              STREAM_CACHE_TRACK_SIZE);
+    AStreamUpdateReadSize(s);
+}
+
+/* (Re)allocates the buffer of a track with the current track size */
+static int AStreamTrackAlloc(stream_t *s, stream_track_t *tk, size_t i_size)
+{
+    stream_sys_t *sys = s->p_sys;
+
+    if (tk->p_buffer != NULL && tk->i_size == i_size)
+        return VLC_SUCCESS;
+    if (sys->i_cache_size - tk->i_size + i_size > STREAM_CACHE_SIZE)
+        return VLC_EGENERIC;
+
+    uint8_t *p_buffer = malloc(i_size);
+    if (unlikely(p_buffer == NULL))
+        return VLC_ENOMEM;
+
+    free(tk->p_buffer);
+    sys->i_cache_size += i_size - tk->i_size;
+    tk->p_buffer = p_buffer;
+    tk->i_size = i_size;
+    tk->i_start = tk->i_end = 0;
+    return VLC_SUCCESS;
+}
+
+/* Picks a track to restart at the given offset */
+static int AStreamTrackEvict(stream_t *s, uint64_t i_pos)
+{
+    stream_sys_t *sys = s->p_sys;
+    bool b_ghost = false;
+
+    for (unsigned i = 0; i < STREAM_CACHE_TRACK_MAX; i++)
+        if (sys->ghost[i].i_start <= i_pos && i_pos < sys->ghost[i].i_end)
+        {
+            sys->ghost[i].i_start = sys->ghost[i].i_end = 0;
+            b_ghost = true;
+            break;
+        }
+
+    /* The data was recently evicted: add a track if possible */
+    if (b_ghost && sys->i_tk_count < STREAM_CACHE_TRACK_MAX)
+    {
+        stream_track_t *tk = &sys->tk[sys->i_tk_count];
+
+        if (AStreamTrackAlloc(s, tk, sys->i_tk_size) == VLC_SUCCESS)
+        {
+            msg_Dbg(s, "using %d tracks of %zu bytes", sys->i_tk_count + 1,
+                    sys->i_tk_size);
+            return sys->i_tk_count++;
+        }
+    }
+
+    /* Use the least recently used */
+    int i_tk_idx = 0;
+    for (int i = 1; i < sys->i_tk_count; i++)
+        if (sys->tk[i].date < sys->tk[i_tk_idx].date)
+            i_tk_idx = i;
+
+    stream_track_t *tk = &sys->tk[i_tk_idx];
+    if (tk->i_start < tk->i_end)
+    {
+        sys->ghost[sys->i_ghost].i_start = tk->i_start;
+        sys->ghost[sys->i_ghost].i_end = tk->i_end;
+        sys->i_ghost = (sys->i_ghost + 1) % STREAM_CACHE_TRACK_MAX;
+    }
+    return i_tk_idx;
+}
+
 static int AStreamRefillStream(stream_t *s)
 {
     stream_sys_t *sys = s->p_sys;
@@ -114,7 +245,7 @@ static int AStreamRefillStream(stream_t *s)
 
     /* We read but won't increase i_start after initial start + offset */
     int i_toread =
-        __MIN(sys->i_used, STREAM_CACHE_TRACK_SIZE -
+        __MIN(sys->i_used, tk->i_size -
                (tk->i_end - tk->i_start - sys->i_offset));
 
     if (i_toread <= 0) return VLC_SUCCESS; /* EOF */
@@ -127,13 +258,13 @@ static int AStreamRefillStream(stream_t *s)
     mtime_t start = mdate();
     while (i_toread > 0)
     {
-        int i_off = tk->i_end % STREAM_CACHE_TRACK_SIZE;
+        int i_off = tk->i_end % tk->i_size;
         int i_read;
 
         if (vlc_killed())
             return VLC_EGENERIC;
 
-        i_read = __MIN(i_toread, STREAM_CACHE_TRACK_SIZE - i_off);
+        i_read = __MIN((size_t)i_toread, tk->i_size - i_off);
         i_read = vlc_stream_Read(s->p_source, &tk->p_buffer[i_off], i_read);
 
         /* msg_Dbg(s, "AStreamRefillStream: read=%d", i_read); */
@@ -142,15 +273,15 @@ static int AStreamRefillStream(stream_t *s)
             continue;
         }
         else if (i_read == 0)
-            return VLC_SUCCESS;
+            break;
 
         /* Update end */
         tk->i_end += i_read;
 
-        /* Windows of STREAM_CACHE_TRACK_SIZE */
-        if (tk->i_start + STREAM_CACHE_TRACK_SIZE < tk->i_end)
+        /* Windows of the track size */
+        if (tk->i_start + tk->i_size < tk->i_end)
         {
-            unsigned i_invalid = tk->i_end - tk->i_start - STREAM_CACHE_TRACK_SIZE;
+            unsigned i_invalid = tk->i_end - tk->i_start - tk->i_size;
 
             tk->i_start += i_invalid;
             sys->i_offset -= i_invalid;
@@ -164,6 +295,7 @@ static int AStreamRefillStream(stream_t *s)
     }
 
     sys->stat.i_read_time += mdate() - start;
+    AStreamUpdateReadSize(s);
     return VLC_SUCCESS;
 }
 
@@ -198,7 +330,7 @@ static void AStreamPrebufferStream(stream_t *s)
             break;
         }
 
-        i_read = STREAM_CACHE_TRACK_SIZE - i_buffered;
+        i_read = tk->i_size - i_buffered;
         i_read = __MIN((int)sys->i_read_size, i_read);
         i_read = vlc_stream_Read(s->p_source, &tk->p_buffer[i_buffered],
                                  i_read);
@@ -233,13 +365,18 @@ static void AStreamControlReset(stream_t *s)
     sys->i_tk     = 0;
     sys->i_used   = 0;
 
-    for (unsigned i = 0; i < STREAM_CACHE_TRACK; i++)
+    sys->i_run_start = 0;
+
+    for (int i = 0; i < sys->i_tk_count; i++)
     {
         sys->tk[i].date  = 0;
         sys->tk[i].i_start = sys->i_pos;
         sys->tk[i].i_end   = sys->i_pos;
     }
 
+    for (unsigned i = 0; i < STREAM_CACHE_TRACK_MAX; i++)
+        sys->ghost[i].i_start = sys->ghost[i].i_end = 0;
+
     /* Do the prebuffering */
     AStreamPrebufferStream(s);
 }
@@ -258,9 +395,9 @@ static ssize_t AStreamReadNoSeekStream(stream_t *s, void *buf, size_t len)
             tk->i_start, sys->i_offset, tk->i_end);
 #endif
 
-    unsigned i_off = (tk->i_start + sys->i_offset) % STREAM_CACHE_TRACK_SIZE;
+    unsigned i_off = (tk->i_start + sys->i_offset) % tk->i_size;
     size_t i_current = __MIN(tk->i_end - tk->i_start - sys->i_offset,
-                             STREAM_CACHE_TRACK_SIZE - i_off);
+                             tk->i_size - i_off);
     ssize_t i_copy = __MIN(i_current, len);
     if (i_copy <= 0)
         return 0; /* EOF */
@@ -280,8 +417,8 @@ static ssize_t AStreamReadNoSeekStream(stream_t *s, void *buf, size_t len)
     if (tk->i_end + i_copy <= tk->i_start + sys->i_offset + len)
     {
         const size_t i_read_requested = VLC_CLIP(len - i_copy,
-                                                 STREAM_READ_ATONCE / 2,
-                                                 STREAM_READ_ATONCE * 10);
+                                                 sys->i_read_size / 2,
+                                                 sys->i_read_size * 10);
         if (sys->i_used < i_read_requested)
             sys->i_used = i_read_requested;
 
@@ -324,8 +461,12 @@ static int AStreamSeekStream(stream_t *s, uint64_t i_pos)
     else
         i_skip_threshold = INT64_MAX;
 
+    /* Learn the seek pattern, short forward skips excluded */
+    if (i_pos < sys->i_pos || i_pos > sys->i_pos + i_skip_threshold)
+        AStreamUpdateSeekPattern(s, i_pos);
+
     /* Date the current track */
-    p_current->date = mdate();
+    p_current->date = ++sys->i_date;
 
     /* Search a new track slot */
     stream_track_t *tk = NULL;
@@ -340,7 +481,7 @@ static int AStreamSeekStream(stream_t *s, uint64_t i_pos)
     if (!tk)
     {
         /* Try to maximize already read data */
-        for (int i = 0; i < STREAM_CACHE_TRACK; i++)
+        for (int i = 0; i < sys->i_tk_count; i++)
         {
             stream_track_t *t = &sys->tk[i];
 
@@ -356,19 +497,10 @@ static int AStreamSeekStream(stream_t *s, uint64_t i_pos)
     }
     if (!tk)
     {
-        /* Use the oldest unused */
-        for (int i = 0; i < STREAM_CACHE_TRACK; i++)
-        {
-            stream_track_t *t = &sys->tk[i];
-
-            if (!tk || tk->date > t->date)
-            {
-                tk = t;
-                i_tk_idx = i;
-            }
-        }
+        i_tk_idx = AStreamTrackEvict(s, i_pos);
+        tk = &sys->tk[i_tk_idx];
     }
-    assert(i_tk_idx >= 0 && i_tk_idx < STREAM_CACHE_TRACK);
+    assert(i_tk_idx >= 0 && i_tk_idx < sys->i_tk_count);
 
     if (tk != p_current)
         i_skip_threshold = 0;
@@ -398,7 +530,7 @@ static int AStreamSeekStream(stream_t *s, uint64_t i_pos)
             uint64_t i_skip = i_pos - tk->i_end;
             while (i_skip > 0)
             {
-                const int i_read_max = __MIN(10 * STREAM_READ_ATONCE, i_skip);
+                const int i_read_max = __MIN(10 * sys->i_read_size, i_skip);
                 int i_read = 0;
                 if ((i_read = AStreamReadNoSeekStream(s, NULL, i_read_max)) < 0)
                 {
@@ -406,7 +538,7 @@ static int AStreamSeekStream(stream_t *s, uint64_t i_pos)
                     return VLC_EGENERIC;
                 } else if (i_read == 0)
                     return VLC_SUCCESS; /* EOF */
-                i_skip -= i_read_max;
+                i_skip -= i_read;
             }
         }
     }
@@ -422,6 +554,8 @@ static int AStreamSeekStream(stream_t *s, uint64_t i_pos)
             return VLC_EGENERIC;
         }
 
+        /* Follow the seek pattern (keep the old buffer on failure) */
+        AStreamTrackAlloc(s, tk, sys->i_tk_size);
         tk->i_start = i_pos;
         tk->i_end   = i_pos;
     }
@@ -436,8 +570,8 @@ static int AStreamSeekStream(stream_t *s, uint64_t i_pos)
      */
     if (tk->i_end < tk->i_start + sys->i_offset + sys->i_read_size)
     {
-        if (sys->i_used < STREAM_READ_ATONCE / 2)
-            sys->i_used = STREAM_READ_ATONCE / 2;
+        if (sys->i_used < sys->i_read_size / 2)
+            sys->i_used = sys->i_read_size / 2;
 
         if (AStreamRefillStream(s))
             return VLC_EGENERIC;
@@ -521,50 +655,62 @@ static int Open(vlc_object_t *obj)
     sys->stat.i_bytes = 0;
     sys->stat.i_read_time = 0;
     sys->stat.i_read_count = 0;
+    sys->stat.i_seek_count = 0;
 
     msg_Dbg(s, "Using stream method for AStream*");
 
     /* Allocate/Setup our tracks */
     sys->i_offset = 0;
     sys->i_tk     = 0;
-    sys->p_buffer = malloc(STREAM_CACHE_SIZE);
-    if (sys->p_buffer == NULL)
+    sys->i_tk_count = STREAM_CACHE_TRACK;
+    sys->i_tk_size = STREAM_CACHE_TRACK_SIZE;
+    sys->i_cache_size = 0;
+    sys->i_date = 0;
+    sys->i_ghost = 0;
+    sys->i_run_start = 0;
+    sys->i_run_avg = 0;
+
+    for (unsigned i = 0; i < STREAM_CACHE_TRACK_MAX; i++)
     {
-        free(sys);
-        return VLC_ENOMEM;
+        sys->tk[i].date  = 0;
+        sys->tk[i].i_start = sys->i_pos;
+        sys->tk[i].i_end   = sys->i_pos;
+        sys->tk[i].i_size  = 0;
+        sys->tk[i].p_buffer = NULL;
+        sys->ghost[i].i_start = sys->ghost[i].i_end = 0;
     }
 
+    s->p_sys = sys;
+
+    for (int i = 0; i < sys->i_tk_count; i++)
+        if (AStreamTrackAlloc(s, &sys->tk[i], sys->i_tk_size))
+            goto error;
+
     sys->i_used   = 0;
     sys->i_read_size = STREAM_READ_ATONCE;
 #if STREAM_READ_ATONCE < 256
 #   error "Invalid STREAM_READ_ATONCE value"
 #endif
 
-    for (unsigned i = 0; i < STREAM_CACHE_TRACK; i++)
-    {
-        sys->tk[i].date  = 0;
-        sys->tk[i].i_start = sys->i_pos;
-        sys->tk[i].i_end   = sys->i_pos;
-        sys->tk[i].p_buffer = &sys->p_buffer[i * STREAM_CACHE_TRACK_SIZE];
-    }
-
-    s->p_sys = sys;
-
     /* Do the prebuffering */
     AStreamPrebufferStream(s);
 
     if (sys->tk[sys->i_tk].i_end <= 0)
     {
         msg_Err(s, "cannot pre fill buffer");
-        free(sys->p_buffer);
-        free(sys);
-        return VLC_EGENERIC;
+        goto error;
     }
 
     s->pf_read = AStreamReadStream;
     s->pf_seek = AStreamSeekStream;
     s->pf_control = AStreamControl;
     return VLC_SUCCESS;
+
+error:
+    for (int i = 0; i < sys->i_tk_count; i++)
+        free(sys->tk[i].p_buffer);
+    free(sys);
+    return VLC_EGENERIC;
 }
 
 /****************************************************************************
@@ -575,7 +721,12 @@ static void Close(vlc_object_t *obj)
     stream_t *s = (stream_t *)obj;
     stream_sys_t *sys = s->p_sys;
 
-    free(sys->p_buffer);
+    msg_Dbg(s, "%"PRIu64" bytes in %"PRIu64" reads, %"PRIu64" seeks, "
+            "%d tracks", sys->stat.i_bytes, sys->stat.i_read_count,
+            sys->stat.i_seek_count, sys->i_tk_count);
+
+    for (int i = 0; i < sys->i_tk_count; i++)
+        free(sys->tk[i].p_buffer);
     free(sys);
 }
 
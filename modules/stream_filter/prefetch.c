@@ -28,12 +28,40 @@
 
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_stream.h>
 #include <vlc_fs.h>
 #include <vlc_interrupt.h>
+#include <vlc_atomic.h>
+
+/**
+ * Buffer chunk.
+ *
+ * The prefetch buffer is a ring of fixed-size chunks. Chunk k covers the
+ * stream offsets [k * chunk_size, (k + 1) * chunk_size) and lives in slot
+ * (k % chunk_count) of the ring. Chunks are reference counted so that
+ * Block() can hand them out without copying.
+ */
+typedef struct
+{
+    atomic_uint    refs;
+    uint64_t       index; /**< chunk number, or UINT64_MAX if stale */
+    size_t         size;
+    unsigned char *data;
+} prefetch_chunk_t;
+
+#define CHUNK_SIZE (256 << 10)
+
+typedef struct
+{
+    block_t           self;
+    prefetch_chunk_t *chunk;
+} prefetch_slice_t;
 
 struct stream_sys_t
 {
@@ -46,6 +74,7 @@ struct stream_sys_t
     bool         eof;
     bool         error;
     bool         paused;
+    bool         reset;
 
     bool         can_seek;
     bool         can_pace;
@@ -54,15 +83,77 @@ struct stream_sys_t
     int64_t      pts_delay;
     char        *content_type;
 
+    /* The reader thread only ever reads the data between stream_offset and
+     * buffer_end, so it does not need to lock against the prefetch thread.
+     * buffer_end is only written (with the lock held) by the prefetch thread,
+     * and by Seek() when dropping the buffered data. */
     uint64_t     buffer_offset;
-    uint64_t     stream_offset;
-    size_t       buffer_length;
+    atomic_ullong buffer_end;
+    atomic_ullong stream_offset;
+    atomic_ullong wake_offset; /**< reader offset to wake up the thread at */
+    uint64_t     slice_end; /**< end of the data handed out by Block() */
+    unsigned     generation;
+
+    prefetch_chunk_t **chunks;
+    unsigned     chunk_count;
+    size_t       chunk_size;
     size_t       buffer_size;
-    char        *buffer;
     size_t       read_size;
     size_t       seek_threshold;
+
+    /* Read-ahead estimation (prefetch thread only) */
+    mtime_t      readahead;
+    mtime_t      rate_date;
+    uint64_t     rate_offset;
+    uint64_t     rate;
 };
 
+static prefetch_chunk_t *ChunkNew(size_t size)
+{
+    prefetch_chunk_t *chunk = malloc(sizeof (*chunk));
+    if (unlikely(chunk == NULL))
+        return NULL;
+
+#ifdef HAVE_MMAP
+    chunk->data = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (chunk->data == MAP_FAILED)
+#else
+    chunk->data = malloc(size);
+    if (chunk->data == NULL)
+#endif
+    {
+        free(chunk);
+        return NULL;
+    }
+
+    atomic_init(&chunk->refs, 1);
+    chunk->index = UINT64_MAX;
+    chunk->size = size;
+    return chunk;
+}
+
+static void ChunkRelease(prefetch_chunk_t *chunk)
+{
+    if (atomic_fetch_sub_explicit(&chunk->refs, 1, memory_order_acq_rel) > 1)
+        return;
+
+#ifdef HAVE_MMAP
+    munmap(chunk->data, chunk->size);
+#else
+    free(chunk->data);
+#endif
+    free(chunk);
+}
+
+static void SliceRelease(block_t *block)
+{
+    prefetch_slice_t *slice = (prefetch_slice_t *)block;
+
+    ChunkRelease(slice->chunk);
+    free(slice);
+}
+
 static ssize_t ThreadRead(stream_t *stream, void *buf, size_t length)
 {
     stream_sys_t *sys = stream->p_sys;
@@ -114,13 +205,97 @@ static int ThreadControl(stream_t *stream, int query, ...)
     return ret;
 }
 
-#define MAX_READ 65536
-#define SEEK_THRESHOLD MAX_READ
+/**
+ * Waits until the reader thread reaches the given offset.
+ */
+static void ThreadWaitReader(stream_t *stream, uint64_t offset)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    /* The reader stores its offset before it checks wake_offset, and we store
+     * wake_offset before we check the reader offset. Either way, one side
+     * sees the other, and the wake-up cannot be lost. */
+    atomic_store(&sys->wake_offset, offset);
+    if (atomic_load(&sys->stream_offset) < offset)
+        vlc_cond_wait(&sys->wait_space, &sys->lock);
+    atomic_store(&sys->wake_offset, UINT64_MAX);
+}
+
+/**
+ * Drops the buffered data after a reset.
+ *
+ * Chunks still referenced by blocks are detached from the ring, as they
+ * cannot be overwritten. The others are kept for reuse.
+ */
+static void ThreadReset(stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    for (unsigned i = 0; i < sys->chunk_count; i++)
+    {
+        prefetch_chunk_t *chunk = sys->chunks[i];
+
+        if (chunk == NULL)
+            continue;
+        if (atomic_load_explicit(&chunk->refs, memory_order_acquire) > 1)
+        {
+            ChunkRelease(chunk);
+            sys->chunks[i] = NULL;
+        }
+        else
+            chunk->index = UINT64_MAX;
+    }
+
+    sys->rate_date = VLC_TS_INVALID;
+}
+
+/**
+ * Computes the read-ahead target from the rate the reader consumes data at.
+ */
+static uint64_t ThreadReadAhead(stream_t *stream, uint64_t offset)
+{
+    stream_sys_t *sys = stream->p_sys;
+    uint64_t capacity = (uint64_t)sys->chunk_count * sys->chunk_size;
+    uint64_t low = 2 * sys->chunk_size;
+    mtime_t now = mdate();
+
+    if (low < sys->read_size)
+        low = sys->read_size;
+    if (low > capacity)
+        low = capacity;
+
+    if (sys->rate_date == VLC_TS_INVALID || offset < sys->rate_offset)
+    {   /* (Re)start the measurement */
+        sys->rate_date = now;
+        sys->rate_offset = offset;
+    }
+    else if (now - sys->rate_date >= CLOCK_FREQ / 10)
+    {
+        uint64_t rate = (offset - sys->rate_offset) * CLOCK_FREQ
+                        / (now - sys->rate_date);
+
+        /* Exponentially weighted moving average of the reading rate */
+        if (sys->rate == 0)
+            sys->rate = rate;
+        else
+            sys->rate = (7 * sys->rate + rate) / 8;
+        sys->rate_date = now;
+        sys->rate_offset = offset;
+    }
+
+    uint64_t target = sys->rate * sys->readahead / CLOCK_FREQ;
+    if (target < low)
+        target = low;
+    if (target > capacity)
+        target = capacity;
+    return target;
+}
 
 static void *Thread(void *data)
 {
     stream_t *stream = data;
     stream_sys_t *sys = stream->p_sys;
+    size_t chunk_size = sys->chunk_size;
     bool paused = false;
 
     vlc_interrupt_set(sys->interrupt);
@@ -134,6 +309,7 @@ static void *Thread(void *data)
             msg_Dbg(stream, paused ? "resuming" : "pausing");
             paused = sys->paused;
             ThreadControl(stream, STREAM_SET_PAUSE_STATE, paused);
+            sys->rate_date = VLC_TS_INVALID;
             continue;
         }
 
@@ -143,18 +319,16 @@ static void *Thread(void *data)
             continue;
         }
 
-        uint_fast64_t stream_offset = sys->stream_offset;
+        if (sys->reset)
+        {   /* The reader seeked outside of the buffer */
+            unsigned generation = sys->generation;
+            uint64_t seek_offset = sys->buffer_offset;
 
-        if (stream_offset < sys->buffer_offset)
-        {   /* Need to seek backward */
-            if (ThreadSeek(stream, stream_offset) == 0)
-            {
-                sys->buffer_offset = stream_offset;
-                sys->buffer_length = 0;
-                assert(!sys->error);
-                sys->eof = false;
-            }
-            else
+            sys->reset = false;
+            ThreadReset(stream);
+
+            if (ThreadSeek(stream, seek_offset) != 0
+             && generation == sys->generation)
             {
                 sys->error = true;
                 vlc_cond_signal(&sys->wait_data);
@@ -168,76 +342,71 @@ static void *Thread(void *data)
             continue;
         }
 
-        assert(stream_offset >= sys->buffer_offset);
+        uint64_t end = atomic_load_explicit(&sys->buffer_end,
+                                            memory_order_relaxed);
+        uint64_t offset = atomic_load(&sys->stream_offset);
+        uint64_t target = ThreadReadAhead(stream, offset);
 
-        /* As long as there is space, the buffer will retain already read
-         * ("historical") data. The data can be used if/when seeking backward.
-         * Unread data is however given precedence if the buffer is full. */
-        uint64_t history = stream_offset - sys->buffer_offset;
-
-        /* If upstream supports seeking and if the downstream offset is far
-         * beyond the upstream offset, then attempt to skip forward.
-         * If it fails, assume upstream is well-behaved such that the failed
-         * seek is a no-op, and continue as if seeking was not supported.
-         * WARNING: Except problems with misbehaving access plug-ins. */
-        if (sys->can_seek
-         && history >= (sys->buffer_length + sys->seek_threshold))
-        {
-            if (ThreadSeek(stream, stream_offset) == 0)
-            {
-                sys->buffer_offset = stream_offset;
-                sys->buffer_length = 0;
-                assert(!sys->error);
-                assert(!sys->eof);
-            }
-            else
-            {   /* Seek failure is not necessarily fatal here. We could read
-                 * data instead until the desired seek offset. But in practice,
-                 * not all upstream accesses handle reads after failed seek
-                 * correctly. Furthermore, sys->stream_offset and/or
-                 * sys->paused might have changed in the mean time. */
-                sys->error = true;
-                vlc_cond_signal(&sys->wait_data);
-            }
+        if (end >= offset + target)
+        {   /* Enough data is buffered. Wait until half of it is consumed. */
+            ThreadWaitReader(stream, end - target / 2);
             continue;
         }
 
-        assert(sys->buffer_size >= sys->buffer_length);
+        uint64_t index = end / chunk_size;
+        unsigned slot = index % sys->chunk_count;
+        prefetch_chunk_t *chunk = sys->chunks[slot];
 
-        size_t len = sys->buffer_size - sys->buffer_length;
-        if (len == 0)
-        {   /* Buffer is full */
-            if (history == 0)
-            {   /* Wait for data to be read */
-                vlc_cond_wait(&sys->wait_space, &sys->lock);
-                continue;
+        if (chunk == NULL || chunk->index != index)
+        {   /* Recycle the slot */
+            if (chunk != NULL && chunk->index != UINT64_MAX)
+            {
+                uint64_t chunk_end = (chunk->index + 1) * chunk_size;
+
+                assert(chunk->index < index);
+                if (offset < chunk_end)
+                {   /* Buffer is full: wait for data to be read */
+                    ThreadWaitReader(stream, chunk_end);
+                    continue;
+                }
+
+                /* Discard historical data to make room. */
+                if (sys->buffer_offset < chunk_end)
+                    sys->buffer_offset = chunk_end;
             }
 
-            /* Discard some historical data to make room. */
-            len = history;
-            if (len > sys->read_size)
-                len = sys->read_size;
-
-            assert(len <= sys->buffer_length);
-            sys->buffer_offset += len;
-            sys->buffer_length -= len;
-        }
-        else
-        {   /* Some streams cannot return a short data count and just wait for
-             * all requested data to become available (e.g. regular files). So
-             * we have to limit the data read in a single operation to avoid
-             * blocking for too long. */
-            if (len > sys->read_size)
-                len = sys->read_size;
+            if (chunk == NULL
+             || atomic_load_explicit(&chunk->refs, memory_order_acquire) > 1)
+            {   /* The old chunk is still used by a block: replace it */
+                prefetch_chunk_t *fresh = ChunkNew(chunk_size);
+                if (unlikely(fresh == NULL))
+                {
+                    msg_Err(stream, "cannot allocate buffer");
+                    sys->error = true;
+                    vlc_cond_signal(&sys->wait_data);
+                    continue;
+                }
+
+                if (chunk != NULL)
+                    ChunkRelease(chunk);
+                sys->chunks[slot] = chunk = fresh;
+            }
+            chunk->index = index;
         }
 
-        size_t offset = (sys->buffer_offset + sys->buffer_length)
-                        % sys->buffer_size;
-         /* Do not step past the sharp edge of the circular buffer */
-        if (offset + len > sys->buffer_size)
-            len = sys->buffer_size - offset;
-
-        ssize_t val = ThreadRead(stream, sys->buffer + offset, len);
+        /* Some streams cannot return a short data count and just wait for
+         * all requested data to become available (e.g. regular files). So
+         * we have to limit the data read in a single operation to avoid
+         * blocking for too long. */
+        size_t len = chunk_size - (end % chunk_size);
+        if (len > sys->read_size)
+            len = sys->read_size;
+
+        unsigned generation = sys->generation;
+        ssize_t val = ThreadRead(stream, chunk->data + (end % chunk_size),
+                                 len);
+        if (generation != sys->generation)
+            continue; /* The reader seeked in the mean time */
         if (val < 0)
             continue;
         if (val == 0)
@@ -248,10 +417,8 @@ static void *Thread(void *data)
         }
 
         assert((size_t)val <= len);
-        sys->buffer_length += val;
-        assert(sys->buffer_length <= sys->buffer_size);
-        //msg_Dbg(stream, "buffer: %zu/%zu", sys->buffer_length,
-        //        sys->buffer_size);
+        atomic_store_explicit(&sys->buffer_end, end + val,
+                              memory_order_release);
         vlc_cond_signal(&sys->wait_data);
     }
     vlc_assert_unreachable();
@@ -264,46 +431,66 @@ static int Seek(stream_t *stream, uint64_t offset)
     stream_sys_t *sys = stream->p_sys;
 
     vlc_mutex_lock(&sys->lock);
-    sys->stream_offset = offset;
+
+    uint64_t end = atomic_load_explicit(&sys->buffer_end,
+                                        memory_order_relaxed);
+
+    /* Drop the buffer if the target offset was discarded, if data handed out
+     * by Block() would be read again (the owner may have modified it), or if
+     * the target is far enough ahead to justify seeking upstream. If seeking
+     * fails, assume upstream is well-behaved such that the failed seek is a
+     * no-op. WARNING: Except problems with misbehaving access plug-ins. */
+    if (offset < sys->buffer_offset || offset < sys->slice_end
+     || (sys->can_seek && offset >= end + sys->seek_threshold))
+    {
+        sys->buffer_offset = offset;
+        atomic_store_explicit(&sys->buffer_end, offset, memory_order_relaxed);
+        sys->slice_end = 0;
+        sys->generation++;
+        sys->reset = true;
+        sys->eof = false;
+    }
+
+    atomic_store(&sys->stream_offset, offset);
     sys->error = false;
     vlc_cond_signal(&sys->wait_space);
     vlc_mutex_unlock(&sys->lock);
     return 0;
 }
 
-static size_t BufferLevel(const stream_t *stream, bool *eof)
+/**
+ * Moves the read offset forward within the buffered data.
+ */
+static void Advance(stream_t *stream, uint64_t offset)
 {
     stream_sys_t *sys = stream->p_sys;
 
-    *eof = false;
+    atomic_store(&sys->stream_offset, offset);
 
-    if (sys->stream_offset < sys->buffer_offset)
-        return 0;
-    if ((sys->stream_offset - sys->buffer_offset) >= sys->buffer_length)
+    if (offset >= atomic_load(&sys->wake_offset))
     {
-        *eof = sys->eof;
-        return 0;
+        vlc_mutex_lock(&sys->lock);
+        vlc_cond_signal(&sys->wait_space);
+        vlc_mutex_unlock(&sys->lock);
     }
-    return sys->buffer_offset + sys->buffer_length - sys->stream_offset;
 }
 
-static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
+/**
+ * Waits for data at the read offset.
+ *
+ * \return the number of bytes buffered from the offset onward,
+ * or zero at end of stream or on error
+ */
+static uint64_t WaitData(stream_t *stream, uint64_t offset)
 {
     stream_sys_t *sys = stream->p_sys;
-    size_t copy, offset;
-    bool eof;
+    uint64_t end = atomic_load_explicit(&sys->buffer_end,
+                                        memory_order_acquire);
 
-    if (buflen == 0)
-        return buflen;
+    if (likely(end > offset))
+        return end - offset;
 
     vlc_mutex_lock(&sys->lock);
-    if (buf == NULL)
-    {
-        sys->stream_offset += buflen;
-        copy = buflen;
-        goto out;
-    }
-
     if (sys->paused)
     {
         msg_Err(stream, "reading while paused (buggy demux?)");
@@ -311,36 +498,97 @@ static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
         vlc_cond_signal(&sys->wait_space);
     }
 
-    while ((copy = BufferLevel(stream, &eof)) == 0 && !eof)
+    while ((end = atomic_load_explicit(&sys->buffer_end,
+                                       memory_order_acquire)) <= offset)
     {
         void *data[2];
 
-        if (sys->error)
-        {
-            vlc_mutex_unlock(&sys->lock);
-            return 0;
-        }
+        if (sys->eof || sys->error)
+            break;
 
         vlc_interrupt_forward_start(sys->interrupt, data);
         vlc_cond_wait(&sys->wait_data, &sys->lock);
         vlc_interrupt_forward_stop(data);
     }
+    vlc_mutex_unlock(&sys->lock);
+
+    return (end > offset) ? (end - offset) : 0;
+}
+
+static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
+{
+    stream_sys_t *sys = stream->p_sys;
+    uint64_t offset = atomic_load_explicit(&sys->stream_offset,
+                                           memory_order_relaxed);
+
+    if (buflen == 0)
+        return buflen;
+
+    if (buf == NULL)
+    {
+        Seek(stream, offset + buflen);
+        return buflen;
+    }
+
+    uint64_t avail = WaitData(stream, offset);
+    if (avail == 0)
+        return 0;
 
-    offset = sys->stream_offset % sys->buffer_size;
+    size_t chunk_offset = offset % sys->chunk_size;
+    size_t copy = sys->chunk_size - chunk_offset;
+    /* Do not step past the edge of the chunk */
+    if (copy > avail)
+        copy = avail;
     if (copy > buflen)
         copy = buflen;
-    /* Do not step past the sharp edge of the circular buffer */
-    if (offset + copy > sys->buffer_size)
-        copy = sys->buffer_size - offset;
 
-    memcpy(buf, sys->buffer + offset, copy);
-    sys->stream_offset += copy;
-out:
-    vlc_cond_signal(&sys->wait_space);
-    vlc_mutex_unlock(&sys->lock);
+    const prefetch_chunk_t *chunk =
+        sys->chunks[(offset / sys->chunk_size) % sys->chunk_count];
+
+    assert(chunk->index == offset / sys->chunk_size);
+    memcpy(buf, chunk->data + chunk_offset, copy);
+    Advance(stream, offset + copy);
     return copy;
 }
 
+static block_t *Block(stream_t *stream, bool *restrict eof)
+{
+    stream_sys_t *sys = stream->p_sys;
+    uint64_t offset = atomic_load_explicit(&sys->stream_offset,
+                                           memory_order_relaxed);
+
+    uint64_t avail = WaitData(stream, offset);
+    if (avail == 0)
+    {
+        *eof = true;
+        return NULL;
+    }
+
+    prefetch_slice_t *slice = malloc(sizeof (*slice));
+    if (unlikely(slice == NULL))
+        return NULL;
+
+    size_t chunk_offset = offset % sys->chunk_size;
+    size_t length = sys->chunk_size - chunk_offset;
+    if (length > avail)
+        length = avail;
+
+    prefetch_chunk_t *chunk =
+        sys->chunks[(offset / sys->chunk_size) % sys->chunk_count];
+
+    assert(chunk->index == offset / sys->chunk_size);
+    /* The reference must be visible to the prefetch thread before the
+     * offset moves past the chunk (see Advance()). */
+    atomic_fetch_add_explicit(&chunk->refs, 1, memory_order_relaxed);
+    slice->chunk = chunk;
+    block_Init(&slice->self, chunk->data + chunk_offset, length);
+    slice->self.pf_release = SliceRelease;
+
+    sys->slice_end = offset + length;
+    Advance(stream, offset + length);
+    return &slice->self;
+}
+
 static int ReadDir(stream_t *stream, input_item_node_t *node)
 {
     (void) stream; (void) node;
@@ -418,9 +666,11 @@ static int Open(vlc_object_t *obj)
     /* For local files, the operating system is likely to do a better work at
      * caching/prefetching. Also, prefetching with this module could cause
      * undesirable high load at start-up. Lastly, local files may require
-     * support for title/seekpoint and meta control requests. */
+     * support for title/seekpoint and meta control requests.
+     * Network file systems may be slow all the same, so prefetching can still
+     * be enabled for them. */
     vlc_stream_Control(stream->p_source, STREAM_CAN_FASTSEEK, &fast_seek);
-    if (fast_seek)
+    if (fast_seek && !var_InheritBool(obj, "prefetch-local"))
         return VLC_EGENERIC;
 
     /* PID-filtered streams are not suitable for prefetching, as they would
@@ -436,6 +686,7 @@ static int Open(vlc_object_t *obj)
         return VLC_ENOMEM;
 
     stream->pf_read = Read;
+    stream->pf_block = Block;
     stream->pf_seek = Seek;
     stream->pf_control = Control;
 
@@ -454,12 +705,20 @@ static int Open(vlc_object_t *obj)
     sys->eof = false;
     sys->error = false;
     sys->paused = false;
+    sys->reset = false;
     sys->buffer_offset = 0;
-    sys->stream_offset = 0;
-    sys->buffer_length = 0;
+    atomic_init(&sys->buffer_end, 0);
+    atomic_init(&sys->stream_offset, 0);
+    atomic_init(&sys->wake_offset, UINT64_MAX);
+    sys->slice_end = 0;
+    sys->generation = 0;
     sys->buffer_size = var_InheritInteger(obj, "prefetch-buffer-size") << 10u;
     sys->read_size = var_InheritInteger(obj, "prefetch-read-size");
     sys->seek_threshold = var_InheritInteger(obj, "prefetch-seek-threshold");
+    sys->readahead = var_InheritInteger(obj, "prefetch-readahead") * 1000;
+    sys->rate_date = VLC_TS_INVALID;
+    sys->rate_offset = 0;
+    sys->rate = 0;
 
     uint64_t size = stream_Size(stream->p_source);
     if (size > 0)
@@ -472,8 +731,21 @@ static int Open(vlc_object_t *obj)
     if (sys->buffer_size < sys->read_size)
         sys->buffer_size = sys->read_size;
 
-    sys->buffer = malloc(sys->buffer_size);
-    if (sys->buffer == NULL)
+    /* Split the buffer in at least two chunks, so that the thread can fill
+     * one while the other is being read. */
+    sys->chunk_size = sys->buffer_size / 2;
+    if (sys->chunk_size > CHUNK_SIZE)
+        sys->chunk_size = CHUNK_SIZE;
+    if (sys->chunk_size == 0)
+        sys->chunk_size = 1;
+    sys->chunk_count = (sys->buffer_size + sys->chunk_size - 1)
+                       / sys->chunk_size;
+    if (sys->chunk_count < 2)
+        sys->chunk_count = 2;
+
+    /* Chunks are allocated as they are needed. */
+    sys->chunks = calloc(sys->chunk_count, sizeof (*sys->chunks));
+    if (unlikely(sys->chunks == NULL))
         goto error;
 
     sys->interrupt = vlc_interrupt_create();
@@ -495,15 +767,14 @@ static int Open(vlc_object_t *obj)
         goto error;
     }
 
-    msg_Dbg(stream, "using %zu bytes buffer, %zu bytes read",
-            sys->buffer_size, sys->read_size);
-    stream->pf_read = Read;
+    msg_Dbg(stream, "using %u chunks of %zu bytes, %zu bytes read",
+            sys->chunk_count, sys->chunk_size, sys->read_size);
     stream->pf_readdir = ReadDir;
     stream->pf_control = Control;
     return VLC_SUCCESS;
 
 error:
-    free(sys->buffer);
+    free(sys->chunks);
     free(sys->content_type);
     free(sys);
     return VLC_ENOMEM;
@@ -526,7 +797,11 @@ static void Close (vlc_object_t *obj)
     vlc_cond_destroy(&sys->wait_data);
     vlc_mutex_destroy(&sys->lock);
 
-    free(sys->buffer);
+    /* Chunks still referenced by blocks are freed with the last block. */
+    for (unsigned i = 0; i < sys->chunk_count; i++)
+        if (sys->chunks[i] != NULL)
+            ChunkRelease(sys->chunks[i]);
+    free(sys->chunks);
     free(sys->content_type);
     free(sys);
 }
@@ -548,4 +823,11 @@ vlc_module_begin()
     add_integer("prefetch-seek-threshold", 1 << 14, N_("Seek threshold"),
                 N_("Prefetch forward seek threshold (bytes)"), true)
         change_integer_range(0, UINT64_C(1) << 60)
+    add_integer("prefetch-readahead", 5000, N_("Read-ahead duration"),
+                N_("Prefetch read-ahead at the measured reading rate (ms)"),
+                true)
+        change_integer_range(0, 3600000)
+    add_bool("prefetch-local", false, N_("Prefetch local files"),
+             N_("Also prefetch from sources with fast seeking, such as files "
+                "on network file systems."), true)
 vlc_module_end()
@@ -31,7 +31,14 @@
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_filter.h>
+#include <vlc_cpu.h>
 #include "filter_picture.h"
+#include "blend.h"
+
+#ifdef HAVE_SSE2_INTRINSICS
+# include <emmintrin.h>
+# define BLEND_SSE2 __attribute__ ((__target__ ("sse2")))
+#endif
 
 /*****************************************************************************
  * Module descriptor
@@ -139,7 +146,6 @@ public:
         if (has_alpha)
             data[3] += picture->p[3].i_pitch;
     }
-private:
     pixel *getPointer(unsigned plane, unsigned dx) const
     {
         if (plane == 1 || plane == 2)
@@ -147,6 +153,7 @@ private:
         else
             return (pixel*)&data[plane][(x + dx) /  1 * sizeof(pixel)];
     }
+private:
     uint8_t *data[4];
 };
 
@@ -185,7 +192,6 @@ public:
         if ((y % 2) == 0)
             data[1] += picture->p[1].i_pitch;
     }
-private:
     uint8_t *getPointer(unsigned plane, unsigned dx) const
     {
         if (plane == 0)
@@ -193,6 +199,7 @@ private:
         else
             return &data[plane][(x + dx) / 2 * 2];
     }
+private:
     uint8_t *data[2];
 };
 
@@ -331,11 +338,17 @@ public:
         y++;
         data += picture->p[0].i_pitch;
     }
-private:
     uint8_t *getPointer(unsigned dx) const
     {
         return &data[(x + dx) * bytes];
     }
+    void getOffsets(unsigned *r, unsigned *g, unsigned *b) const
+    {
+        *r = offset_r;
+        *g = offset_g;
+        *b = offset_b;
+    }
+private:
     unsigned offset_r;
     unsigned offset_g;
     unsigned offset_b;
@@ -518,16 +531,291 @@ private:
     G g;
 };
 
-template <class TDst, class TSrc, class TConvert>
+/* A row kernel blends the first pixels of a line at once, and returns how
+ * many it has blended. The remaining ones are blended pixel by pixel. */
+struct rowNone {
+    rowNone(const video_format_t *, const video_format_t *) {}
+    template <class TDst, class TSrc>
+    unsigned operator()(TDst &, const TSrc &, unsigned, int)
+    {
+        return 0;
+    }
+};
+
+#ifdef HAVE_SSE2_INTRINSICS
+/* div255() of 16 bits lanes */
+BLEND_SSE2
+static inline __m128i div255_epi16(__m128i v)
+{
+    v = _mm_add_epi16(_mm_add_epi16(_mm_srli_epi16(v, 8), v),
+                      _mm_set1_epi16(1));
+    return _mm_srli_epi16(v, 8);
+}
+
+/* merge() of 16 bits lanes */
+BLEND_SSE2
+static inline __m128i merge_epi16(__m128i dst, __m128i src, __m128i f)
+{
+    const __m128i nf = _mm_sub_epi16(_mm_set1_epi16(255), f);
+
+    return div255_epi16(_mm_add_epi16(_mm_mullo_epi16(nf, dst),
+                                      _mm_mullo_epi16(src, f)));
+}
+
+/* merge() of 8 bits lanes */
+BLEND_SSE2
+static inline __m128i merge_epu8(__m128i dst, __m128i src, __m128i f)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = merge_epi16(_mm_unpacklo_epi8(dst, zero),
+                                   _mm_unpacklo_epi8(src, zero),
+                                   _mm_unpacklo_epi8(f, zero));
+    const __m128i hi = merge_epi16(_mm_unpackhi_epi8(dst, zero),
+                                   _mm_unpackhi_epi8(src, zero),
+                                   _mm_unpackhi_epi8(f, zero));
+    return _mm_packus_epi16(lo, hi);
+}
+
+/* div255(alpha * a) of 8 bits lanes */
+BLEND_SSE2
+static inline __m128i alpha_epu8(__m128i a, __m128i alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), alpha);
+    const __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), alpha);
+    return _mm_packus_epi16(div255_epi16(lo), div255_epi16(hi));
+}
+
+/* Even (odd = 0) or odd (odd = 1) 8 bits lanes, into 16 bits lanes */
+BLEND_SSE2
+static inline __m128i select_epu8(__m128i v, int odd)
+{
+    return odd ? _mm_srli_epi16(v, 8) : _mm_and_si128(v, _mm_set1_epi16(0xff));
+}
+
+/* Even or odd 16 bits lanes of two vectors, into 16 bits lanes */
+BLEND_SSE2
+static inline __m128i select_epi16(__m128i lo, __m128i hi, int odd)
+{
+    if (odd) {
+        lo = _mm_srli_epi32(lo, 16);
+        hi = _mm_srli_epi32(hi, 16);
+    } else {
+        lo = _mm_and_si128(lo, _mm_set1_epi32(0xffff));
+        hi = _mm_and_si128(hi, _mm_set1_epi32(0xffff));
+    }
+    return _mm_packs_epi32(lo, hi);
+}
+
+/* Column of the first chroma sample of the line (0 or 1), -1 if none */
+template <class TDst>
+static inline int firstFull(const TDst &dst)
+{
+    return dst.isFull(0) ? 0 : dst.isFull(1) ? 1 : -1;
+}
+
+/* 8 bits chroma samples merged into a 4:2:0 planar line */
+BLEND_SSE2
+static inline void mergeChroma420(uint8_t *dst, __m128i src, __m128i f)
+{
+    const __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)dst),
+                                        _mm_setzero_si128());
+    const __m128i v = merge_epi16(d, src, f);
+    _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(v, v));
+}
+
+/* 8 bits chroma samples merged into a 4:2:0 semi-planar line */
+BLEND_SSE2
+static inline void mergeChroma420SP(uint8_t *dst, __m128i u, __m128i v,
+                                    __m128i f, bool swap_uv)
+{
+    const __m128i uv = swap_uv ? _mm_or_si128(v, _mm_slli_epi16(u, 8))
+                               : _mm_or_si128(u, _mm_slli_epi16(v, 8));
+    f = _mm_or_si128(f, _mm_slli_epi16(f, 8));
+    _mm_storeu_si128((__m128i *)dst,
+                     merge_epu8(_mm_loadu_si128((__m128i *)dst), uv, f));
+}
+
+/* YUVA onto 4:2:0 planar or semi-planar 8 bits pictures */
+template <int semi_planar, bool swap_uv>
+struct rowYuvaToYuv420SSE2 {
+    rowYuvaToYuv420SSE2(const video_format_t *, const video_format_t *) {}
+    template <class TDst>
+    BLEND_SSE2
+    unsigned operator()(TDst &dst, const CPictureYUVA &src,
+                        unsigned width, int alpha)
+    {
+        const __m128i va = _mm_set1_epi16(alpha);
+        const int full = firstFull(dst);
+        const unsigned n = width & ~15;
+
+        for (unsigned x = 0; x < n; x += 16) {
+            const __m128i a = alpha_epu8(
+                _mm_loadu_si128((__m128i *)src.getPointer(3, x)), va);
+
+            uint8_t *y = dst.getPointer(0, x);
+            _mm_storeu_si128((__m128i *)y,
+                merge_epu8(_mm_loadu_si128((__m128i *)y),
+                           _mm_loadu_si128((__m128i *)src.getPointer(0, x)),
+                           a));
+            if (full < 0)
+                continue;
+
+            const __m128i fc = select_epu8(a, full);
+            const __m128i u = select_epu8(
+                _mm_loadu_si128((__m128i *)src.getPointer(1, x)), full);
+            const __m128i v = select_epu8(
+                _mm_loadu_si128((__m128i *)src.getPointer(2, x)), full);
+            if (semi_planar) {
+                mergeChroma420SP(dst.getPointer(1, x + full), u, v, fc,
+                                 swap_uv);
+            } else {
+                mergeChroma420(dst.getPointer(1, x + full), u, fc);
+                mergeChroma420(dst.getPointer(2, x + full), v, fc);
+            }
+        }
+        return n;
+    }
+};
+typedef rowYuvaToYuv420SSE2<false, false> rowYuvaToI420SSE2;
+typedef rowYuvaToYuv420SSE2<true,  false> rowYuvaToNV12SSE2;
+typedef rowYuvaToYuv420SSE2<true,  true>  rowYuvaToNV21SSE2;
+
+/* 4 RGBA pixels split into 32 bits lanes */
+BLEND_SSE2
+static inline void splitRgba(const uint8_t *p, __m128i *r, __m128i *g,
+                             __m128i *b, __m128i *a)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+
+    *r = _mm_and_si128(v, mask);
+    *g = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+    *b = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+    *a = _mm_srli_epi32(v, 24);
+}
+
+/* RGBA onto 4:2:0 planar 8 bits pictures, converted as by rgb_to_yuv() */
+struct rowRgbaToI420SSE2 {
+    rowRgbaToI420SSE2(const video_format_t *, const video_format_t *) {}
+    template <class TDst>
+    BLEND_SSE2
+    unsigned operator()(TDst &dst, const CPictureRGBA &src,
+                        unsigned width, int alpha)
+    {
+        const __m128i va = _mm_set1_epi16(alpha);
+        const __m128i round = _mm_set1_epi16(128);
+        const int full = firstFull(dst);
+        const unsigned n = width & ~15;
+
+        for (unsigned x = 0; x < n; x += 16) {
+            __m128i r[2], g[2], b[2], a[2], y[2], u[2], v[2];
+
+            /* 8 pixels per 16 bits lanes vector */
+            for (unsigned i = 0; i < 2; i++) {
+                __m128i r0, g0, b0, a0, r1, g1, b1, a1;
+
+                splitRgba(src.getPointer(x + 8 * i), &r0, &g0, &b0, &a0);
+                splitRgba(src.getPointer(x + 8 * i + 4), &r1, &g1, &b1, &a1);
+                r[i] = _mm_packs_epi32(r0, r1);
+                g[i] = _mm_packs_epi32(g0, g1);
+                b[i] = _mm_packs_epi32(b0, b1);
+                a[i] = div255_epi16(_mm_mullo_epi16(_mm_packs_epi32(a0, a1), va));
+
+                y[i] = _mm_add_epi16(_mm_mullo_epi16(r[i], _mm_set1_epi16(66)),
+                                     _mm_mullo_epi16(g[i], _mm_set1_epi16(129)));
+                y[i] = _mm_add_epi16(y[i], _mm_mullo_epi16(b[i], _mm_set1_epi16(25)));
+                y[i] = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y[i], round), 8),
+                                     _mm_set1_epi16(16));
+            }
+
+            uint8_t *py = dst.getPointer(0, x);
+            const __m128i d = _mm_loadu_si128((__m128i *)py);
+            const __m128i zero = _mm_setzero_si128();
+            _mm_storeu_si128((__m128i *)py, _mm_packus_epi16(
+                merge_epi16(_mm_unpacklo_epi8(d, zero), y[0], a[0]),
+                merge_epi16(_mm_unpackhi_epi8(d, zero), y[1], a[1])));
+            if (full < 0)
+                continue;
+
+            for (unsigned i = 0; i < 2; i++) {
+                u[i] = _mm_add_epi16(_mm_mullo_epi16(r[i], _mm_set1_epi16(-38)),
+                                     _mm_mullo_epi16(g[i], _mm_set1_epi16(-74)));
+                u[i] = _mm_add_epi16(u[i], _mm_mullo_epi16(b[i], _mm_set1_epi16(112)));
+                u[i] = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(u[i], round), 8),
+                                     round);
+                v[i] = _mm_add_epi16(_mm_mullo_epi16(r[i], _mm_set1_epi16(112)),
+                                     _mm_mullo_epi16(g[i], _mm_set1_epi16(-94)));
+                v[i] = _mm_add_epi16(v[i], _mm_mullo_epi16(b[i], _mm_set1_epi16(-18)));
+                v[i] = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(v[i], round), 8),
+                                     round);
+            }
+
+            const __m128i fc = select_epi16(a[0], a[1], full);
+            mergeChroma420(dst.getPointer(1, x + full),
+                           select_epi16(u[0], u[1], full), fc);
+            mergeChroma420(dst.getPointer(2, x + full),
+                           select_epi16(v[0], v[1], full), fc);
+        }
+        return n;
+    }
+};
+
+/* RGBA onto RGB32 pictures with the red and blue components in the first
+ * three bytes */
+struct rowRgbaToRgb32SSE2 {
+    rowRgbaToRgb32SSE2(const video_format_t *, const video_format_t *) {}
+    BLEND_SSE2
+    unsigned operator()(CPictureRGB32 &dst, const CPictureRGBA &src,
+                        unsigned width, int alpha)
+    {
+        unsigned offset_r, offset_g, offset_b;
+        bool swap_rb;
+
+        dst.getOffsets(&offset_r, &offset_g, &offset_b);
+        if (offset_r == 0 && offset_g == 1 && offset_b == 2)
+            swap_rb = false;
+        else if (offset_r == 2 && offset_g == 1 && offset_b == 0)
+            swap_rb = true;
+        else
+            return 0;
+
+        const __m128i va = _mm_set1_epi32(alpha);
+        const __m128i mask = _mm_set1_epi32(0xff);
+        const unsigned n = width & ~3;
+
+        for (unsigned x = 0; x < n; x += 4) {
+            __m128i s = _mm_loadu_si128((__m128i *)src.getPointer(x));
+
+            /* the fourth byte is left untouched with a null factor */
+            __m128i f = div255_epi16(_mm_mullo_epi16(_mm_srli_epi32(s, 24), va));
+            f = _mm_or_si128(_mm_or_si128(f, _mm_slli_epi32(f, 8)),
+                             _mm_slli_epi32(f, 16));
+            if (swap_rb)
+                s = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(s, mask), 16),
+                                              _mm_and_si128(s, _mm_set1_epi32(0xff00))),
+                                 _mm_and_si128(_mm_srli_epi32(s, 16), mask));
+
+            uint8_t *d = dst.getPointer(x);
+            _mm_storeu_si128((__m128i *)d,
+                             merge_epu8(_mm_loadu_si128((__m128i *)d), s, f));
+        }
+        return n;
+    }
+};
+#endif
+
+template <class TDst, class TSrc, class TConvert, class TRow = rowNone>
 void Blend(const CPicture &dst_data, const CPicture &src_data,
            unsigned width, unsigned height, int alpha)
 {
     TSrc src(src_data);
     TDst dst(dst_data);
     TConvert convert(dst_data.getFormat(), src_data.getFormat());
+    TRow row(dst_data.getFormat(), src_data.getFormat());
 
     for (unsigned y = 0; y < height; y++) {
-        for (unsigned x = 0; x < width; x++) {
+        for (unsigned x = row(dst, src, width, alpha); x < width; x++) {
             CPixel spx;
 
             src.get(&spx, x);
@@ -560,68 +848,46 @@ static const struct {
 #define RGB(csp, picture, cvt) \
     { csp, VLC_CODEC_YUVA, Blend<picture, CPictureYUVA, compose<cvt, convertYuv8ToRgb> > }, \
     { csp, VLC_CODEC_RGBA, Blend<picture, CPictureRGBA, compose<cvt, convertNone> > }, \
-    { csp, VLC_CODEC_YUVP, Blend<picture, CPictureYUVP, compose<cvt, convertYuvpToRgba> > }
+    { csp, VLC_CODEC_YUVP, Blend<picture, CPictureYUVP, compose<cvt, convertYuvpToRgba> > },
 #define YUV(csp, picture, cvt) \
     { csp, VLC_CODEC_YUVA, Blend<picture, CPictureYUVA, compose<cvt, convertNone> > }, \
     { csp, VLC_CODEC_RGBA, Blend<picture, CPictureRGBA, compose<cvt, convertRgbToYuv8> > }, \
-    { csp, VLC_CODEC_YUVP, Blend<picture, CPictureYUVP, compose<cvt, convertYuvpToYuva8> > }
-
-    RGB(VLC_CODEC_RGB15,    CPictureRGB16,    convertRgbToRgbSmall),
-    RGB(VLC_CODEC_RGB16,    CPictureRGB16,    convertRgbToRgbSmall),
-    RGB(VLC_CODEC_RGB24,    CPictureRGB24,    convertNone),
-    RGB(VLC_CODEC_RGB32,    CPictureRGB32,    convertNone),
-    RGB(VLC_CODEC_RGBA,     CPictureRGBA,     convertNone),
-    RGB(VLC_CODEC_BGRA,     CPictureBGRA,     convertNone),
-
-    YUV(VLC_CODEC_YV9,      CPictureYV9,      convertNone),
-    YUV(VLC_CODEC_I410,     CPictureI410_8,   convertNone),
+    { csp, VLC_CODEC_YUVP, Blend<picture, CPictureYUVP, compose<cvt, convertYuvpToYuva8> > },
 
-    YUV(VLC_CODEC_I411,     CPictureI411_8,   convertNone),
-
-    YUV(VLC_CODEC_YV12,     CPictureYV12,     convertNone),
-    YUV(VLC_CODEC_NV12,     CPictureNV12,     convertNone),
-    YUV(VLC_CODEC_NV21,     CPictureNV21,     convertNone),
-    YUV(VLC_CODEC_J420,     CPictureI420_8,   convertNone),
-    YUV(VLC_CODEC_I420,     CPictureI420_8,   convertNone),
-#ifdef WORDS_BIGENDIAN
-    YUV(VLC_CODEC_I420_9B,  CPictureI420_16,  convert8To9Bits),
-    YUV(VLC_CODEC_I420_10B, CPictureI420_16,  convert8To10Bits),
-#else
-    YUV(VLC_CODEC_I420_9L,  CPictureI420_16,  convert8To9Bits),
-    YUV(VLC_CODEC_I420_10L, CPictureI420_16,  convert8To10Bits),
-#endif
-
-    YUV(VLC_CODEC_J422,     CPictureI422_8,   convertNone),
-    YUV(VLC_CODEC_I422,     CPictureI422_8,   convertNone),
-#ifdef WORDS_BIGENDIAN
-    YUV(VLC_CODEC_I422_9B,  CPictureI422_16,  convert8To9Bits),
-    YUV(VLC_CODEC_I422_10B, CPictureI422_16,  convert8To10Bits),
-#else
-    YUV(VLC_CODEC_I422_9L,  CPictureI422_16,  convert8To9Bits),
-    YUV(VLC_CODEC_I422_10L, CPictureI422_16,  convert8To10Bits),
-#endif
-
-    YUV(VLC_CODEC_J444,     CPictureI444_8,   convertNone),
-    YUV(VLC_CODEC_I444,     CPictureI444_8,   convertNone),
-#ifdef WORDS_BIGENDIAN
-    YUV(VLC_CODEC_I444_9B,  CPictureI444_16,  convert8To9Bits),
-    YUV(VLC_CODEC_I444_10B, CPictureI444_16,  convert8To10Bits),
-    YUV(VLC_CODEC_I444_16B, CPictureI444_16,  convert8To16Bits),
-#else
-    YUV(VLC_CODEC_I444_9L,  CPictureI444_16,  convert8To9Bits),
-    YUV(VLC_CODEC_I444_10L, CPictureI444_16,  convert8To10Bits),
-    YUV(VLC_CODEC_I444_16L, CPictureI444_16,  convert8To16Bits),
-#endif
-
-    YUV(VLC_CODEC_YUYV,     CPictureYUYV,     convertNone),
-    YUV(VLC_CODEC_UYVY,     CPictureUYVY,     convertNone),
-    YUV(VLC_CODEC_YVYU,     CPictureYVYU,     convertNone),
-    YUV(VLC_CODEC_VYUY,     CPictureVYUY,     convertNone),
+    BLEND_CHROMAS(RGB, YUV)
 
 #undef RGB
 #undef YUV
 };
 
+#ifdef HAVE_SSE2_INTRINSICS
+/* Blending with row kernels, used instead of the above when available */
+static const struct {
+    vlc_fourcc_t     dst;
+    vlc_fourcc_t     src;
+    blend_function_t blend;
+} blends_sse2[] = {
+#define YUV420(csp, picture, row) \
+    { csp, VLC_CODEC_YUVA, Blend<picture, CPictureYUVA, compose<convertNone, convertNone>, row> }
+#define RGBA(csp, picture, cvt, row) \
+    { csp, VLC_CODEC_RGBA, Blend<picture, CPictureRGBA, compose<convertNone, cvt>, row> }
+
+    YUV420(VLC_CODEC_YV12,  CPictureYV12,    rowYuvaToI420SSE2),
+    YUV420(VLC_CODEC_J420,  CPictureI420_8,  rowYuvaToI420SSE2),
+    YUV420(VLC_CODEC_I420,  CPictureI420_8,  rowYuvaToI420SSE2),
+    YUV420(VLC_CODEC_NV12,  CPictureNV12,    rowYuvaToNV12SSE2),
+    YUV420(VLC_CODEC_NV21,  CPictureNV21,    rowYuvaToNV21SSE2),
+
+    RGBA(VLC_CODEC_YV12,    CPictureYV12,    convertRgbToYuv8, rowRgbaToI420SSE2),
+    RGBA(VLC_CODEC_J420,    CPictureI420_8,  convertRgbToYuv8, rowRgbaToI420SSE2),
+    RGBA(VLC_CODEC_I420,    CPictureI420_8,  convertRgbToYuv8, rowRgbaToI420SSE2),
+    RGBA(VLC_CODEC_RGB32,   CPictureRGB32,   convertNone,      rowRgbaToRgb32SSE2),
+
+#undef YUV420
+#undef RGBA
+};
+#endif
+
 struct filter_sys_t {
     filter_sys_t() : blend(NULL)
     {
@@ -670,7 +936,15 @@ static int Open(vlc_object_t *object)
     const vlc_fourcc_t dst = filter->fmt_out.video.i_chroma;
 
     filter_sys_t *sys = new filter_sys_t();
-    for (size_t i = 0; i < sizeof(blends) / sizeof(*blends); i++) {
+#ifdef HAVE_SSE2_INTRINSICS
+    if (vlc_CPU_SSE2()) {
+        for (size_t i = 0; i < sizeof(blends_sse2) / sizeof(*blends_sse2); i++) {
+            if (blends_sse2[i].src == src && blends_sse2[i].dst == dst)
+                sys->blend = blends_sse2[i].blend;
+        }
+    }
+#endif
+    for (size_t i = 0; !sys->blend && i < sizeof(blends) / sizeof(*blends); i++) {
         if (blends[i].src == src && blends[i].dst == dst)
             sys->blend = blends[i].blend;
     }
@@ -0,0 +1,75 @@
+/*****************************************************************************
+ * blend.h: chromas supported by the blend module
+ *****************************************************************************
+ * Copyright (C) 2012 Laurent Aimar
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_BLEND_H
+#define VLC_BLEND_H
+
+/* Chromas that can be blended onto, each from YUVA, RGBA and YUVP.
+ * RGB(chroma, picture, convert) and YUV(chroma, picture, convert) are
+ * expanded for every RGB and YUV chroma, with the picture class and the
+ * conversion of the blend template. */
+#ifdef WORDS_BIGENDIAN
+# define BLEND_CHROMAS_16(YUV) \
+    YUV(VLC_CODEC_I420_9B,  CPictureI420_16,  convert8To9Bits) \
+    YUV(VLC_CODEC_I420_10B, CPictureI420_16,  convert8To10Bits) \
+    YUV(VLC_CODEC_I422_9B,  CPictureI422_16,  convert8To9Bits) \
+    YUV(VLC_CODEC_I422_10B, CPictureI422_16,  convert8To10Bits) \
+    YUV(VLC_CODEC_I444_9B,  CPictureI444_16,  convert8To9Bits) \
+    YUV(VLC_CODEC_I444_10B, CPictureI444_16,  convert8To10Bits) \
+    YUV(VLC_CODEC_I444_16B, CPictureI444_16,  convert8To16Bits)
+#else
+# define BLEND_CHROMAS_16(YUV) \
+    YUV(VLC_CODEC_I420_9L,  CPictureI420_16,  convert8To9Bits) \
+    YUV(VLC_CODEC_I420_10L, CPictureI420_16,  convert8To10Bits) \
+    YUV(VLC_CODEC_I422_9L,  CPictureI422_16,  convert8To9Bits) \
+    YUV(VLC_CODEC_I422_10L, CPictureI422_16,  convert8To10Bits) \
+    YUV(VLC_CODEC_I444_9L,  CPictureI444_16,  convert8To9Bits) \
+    YUV(VLC_CODEC_I444_10L, CPictureI444_16,  convert8To10Bits) \
+    YUV(VLC_CODEC_I444_16L, CPictureI444_16,  convert8To16Bits)
+#endif
+
+#define BLEND_CHROMAS(RGB, YUV) \
+    RGB(VLC_CODEC_RGB15,    CPictureRGB16,    convertRgbToRgbSmall) \
+    RGB(VLC_CODEC_RGB16,    CPictureRGB16,    convertRgbToRgbSmall) \
+    RGB(VLC_CODEC_RGB24,    CPictureRGB24,    convertNone) \
+    RGB(VLC_CODEC_RGB32,    CPictureRGB32,    convertNone) \
+    RGB(VLC_CODEC_RGBA,     CPictureRGBA,     convertNone) \
+    RGB(VLC_CODEC_BGRA,     CPictureBGRA,     convertNone) \
+    \
+    YUV(VLC_CODEC_YV9,      CPictureYV9,      convertNone) \
+    YUV(VLC_CODEC_I410,     CPictureI410_8,   convertNone) \
+    YUV(VLC_CODEC_I411,     CPictureI411_8,   convertNone) \
+    YUV(VLC_CODEC_YV12,     CPictureYV12,     convertNone) \
+    YUV(VLC_CODEC_NV12,     CPictureNV12,     convertNone) \
+    YUV(VLC_CODEC_NV21,     CPictureNV21,     convertNone) \
+    YUV(VLC_CODEC_J420,     CPictureI420_8,   convertNone) \
+    YUV(VLC_CODEC_I420,     CPictureI420_8,   convertNone) \
+    YUV(VLC_CODEC_J422,     CPictureI422_8,   convertNone) \
+    YUV(VLC_CODEC_I422,     CPictureI422_8,   convertNone) \
+    YUV(VLC_CODEC_J444,     CPictureI444_8,   convertNone) \
+    YUV(VLC_CODEC_I444,     CPictureI444_8,   convertNone) \
+    BLEND_CHROMAS_16(YUV) \
+    \
+    YUV(VLC_CODEC_YUYV,     CPictureYUYV,     convertNone) \
+    YUV(VLC_CODEC_UYVY,     CPictureUYVY,     convertNone) \
+    YUV(VLC_CODEC_YVYU,     CPictureYVYU,     convertNone) \
+    YUV(VLC_CODEC_VYUY,     CPictureVYUY,     convertNone)
+
+#endif
@@ -201,12 +201,31 @@ static block_t *AStreamReadBlock(stream_t *s, bool *restrict eof)
 
     if (block != NULL && input != NULL)
     {
-        uint64_t total;
+        uint64_t total, lost = 0;
+        size_t bytes = 0;
+        unsigned packets = 0;
+        bool discontinuity = false;
+
+        /* The access may return several packets at once */
+        for (const block_t *b = block; b != NULL; b = b->p_next)
+        {
+            bytes += b->i_buffer;
+            packets++;
+            if (b->i_flags & BLOCK_FLAG_DISCONTINUITY)
+                discontinuity = true;
+        }
+
+        /* Packets lost before reaching the access, e.g. in the kernel */
+        if (discontinuity
+         && vlc_stream_Control(access, STREAM_GET_LOST_PACKETS, &lost))
+            lost = 0;
 
         vlc_mutex_lock(&input->p->counters.counters_lock);
-        stats_Update(input->p->counters.p_read_bytes, block->i_buffer, &total);
+        stats_Update(input->p->counters.p_read_bytes, bytes, &total);
         stats_Update(input->p->counters.p_input_bitrate, total, NULL);
-        stats_Update(input->p->counters.p_read_packets, 1, NULL);
+        stats_Update(input->p->counters.p_read_packets, packets, NULL);
+        if (lost > 0)
+            stats_Update(input->p->counters.p_lost_packets, lost, NULL);
         vlc_mutex_unlock(&input->p->counters.counters_lock);
     }
 
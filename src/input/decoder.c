@@ -1672,7 +1672,7 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
     es_format_Init( &p_owner->fmt, UNKNOWN_ES, 0 );
 
     /* decoder fifo */
-    p_owner->p_fifo = block_FifoNew();
+    p_owner->p_fifo = block_FifoNewSPSC();
     if( unlikely(p_owner->p_fifo == NULL) )
     {
         free( p_owner );
@@ -1992,7 +1992,6 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
-    vlc_fifo_Lock( p_owner->p_fifo );
     if( !b_do_pace )
     {
         /* FIXME: ideally we would check the time amount of data
@@ -2002,20 +2001,26 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
         {
             msg_Warn( p_dec, "decoder/packetizer fifo full (data not "
                       "consumed quickly enough), resetting fifo!" );
+            vlc_fifo_Lock( p_owner->p_fifo );
             block_ChainRelease( vlc_fifo_DequeueAllUnlocked( p_owner->p_fifo ) );
+            vlc_fifo_Unlock( p_owner->p_fifo );
         }
     }
     else
-    if( !p_owner->b_waiting )
+    if( !p_owner->b_waiting
+     && vlc_fifo_GetCount( p_owner->p_fifo ) >= 10 )
     {   /* The FIFO is not consumed when waiting, so pacing would deadlock VLC.
          * Locking is not necessary as b_waiting is only read, not written by
          * the decoder thread. */
+        vlc_fifo_Lock( p_owner->p_fifo );
         while( vlc_fifo_GetCount( p_owner->p_fifo ) >= 10 )
             vlc_fifo_WaitCond( p_owner->p_fifo, &p_owner->wait_fifo );
+        vlc_fifo_Unlock( p_owner->p_fifo );
     }
 
-    vlc_fifo_QueueUnlocked( p_owner->p_fifo, p_block );
-    vlc_fifo_Unlock( p_owner->p_fifo );
+    /* The decoder thread releases the FIFO lock while decoding, so this
+     * does not lock unless the decoder thread is idle. */
+    block_FifoPut( p_owner->p_fifo, p_block );
 }
 
 bool input_DecoderIsEmpty( decoder_t * p_dec )
@@ -142,6 +142,7 @@ struct input_thread_private_t
         counter_t *p_read_packets;
         counter_t *p_read_bytes;
         counter_t *p_input_bitrate;
+        counter_t *p_lost_packets;
         counter_t *p_demux_read;
         counter_t *p_demux_bitrate;
         counter_t *p_demux_corrupted;
@@ -90,6 +90,7 @@ void stats_ComputeInputStats(input_thread_t *input, input_stats_t *st)
     st->i_read_packets = stats_GetTotal(input->p->counters.p_read_packets);
     st->i_read_bytes = stats_GetTotal(input->p->counters.p_read_bytes);
     st->f_input_bitrate = stats_GetRate(input->p->counters.p_input_bitrate);
+    st->i_lost_packets = stats_GetTotal(input->p->counters.p_lost_packets);
     st->i_demux_read_bytes = stats_GetTotal(input->p->counters.p_demux_read);
     st->f_demux_bitrate = stats_GetRate(input->p->counters.p_demux_bitrate);
     st->i_demux_corrupted = stats_GetTotal(input->p->counters.p_demux_corrupted);
@@ -124,6 +125,7 @@ void stats_ReinitInputStats( input_stats_t *p_stats )
     vlc_mutex_lock( &p_stats->lock );
     p_stats->i_read_packets = p_stats->i_read_bytes =
     p_stats->f_input_bitrate = p_stats->f_average_input_bitrate =
+    p_stats->i_lost_packets =
     p_stats->i_demux_read_packets = p_stats->i_demux_read_bytes =
     p_stats->f_demux_bitrate = p_stats->f_average_demux_bitrate =
     p_stats->i_demux_corrupted = p_stats->i_demux_discontinuity =
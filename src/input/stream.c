@@ -105,7 +105,7 @@ void stream_CommonDelete(stream_t *s)
     if (priv->peek != NULL)
         block_Release(priv->peek);
     if (priv->block != NULL)
-        block_Release(priv->block);
+        block_ChainRelease(priv->block);
 
     free(s->psz_url);
     vlc_object_release(s);
@@ -343,9 +343,10 @@ static ssize_t vlc_stream_CopyBlock(block_t **restrict pp,
     block->i_buffer -= len;
 
     if (block->i_buffer == 0)
-    {
+    {   /* Move on to the next block of the chain, if any */
+        *pp = block->p_next;
+        block->p_next = NULL;
         block_Release(block);
-        *pp = NULL;
     }
 
     return likely(len > 0) ? (ssize_t)len : -1;
@@ -434,10 +435,15 @@ ssize_t vlc_stream_Peek(stream_t *s, const uint8_t **restrict bufp, size_t len)
 
     peek = priv->peek;
     if (peek == NULL)
-    {
+    {   /* Peek from the first block, and keep the rest of the chain */
         peek = priv->block;
         priv->peek = peek;
         priv->block = NULL;
+        if (peek != NULL)
+        {
+            priv->block = peek->p_next;
+            peek->p_next = NULL;
+        }
     }
 
     if (peek == NULL)
@@ -525,8 +531,9 @@ block_t *vlc_stream_ReadBlock(stream_t *s)
         priv->eof = !ret;
     }
 
-    if (block != NULL)
-        priv->offset += block->i_buffer;
+    /* The block may be a chain, e.g. a batch of datagrams */
+    for (const block_t *b = block; b != NULL; b = b->p_next)
+        priv->offset += b->i_buffer;
 
     return block;
 }
@@ -595,7 +602,7 @@ int vlc_stream_Seek(stream_t *s, uint64_t offset)
 
     if (priv->block != NULL)
     {
-        block_Release(priv->block);
+        block_ChainRelease(priv->block);
         priv->block = NULL;
     }
 
@@ -630,7 +637,7 @@ int vlc_stream_vaControl(stream_t *s, int cmd, va_list args)
 
             if (priv->block != NULL)
             {
-                block_Release(priv->block);
+                block_ChainRelease(priv->block);
                 priv->block = NULL;
             }
 
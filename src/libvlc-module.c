@@ -822,6 +822,12 @@ static const char *const ppsz_prefres[] = {
     "However allocation of port numbers below 1025 is usually restricted " \
     "by the operating system." )
 
+#define HTTP_THREADS_TEXT N_( "HTTP server threads" )
+#define HTTP_THREADS_LONGTEXT N_( \
+    "Number of threads serving the clients of each HTTP, HTTPS or RTSP " \
+    "server. More threads allow for more concurrent clients. " \
+    "This is only supported on Linux." )
+
 #define RTSP_PORT_TEXT N_( "RTSP server port" )
 #define RTSP_PORT_LONGTEXT N_( \
     "The RTSP server will listen on this TCP port. " \
@@ -1022,6 +1028,12 @@ static const char *const ppsz_prefres[] = {
     "priorities. You can use it to tune VLC priority against other " \
     "programs, or against other VLC instances.")
 
+#define BLOCK_CACHE_TEXT N_("Recycle data blocks")
+#define BLOCK_CACHE_LONGTEXT N_( \
+    "Keep released data blocks of up to 64 KiB in per-thread caches for " \
+    "reuse. This lowers the load on the memory allocator when streaming " \
+    "at high bit rates, at the expense of memory usage.")
+
 #define USE_STREAM_IMMEDIATE_LONGTEXT N_( \
      "This option is useful if you want to lower the latency when " \
      "reading a stream")
@@ -1756,6 +1768,8 @@ vlc_module_begin ()
         change_integer_range( 1, 65535 )
     add_integer( "https-port", 8443, HTTPS_PORT_TEXT, HTTPS_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
+    add_integer( "http-threads", 1, HTTP_THREADS_TEXT, HTTP_THREADS_LONGTEXT, true )
+        change_integer_range( 1, 64 )
     add_string( "rtsp-host", NULL, RTSP_HOST_TEXT, RTSP_HOST_LONGTEXT, true )
     add_integer( "rtsp-port", 554, RTSP_PORT_TEXT, RTSP_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
@@ -1991,6 +2005,9 @@ vlc_module_begin ()
                  RT_OFFSET_LONGTEXT, true )
 #endif
 
+    add_bool( "block-cache", false, BLOCK_CACHE_TEXT,
+              BLOCK_CACHE_LONGTEXT, true )
+
 #if defined(HAVE_DBUS)
     add_bool( "inhibit", 1, INHIBIT_TEXT,
               INHIBIT_LONGTEXT, true )
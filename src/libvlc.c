@@ -67,6 +67,7 @@
 #include <vlc_cpu.h>
 #include <vlc_url.h>
 #include <vlc_modules.h>
+#include <vlc_block.h>
 
 #include "libvlc.h"
 #include "playlist/playlist_internal.h"
@@ -136,7 +137,8 @@ int libvlc_InternalInit( libvlc_int_t *p_libvlc, int i_argc,
      * core module. We need to do this at this stage to be able to display
      * a short help if required by the user. (short help == core module
      * options) */
-    module_InitBank ();
+    if( module_InitBank () )
+        return VLC_ENOMEM;
 
     /* Get command line options that affect module loading. */
     if( config_LoadCmdLine( p_libvlc, i_argc, ppsz_argv, NULL ) )
@@ -355,6 +357,10 @@ dbus_out:
 
     priv->b_stats = var_InheritBool( p_libvlc, "stats" );
 
+    priv->b_block_cache = var_InheritBool( p_libvlc, "block-cache" );
+    if( priv->b_block_cache )
+        vlc_block_cache_Enable();
+
     /*
      * Initialize hotkey handling
      */
@@ -540,6 +546,17 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
 
     vlc_DeinitActions( p_libvlc, priv->actions );
 
+    if( priv->b_block_cache )
+    {
+        vlc_block_cache_stats_t stats;
+
+        vlc_block_cache_GetStats( &stats );
+        msg_Dbg( p_libvlc, "block cache: %"PRIu64" hits, %"PRIu64" misses, "
+                 "%"PRIu64" recycled, %"PRIu64" dropped", stats.hits,
+                 stats.misses, stats.recycled, stats.dropped );
+        vlc_block_cache_Disable();
+    }
+
     /* Save the configuration */
     if( !var_InheritBool( p_libvlc, "ignore-config" ) )
         config_AutoSaveConfigFile( VLC_OBJECT(p_libvlc) );
@@ -142,6 +142,7 @@ typedef struct libvlc_priv_t
 
     /* Logging */
     bool               b_stats;     ///< Whether to collect stats
+    bool               b_block_cache; ///< Whether block recycling is enabled
 
     /* Singleton objects */
     vlc_logger_t      *logger;
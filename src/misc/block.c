@@ -34,6 +34,7 @@
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include <vlc_atomic.h>
 
 #ifndef NDEBUG
 static void BlockNoRelease( block_t *b )
@@ -117,15 +118,21 @@ static void BlockMetaCopy( block_t *restrict out, const block_t *in )
 /** Initial reserved header and footer size. */
 #define BLOCK_PADDING      32
 
+static block_t *block_cache_Alloc(size_t size);
+
 block_t *block_Alloc (size_t size)
 {
+    block_t *b = block_cache_Alloc (size);
+    if (b != NULL)
+        return b;
+
     /* 2 * BLOCK_PADDING: pre + post padding */
     const size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
                        + size;
     if (unlikely(alloc <= size))
         return NULL;
 
-    block_t *b = malloc (alloc);
+    b = malloc (alloc);
     if (unlikely(b == NULL))
         return NULL;
 
@@ -139,6 +146,429 @@ block_t *block_Alloc (size_t size)
     return b;
 }
 
+/*
+ * Recycling allocator
+ *
+ * When enabled, block_Alloc() rounds small sizes up to a power of two and
+ * takes the block from a per-thread free list of that size class. Blocks
+ * return to the cache of the thread that allocated them: directly if that
+ * thread releases them, through a lock-free list otherwise. That way the
+ * allocating thread of a producer/consumer pair still gets its blocks back.
+ * Blocks keep the same memory layout as generic ones, so block_Realloc() and
+ * friends need not know about the cache.
+ */
+#define BLOCK_CACHE_MIN_SHIFT 8  /* 256 bytes */
+#define BLOCK_CACHE_MAX_SHIFT 16 /* 64 KiB */
+#define BLOCK_CACHE_CLASSES (BLOCK_CACHE_MAX_SHIFT - BLOCK_CACHE_MIN_SHIFT + 1)
+/** Maximum number of payload bytes kept per thread and per size class */
+#define BLOCK_CACHE_CLASS_BYTES (1u << 20)
+/** Number of allocations between two updates of the global counters */
+#define BLOCK_CACHE_FLUSH_COUNT 1024
+
+typedef struct
+{
+    block_t *free[BLOCK_CACHE_CLASSES];
+    unsigned count[BLOCK_CACHE_CLASSES];
+    /** LIFOs of blocks released by other threads */
+    atomic_uintptr_t remote[BLOCK_CACHE_CLASSES];
+    /** Owning thread (until it exits) and blocks allocated out of the cache */
+    atomic_uint refs;
+    /* Counters not yet accounted in block_cache.stats */
+    unsigned hits, misses, recycled, dropped;
+} block_cache_t;
+
+/** Cached block, prefixed with its owning cache */
+typedef struct
+{
+    block_cache_t *owner;
+    block_t self;
+} block_cached_t;
+
+static struct
+{
+    vlc_mutex_t lock;
+    unsigned refs;
+    bool initialized;
+    vlc_threadvar_t key;
+    atomic_bool enabled;
+    struct
+    {
+        atomic_ullong hits, misses, recycled, dropped;
+    } stats;
+} block_cache = {
+    .lock = VLC_STATIC_MUTEX,
+    .refs = 0,
+    .initialized = false,
+    .enabled = ATOMIC_VAR_INIT(false),
+};
+
+static block_cached_t *block_cache_Entry (block_t *block)
+{
+    return (block_cached_t *)(((char *)block) - offsetof (block_cached_t, self));
+}
+
+static void block_cache_Flush (block_cache_t *cache)
+{
+    atomic_fetch_add_explicit (&block_cache.stats.hits, cache->hits,
+                               memory_order_relaxed);
+    atomic_fetch_add_explicit (&block_cache.stats.misses, cache->misses,
+                               memory_order_relaxed);
+    atomic_fetch_add_explicit (&block_cache.stats.recycled, cache->recycled,
+                               memory_order_relaxed);
+    atomic_fetch_add_explicit (&block_cache.stats.dropped, cache->dropped,
+                               memory_order_relaxed);
+    cache->hits = cache->misses = cache->recycled = cache->dropped = 0;
+}
+
+static void block_cache_FreeList (block_t *b)
+{
+    while (b != NULL)
+    {
+        block_t *next = b->p_next;
+
+        free (block_cache_Entry (b));
+        b = next;
+    }
+}
+
+/** Drops a reference to a cache, freeing it after its thread and blocks. */
+static void block_cache_Unref (block_cache_t *cache)
+{
+    if (atomic_fetch_sub_explicit (&cache->refs, 1, memory_order_acq_rel) != 1)
+        return;
+
+    for (unsigned i = 0; i < BLOCK_CACHE_CLASSES; i++)
+        block_cache_FreeList ((block_t *)atomic_exchange (&cache->remote[i], 0));
+    free (cache);
+}
+
+static void block_cache_Destroy (void *data)
+{
+    block_cache_t *cache = data;
+
+    for (unsigned i = 0; i < BLOCK_CACHE_CLASSES; i++)
+    {
+        block_cache_FreeList (cache->free[i]);
+        cache->free[i] = NULL;
+        cache->count[i] = 0;
+        block_cache_FreeList ((block_t *)atomic_exchange (&cache->remote[i], 0));
+    }
+    block_cache_Flush (cache);
+    /* Blocks still in use keep the cache alive */
+    block_cache_Unref (cache);
+}
+
+/** Gets the cache of the calling thread, creating it if needed. */
+static block_cache_t *block_cache_Get (void)
+{
+    block_cache_t *cache = vlc_threadvar_get (block_cache.key);
+    if (likely(cache != NULL))
+        return cache;
+
+    cache = calloc (1, sizeof (*cache));
+    if (unlikely(cache == NULL))
+        return NULL;
+    for (unsigned i = 0; i < BLOCK_CACHE_CLASSES; i++)
+        atomic_init (&cache->remote[i], 0);
+    atomic_init (&cache->refs, 1);
+    if (vlc_threadvar_set (block_cache.key, cache))
+    {
+        free (cache);
+        return NULL;
+    }
+    return cache;
+}
+
+static size_t block_cache_AllocSize (unsigned cls)
+{
+    return sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
+           + (1 << (cls + BLOCK_CACHE_MIN_SHIFT));
+}
+
+static unsigned block_cache_ClassMax (unsigned cls)
+{
+    return BLOCK_CACHE_CLASS_BYTES >> (cls + BLOCK_CACHE_MIN_SHIFT);
+}
+
+static void block_cache_Release (block_t *block)
+{
+    unsigned cls = ctz (block->i_size - BLOCK_ALIGN - 2 * BLOCK_PADDING)
+                   - BLOCK_CACHE_MIN_SHIFT;
+    block_cached_t *entry = block_cache_Entry (block);
+    block_cache_t *owner = entry->owner;
+
+    assert (block->p_start == (unsigned char *)(block + 1));
+    assert (block_cache_AllocSize (cls) == sizeof (*block) + block->i_size);
+    block_Invalidate (block);
+
+    if (!atomic_load_explicit (&block_cache.enabled, memory_order_relaxed))
+        free (entry);
+    else if (owner == vlc_threadvar_get (block_cache.key))
+    {   /* Released by the owner: the cache cannot go away meanwhile */
+        if (owner->count[cls] >= block_cache_ClassMax (cls))
+        {
+            owner->dropped++;
+            free (entry);
+        }
+        else
+        {
+            block->p_next = owner->free[cls];
+            owner->free[cls] = block;
+            owner->count[cls]++;
+            owner->recycled++;
+        }
+    }
+    else
+    {   /* Hand the block back to its owner */
+        uintptr_t top = atomic_load_explicit (&owner->remote[cls],
+                                              memory_order_relaxed);
+        do
+            block->p_next = (block_t *)top;
+        while (!atomic_compare_exchange_weak (&owner->remote[cls], &top,
+                                              (uintptr_t)block));
+    }
+
+    block_cache_Unref (owner);
+}
+
+/**
+ * Takes back the blocks of a size class released by other threads.
+ */
+static block_t *block_cache_Reclaim (block_cache_t *cache, unsigned cls)
+{
+    block_t *b = (block_t *)atomic_exchange (&cache->remote[cls], 0);
+    const unsigned max = block_cache_ClassMax (cls);
+
+    while (b != NULL)
+    {
+        block_t *next = b->p_next;
+
+        if (cache->count[cls] < max)
+        {
+            b->p_next = cache->free[cls];
+            cache->free[cls] = b;
+            cache->count[cls]++;
+            cache->recycled++;
+        }
+        else
+        {
+            cache->dropped++;
+            free (block_cache_Entry (b));
+        }
+        b = next;
+    }
+    return cache->free[cls];
+}
+
+/**
+ * Allocates a block from the cache of the calling thread.
+ * @return NULL if the cache is disabled or not suitable for the size.
+ */
+static block_t *block_cache_Alloc (size_t size)
+{
+    if (!atomic_load_explicit (&block_cache.enabled, memory_order_relaxed)
+     || size > (1 << BLOCK_CACHE_MAX_SHIFT))
+        return NULL;
+
+    block_cache_t *cache = block_cache_Get ();
+    if (unlikely(cache == NULL))
+        return NULL;
+
+    unsigned cls = 0;
+    if (size > (1 << BLOCK_CACHE_MIN_SHIFT))
+        cls = (sizeof (unsigned) * 8) - clz ((unsigned)(size - 1)) - BLOCK_CACHE_MIN_SHIFT;
+
+    const size_t alloc = block_cache_AllocSize (cls);
+    block_t *b = cache->free[cls];
+    if (b == NULL)
+        b = block_cache_Reclaim (cache, cls);
+
+    if (b != NULL)
+    {
+        cache->free[cls] = b->p_next;
+        cache->count[cls]--;
+        cache->hits++;
+    }
+    else
+    {
+        block_cached_t *entry = malloc (offsetof (block_cached_t, self)
+                                        + alloc);
+        if (unlikely(entry == NULL))
+            return NULL;
+        entry->owner = cache;
+        b = &entry->self;
+        cache->misses++;
+    }
+
+    if (cache->hits + cache->misses >= BLOCK_CACHE_FLUSH_COUNT)
+        block_cache_Flush (cache);
+
+    atomic_fetch_add_explicit (&cache->refs, 1, memory_order_relaxed);
+    block_Init (b, b + 1, alloc - sizeof (*b));
+    b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
+    b->p_buffer = (void *)(((uintptr_t)b->p_buffer) & ~(BLOCK_ALIGN - 1));
+    b->i_buffer = size;
+    b->pf_release = block_cache_Release;
+    return b;
+}
+
+void vlc_block_cache_Enable (void)
+{
+    vlc_mutex_lock (&block_cache.lock);
+    if (!block_cache.initialized)
+    {   /* The key is never deleted: blocks may outlive all users. */
+        if (vlc_threadvar_create (&block_cache.key, block_cache_Destroy))
+        {
+            vlc_mutex_unlock (&block_cache.lock);
+            return;
+        }
+        block_cache.initialized = true;
+    }
+    if (block_cache.refs++ == 0)
+        atomic_store (&block_cache.enabled, true);
+    vlc_mutex_unlock (&block_cache.lock);
+}
+
+void vlc_block_cache_Disable (void)
+{
+    vlc_mutex_lock (&block_cache.lock);
+    if (block_cache.refs > 0 && --block_cache.refs == 0)
+    {
+        atomic_store (&block_cache.enabled, false);
+
+        /* Other threads free their cache when they exit. */
+        block_cache_t *cache = vlc_threadvar_get (block_cache.key);
+        if (cache != NULL)
+        {
+            vlc_threadvar_set (block_cache.key, NULL);
+            block_cache_Destroy (cache);
+        }
+    }
+    vlc_mutex_unlock (&block_cache.lock);
+}
+
+void vlc_block_cache_GetStats (vlc_block_cache_stats_t *stats)
+{
+    vlc_mutex_lock (&block_cache.lock);
+    if (block_cache.initialized)
+    {   /* Account for the calling thread, which is usually the busiest. */
+        block_cache_t *cache = vlc_threadvar_get (block_cache.key);
+        if (cache != NULL)
+            block_cache_Flush (cache);
+    }
+    vlc_mutex_unlock (&block_cache.lock);
+
+    stats->hits = atomic_load (&block_cache.stats.hits);
+    stats->misses = atomic_load (&block_cache.stats.misses);
+    stats->recycled = atomic_load (&block_cache.stats.recycled);
+    stats->dropped = atomic_load (&block_cache.stats.dropped);
+}
+
+/*
+ * Shared payloads
+ *
+ * block_Shareable() moves the block owning a payload behind a reference
+ * counter, and returns a light block header pointing into it. block_Share()
+ * then only allocates another header. The payload is released together with
+ * the last header.
+ */
+typedef struct
+{
+    atomic_uint refs;
+    block_t *origin; /**< Block owning the payload */
+} block_payload_t;
+
+typedef struct
+{
+    block_t self;
+    block_payload_t *payload;
+} block_shared_t;
+
+static void block_shared_Release (block_t *block)
+{
+    block_shared_t *sh = (block_shared_t *)block;
+    block_payload_t *payload = sh->payload;
+
+    block_Invalidate (block);
+    free (sh);
+
+    if (atomic_fetch_sub_explicit (&payload->refs, 1,
+                                   memory_order_acq_rel) == 1)
+    {
+        block_Release (payload->origin);
+        free (payload);
+    }
+}
+
+/** Checks whether other blocks reference the payload of a block. */
+static bool block_IsShared (const block_t *block)
+{
+    if (block->pf_release != block_shared_Release)
+        return false;
+
+    const block_shared_t *sh = (const block_shared_t *)block;
+    return atomic_load_explicit (&sh->payload->refs,
+                                 memory_order_acquire) > 1;
+}
+
+block_t *block_Shareable (block_t *block)
+{
+    block_Check (block);
+    if (block->pf_release == block_shared_Release)
+        return block;
+
+    block_payload_t *payload = malloc (sizeof (*payload));
+    block_shared_t *sh = malloc (sizeof (*sh));
+    if (unlikely(payload == NULL || sh == NULL))
+    {   /* block_Share() will copy instead */
+        free (payload);
+        free (sh);
+        return block;
+    }
+
+    atomic_init (&payload->refs, 1);
+    payload->origin = block;
+
+    block_Init (&sh->self, block->p_start, block->i_size);
+    sh->self.p_buffer = block->p_buffer;
+    sh->self.i_buffer = block->i_buffer;
+    BlockMetaCopy (&sh->self, block);
+    sh->self.pf_release = block_shared_Release;
+    sh->payload = payload;
+    block->p_next = NULL;
+    return &sh->self;
+}
+
+block_t *block_Share (block_t *block)
+{
+    block_Check (block);
+    if (block->pf_release != block_shared_Release)
+        return block_Duplicate (block);
+
+    block_shared_t *sh = malloc (sizeof (*sh));
+    if (unlikely(sh == NULL))
+        return NULL;
+
+    sh->self = *block;
+    sh->self.p_next = NULL;
+    sh->payload = ((block_shared_t *)block)->payload;
+    atomic_fetch_add_explicit (&sh->payload->refs, 1, memory_order_relaxed);
+    return &sh->self;
+}
+
+block_t *block_Writable (block_t *block)
+{
+    block_Check (block);
+    if (!block_IsShared (block))
+        return block;
+
+    block_t *dup = block_Duplicate (block);
+    if (likely(dup != NULL))
+        dup->p_next = block->p_next;
+    block_Release (block);
+    return dup;
+}
+
 block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
 {
     block_Check( p_block );
@@ -173,9 +603,12 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
 
     size_t requested = i_prebody + i_body;
 
+    /* A shared payload is read-only, and callers write to the result */
+    const bool b_shared = block_IsShared( p_block );
+
     if( p_block->i_buffer == 0 )
     {   /* Corner case: nothing to preserve */
-        if( requested <= p_block->i_size )
+        if( requested <= p_block->i_size && !b_shared )
         {   /* Enough room: recycle buffer */
             size_t extra = p_block->i_size - requested;
 
@@ -200,7 +633,8 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
     /* Second, reallocate the buffer if we lack space. */
     assert( i_prebody >= 0 );
     if( (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
-     || (size_t)(p_end - p_block->p_buffer) < i_body )
+     || (size_t)(p_end - p_block->p_buffer) < i_body
+     || b_shared )
     {
         block_t *p_rea = block_Alloc( requested );
         if( p_rea == NULL )
@@ -30,10 +30,16 @@
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include "libvlc.h"
 
 /**
  * Internal state for block queues
+ *
+ * In single consumer mode, blocks are queued onto a lock-free stack, which
+ * the consumer moves to its own list in FIFO order. The lock is only needed
+ * to wait for data and to protect the user state of the FIFO. Producers take
+ * it only if some thread holds it, i.e. if the consumer may be sleeping.
  */
 struct block_fifo_t
 {
@@ -42,18 +48,26 @@ struct block_fifo_t
 
     block_t             *p_first;
     block_t             **pp_last;
-    size_t              i_depth;
-    size_t              i_size;
+    atomic_size_t       i_depth;
+    atomic_size_t       i_size;
+
+    bool                b_spsc;
+    atomic_uintptr_t    pushed; /**< LIFO of queued blocks (single consumer) */
+    atomic_uint         lockers; /**< Threads holding or waiting for the lock */
 };
 
 void vlc_fifo_Lock(vlc_fifo_t *fifo)
 {
+    if (fifo->b_spsc)
+        atomic_fetch_add(&fifo->lockers, 1);
     vlc_mutex_lock(&fifo->lock);
 }
 
 void vlc_fifo_Unlock(vlc_fifo_t *fifo)
 {
     vlc_mutex_unlock(&fifo->lock);
+    if (fifo->b_spsc)
+        atomic_fetch_sub_explicit(&fifo->lockers, 1, memory_order_relaxed);
 }
 
 void vlc_fifo_Signal(vlc_fifo_t *fifo)
@@ -76,19 +90,97 @@ int vlc_fifo_TimedWaitCond(vlc_fifo_t *fifo, vlc_cond_t *condvar, mtime_t deadli
     return vlc_cond_timedwait(condvar, &fifo->lock, deadline);
 }
 
+/* In single consumer mode, producers account for blocks after linking them,
+ * so that the counters never announce blocks that cannot be dequeued yet.
+ * The consumer may then take a block before it is accounted: the counters
+ * transiently go below zero, which is reported as empty. */
 size_t vlc_fifo_GetCount(const vlc_fifo_t *fifo)
 {
-    return fifo->i_depth;
+    size_t depth = atomic_load_explicit(&fifo->i_depth, memory_order_acquire);
+    return ((ssize_t)depth < 0) ? 0 : depth;
 }
 
 size_t vlc_fifo_GetBytes(const vlc_fifo_t *fifo)
 {
-    return fifo->i_size;
+    size_t size = atomic_load_explicit(&fifo->i_size, memory_order_acquire);
+    return ((ssize_t)size < 0) ? 0 : size;
+}
+
+/**
+ * Pushes a block list onto the lock-free stack (single consumer mode).
+ * @return whether the consumer may be waiting for the lock or data
+ */
+static bool vlc_fifo_Push(block_fifo_t *fifo, block_t *block)
+{
+    block_t *last = NULL;
+    size_t depth = 0, size = 0;
+
+    /* Reverse the list, so that the stack is in LIFO order */
+    while (block != NULL)
+    {
+        block_t *next = block->p_next;
+
+        block->p_next = last;
+        last = block;
+        depth++;
+        size += block->i_buffer;
+        block = next;
+    }
+
+    if (last == NULL)
+        return false;
+
+    block_t *first = last;
+    while (first->p_next != NULL)
+        first = first->p_next;
+
+    uintptr_t top = atomic_load_explicit(&fifo->pushed, memory_order_relaxed);
+    do
+        first->p_next = (block_t *)top;
+    while (!atomic_compare_exchange_weak(&fifo->pushed, &top,
+                                         (uintptr_t)last));
+
+    /* Account after publishing: the blocks are counted once reachable */
+    atomic_fetch_add_explicit(&fifo->i_size, size, memory_order_release);
+    atomic_fetch_add_explicit(&fifo->i_depth, depth, memory_order_release);
+
+    return atomic_load(&fifo->lockers) > 0;
+}
+
+/**
+ * Moves blocks from the lock-free stack to the consumer list.
+ */
+static void vlc_fifo_Pull(block_fifo_t *fifo)
+{
+    block_t *block = (block_t *)atomic_exchange(&fifo->pushed, 0);
+    block_t *list = NULL, **pp_last = fifo->pp_last;
+
+    if (block == NULL)
+        return;
+
+    fifo->pp_last = &block->p_next;
+    while (block != NULL)
+    {
+        block_t *next = block->p_next;
+
+        block->p_next = list;
+        list = block;
+        block = next;
+    }
+    *pp_last = list;
 }
 
 void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
 {
     vlc_assert_locked(&fifo->lock);
+
+    if (fifo->b_spsc)
+    {
+        vlc_fifo_Push(fifo, block);
+        vlc_fifo_Signal(fifo);
+        return;
+    }
+
     assert(*(fifo->pp_last) == NULL);
 
     *(fifo->pp_last) = block;
@@ -96,8 +188,9 @@ void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
     while (block != NULL)
     {
         fifo->pp_last = &block->p_next;
-        fifo->i_depth++;
-        fifo->i_size += block->i_buffer;
+        atomic_fetch_add_explicit(&fifo->i_depth, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&fifo->i_size, block->i_buffer,
+                                  memory_order_relaxed);
 
         block = block->p_next;
     }
@@ -105,9 +198,10 @@ void vlc_fifo_QueueUnlocked(block_fifo_t *fifo, block_t *block)
     vlc_fifo_Signal(fifo);
 }
 
-block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
+static block_t *vlc_fifo_Dequeue(block_fifo_t *fifo)
 {
-    vlc_assert_locked(&fifo->lock);
+    if (fifo->b_spsc && fifo->p_first == NULL)
+        vlc_fifo_Pull(fifo);
 
     block_t *block = fifo->p_first;
 
@@ -119,29 +213,53 @@ block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
         fifo->pp_last = &fifo->p_first;
     block->p_next = NULL;
 
-    assert(fifo->i_depth > 0);
-    fifo->i_depth--;
-    assert(fifo->i_size >= block->i_buffer);
-    fifo->i_size -= block->i_buffer;
+    assert(fifo->b_spsc || vlc_fifo_GetCount(fifo) > 0);
+    atomic_fetch_sub_explicit(&fifo->i_depth, 1, memory_order_relaxed);
+    assert(fifo->b_spsc || vlc_fifo_GetBytes(fifo) >= block->i_buffer);
+    atomic_fetch_sub_explicit(&fifo->i_size, block->i_buffer,
+                              memory_order_relaxed);
 
     return block;
 }
 
-block_t *vlc_fifo_DequeueAllUnlocked(block_fifo_t *fifo)
+block_t *vlc_fifo_DequeueUnlocked(block_fifo_t *fifo)
 {
     vlc_assert_locked(&fifo->lock);
 
+    return vlc_fifo_Dequeue(fifo);
+}
+
+static block_t *vlc_fifo_DequeueAll(block_fifo_t *fifo)
+{
+    if (fifo->b_spsc)
+        vlc_fifo_Pull(fifo);
+
     block_t *block = fifo->p_first;
+    size_t depth = 0, size = 0;
+
+    for (block_t *b = block; b != NULL; b = b->p_next)
+    {
+        depth++;
+        size += b->i_buffer;
+    }
 
     fifo->p_first = NULL;
     fifo->pp_last = &fifo->p_first;
-    fifo->i_depth = 0;
-    fifo->i_size = 0;
+    /* Blocks pushed meanwhile remain accounted for */
+    atomic_fetch_sub_explicit(&fifo->i_depth, depth, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&fifo->i_size, size, memory_order_relaxed);
 
     return block;
 }
 
-block_fifo_t *block_FifoNew( void )
+block_t *vlc_fifo_DequeueAllUnlocked(block_fifo_t *fifo)
+{
+    vlc_assert_locked(&fifo->lock);
+
+    return vlc_fifo_DequeueAll(fifo);
+}
+
+static block_fifo_t *vlc_fifo_New(bool spsc)
 {
     block_fifo_t *p_fifo = malloc( sizeof( block_fifo_t ) );
     if( !p_fifo )
@@ -151,14 +269,28 @@ block_fifo_t *block_FifoNew( void )
     vlc_cond_init( &p_fifo->wait );
     p_fifo->p_first = NULL;
     p_fifo->pp_last = &p_fifo->p_first;
-    p_fifo->i_depth = p_fifo->i_size = 0;
+    atomic_init( &p_fifo->i_depth, 0 );
+    atomic_init( &p_fifo->i_size, 0 );
+    p_fifo->b_spsc = spsc;
+    atomic_init( &p_fifo->pushed, 0 );
+    atomic_init( &p_fifo->lockers, 0 );
 
     return p_fifo;
 }
 
+block_fifo_t *block_FifoNew( void )
+{
+    return vlc_fifo_New( false );
+}
+
+block_fifo_t *block_FifoNewSPSC( void )
+{
+    return vlc_fifo_New( true );
+}
+
 void block_FifoRelease( block_fifo_t *p_fifo )
 {
-    block_ChainRelease( p_fifo->p_first );
+    block_ChainRelease( vlc_fifo_DequeueAll( p_fifo ) );
     vlc_cond_destroy( &p_fifo->wait );
     vlc_mutex_destroy( &p_fifo->lock );
     free( p_fifo );
@@ -168,6 +300,12 @@ void block_FifoEmpty(block_fifo_t *fifo)
 {
     block_t *block;
 
+    if (fifo->b_spsc)
+    {
+        block_ChainRelease(vlc_fifo_DequeueAll(fifo));
+        return;
+    }
+
     vlc_fifo_Lock(fifo);
     block = vlc_fifo_DequeueAllUnlocked(fifo);
     vlc_fifo_Unlock(fifo);
@@ -176,6 +314,17 @@ void block_FifoEmpty(block_fifo_t *fifo)
 
 void block_FifoPut(block_fifo_t *fifo, block_t *block)
 {
+    if (fifo->b_spsc)
+    {
+        if (vlc_fifo_Push(fifo, block))
+        {   /* The consumer may be waiting: wake it up */
+            vlc_fifo_Lock(fifo);
+            vlc_fifo_Signal(fifo);
+            vlc_fifo_Unlock(fifo);
+        }
+        return;
+    }
+
     vlc_fifo_Lock(fifo);
     vlc_fifo_QueueUnlocked(fifo, block);
     vlc_fifo_Unlock(fifo);
@@ -187,14 +336,20 @@ block_t *block_FifoGet(block_fifo_t *fifo)
 
     vlc_testcancel();
 
+    if (fifo->b_spsc)
+    {
+        block = vlc_fifo_Dequeue(fifo);
+        if (block != NULL)
+            return block;
+    }
+
     vlc_fifo_Lock(fifo);
-    while (vlc_fifo_IsEmpty(fifo))
+    while ((block = vlc_fifo_DequeueUnlocked(fifo)) == NULL)
     {
         vlc_fifo_CleanupPush(fifo);
         vlc_fifo_Wait(fifo);
         vlc_cleanup_pop();
     }
-    block = vlc_fifo_DequeueUnlocked(fifo);
     vlc_fifo_Unlock(fifo);
 
     return block;
@@ -204,6 +359,14 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
 {
     block_t *b;
 
+    if( p_fifo->b_spsc )
+    {
+        if( p_fifo->p_first == NULL )
+            vlc_fifo_Pull( p_fifo );
+        assert(p_fifo->p_first != NULL);
+        return p_fifo->p_first;
+    }
+
     vlc_mutex_lock( &p_fifo->lock );
     assert(p_fifo->p_first != NULL);
     b = p_fifo->p_first;
@@ -212,24 +375,12 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
     return b;
 }
 
-/* FIXME: not (really) thread-safe */
 size_t block_FifoSize (block_fifo_t *fifo)
 {
-    size_t size;
-
-    vlc_mutex_lock (&fifo->lock);
-    size = fifo->i_size;
-    vlc_mutex_unlock (&fifo->lock);
-    return size;
+    return vlc_fifo_GetBytes (fifo);
 }
 
-/* FIXME: not (really) thread-safe */
 size_t block_FifoCount (block_fifo_t *fifo)
 {
-    size_t depth;
-
-    vlc_mutex_lock (&fifo->lock);
-    depth = fifo->i_depth;
-    vlc_mutex_unlock (&fifo->lock);
-    return depth;
+    return vlc_fifo_GetCount (fifo);
 }
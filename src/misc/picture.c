@@ -200,7 +200,8 @@ int picture_Setup( picture_t *p_picture, const video_format_t *restrict fmt )
 /*****************************************************************************
  *
  *****************************************************************************/
-picture_t *picture_NewFromResource( const video_format_t *p_fmt, const picture_resource_t *p_resource )
+int picture_InitFromResource( picture_priv_t *priv, const video_format_t *p_fmt,
+                              const picture_resource_t *p_resource )
 {
     video_format_t fmt = *p_fmt;
 
@@ -216,10 +217,6 @@ picture_t *picture_NewFromResource( const video_format_t *p_fmt, const picture_r
         video_format_CopyCrop( &fmt, p_fmt );
 
     /* */
-    picture_priv_t *priv = malloc( sizeof (*priv) );
-    if( unlikely(priv == NULL) )
-        return NULL;
-
     picture_t *p_picture = &priv->picture;
 
     memset( p_picture, 0, sizeof( *p_picture ) );
@@ -227,10 +224,7 @@ picture_t *picture_NewFromResource( const video_format_t *p_fmt, const picture_r
 
     /* Make sure the real dimensions are a multiple of 16 */
     if( picture_Setup( p_picture, &fmt ) )
-    {
-        free( p_picture );
-        return NULL;
-    }
+        return VLC_EGENERIC;
 
     atomic_init( &priv->gc.refs, 1 );
     priv->gc.opaque = NULL;
@@ -254,14 +248,26 @@ picture_t *picture_NewFromResource( const video_format_t *p_fmt, const picture_r
     else
     {
         if( AllocatePicture( p_picture ) )
-        {
-            free( p_picture );
-            return NULL;
-        }
+            return VLC_ENOMEM;
         priv->gc.destroy = picture_Destroy;
     }
 
-    return p_picture;
+    return VLC_SUCCESS;
+}
+
+picture_t *picture_NewFromResource( const video_format_t *p_fmt, const picture_resource_t *p_resource )
+{
+    picture_priv_t *priv = malloc( sizeof (*priv) );
+    if( unlikely(priv == NULL) )
+        return NULL;
+
+    if( picture_InitFromResource( priv, p_fmt, p_resource ) )
+    {
+        free( priv );
+        return NULL;
+    }
+
+    return &priv->picture;
 }
 
 picture_t *picture_NewFromFormat( const video_format_t *p_fmt )
@@ -31,3 +31,10 @@ typedef struct
         void *opaque;
     } gc;
 } picture_priv_t;
+
+/**
+ * Initializes a picture in caller-provided storage, as
+ * picture_NewFromResource() does for the storage it allocates.
+ */
+int picture_InitFromResource(picture_priv_t *, const video_format_t *,
+                             const picture_resource_t *);
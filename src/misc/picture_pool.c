@@ -36,29 +36,56 @@
 
 static const uintptr_t pool_max = CHAR_BIT * sizeof (unsigned long long);
 
+enum {
+    CLONE_RELEASED,
+    CLONE_USED,
+    CLONE_ORPHANED, /* taken away from its slot by picture_pool_Reset() */
+};
+
+struct picture_pool_clone {
+    picture_priv_t priv; /* must be first */
+    atomic_uint state;
+};
+
+struct picture_pool_slot {
+    struct picture_pool_clone *clone; /* handed out by picture_pool_Get() */
+    picture_priv_t pristine; /* initial state of the clone */
+};
+
 struct picture_pool_t {
     int       (*pic_lock)(picture_t *);
     void      (*pic_unlock)(picture_t *);
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
-    bool               canceled;
-    unsigned long long available;
+    atomic_bool        canceled;
+    atomic_ullong      available;
+    atomic_uint        waiters;
     atomic_ushort      refs;
     unsigned short     picture_count;
+    struct picture_pool_slot *slots;
     picture_t  *picture[];
 };
 
-static void picture_pool_Destroy(picture_pool_t *pool)
+static void picture_pool_Free(picture_pool_t *pool)
 {
-    if (atomic_fetch_sub(&pool->refs, 1) != 1)
-        return;
+    for (unsigned i = 0; i < pool->picture_count; i++)
+        free(pool->slots[i].clone);
 
     vlc_cond_destroy(&pool->wait);
     vlc_mutex_destroy(&pool->lock);
+    free(pool->slots);
     vlc_free(pool);
 }
 
+static void picture_pool_Destroy(picture_pool_t *pool)
+{
+    if (atomic_fetch_sub(&pool->refs, 1) != 1)
+        return;
+
+    picture_pool_Free(pool);
+}
+
 void picture_pool_Release(picture_pool_t *pool)
 {
     for (unsigned i = 0; i < pool->picture_count; i++)
@@ -66,26 +93,53 @@ void picture_pool_Release(picture_pool_t *pool)
     picture_pool_Destroy(pool);
 }
 
+/** Atomically takes the first available slot within mask, or returns -1 */
+static int picture_pool_TakeSlot(picture_pool_t *pool, unsigned long long mask)
+{
+    unsigned long long available = atomic_load(&pool->available);
+
+    while (available & mask)
+    {
+        int i = ffsll(available & mask) - 1;
+
+        if (atomic_compare_exchange_weak(&pool->available, &available,
+                                         available & ~(1ULL << i)))
+            return i;
+    }
+    return -1;
+}
+
+static void picture_pool_GiveSlot(picture_pool_t *pool, unsigned offset)
+{
+    unsigned long long prev = atomic_fetch_or(&pool->available, 1ULL << offset);
+    assert(!(prev & (1ULL << offset)));
+    (void) prev;
+
+    /* Only bother with the mutex if someone is sleeping in Wait() */
+    if (atomic_load(&pool->waiters) > 0)
+    {
+        vlc_mutex_lock(&pool->lock);
+        vlc_cond_signal(&pool->wait);
+        vlc_mutex_unlock(&pool->lock);
+    }
+}
+
 static void picture_pool_ReleasePicture(picture_t *clone)
 {
-    picture_priv_t *priv = (picture_priv_t *)clone;
-    uintptr_t sys = (uintptr_t)priv->gc.opaque;
+    struct picture_pool_clone *storage = (struct picture_pool_clone *)clone;
+    uintptr_t sys = (uintptr_t)storage->priv.gc.opaque;
     picture_pool_t *pool = (void *)(sys & ~(pool_max - 1));
     unsigned offset = sys & (pool_max - 1);
     picture_t *picture = pool->picture[offset];
 
-    free(clone);
-
     if (pool->pic_unlock != NULL)
         pool->pic_unlock(picture);
     picture_Release(picture);
 
-    vlc_mutex_lock(&pool->lock);
-    assert(!(pool->available & (1ULL << offset)));
-    pool->available |= 1ULL << offset;
-    vlc_cond_signal(&pool->wait);
-    vlc_mutex_unlock(&pool->lock);
-
+    if (atomic_exchange(&storage->state, CLONE_RELEASED) == CLONE_ORPHANED)
+        free(storage); /* the slot was reset and has new storage already */
+    else
+        picture_pool_GiveSlot(pool, offset);
     picture_pool_Destroy(pool);
 }
 
@@ -93,7 +147,39 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
                                             unsigned offset)
 {
     picture_t *picture = pool->picture[offset];
-    uintptr_t sys = ((uintptr_t)pool) + offset;
+    struct picture_pool_slot *slot = &pool->slots[offset];
+    struct picture_pool_clone *storage = slot->clone;
+    picture_t *clone = &storage->priv.picture;
+
+    /* The slot is ours until the clone is released: reuse it as is */
+    memcpy(&storage->priv, &slot->pristine, sizeof (storage->priv));
+    atomic_init(&storage->priv.gc.refs, 1);
+
+    clone->p_sys = picture->p_sys;
+    for (int i = 0; i < picture->i_planes; i++) {
+        clone->p[i].p_pixels = picture->p[i].p_pixels;
+        clone->p[i].i_lines = picture->p[i].i_lines;
+        clone->p[i].i_pitch = picture->p[i].i_pitch;
+    }
+
+    picture_Hold(picture);
+    atomic_fetch_add(&pool->refs, 1);
+    atomic_store(&storage->state, CLONE_USED);
+    return clone;
+}
+
+static struct picture_pool_clone *picture_pool_NewClone(void)
+{
+    struct picture_pool_clone *storage = malloc(sizeof (*storage));
+    if (likely(storage != NULL))
+        atomic_init(&storage->state, CLONE_RELEASED);
+    return storage;
+}
+
+static int picture_pool_InitSlot(picture_pool_t *pool, unsigned offset)
+{
+    picture_t *picture = pool->picture[offset];
+    picture_priv_t *pristine = &pool->slots[offset].pristine;
     picture_resource_t res = {
         .p_sys = picture->p_sys,
         .pf_destroy = picture_pool_ReleasePicture,
@@ -105,12 +191,14 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
         res.p[i].i_pitch = picture->p[i].i_pitch;
     }
 
-    picture_t *clone = picture_NewFromResource(&picture->format, &res);
-    if (likely(clone != NULL)) {
-        ((picture_priv_t *)clone)->gc.opaque = (void *)sys;
-        picture_Hold(picture);
-    }
-    return clone;
+    if (picture_InitFromResource(pristine, &picture->format, &res))
+        return VLC_EGENERIC;
+    pristine->gc.opaque = (void *)(((uintptr_t)pool) + offset);
+
+    pool->slots[offset].clone = picture_pool_NewClone();
+    if (unlikely(pool->slots[offset].clone == NULL))
+        return VLC_ENOMEM;
+    return VLC_SUCCESS;
 }
 
 picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg)
@@ -123,16 +211,32 @@ picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg
     if (unlikely(pool == NULL))
         return NULL;
 
+    pool->slots = malloc(cfg->picture_count * sizeof (*pool->slots));
+    if (unlikely(pool->slots == NULL && cfg->picture_count > 0)) {
+        vlc_free(pool);
+        return NULL;
+    }
+
     pool->pic_lock   = cfg->lock;
     pool->pic_unlock = cfg->unlock;
     vlc_mutex_init(&pool->lock);
     vlc_cond_init(&pool->wait);
-    pool->available = (1ULL << cfg->picture_count) - 1;
+    atomic_init(&pool->available, (1ULL << cfg->picture_count) - 1);
+    atomic_init(&pool->waiters, 0);
     atomic_init(&pool->refs,  1);
     pool->picture_count = cfg->picture_count;
     memcpy(pool->picture, cfg->picture,
            cfg->picture_count * sizeof (picture_t *));
-    pool->canceled = false;
+    atomic_init(&pool->canceled, false);
+
+    for (unsigned i = 0; i < pool->picture_count; i++)
+        pool->slots[i].clone = NULL;
+
+    for (unsigned i = 0; i < pool->picture_count; i++)
+        if (picture_pool_InitSlot(pool, i)) {
+            picture_pool_Free(pool);
+            return NULL;
+        }
     return pool;
 }
 
@@ -193,96 +297,73 @@ error:
     return NULL;
 }
 
-/** Find next (bit) set */
-static int fnsll(unsigned long long x, unsigned i)
-{
-    if (i >= CHAR_BIT * sizeof (x))
-        return 0;
-    return ffsll(x & ~((1ULL << i) - 1));
-}
-
 picture_t *picture_pool_Get(picture_pool_t *pool)
 {
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    unsigned long long mask = ~0ULL;
+    int i;
 
-    if (pool->canceled)
-    {
-        vlc_mutex_unlock(&pool->lock);
-        return NULL;
-    }
+    assert(atomic_load(&pool->refs) > 0);
 
-    for (unsigned i = ffsll(pool->available); i; i = fnsll(pool->available, i))
+    while (!atomic_load(&pool->canceled)
+        && (i = picture_pool_TakeSlot(pool, mask)) >= 0)
     {
-        pool->available &= ~(1ULL << (i - 1));
-        vlc_mutex_unlock(&pool->lock);
-
-        picture_t *picture = pool->picture[i - 1];
+        picture_t *picture = pool->picture[i];
 
         if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-            vlc_mutex_lock(&pool->lock);
-            pool->available |= 1ULL << (i - 1);
+            picture_pool_GiveSlot(pool, i);
+            mask &= ~(1ULL << i);
             continue;
         }
 
-        picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
-        if (clone != NULL) {
-            assert(clone->p_next == NULL);
-            atomic_fetch_add(&pool->refs, 1);
-        }
+        picture_t *clone = picture_pool_ClonePicture(pool, i);
+        assert(clone->p_next == NULL);
         return clone;
     }
-
-    vlc_mutex_unlock(&pool->lock);
     return NULL;
 }
 
 picture_t *picture_pool_Wait(picture_pool_t *pool)
 {
-    unsigned i;
+    int i;
 
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    while (pool->available == 0)
+    i = picture_pool_TakeSlot(pool, ~0ULL);
+    if (i < 0)
     {
-        if (pool->canceled)
+        vlc_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->waiters, 1);
+        while ((i = picture_pool_TakeSlot(pool, ~0ULL)) < 0)
         {
-            vlc_mutex_unlock(&pool->lock);
-            return NULL;
+            if (atomic_load(&pool->canceled))
+                break;
+            vlc_cond_wait(&pool->wait, &pool->lock);
         }
-        vlc_cond_wait(&pool->wait, &pool->lock);
-    }
+        atomic_fetch_sub(&pool->waiters, 1);
+        vlc_mutex_unlock(&pool->lock);
 
-    i = ffsll(pool->available);
-    assert(i > 0);
-    pool->available &= ~(1ULL << (i - 1));
-    vlc_mutex_unlock(&pool->lock);
+        if (i < 0)
+            return NULL;
+    }
 
-    picture_t *picture = pool->picture[i - 1];
+    picture_t *picture = pool->picture[i];
 
     if (pool->pic_lock != NULL && pool->pic_lock(picture) != VLC_SUCCESS) {
-        vlc_mutex_lock(&pool->lock);
-        pool->available |= 1ULL << (i - 1);
-        vlc_cond_signal(&pool->wait);
-        vlc_mutex_unlock(&pool->lock);
+        picture_pool_GiveSlot(pool, i);
         return NULL;
     }
 
-    picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
-    if (clone != NULL) {
-        assert(clone->p_next == NULL);
-        atomic_fetch_add(&pool->refs, 1);
-    }
+    picture_t *clone = picture_pool_ClonePicture(pool, i);
+    assert(clone->p_next == NULL);
     return clone;
 }
 
 void picture_pool_Cancel(picture_pool_t *pool, bool canceled)
 {
     vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    pool->canceled = canceled;
+    atomic_store(&pool->canceled, canceled);
     if (canceled)
         vlc_cond_broadcast(&pool->wait);
     vlc_mutex_unlock(&pool->lock);
@@ -290,16 +371,43 @@ void picture_pool_Cancel(picture_pool_t *pool, bool canceled)
 
 unsigned picture_pool_Reset(picture_pool_t *pool)
 {
-    unsigned ret;
+    unsigned long long available;
+    unsigned leaks = 0;
 
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
-    ret = pool->picture_count - popcountll(pool->available);
-    pool->available = (1ULL << pool->picture_count) - 1;
-    pool->canceled = false;
-    vlc_mutex_unlock(&pool->lock);
+    assert(atomic_load(&pool->refs) > 0);
+    available = atomic_load(&pool->available);
+
+    for (unsigned i = 0; i < pool->picture_count; i++)
+    {
+        if (available & (1ULL << i))
+            continue;
+
+        /* The leaked clone keeps its storage: the slot gets a new one, and
+         * the late release frees the old one instead of giving the slot. */
+        struct picture_pool_slot *slot = &pool->slots[i];
+        struct picture_pool_clone *storage = picture_pool_NewClone();
+        unsigned expected = CLONE_USED;
+
+        if (unlikely(storage == NULL))
+        {
+            leaks++;
+            continue;
+        }
+
+        if (!atomic_compare_exchange_strong(&slot->clone->state, &expected,
+                                            CLONE_ORPHANED))
+        {   /* Not leaked: concurrently taken, or being given back */
+            free(storage);
+            continue;
+        }
+
+        slot->clone = storage;
+        picture_pool_GiveSlot(pool, i);
+        leaks++;
+    }
 
-    return ret;
+    atomic_store(&pool->canceled, false);
+    return leaks;
 }
 
 unsigned picture_pool_GetSize(const picture_pool_t *pool)
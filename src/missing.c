@@ -65,6 +65,18 @@ httpd_file_t *httpd_FileNew (httpd_host_t *host,
     vlc_assert_unreachable ();
 }
 
+httpd_file_t *httpd_FileNewPath (httpd_host_t *host,
+                                 const char *url, const char *content_type,
+                                 const char *login, const char *password,
+                                 const char *path)
+{
+    (void) host;
+    (void) url; (void) content_type;
+    (void) login; (void) password;
+    (void) path;
+    vlc_assert_unreachable ();
+}
+
 httpd_handler_sys_t *httpd_HandlerDelete (httpd_handler_t *handler)
 {
     (void) handler;
@@ -158,7 +170,7 @@ httpd_stream_t *httpd_StreamNew (httpd_host_t *host,
     vlc_assert_unreachable ();
 }
 
-int httpd_StreamSend (httpd_stream_t *stream, const block_t *p_block)
+int httpd_StreamSend (httpd_stream_t *stream, block_t *p_block)
 {
     (void) stream; (void) p_block;
     vlc_assert_unreachable ();
@@ -36,6 +36,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_SEARCH_H
+# include <search.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
@@ -46,20 +49,240 @@
 #include "config/configuration.h"
 #include "modules/modules.h"
 
+/** Modules providing a capability, from the highest score to the lowest */
+struct vlc_modcap
+{
+    char *name;
+    module_t **modv;
+    size_t modc;
+};
+
+/** Module by (first shortcut) name */
+struct vlc_modname
+{
+    const char *name;
+    module_t *module;
+};
+
 static struct
 {
     vlc_mutex_t lock;
     block_t *caches;
+    void *caps_tree;
+    void *names_tree;
     unsigned usage;
-} modules = { VLC_STATIC_MUTEX, NULL, 0 };
+
+    /* Start-up timing (microseconds) */
+    struct
+    {
+        mtime_t cache_load;
+        mtime_t scan;
+        mtime_t cache_save;
+        mtime_t ready; /**< Date the bank was ready, or 0 */
+        atomic_bool first_load; /**< Whether a module was loaded yet */
+    } timing;
+} modules = { VLC_STATIC_MUTEX, NULL, NULL, NULL, 0,
+              { 0, 0, 0, 0, ATOMIC_VAR_INIT(false) } };
 
 vlc_plugin_t *vlc_plugins = NULL;
 
-static void module_StoreBank(vlc_plugin_t *lib)
+static int vlc_modcap_cmp(const void *a, const void *b)
+{
+    const struct vlc_modcap *capa = a, *capb = b;
+    return strcmp(capa->name, capb->name);
+}
+
+static void vlc_modcap_free(void *data)
+{
+    struct vlc_modcap *cap = data;
+
+    free(cap->modv);
+    free(cap->name);
+    free(cap);
+}
+
+static int vlc_modname_cmp(const void *a, const void *b)
+{
+    const struct vlc_modname *namea = a, *nameb = b;
+    return strcmp(namea->name, nameb->name);
+}
+
+/**
+ * Adds a module to the list of its capability, keeping it sorted by score.
+ */
+static int vlc_module_store_cap(module_t *mod)
+{
+    const char *name = module_get_capability(mod);
+    struct vlc_modcap *cap = malloc(sizeof (*cap));
+    if (unlikely(cap == NULL))
+        return -1;
+
+    cap->name = strdup(name);
+    cap->modv = NULL;
+    cap->modc = 0;
+
+    if (unlikely(cap->name == NULL))
+        goto error;
+
+    struct vlc_modcap **cp = tsearch(cap, &modules.caps_tree, vlc_modcap_cmp);
+    if (unlikely(cp == NULL))
+        goto error;
+
+    if (*cp != cap)
+    {
+        vlc_modcap_free(cap);
+        cap = *cp;
+    }
+
+    module_t **modv = realloc(cap->modv, sizeof (*modv) * (cap->modc + 1));
+    if (unlikely(modv == NULL))
+        return -1;
+
+    /* Modules stored later used to come first among those of equal score
+     * (the plug-ins list is built backward): keep it that way. */
+    size_t i = 0;
+    while (i < cap->modc && modv[i]->i_score > mod->i_score)
+        i++;
+
+    memmove(modv + i + 1, modv + i, sizeof (*modv) * (cap->modc - i));
+    modv[i] = mod;
+    cap->modv = modv;
+    cap->modc++;
+    return 0;
+error:
+    vlc_modcap_free(cap);
+    return -1;
+}
+
+/**
+ * Adds a module to the names index. For a given name, the latest plug-in
+ * wins, and within a plug-in, the first module (submodules inherit the name
+ * of the main module, which comes first).
+ */
+static int vlc_module_store_name(module_t *mod)
+{
+    if (unlikely(mod->i_shortcuts == 0))
+        return 0;
+
+    struct vlc_modname *name = malloc(sizeof (*name));
+    if (unlikely(name == NULL))
+        return -1;
+
+    name->name = mod->pp_shortcuts[0];
+    name->module = mod;
+
+    struct vlc_modname **np = tsearch(name, &modules.names_tree,
+                                      vlc_modname_cmp);
+    if (unlikely(np == NULL))
+    {
+        free(name);
+        return -1;
+    }
+
+    if (*np != name)
+    {   /* Shadow modules of earlier plug-ins, as linear lookups would */
+        if ((*np)->module->plugin != mod->plugin)
+        {
+            (*np)->name = name->name;
+            (*np)->module = mod;
+        }
+        free(name);
+    }
+    return 0;
+}
+
+/**
+ * Removes a module from the list of its capability.
+ */
+static void vlc_module_unstore_cap(module_t *mod)
+{
+    const struct vlc_modcap key = {
+        .name = (char *)module_get_capability(mod),
+    };
+    struct vlc_modcap **cp = tfind(&key, &modules.caps_tree, vlc_modcap_cmp);
+    if (cp == NULL)
+        return;
+
+    struct vlc_modcap *cap = *cp;
+    for (size_t i = 0; i < cap->modc; i++)
+        if (cap->modv[i] == mod)
+        {
+            memmove(cap->modv + i, cap->modv + i + 1,
+                    sizeof (*cap->modv) * (cap->modc - i - 1));
+            cap->modc--;
+            break;
+        }
+
+    if (cap->modc == 0)
+    {
+        tdelete(cap, &modules.caps_tree, vlc_modcap_cmp);
+        vlc_modcap_free(cap);
+    }
+}
+
+/**
+ * Finds the module that the names index held for a name, among the stored
+ * plug-ins: the first one of the latest plug-in.
+ */
+static module_t *vlc_module_find_stored(const char *name)
+{
+    for (vlc_plugin_t *lib = vlc_plugins; lib != NULL; lib = lib->next)
+        for (module_t *m = lib->module; m != NULL; m = m->next)
+            if (m->i_shortcuts > 0 && strcmp(m->pp_shortcuts[0], name) == 0)
+                return m;
+    return NULL;
+}
+
+/**
+ * Removes a module from the names index, uncovering the one it shadowed.
+ */
+static void vlc_module_unstore_name(module_t *mod)
+{
+    if (mod->i_shortcuts == 0)
+        return;
+
+    const struct vlc_modname key = { .name = mod->pp_shortcuts[0] };
+    struct vlc_modname **np = tfind(&key, &modules.names_tree,
+                                    vlc_modname_cmp);
+    if (np == NULL || (*np)->module != mod)
+        return;
+
+    struct vlc_modname *name = *np;
+    module_t *prev = vlc_module_find_stored(name->name);
+
+    if (prev != NULL)
+    {
+        name->name = prev->pp_shortcuts[0];
+        name->module = prev;
+    }
+    else
+    {
+        tdelete(name, &modules.names_tree, vlc_modname_cmp);
+        free(name);
+    }
+}
+
+/**
+ * Adds the modules of a plug-in to the bank.
+ * On error, none of them is left in the bank, and the plug-in is not stored.
+ */
+static int module_StoreBank(vlc_plugin_t *lib)
 {
     /*vlc_assert_locked (&modules.lock);*/
+    for (module_t *m = lib->module; m != NULL; m = m->next)
+        if (unlikely(vlc_module_store_cap(m) || vlc_module_store_name(m)))
+        {
+            for (module_t *u = lib->module; u != m->next; u = u->next)
+            {
+                vlc_module_unstore_cap(u);
+                vlc_module_unstore_name(u);
+            }
+            return -1;
+        }
+
     lib->next = vlc_plugins;
     vlc_plugins = lib;
+    return 0;
 }
 
 /**
@@ -95,8 +318,8 @@ static void module_InitStaticModules(void)
     for (unsigned i = 0; vlc_static_modules[i]; i++)
     {
         vlc_plugin_t *lib = module_InitStatic(vlc_static_modules[i]);
-        if (likely(lib != NULL))
-            module_StoreBank(lib);
+        if (likely(lib != NULL) && unlikely(module_StoreBank(lib)))
+            vlc_plugin_destroy(lib);
     }
 }
 #else
@@ -168,6 +391,8 @@ typedef struct module_bank
     vlc_plugin_t *cache;
 } module_bank_t;
 
+static void module_Unmap(vlc_plugin_t *);
+
 /**
  * Scans a plug-in from a file.
  */
@@ -207,7 +432,13 @@ static int AllocatePluginFile (module_bank_t *bank, const char *abspath,
     if (plugin == NULL)
         return -1;
 
-    module_StoreBank(plugin);
+    if (unlikely(module_StoreBank(plugin)))
+    {
+        msg_Err(bank->obj, "cannot register plug-in %s", abspath);
+        module_Unmap(plugin);
+        vlc_plugin_destroy(plugin);
+        return -1;
+    }
 
     if (bank->mode & CACHE_WRITE_FILE) /* Add entry to to-be-saved cache */
     {
@@ -312,11 +543,16 @@ static void AllocatePluginPath(vlc_object_t *obj, const char *path,
         .mode = mode,
     };
 
+    mtime_t date = mdate();
+
     if (mode & CACHE_READ_FILE)
         bank.cache = vlc_cache_load(obj, path, &modules.caches);
     else
         msg_Dbg(bank.obj, "ignoring plugins cache file");
 
+    modules.timing.cache_load += mdate() - date;
+    date = mdate();
+
     if (mode & CACHE_SCAN_DIR)
     {
         msg_Dbg(obj, "recursively browsing `%s'", bank.base);
@@ -331,15 +567,18 @@ static void AllocatePluginPath(vlc_object_t *obj, const char *path,
         vlc_plugin_t *plugin = bank.cache;
 
         bank.cache = plugin->next;
-        if (mode & CACHE_SCAN_DIR)
+        if ((mode & CACHE_SCAN_DIR) || module_StoreBank(plugin))
             vlc_plugin_destroy(plugin);
-        else
-            module_StoreBank(plugin);
     }
 
+    modules.timing.scan += mdate() - date;
+    date = mdate();
+
     if (mode & CACHE_WRITE_FILE)
         CacheSave(obj, path, bank.plugins, bank.size);
 
+    modules.timing.cache_save += mdate() - date;
+
     free(bank.plugins);
 }
 
@@ -481,8 +720,11 @@ static void module_Unmap(vlc_plugin_t *plugin)
  *
  * Creates a module bank structure which will be filled later
  * on with all the modules found.
+ *
+ * \return 0 on success, -1 if the core module could not be stored (the bank
+ * lock is then released)
  */
-void module_InitBank (void)
+int module_InitBank (void)
 {
     vlc_mutex_lock (&modules.lock);
 
@@ -494,8 +736,13 @@ void module_InitBank (void)
          * options of core will be available in the module bank structure just
          * as for every other module. */
         vlc_plugin_t *plugin = module_InitStatic(vlc_entry__core);
-        if (likely(plugin != NULL))
-            module_StoreBank(plugin);
+        if (unlikely(plugin == NULL || module_StoreBank(plugin)))
+        {
+            if (plugin != NULL)
+                vlc_plugin_destroy(plugin);
+            vlc_mutex_unlock (&modules.lock);
+            return -1;
+        }
         config_SortConfig ();
     }
     modules.usage++;
@@ -508,6 +755,7 @@ void module_InitBank (void)
      * DO NOT UNCOMMENT the following line unless you managed to squeeze
      * module_LoadPlugins() before you unlock the mutex. */
     /*vlc_mutex_unlock (&modules.lock);*/
+    return 0;
 }
 
 /**
@@ -518,6 +766,7 @@ void module_EndBank (bool b_plugins)
 {
     vlc_plugin_t *libs = NULL;
     block_t *caches = NULL;
+    void *caps_tree = NULL, *names_tree = NULL;
 
     /* If plugins were _not_ loaded, then the caller still has the bank lock
      * from module_InitBank(). */
@@ -532,11 +781,23 @@ void module_EndBank (bool b_plugins)
         config_UnsortConfig ();
         libs = vlc_plugins;
         caches = modules.caches;
+        caps_tree = modules.caps_tree;
+        names_tree = modules.names_tree;
         vlc_plugins = NULL;
         modules.caches = NULL;
+        modules.caps_tree = NULL;
+        modules.names_tree = NULL;
+        modules.timing.cache_load = 0;
+        modules.timing.scan = 0;
+        modules.timing.cache_save = 0;
+        modules.timing.ready = 0;
+        atomic_store(&modules.timing.first_load, false);
     }
     vlc_mutex_unlock (&modules.lock);
 
+    tdestroy(caps_tree, vlc_modcap_free);
+    tdestroy(names_tree, free);
+
     while (libs != NULL)
     {
         vlc_plugin_t *lib = libs;
@@ -563,13 +824,28 @@ size_t module_LoadPlugins (vlc_object_t *obj)
 
     if (modules.usage == 1)
     {
+        mtime_t start = mdate();
+
         module_InitStaticModules ();
+
+        mtime_t dynamic = mdate();
 #ifdef HAVE_DYNAMIC_PLUGINS
         msg_Dbg (obj, "searching plug-in modules");
         AllocateAllPlugins (obj);
 #endif
+        mtime_t config = mdate();
+
         config_UnsortConfig ();
         config_SortConfig ();
+
+        modules.timing.ready = mdate();
+        msg_Dbg (obj, "plug-ins start-up took %"PRId64" us: static %"PRId64
+                 " us, dynamic %"PRId64" us (cache load %"PRId64" us, "
+                 "scan %"PRId64" us, cache save %"PRId64" us), "
+                 "configuration %"PRId64" us", modules.timing.ready - start,
+                 dynamic - start, config - dynamic, modules.timing.cache_load,
+                 modules.timing.scan, modules.timing.cache_save,
+                 modules.timing.ready - config);
     }
     vlc_mutex_unlock (&modules.lock);
 
@@ -580,6 +856,25 @@ size_t module_LoadPlugins (vlc_object_t *obj)
     return count;
 }
 
+/**
+ * Reports how long after the plug-ins were loaded the first module was.
+ *
+ * \note This only prints a debug message the first time it is called.
+ */
+void module_TraceFirstLoad(vlc_object_t *obj, const module_t *module)
+{
+    if (likely(atomic_load_explicit(&modules.timing.first_load,
+                                    memory_order_relaxed))
+     || atomic_exchange(&modules.timing.first_load, true))
+        return;
+
+    /* The bank is read-only once loaded, no need to lock */
+    if (modules.timing.ready != 0)
+        msg_Dbg(obj, "first module \"%s\" loaded %"PRId64" us after "
+                "plug-ins", module_get_object(module),
+                mdate() - modules.timing.ready);
+}
+
 /**
  * Frees the flat list of VLC modules.
  * @param list list obtained by module_list_get()
@@ -622,14 +917,6 @@ module_t **module_list_get (size_t *n)
     return tab;
 }
 
-static int modulecmp (const void *a, const void *b)
-{
-    const module_t *const *ma = a, *const *mb = b;
-    /* Note that qsort() uses _ascending_ order,
-     * so the smallest module is the one with the biggest score. */
-    return (*mb)->i_score - (*ma)->i_score;
-}
-
 /**
  * Builds a sorted list of all VLC modules with a given capability.
  * The list is sorted from the highest module score to the lowest.
@@ -640,27 +927,40 @@ static int modulecmp (const void *a, const void *b)
  */
 ssize_t module_list_cap (module_t ***restrict list, const char *cap)
 {
-    /* TODO: This is quite inefficient. List should be sorted by capability. */
-    ssize_t n = 0;
+    const struct vlc_modcap key = { .name = (char *)cap };
+    struct vlc_modcap **cp;
 
     assert (list != NULL);
 
-    for (vlc_plugin_t *lib = vlc_plugins; lib != NULL; lib = lib->next)
-         for (module_t *m = lib->module; m != NULL; m = m->next)
-             if (module_provides(m, cap))
-                 n++;
+    cp = tfind(&key, &modules.caps_tree, vlc_modcap_cmp);
+    if (cp == NULL)
+    {
+        *list = NULL;
+        return 0;
+    }
+
+    const struct vlc_modcap *capv = *cp;
+    size_t n = capv->modc;
 
     module_t **tab = malloc (sizeof (*tab) * n);
     *list = tab;
     if (unlikely(tab == NULL))
         return -1;
 
-    for (vlc_plugin_t *lib = vlc_plugins; lib != NULL; lib = lib->next)
-         for (module_t *m = lib->module; m != NULL; m = m->next)
-             if (module_provides (m, cap))
-                 *(tab++) = m;
-
-    assert (tab == *list + n);
-    qsort (*list, n, sizeof (*tab), modulecmp);
+    memcpy(tab, capv->modv, sizeof (*tab) * n);
     return n;
 }
+
+/**
+ * Finds a module by name, i.e. its first shortcut.
+ * @param name module name
+ * @return the module or NULL if not found.
+ */
+module_t *module_list_find (const char *name)
+{
+    const struct vlc_modname key = { .name = name };
+    struct vlc_modname **np;
+
+    np = tfind(&key, &modules.names_tree, vlc_modname_cmp);
+    return (np != NULL) ? (*np)->module : NULL;
+}
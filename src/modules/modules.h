@@ -111,13 +111,15 @@ void vlc_module_destroy (module_t *);
 vlc_plugin_t *vlc_plugin_describe(vlc_plugin_cb);
 int vlc_plugin_resolve(vlc_plugin_t *, vlc_plugin_cb);
 
-void module_InitBank (void);
+int module_InitBank (void);
 size_t module_LoadPlugins( vlc_object_t * );
 #define module_LoadPlugins(a) module_LoadPlugins(VLC_OBJECT(a))
 void module_EndBank (bool);
 int module_Map(vlc_object_t *, vlc_plugin_t *);
 
 ssize_t module_list_cap (module_t ***, const char *);
+module_t *module_list_find (const char *);
+void module_TraceFirstLoad(vlc_object_t *, const module_t *);
 
 int vlc_bindtextdomain (const char *);
 
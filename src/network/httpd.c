@@ -40,15 +40,27 @@
 #include <vlc_url.h>
 #include <vlc_mime.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
+#include <vlc_fs.h>
 #include "../libvlc.h"
 
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_POLL
 # include <poll.h>
 #endif
+#ifdef HAVE_SENDFILE
+# include <sys/sendfile.h>
+#endif
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# define HTTPD_EPOLL 1
+#endif
 
 #if defined(_WIN32)
 #   include <winsock2.h>
@@ -63,10 +75,40 @@
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+/* maximum number of stream segments sent at once to a client */
+#define HTTPD_CL_SEGMENTS 32
+
 static void httpd_ClientDestroy(httpd_client_t *cl);
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data);
+static void httpd_AppendData(httpd_stream_t *stream, block_t *p_block);
 
-/* each host run in his own thread */
+/* a block of stream data, shared by all the clients sending it */
+typedef struct httpd_segment_t httpd_segment_t;
+struct httpd_segment_t
+{
+    httpd_segment_t *p_next; /* protected by the stream lock */
+    block_t         *p_block;
+    int64_t          i_pos;  /* absolute position of the first byte */
+    atomic_uint      refs;
+};
+
+/* each worker thread serves its own share of the host clients */
+typedef struct
+{
+    httpd_host_t *host;
+
+    vlc_thread_t thread;
+    vlc_mutex_t  lock; /* protects the clients, held while serving them */
+
+    int            i_client;
+    httpd_client_t **client;
+
+#ifdef HTTPD_EPOLL
+    int          epfd;
+    int          evfd; /* wakes the worker up */
+#endif
+} httpd_worker_t;
+
+/* each host run in his own thread(s) */
 struct httpd_host_t
 {
     VLC_COMMON_MEMBERS
@@ -79,7 +121,11 @@ struct httpd_host_t
     unsigned     nfd;
     unsigned     port;
 
-    vlc_thread_t thread;
+    /* the first worker also accepts new connections */
+    unsigned        i_worker;
+    unsigned        i_next_worker;
+    httpd_worker_t *worker;
+
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
@@ -90,9 +136,6 @@ struct httpd_host_t
     int         i_url;
     httpd_url_t **url;
 
-    int            i_client;
-    httpd_client_t **client;
-
     /* TLS data */
     vlc_tls_creds_t *p_tls;
 };
@@ -149,6 +192,7 @@ struct httpd_client_t
 
     bool    b_stream_mode;
     uint8_t i_state;
+    short   i_poll_events; /* currently waited for */
 
     mtime_t i_activity_date;
     mtime_t i_activity_timeout;
@@ -165,6 +209,21 @@ struct httpd_client_t
      */
     int64_t i_keyframe_wait_to_pass;
 
+    /*
+     * Stream data sent in place from the shared segments. Segments already
+     * sent are kept referenced until the next ones are fetched, so that the
+     * last one can be used to resume from.
+     */
+    httpd_segment_t *p_segments[HTTPD_CL_SEGMENTS];
+    unsigned i_segments;
+    unsigned i_segment;         /* first segment not fully sent */
+    size_t   i_segment_offset;  /* bytes of it already sent */
+
+    /* File the body is sent from, -1 if none */
+    int      i_file_fd;
+    uint64_t i_file_offset;
+    uint64_t i_file_left;
+
     /* */
     httpd_message_t query;  /* client -> httpd */
     httpd_message_t answer; /* httpd -> client */
@@ -302,6 +361,7 @@ struct httpd_file_t
     httpd_url_t *url;
     httpd_file_callback_t pf_fill;
     httpd_file_sys_t      *p_sys;
+    const char *path; /* served from disk if not NULL */
     char mime[1];
 };
 
@@ -356,6 +416,122 @@ httpd_FileCallBack(httpd_callback_sys_t *p_sys, httpd_client_t *cl,
     return VLC_SUCCESS;
 }
 
+/**
+ * Parses a single byte range request for a file.
+ * @return 0 if the range is valid, -1 if it cannot be satisfied,
+ *         1 if it should be ignored and the whole file sent
+ */
+static int httpd_ParseRange(const char *str, uint64_t size,
+                            uint64_t *start, uint64_t *end)
+{
+    char *end_str;
+
+    /* Multiple ranges are not supported */
+    if (strncasecmp(str, "bytes=", 6) || strchr(str, ',') != NULL)
+        return 1;
+    str += 6;
+
+    if (*str == '-') {
+        /* last bytes */
+        uint64_t len = strtoull(str + 1, &end_str, 10);
+        if (end_str == str + 1 || *end_str)
+            return 1;
+        if (len == 0 || size == 0)
+            return -1;
+        *start = (len < size) ? size - len : 0;
+        *end = size;
+        return 0;
+    }
+
+    uint64_t first = strtoull(str, &end_str, 10), last = UINT64_MAX;
+    if (end_str == str || *end_str != '-')
+        return 1;
+    str = end_str + 1;
+    if (*str) {
+        last = strtoull(str, &end_str, 10);
+        if (end_str == str || *end_str || last < first)
+            return 1;
+    }
+
+    if (first >= size)
+        return -1;
+    *start = first;
+    *end = (last < size - 1) ? last + 1 : size;
+    return 0;
+}
+
+static int
+httpd_PathCallBack(httpd_callback_sys_t *p_sys, httpd_client_t *cl,
+                    httpd_message_t *answer, const httpd_message_t *query)
+{
+    httpd_file_t *file = (httpd_file_t*)p_sys;
+    const char *psz_connection, *psz_range;
+    struct stat st;
+
+    if (!answer || !query)
+        return VLC_SUCCESS;
+
+    answer->i_proto  = HTTPD_PROTO_HTTP;
+    answer->i_version= 1;
+    answer->i_type   = HTTPD_MSG_ANSWER;
+
+    /* We respect client request */
+    psz_connection = httpd_MsgGet(&cl->query, "Connection");
+    if (psz_connection)
+        httpd_MsgAdd(answer, "Connection", "%s", psz_connection);
+
+    int fd = vlc_open(file->path, O_RDONLY);
+    if (fd != -1 && (fstat(fd, &st) || !S_ISREG(st.st_mode))) {
+        vlc_close(fd);
+        fd = -1;
+    }
+    if (fd == -1) {
+        char *p;
+
+        answer->i_status = 404;
+        answer->i_body = httpd_HtmlError(&p, 404, query->psz_url);
+        answer->p_body = (uint8_t *)p;
+        httpd_MsgAdd(answer, "Content-Type", "%s", "text/html");
+        httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
+        return VLC_SUCCESS;
+    }
+
+    uint64_t size = st.st_size, start = 0, end = size;
+
+    answer->i_status = 200;
+    httpd_MsgAdd(answer, "Content-Type", "%s", file->mime);
+    httpd_MsgAdd(answer, "Accept-Ranges", "bytes");
+
+    psz_range = httpd_MsgGet(query, "Range");
+    if (psz_range != NULL)
+        switch (httpd_ParseRange(psz_range, size, &start, &end)) {
+            case 0:
+                answer->i_status = 206;
+                httpd_MsgAdd(answer, "Content-Range",
+                             "bytes %"PRIu64"-%"PRIu64"/%"PRIu64,
+                             start, end - 1, size);
+                break;
+            case -1:
+                answer->i_status = 416;
+                httpd_MsgAdd(answer, "Content-Range", "bytes */%"PRIu64,
+                             size);
+                start = end = 0;
+                break;
+        }
+
+    httpd_MsgAdd(answer, "Content-Length", "%"PRIu64, end - start);
+
+    /* The body is sent straight from the file by httpd_ClientSend() */
+    if (query->i_type == HTTPD_MSG_HEAD || start == end) {
+        vlc_close(fd);
+        return VLC_SUCCESS;
+    }
+    cl->i_file_fd = fd;
+    cl->i_file_offset = start;
+    cl->i_file_left = end - start;
+    return VLC_SUCCESS;
+}
+
 httpd_file_t *httpd_FileNew(httpd_host_t *host,
                              const char *psz_url, const char *psz_mime,
                              const char *psz_user, const char *psz_password,
@@ -379,6 +555,7 @@ httpd_file_t *httpd_FileNew(httpd_host_t *host,
 
     file->pf_fill = pf_fill;
     file->p_sys   = p_sys;
+    file->path    = NULL;
     memcpy(file->mime, mime, mimelen + 1);
 
     httpd_UrlCatch(file->url, HTTPD_MSG_HEAD, httpd_FileCallBack,
@@ -391,6 +568,39 @@ httpd_file_t *httpd_FileNew(httpd_host_t *host,
     return file;
 }
 
+httpd_file_t *httpd_FileNewPath(httpd_host_t *host,
+                                 const char *psz_url, const char *psz_mime,
+                                 const char *psz_user, const char *psz_password,
+                                 const char *psz_path)
+{
+    const char *mime = psz_mime;
+    if (mime == NULL || mime[0] == '\0')
+        mime = vlc_mime_Ext2Mime(psz_url);
+
+    size_t mimelen = strlen(mime), pathlen = strlen(psz_path);
+    httpd_file_t *file = malloc(sizeof(*file) + mimelen + pathlen + 1);
+    if (unlikely(file == NULL))
+        return NULL;
+
+    file->url = httpd_UrlNew(host, psz_url, psz_user, psz_password);
+    if (!file->url) {
+        free(file);
+        return NULL;
+    }
+
+    file->pf_fill = NULL;
+    file->p_sys   = NULL;
+    memcpy(file->mime, mime, mimelen + 1);
+    file->path = memcpy(file->mime + mimelen + 1, psz_path, pathlen + 1);
+
+    httpd_UrlCatch(file->url, HTTPD_MSG_HEAD, httpd_PathCallBack,
+                    (httpd_callback_sys_t*)file);
+    httpd_UrlCatch(file->url, HTTPD_MSG_GET,  httpd_PathCallBack,
+                    (httpd_callback_sys_t*)file);
+
+    return file;
+}
+
 httpd_file_sys_t *httpd_FileDelete(httpd_file_t *file)
 {
     httpd_file_sys_t *p_sys = file->p_sys;
@@ -611,9 +821,11 @@ struct httpd_stream_t
     bool        b_has_keyframes;
     int64_t     i_last_keyframe_seen_pos;
 
-    /* circular buffer */
-    int         i_buffer_size;      /* buffer size, can't be reallocated smaller */
-    uint8_t     *p_buffer;          /* buffer */
+    /* segments of data, oldest first, shared with the clients */
+    int64_t     i_buffer_size;      /* bytes kept for late clients */
+    int64_t     i_buffer;           /* bytes currently kept */
+    httpd_segment_t *p_first;
+    httpd_segment_t *p_last;
     int64_t     i_buffer_pos;       /* absolute position from beginning */
     int64_t     i_buffer_last_pos;  /* a new connection will start with that */
 
@@ -622,6 +834,43 @@ struct httpd_stream_t
     httpd_header * p_http_headers;
 };
 
+static void httpd_SegmentRelease(httpd_segment_t *seg)
+{
+    if (atomic_fetch_sub(&seg->refs, 1) == 1) {
+        block_Release(seg->p_block);
+        free(seg);
+    }
+}
+
+static void httpd_ClientReleaseSegments(httpd_client_t *cl)
+{
+    for (unsigned i = 0; i < cl->i_segments; i++)
+        httpd_SegmentRelease(cl->p_segments[i]);
+    cl->i_segments = 0;
+    cl->i_segment = 0;
+    cl->i_segment_offset = 0;
+}
+
+/* Finds the segment holding a given position, with the stream lock held */
+static httpd_segment_t *httpd_StreamSeek(httpd_stream_t *stream,
+                                         const httpd_segment_t *resume,
+                                         int64_t i_pos)
+{
+    /* Eviction leaves p_next as is, but the successor of an evicted segment
+     * may have been freed already: only follow it from a queued segment */
+    if (resume != NULL && resume->i_pos >= stream->p_first->i_pos
+     && resume->i_pos + (int64_t)resume->p_block->i_buffer == i_pos)
+        return resume->p_next;
+
+    if (i_pos >= stream->p_last->i_pos)
+        return stream->p_last;
+
+    httpd_segment_t *seg = stream->p_first;
+    while (seg->i_pos + (int64_t)seg->p_block->i_buffer <= i_pos)
+        seg = seg->p_next;
+    return seg;
+}
+
 static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
                                  httpd_client_t *cl, httpd_message_t *answer,
                                  const httpd_message_t *query)
@@ -632,48 +881,59 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         return VLC_SUCCESS;
 
     if (answer->i_body_offset > 0) {
-        int     i_pos;
+        httpd_segment_t *resume = NULL;
 
-        if (answer->i_body_offset >= stream->i_buffer_pos)
+        vlc_mutex_lock(&stream->lock);
+        if (answer->i_body_offset >= stream->i_buffer_pos) {
+            vlc_mutex_unlock(&stream->lock);
             return VLC_EGENERIC;    /* wait, no data available */
+        }
 
         if (cl->i_keyframe_wait_to_pass >= 0) {
-            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
+            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass) {
                 /* still waiting for the next keyframe */
+                vlc_mutex_unlock(&stream->lock);
                 return VLC_EGENERIC;
+            }
 
             /* seek to the new keyframe */
             answer->i_body_offset = stream->i_last_keyframe_seen_pos;
             cl->i_keyframe_wait_to_pass = -1;
         }
 
-        if (answer->i_body_offset + stream->i_buffer_size < stream->i_buffer_pos)
+        if (answer->i_body_offset < stream->p_first->i_pos)
             answer->i_body_offset = stream->i_buffer_last_pos; /* this client isn't fast enough */
 
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        int64_t i_write = stream->i_buffer_pos - answer->i_body_offset;
-
-        if (i_write > HTTPD_CL_BUFSIZE)
-            i_write = HTTPD_CL_BUFSIZE;
-        else if (i_write <= 0)
-            return VLC_EGENERIC;    /* wait, no data available */
-
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN(i_write, stream->i_buffer_size - i_pos);
+        if (cl->i_segments > 0)
+            resume = cl->p_segments[cl->i_segments - 1];
+
+        httpd_segment_t *seg = httpd_StreamSeek(stream, resume,
+                                                answer->i_body_offset);
+        size_t i_offset = answer->i_body_offset - seg->i_pos;
+
+        /* Reference the data instead of copying it */
+        httpd_ClientReleaseSegments(cl);
+        do {
+            atomic_fetch_add(&seg->refs, 1);
+            cl->p_segments[cl->i_segments++] = seg;
+            answer->i_body_offset = seg->i_pos + seg->p_block->i_buffer;
+            seg = seg->p_next;
+        } while (seg != NULL && cl->i_segments < HTTPD_CL_SEGMENTS);
+        cl->i_segment_offset = i_offset;
+        vlc_mutex_unlock(&stream->lock);
 
         /* using HTTPD_MSG_ANSWER -> data available */
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
         answer->i_type   = HTTPD_MSG_ANSWER;
 
-        answer->i_body = i_write;
-        answer->p_body = xmalloc(i_write);
-        memcpy(answer->p_body, &stream->p_buffer[i_pos], i_write);
-
-        answer->i_body_offset += i_write;
+        answer->i_body = 0;
+        answer->p_body = NULL;
 
         return VLC_SUCCESS;
     } else {
+        httpd_ClientReleaseSegments(cl);
+
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
         answer->i_type   = HTTPD_MSG_ANSWER;
@@ -766,7 +1026,9 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_header = 0;
     stream->p_header = NULL;
     stream->i_buffer_size = 5000000;    /* 5 Mo per stream */
-    stream->p_buffer = xmalloc(stream->i_buffer_size);
+    stream->i_buffer = 0;
+    stream->p_first = NULL;
+    stream->p_last = NULL;
     /* We set to 1 to make life simpler
      * (this way i_body_offset can never be 0) */
     stream->i_buffer_pos = 1;
@@ -802,28 +1064,47 @@ int httpd_StreamHeader(httpd_stream_t *stream, uint8_t *p_data, int i_data)
     return VLC_SUCCESS;
 }
 
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data)
+static void httpd_AppendData(httpd_stream_t *stream, block_t *p_block)
 {
-    int i_pos = stream->i_buffer_pos % stream->i_buffer_size;
-    int i_count = i_data;
-    while (i_count > 0) {
-        int i_copy = __MIN(i_count, stream->i_buffer_size - i_pos);
+    httpd_segment_t *seg = malloc(sizeof (*seg));
+    if (unlikely(seg == NULL)) {
+        block_Release(p_block);
+        return;
+    }
 
-        /* Ok, we can't go past the end of our buffer */
-        memcpy(&stream->p_buffer[i_pos], p_data, i_copy);
+    p_block->p_next = NULL;
+    seg->p_next = NULL;
+    seg->p_block = p_block;
+    seg->i_pos = stream->i_buffer_pos;
+    atomic_init(&seg->refs, 1);
 
-        i_pos = (i_pos + i_copy) % stream->i_buffer_size;
-        i_count -= i_copy;
-        p_data  += i_copy;
+    if (stream->p_last != NULL)
+        stream->p_last->p_next = seg;
+    else
+        stream->p_first = seg;
+    stream->p_last = seg;
+    stream->i_buffer += p_block->i_buffer;
+    stream->i_buffer_pos += p_block->i_buffer;
+
+    /* Drop the oldest data, clients still sending it keep it alive */
+    while (stream->i_buffer - (int64_t)stream->p_first->p_block->i_buffer
+                                                   >= stream->i_buffer_size) {
+        httpd_segment_t *first = stream->p_first;
+
+        stream->p_first = first->p_next;
+        stream->i_buffer -= first->p_block->i_buffer;
+        httpd_SegmentRelease(first);
     }
-
-    stream->i_buffer_pos += i_data;
 }
 
-int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
+int httpd_StreamSend(httpd_stream_t *stream, block_t *p_block)
 {
-    if (!p_block || !p_block->p_buffer)
+    if (!p_block)
+        return VLC_SUCCESS;
+    if (p_block->i_buffer == 0) {
+        block_Release(p_block);
         return VLC_SUCCESS;
+    }
 
     vlc_mutex_lock(&stream->lock);
 
@@ -835,7 +1116,7 @@ int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
         stream->i_last_keyframe_seen_pos = stream->i_buffer_pos;
     }
 
-    httpd_AppendData(stream, p_block->p_buffer, p_block->i_buffer);
+    httpd_AppendData(stream, p_block);
 
     vlc_mutex_unlock(&stream->lock);
     return VLC_SUCCESS;
@@ -852,14 +1133,19 @@ void httpd_StreamDelete(httpd_stream_t *stream)
     vlc_mutex_destroy(&stream->lock);
     free(stream->psz_mime);
     free(stream->p_header);
-    free(stream->p_buffer);
+    while (stream->p_first != NULL) {
+        httpd_segment_t *seg = stream->p_first;
+
+        stream->p_first = seg->p_next;
+        httpd_SegmentRelease(seg);
+    }
     free(stream);
 }
 
 /*****************************************************************************
  * Low level
  *****************************************************************************/
-static void* httpd_HostThread(void *);
+static void* httpd_WorkerThread(void *);
 static httpd_host_t *httpd_HostCreate(vlc_object_t *, const char *,
                                        const char *, vlc_tls_creds_t *);
 
@@ -906,6 +1192,64 @@ static struct httpd
     int          i_host;
 } httpd = { VLC_STATIC_MUTEX, NULL, 0 };
 
+static int httpd_WorkerInit(httpd_host_t *host, httpd_worker_t *w)
+{
+    w->host = host;
+    vlc_mutex_init(&w->lock);
+    w->i_client = 0;
+    w->client = NULL;
+
+#ifdef HTTPD_EPOLL
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epfd == -1)
+        goto error;
+
+    w->evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (w->evfd == -1) {
+        close(w->epfd);
+        goto error;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w };
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->evfd, &ev))
+        goto error_ep;
+
+    /* Only the first worker accepts connections */
+    if (w == host->worker) {
+        ev.data.ptr = host;
+        for (unsigned i = 0; i < host->nfd; i++)
+            if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, host->fds[i], &ev))
+                goto error_ep;
+    }
+#endif
+    return 0;
+
+#ifdef HTTPD_EPOLL
+error_ep:
+    msg_Err(host, "cannot poll HTTP host sockets: %s",
+            vlc_strerror_c(errno));
+    close(w->evfd);
+    close(w->epfd);
+error:
+    vlc_mutex_destroy(&w->lock);
+    return -1;
+#endif
+}
+
+static void httpd_WorkerClean(httpd_worker_t *w)
+{
+    for (int i = 0; i < w->i_client; i++) {
+        msg_Warn(w->host, "client still connected");
+        httpd_ClientDestroy(w->client[i]);
+    }
+    TAB_CLEAN(w->i_client, w->client);
+#ifdef HTTPD_EPOLL
+    close(w->evfd);
+    close(w->epfd);
+#endif
+    vlc_mutex_destroy(&w->lock);
+}
+
 static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
                                        const char *hostvar,
                                        const char *portvar,
@@ -959,6 +1303,9 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     vlc_mutex_init(&host->lock);
     vlc_cond_init(&host->wait);
     host->i_ref = 1;
+    host->i_worker = 0;
+    host->i_next_worker = 0;
+    host->worker = NULL;
 
     host->fds = net_ListenTCP(p_this, url.psz_host, port);
     if (!host->fds) {
@@ -970,15 +1317,32 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     host->port     = port;
     host->i_url    = 0;
     host->url      = NULL;
-    host->i_client = 0;
-    host->client   = NULL;
     host->p_tls    = p_tls;
 
-    /* create the thread */
-    if (vlc_clone(&host->thread, httpd_HostThread, host,
-                   VLC_THREAD_PRIORITY_LOW)) {
-        msg_Err(p_this, "cannot spawn http host thread");
+#ifdef HTTPD_EPOLL
+    unsigned workers = var_InheritInteger(p_this, "http-threads");
+    if (workers < 1)
+        workers = 1;
+#else
+    const unsigned workers = 1;
+#endif
+    host->worker = malloc(workers * sizeof (*host->worker));
+    if (unlikely(host->worker == NULL))
         goto error;
+
+    /* create the threads */
+    for (unsigned i = 0; i < workers; i++) {
+        httpd_worker_t *w = &host->worker[i];
+
+        if (httpd_WorkerInit(host, w))
+            goto error;
+        if (vlc_clone(&w->thread, httpd_WorkerThread, w,
+                       VLC_THREAD_PRIORITY_LOW)) {
+            msg_Err(p_this, "cannot spawn http host thread");
+            httpd_WorkerClean(w);
+            goto error;
+        }
+        host->i_worker++;
     }
 
     /* now add it to httpd */
@@ -993,6 +1357,12 @@ error:
     vlc_mutex_unlock(&httpd.mutex);
 
     if (host) {
+        for (unsigned i = 0; i < host->i_worker; i++) {
+            vlc_cancel(host->worker[i].thread);
+            vlc_join(host->worker[i].thread, NULL);
+            httpd_WorkerClean(&host->worker[i]);
+        }
+        free(host->worker);
         net_ListenClose(host->fds);
         vlc_cond_destroy(&host->wait);
         vlc_mutex_destroy(&host->lock);
@@ -1024,19 +1394,19 @@ void httpd_HostDelete(httpd_host_t *host)
     }
     TAB_REMOVE(httpd.i_host, httpd.host, host);
 
-    vlc_cancel(host->thread);
-    vlc_join(host->thread, NULL);
+    for (unsigned i = 0; i < host->i_worker; i++)
+        vlc_cancel(host->worker[i].thread);
+    for (unsigned i = 0; i < host->i_worker; i++)
+        vlc_join(host->worker[i].thread, NULL);
 
     msg_Dbg(host, "HTTP host removed");
 
     for (int i = 0; i < host->i_url; i++)
         msg_Err(host, "url still registered: %s", host->url[i]->psz_url);
 
-    for (int i = 0; i < host->i_client; i++) {
-        msg_Warn(host, "client still connected");
-        httpd_ClientDestroy(host->client[i]);
-    }
-    TAB_CLEAN(host->i_client, host->client);
+    for (unsigned i = 0; i < host->i_worker; i++)
+        httpd_WorkerClean(&host->worker[i]);
+    free(host->worker);
 
     vlc_tls_Delete(host->p_tls);
     net_ListenClose(host->fds);
@@ -1075,7 +1445,7 @@ httpd_url_t *httpd_UrlNew(httpd_host_t *host, const char *psz_url,
     }
 
     TAB_APPEND(host->i_url, host->url, url);
-    vlc_cond_signal(&host->wait);
+    vlc_cond_broadcast(&host->wait);
     vlc_mutex_unlock(&host->lock);
 
     return url;
@@ -1100,26 +1470,42 @@ void httpd_UrlDelete(httpd_url_t *url)
 
     vlc_mutex_lock(&host->lock);
     TAB_REMOVE(host->i_url, host->url, url);
+    vlc_mutex_unlock(&host->lock);
+
+    /* No new clients can be bound to the url from now on. Workers hold their
+     * lock while invoking callbacks, so none is left running afterwards. */
+    for (unsigned i = 0; i < host->i_worker; i++) {
+        httpd_worker_t *w = &host->worker[i];
+
+        vlc_mutex_lock(&w->lock);
+        for (int j = 0; j < w->i_client; j++) {
+            httpd_client_t *client = w->client[j];
+
+            if (client->url != url)
+                continue;
+
+            /* TODO complete it */
+            msg_Warn(host, "force closing connections");
+#ifdef HTTPD_EPOLL
+            /* The worker may have pending events for the client:
+             * let it destroy the client itself. */
+            client->url = NULL;
+            client->i_state = HTTPD_CLIENT_DEAD;
+            eventfd_write(w->evfd, 1);
+#else
+            TAB_REMOVE(w->i_client, w->client, client);
+            httpd_ClientDestroy(client);
+            j--;
+#endif
+        }
+        vlc_mutex_unlock(&w->lock);
+    }
 
     vlc_mutex_destroy(&url->lock);
     free(url->psz_url);
     free(url->psz_user);
     free(url->psz_password);
-
-    for (int i = 0; i < host->i_client; i++) {
-        httpd_client_t *client = host->client[i];
-
-        if (client->url != url)
-            continue;
-
-        /* TODO complete it */
-        msg_Warn(host, "force closing connections");
-        TAB_REMOVE(host->i_client, host->client, client);
-        httpd_ClientDestroy(client);
-        i--;
-    }
     free(url);
-    vlc_mutex_unlock(&host->lock);
 }
 
 static void httpd_MsgInit(httpd_message_t *msg)
@@ -1201,6 +1587,11 @@ static void httpd_ClientInit(httpd_client_t *cl, mtime_t now)
     cl->p_buffer = xmalloc(cl->i_buffer_size);
     cl->i_keyframe_wait_to_pass = -1;
     cl->b_stream_mode = false;
+    cl->i_segments = 0;
+    cl->i_segment = 0;
+    cl->i_segment_offset = 0;
+    cl->i_file_fd = -1;
+    cl->i_file_left = 0;
 
     httpd_MsgInit(&cl->query);
     httpd_MsgInit(&cl->answer);
@@ -1226,6 +1617,9 @@ static void httpd_ClientDestroy(httpd_client_t *cl)
     httpd_MsgClean(&cl->answer);
     httpd_MsgClean(&cl->query);
 
+    httpd_ClientReleaseSegments(cl);
+    if (cl->i_file_fd != -1)
+        vlc_close(cl->i_file_fd);
     free(cl->p_buffer);
     free(cl);
 }
@@ -1240,6 +1634,7 @@ static httpd_client_t *httpd_ClientNew(int fd, vlc_tls_t *p_tls, mtime_t now)
     cl->fd      = fd;
     cl->url     = NULL;
     cl->p_tls = p_tls;
+    cl->i_poll_events = 0;
 
     httpd_ClientInit(cl, now);
     if (p_tls)
@@ -1276,6 +1671,28 @@ ssize_t httpd_NetSend (httpd_client_t *cl, const uint8_t *p, size_t i_len)
     return val;
 }
 
+static
+ssize_t httpd_NetSendv (httpd_client_t *cl, const struct iovec *iov,
+                        unsigned iovcnt)
+{
+    vlc_tls_t *p_tls;
+    ssize_t val;
+
+    p_tls = cl->p_tls;
+    do
+        if (p_tls != NULL)
+            val = p_tls->writev(p_tls, iov, iovcnt);
+        else
+        {
+            struct msghdr msg = {
+                .msg_iov = (struct iovec *)iov,
+                .msg_iovlen = iovcnt,
+            };
+            val = sendmsg(cl->fd, &msg, MSG_NOSIGNAL);
+        }
+    while (val == -1 && errno == EINTR);
+    return val;
+}
 
 static const struct
 {
@@ -1580,6 +1997,79 @@ static void httpd_ClientRecv(httpd_client_t *cl)
         cl->i_activity_timeout = 0;
 }
 
+/* Sends stream data straight from the shared segments */
+static ssize_t httpd_ClientSendSegments(httpd_client_t *cl)
+{
+    struct iovec iov[HTTPD_CL_SEGMENTS];
+    unsigned iovcnt = 0;
+    size_t i_offset = cl->i_segment_offset;
+
+    for (unsigned i = cl->i_segment; i < cl->i_segments; i++) {
+        const block_t *p_block = cl->p_segments[i]->p_block;
+
+        iov[iovcnt].iov_base = p_block->p_buffer + i_offset;
+        iov[iovcnt].iov_len = p_block->i_buffer - i_offset;
+        iovcnt++;
+        i_offset = 0;
+    }
+
+    ssize_t i_len = httpd_NetSendv(cl, iov, iovcnt);
+    for (size_t i_sent = (i_len > 0) ? i_len : 0; i_sent > 0;) {
+        size_t i_left = cl->p_segments[cl->i_segment]->p_block->i_buffer
+                      - cl->i_segment_offset;
+
+        if (i_sent < i_left) {
+            cl->i_segment_offset += i_sent;
+            break;
+        }
+        i_sent -= i_left;
+        cl->i_segment++;
+        cl->i_segment_offset = 0;
+    }
+    return i_len;
+}
+
+/* Sends the body straight from a file, without buffering it all */
+static ssize_t httpd_ClientSendFile(httpd_client_t *cl)
+{
+    size_t i_len = __MIN(cl->i_file_left, (uint64_t)HTTPD_CL_BUFSIZE * 16);
+    ssize_t val;
+
+#ifdef HAVE_SENDFILE
+    if (cl->p_tls == NULL) {
+        off_t offset = cl->i_file_offset;
+
+        do
+            val = sendfile(cl->fd, cl->i_file_fd, &offset, i_len);
+        while (val == -1 && errno == EINTR);
+    } else
+#endif
+    {
+        uint8_t buf[16384];
+
+        if (lseek(cl->i_file_fd, cl->i_file_offset, SEEK_SET) == -1)
+            return -1;
+        val = read(cl->i_file_fd, buf, __MIN(i_len, sizeof (buf)));
+        if (val > 0)
+            val = httpd_NetSend(cl, buf, val);
+    }
+
+    if (val == 0) {
+        /* the file was truncated */
+        errno = EIO;
+        return -1;
+    }
+    if (val > 0) {
+        cl->i_file_offset += val;
+        cl->i_file_left -= val;
+        if (cl->i_file_left == 0) {
+            vlc_close(cl->i_file_fd);
+            cl->i_file_fd = -1;
+        }
+    }
+    return val;
+}
+
 static void httpd_ClientSend(httpd_client_t *cl)
 {
     int i_len;
@@ -1615,12 +2105,21 @@ static void httpd_ClientSend(httpd_client_t *cl)
         cl->i_buffer_size = (uint8_t*)p - cl->p_buffer;
     }
 
-    i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
-                           cl->i_buffer_size - cl->i_buffer);
-    if (i_len >= 0) {
-        cl->i_buffer += i_len;
+    if (cl->i_buffer < cl->i_buffer_size) {
+        i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
+                               cl->i_buffer_size - cl->i_buffer);
+        if (i_len > 0)
+            cl->i_buffer += i_len;
+    } else if (cl->i_segment < cl->i_segments)
+        i_len = httpd_ClientSendSegments(cl);
+    else if (cl->i_file_left > 0)
+        i_len = httpd_ClientSendFile(cl);
+    else
+        i_len = 0;
 
-        if (cl->i_buffer >= cl->i_buffer_size) {
+    if (i_len >= 0) {
+        if (cl->i_buffer >= cl->i_buffer_size
+         && cl->i_segment >= cl->i_segments && cl->i_file_left == 0) {
             if (cl->answer.i_body == 0  && cl->answer.i_body_offset > 0) {
                 /* catch more body data */
                 int     i_msg = cl->query.i_type;
@@ -1642,6 +2141,12 @@ static void httpd_ClientSend(httpd_client_t *cl)
 
                 cl->answer.i_body = 0;
                 cl->answer.p_body = NULL;
+            } else if (cl->i_segment < cl->i_segments) {
+                /* send the stream data in place */
+                free(cl->p_buffer);
+                cl->p_buffer = NULL;
+                cl->i_buffer_size = 0;
+                cl->i_buffer = 0;
             } else /* send finished */
                 cl->i_state = HTTPD_CLIENT_SEND_DONE;
         }
@@ -1709,276 +2214,472 @@ auth_failed:
     return false;
 }
 
-static void httpdLoop(httpd_host_t *host)
+/**
+ * Handles the client states which do not depend on I/O.
+ * @return the poll events to wait for, or -1 if the client was destroyed
+ */
+static int httpd_ClientPrepare(httpd_worker_t *w, httpd_client_t *cl,
+                               mtime_t now)
 {
-    struct pollfd ufd[host->nfd + host->i_client];
-    unsigned nfd;
-    for (nfd = 0; nfd < host->nfd; nfd++) {
-        ufd[nfd].fd = host->fds[nfd];
-        ufd[nfd].events = POLLIN;
-        ufd[nfd].revents = 0;
+    httpd_host_t *host = w->host;
+    int64_t i_offset;
+
+    if (cl->i_ref < 0 || (cl->i_ref == 0 &&
+                (cl->i_state == HTTPD_CLIENT_DEAD ||
+                  (cl->i_activity_timeout > 0 &&
+                    cl->i_activity_date+cl->i_activity_timeout < now)))) {
+        TAB_REMOVE(w->i_client, w->client, cl);
+#ifdef HTTPD_EPOLL
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, cl->fd, NULL);
+#endif
+        httpd_ClientDestroy(cl);
+        return -1;
     }
 
-    /* add all socket that should be read/write and close dead connection */
-    while (host->i_url <= 0) {
-        mutex_cleanup_push(&host->lock);
-        vlc_cond_wait(&host->wait, &host->lock);
-        vlc_cleanup_pop();
-    }
+    switch (cl->i_state) {
+    case HTTPD_CLIENT_RECEIVE_DONE: {
+        httpd_message_t *answer = &cl->answer;
+        httpd_message_t *query  = &cl->query;
 
-    mtime_t now = mdate();
-    bool b_low_delay = false;
+        httpd_MsgInit(answer);
 
-    int canc = vlc_savecancel();
-    for (int i_client = 0; i_client < host->i_client; i_client++) {
-        int64_t i_offset;
-        httpd_client_t *cl = host->client[i_client];
-        if (cl->i_ref < 0 || (cl->i_ref == 0 &&
-                    (cl->i_state == HTTPD_CLIENT_DEAD ||
-                      (cl->i_activity_timeout > 0 &&
-                        cl->i_activity_date+cl->i_activity_timeout < now)))) {
-            TAB_REMOVE(host->i_client, host->client, cl);
-            i_client--;
-            httpd_ClientDestroy(cl);
-            continue;
-        }
+        /* Handle what we received */
+        switch (query->i_type) {
+            case HTTPD_MSG_ANSWER:
+                cl->url     = NULL;
+                cl->i_state = HTTPD_CLIENT_DEAD;
+                break;
 
-        struct pollfd *pufd = ufd + nfd;
-        assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
+            case HTTPD_MSG_OPTIONS:
+                answer->i_type   = HTTPD_MSG_ANSWER;
+                answer->i_proto  = query->i_proto;
+                answer->i_status = 200;
+                answer->i_body = 0;
+                answer->p_body = NULL;
+
+                httpd_MsgAdd(answer, "Server", "VLC/%s", VERSION);
+                httpd_MsgAdd(answer, "Content-Length", "0");
+
+                switch(query->i_proto) {
+                case HTTPD_PROTO_HTTP:
+                    answer->i_version = 1;
+                    httpd_MsgAdd(answer, "Allow", "GET,HEAD,POST,OPTIONS");
+                    break;
+
+                case HTTPD_PROTO_RTSP:
+                    answer->i_version = 0;
+
+                    const char *p = httpd_MsgGet(query, "Cseq");
+                    if (p)
+                        httpd_MsgAdd(answer, "Cseq", "%s", p);
+                    p = httpd_MsgGet(query, "Timestamp");
+                    if (p)
+                        httpd_MsgAdd(answer, "Timestamp", "%s", p);
+
+                    p = httpd_MsgGet(query, "Require");
+                    if (p) {
+                        answer->i_status = 551;
+                        httpd_MsgAdd(query, "Unsupported", "%s", p);
+                    }
 
-        pufd->fd = cl->fd;
-        pufd->events = pufd->revents = 0;
+                    httpd_MsgAdd(answer, "Public", "DESCRIBE,SETUP,"
+                            "TEARDOWN,PLAY,PAUSE,GET_PARAMETER");
+                    break;
+                }
 
-        switch (cl->i_state) {
-            case HTTPD_CLIENT_RECEIVING:
-            case HTTPD_CLIENT_TLS_HS_IN:
-                pufd->events = POLLIN;
+                cl->i_buffer = -1;  /* Force the creation of the answer in
+                                     * httpd_ClientSend */
+                cl->i_state = HTTPD_CLIENT_SENDING;
                 break;
 
-            case HTTPD_CLIENT_SENDING:
-            case HTTPD_CLIENT_TLS_HS_OUT:
-                pufd->events = POLLOUT;
+            case HTTPD_MSG_NONE:
+                if (query->i_proto == HTTPD_PROTO_NONE) {
+                    cl->url = NULL;
+                    cl->i_state = HTTPD_CLIENT_DEAD;
+                } else {
+                    /* unimplemented */
+                    answer->i_proto  = query->i_proto ;
+                    answer->i_type   = HTTPD_MSG_ANSWER;
+                    answer->i_version= 0;
+                    answer->i_status = 501;
+
+                    char *p;
+                    answer->i_body = httpd_HtmlError (&p, 501, NULL);
+                    answer->p_body = (uint8_t *)p;
+                    httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
+
+                    cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                    cl->i_state = HTTPD_CLIENT_SENDING;
+                }
                 break;
 
-            case HTTPD_CLIENT_RECEIVE_DONE: {
-                httpd_message_t *answer = &cl->answer;
-                httpd_message_t *query  = &cl->query;
+            default: {
+                int i_msg = query->i_type;
+                bool b_auth_failed = false;
+
+                /* Search the url and trigger callbacks */
+                vlc_mutex_lock(&host->lock);
+                for (int i = 0; i < host->i_url; i++) {
+                    httpd_url_t *url = host->url[i];
+
+                    if (strcmp(url->psz_url, query->psz_url))
+                        continue;
+                    if (!url->catch[i_msg].cb)
+                        continue;
+
+                    if (answer) {
+                        b_auth_failed = !httpdAuthOk(url->psz_user,
+                           url->psz_password,
+                           httpd_MsgGet(query, "Authorization")); /* BASIC id */
+                        if (b_auth_failed)
+                           break;
+                    }
 
-                httpd_MsgInit(answer);
+                    if (url->catch[i_msg].cb(url->catch[i_msg].p_sys, cl, answer, query))
+                        continue;
 
-                /* Handle what we received */
-                switch (query->i_type) {
-                    case HTTPD_MSG_ANSWER:
-                        cl->url     = NULL;
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                        break;
+                    if (answer->i_proto == HTTPD_PROTO_NONE)
+                        cl->i_buffer = cl->i_buffer_size; /* Raw answer from a CGI */
+                    else
+                        cl->i_buffer = -1;
 
-                    case HTTPD_MSG_OPTIONS:
-                        answer->i_type   = HTTPD_MSG_ANSWER;
-                        answer->i_proto  = query->i_proto;
-                        answer->i_status = 200;
-                        answer->i_body = 0;
-                        answer->p_body = NULL;
+                    /* only one url can answer */
+                    answer = NULL;
+                    if (!cl->url)
+                        cl->url = url;
+                }
+                vlc_mutex_unlock(&host->lock);
 
-                        httpd_MsgAdd(answer, "Server", "VLC/%s", VERSION);
-                        httpd_MsgAdd(answer, "Content-Length", "0");
+                if (answer) {
+                    answer->i_proto  = query->i_proto;
+                    answer->i_type   = HTTPD_MSG_ANSWER;
+                    answer->i_version= 0;
 
-                        switch(query->i_proto) {
-                        case HTTPD_PROTO_HTTP:
-                            answer->i_version = 1;
-                            httpd_MsgAdd(answer, "Allow", "GET,HEAD,POST,OPTIONS");
-                            break;
+                   if (b_auth_failed) {
+                        httpd_MsgAdd(answer, "WWW-Authenticate",
+                                "Basic realm=\"VLC stream\"");
+                        answer->i_status = 401;
+                    } else
+                        answer->i_status = 404; /* no url registered */
 
-                        case HTTPD_PROTO_RTSP:
-                            answer->i_version = 0;
+                    char *p;
+                    answer->i_body = httpd_HtmlError (&p, answer->i_status,
+                            query->psz_url);
+                    answer->p_body = (uint8_t *)p;
 
-                            const char *p = httpd_MsgGet(query, "Cseq");
-                            if (p)
-                                httpd_MsgAdd(answer, "Cseq", "%s", p);
-                            p = httpd_MsgGet(query, "Timestamp");
-                            if (p)
-                                httpd_MsgAdd(answer, "Timestamp", "%s", p);
+                    cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                    httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
+                    httpd_MsgAdd(answer, "Content-Type", "%s", "text/html");
+                }
 
-                            p = httpd_MsgGet(query, "Require");
-                            if (p) {
-                                answer->i_status = 551;
-                                httpd_MsgAdd(query, "Unsupported", "%s", p);
-                            }
+                cl->i_state = HTTPD_CLIENT_SENDING;
+            }
+        }
+        break;
+    }
 
-                            httpd_MsgAdd(answer, "Public", "DESCRIBE,SETUP,"
-                                    "TEARDOWN,PLAY,PAUSE,GET_PARAMETER");
-                            break;
-                        }
+    case HTTPD_CLIENT_SEND_DONE:
+        if (!cl->b_stream_mode || cl->answer.i_body_offset == 0) {
+            const char *psz_connection = httpd_MsgGet(&cl->answer, "Connection");
+            const char *psz_query = httpd_MsgGet(&cl->query, "Connection");
+            bool b_connection = false;
+            bool b_keepalive = false;
+            bool b_query = false;
+
+            cl->url = NULL;
+            if (psz_connection) {
+                b_connection = (strcasecmp(psz_connection, "Close") == 0);
+                b_keepalive = (strcasecmp(psz_connection, "Keep-Alive") == 0);
+            }
 
-                        cl->i_buffer = -1;  /* Force the creation of the answer in
-                                             * httpd_ClientSend */
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                        break;
+            if (psz_query)
+                b_query = (strcasecmp(psz_query, "Close") == 0);
 
-                    case HTTPD_MSG_NONE:
-                        if (query->i_proto == HTTPD_PROTO_NONE) {
-                            cl->url = NULL;
-                            cl->i_state = HTTPD_CLIENT_DEAD;
-                        } else {
-                            /* unimplemented */
-                            answer->i_proto  = query->i_proto ;
-                            answer->i_type   = HTTPD_MSG_ANSWER;
-                            answer->i_version= 0;
-                            answer->i_status = 501;
-
-                            char *p;
-                            answer->i_body = httpd_HtmlError (&p, 501, NULL);
-                            answer->p_body = (uint8_t *)p;
-                            httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
-
-                            cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                            cl->i_state = HTTPD_CLIENT_SENDING;
-                        }
-                        break;
+            if (((cl->query.i_proto == HTTPD_PROTO_HTTP) &&
+                        ((cl->query.i_version == 0 && b_keepalive) ||
+                          (cl->query.i_version == 1 && !b_connection))) ||
+                    ((cl->query.i_proto == HTTPD_PROTO_RTSP) &&
+                      !b_query && !b_connection)) {
+                httpd_MsgClean(&cl->query);
+                httpd_MsgInit(&cl->query);
 
-                    default: {
-                        int i_msg = query->i_type;
-                        bool b_auth_failed = false;
-
-                        /* Search the url and trigger callbacks */
-                        for (int i = 0; i < host->i_url; i++) {
-                            httpd_url_t *url = host->url[i];
-
-                            if (strcmp(url->psz_url, query->psz_url))
-                                continue;
-                            if (!url->catch[i_msg].cb)
-                                continue;
-
-                            if (answer) {
-                                b_auth_failed = !httpdAuthOk(url->psz_user,
-                                   url->psz_password,
-                                   httpd_MsgGet(query, "Authorization")); /* BASIC id */
-                                if (b_auth_failed)
-                                   break;
-                            }
-
-                            if (url->catch[i_msg].cb(url->catch[i_msg].p_sys, cl, answer, query))
-                                continue;
-
-                            if (answer->i_proto == HTTPD_PROTO_NONE)
-                                cl->i_buffer = cl->i_buffer_size; /* Raw answer from a CGI */
-                            else
-                                cl->i_buffer = -1;
-
-                            /* only one url can answer */
-                            answer = NULL;
-                            if (!cl->url)
-                                cl->url = url;
-                        }
+                cl->i_buffer = 0;
+                cl->i_buffer_size = 1000;
+                free(cl->p_buffer);
+                cl->p_buffer = xmalloc(cl->i_buffer_size);
+                cl->i_state = HTTPD_CLIENT_RECEIVING;
+            } else
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            httpd_MsgClean(&cl->answer);
+        } else {
+            i_offset = cl->answer.i_body_offset;
+            httpd_MsgClean(&cl->answer);
 
-                        if (answer) {
-                            answer->i_proto  = query->i_proto;
-                            answer->i_type   = HTTPD_MSG_ANSWER;
-                            answer->i_version= 0;
-
-                           if (b_auth_failed) {
-                                httpd_MsgAdd(answer, "WWW-Authenticate",
-                                        "Basic realm=\"VLC stream\"");
-                                answer->i_status = 401;
-                            } else
-                                answer->i_status = 404; /* no url registered */
-
-                            char *p;
-                            answer->i_body = httpd_HtmlError (&p, answer->i_status,
-                                    query->psz_url);
-                            answer->p_body = (uint8_t *)p;
-
-                            cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                            httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
-                            httpd_MsgAdd(answer, "Content-Type", "%s", "text/html");
-                        }
+            cl->answer.i_body_offset = i_offset;
+            free(cl->p_buffer);
+            cl->p_buffer = NULL;
+            cl->i_buffer = 0;
+            cl->i_buffer_size = 0;
 
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                    }
-                }
-                break;
-            }
+            cl->i_state = HTTPD_CLIENT_WAITING;
+        }
+        break;
+
+    case HTTPD_CLIENT_WAITING:
+        i_offset = cl->answer.i_body_offset;
+        int i_msg = cl->query.i_type;
+
+        httpd_MsgInit(&cl->answer);
+        cl->answer.i_body_offset = i_offset;
+
+        cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
+                &cl->answer, &cl->query);
+        if (cl->answer.i_type != HTTPD_MSG_NONE) {
+            /* we have new data, so re-enter send mode */
+            cl->i_buffer      = 0;
+            cl->p_buffer      = cl->answer.p_body;
+            cl->i_buffer_size = cl->answer.i_body;
+            cl->answer.p_body = NULL;
+            cl->answer.i_body = 0;
+            cl->i_state = HTTPD_CLIENT_SENDING;
+        }
+    }
 
-            case HTTPD_CLIENT_SEND_DONE:
-                if (!cl->b_stream_mode || cl->answer.i_body_offset == 0) {
-                    const char *psz_connection = httpd_MsgGet(&cl->answer, "Connection");
-                    const char *psz_query = httpd_MsgGet(&cl->query, "Connection");
-                    bool b_connection = false;
-                    bool b_keepalive = false;
-                    bool b_query = false;
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVING:
+        case HTTPD_CLIENT_TLS_HS_IN:
+            return POLLIN;
+        case HTTPD_CLIENT_SENDING:
+        case HTTPD_CLIENT_TLS_HS_OUT:
+            return POLLOUT;
+    }
+    return 0;
+}
 
-                    cl->url = NULL;
-                    if (psz_connection) {
-                        b_connection = (strcasecmp(psz_connection, "Close") == 0);
-                        b_keepalive = (strcasecmp(psz_connection, "Keep-Alive") == 0);
-                    }
+/**
+ * Performs pending I/O on a client.
+ */
+static void httpd_ClientProcess(httpd_host_t *host, httpd_client_t *cl,
+                                mtime_t now)
+{
+    cl->i_activity_date = now;
 
-                    if (psz_query)
-                        b_query = (strcasecmp(psz_query, "Close") == 0);
-
-                    if (((cl->query.i_proto == HTTPD_PROTO_HTTP) &&
-                                ((cl->query.i_version == 0 && b_keepalive) ||
-                                  (cl->query.i_version == 1 && !b_connection))) ||
-                            ((cl->query.i_proto == HTTPD_PROTO_RTSP) &&
-                              !b_query && !b_connection)) {
-                        httpd_MsgClean(&cl->query);
-                        httpd_MsgInit(&cl->query);
-
-                        cl->i_buffer = 0;
-                        cl->i_buffer_size = 1000;
-                        free(cl->p_buffer);
-                        cl->p_buffer = xmalloc(cl->i_buffer_size);
-                        cl->i_state = HTTPD_CLIENT_RECEIVING;
-                    } else
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                    httpd_MsgClean(&cl->answer);
-                } else {
-                    i_offset = cl->answer.i_body_offset;
-                    httpd_MsgClean(&cl->answer);
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVING: httpd_ClientRecv(cl); break;
+        case HTTPD_CLIENT_SENDING:   httpd_ClientSend(cl); break;
+        case HTTPD_CLIENT_TLS_HS_IN:
+        case HTTPD_CLIENT_TLS_HS_OUT:
+            httpd_ClientTlsHandshake(host, cl);
+            break;
+    }
+}
 
-                    cl->answer.i_body_offset = i_offset;
-                    free(cl->p_buffer);
-                    cl->p_buffer = NULL;
-                    cl->i_buffer = 0;
-                    cl->i_buffer_size = 0;
+/**
+ * Accepts new connections, and spreads them over the workers.
+ */
+static void httpd_HostAccept(httpd_host_t *host, int lfd, mtime_t now)
+{
+    int fd;
 
-                    cl->i_state = HTTPD_CLIENT_WAITING;
-                }
-                break;
+    while ((fd = vlc_accept (lfd, NULL, NULL, true)) != -1) {
+        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+                &(int){ 1 }, sizeof(int));
 
-            case HTTPD_CLIENT_WAITING:
-                i_offset = cl->answer.i_body_offset;
-                int i_msg = cl->query.i_type;
+        vlc_tls_t *p_tls;
 
-                httpd_MsgInit(&cl->answer);
-                cl->answer.i_body_offset = i_offset;
+        if (host->p_tls != NULL)
+        {
+            const char *alpn[] = { "http/1.1", NULL };
 
-                cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
-                        &cl->answer, &cl->query);
-                if (cl->answer.i_type != HTTPD_MSG_NONE) {
-                    /* we have new data, so re-enter send mode */
-                    cl->i_buffer      = 0;
-                    cl->p_buffer      = cl->answer.p_body;
-                    cl->i_buffer_size = cl->answer.i_body;
-                    cl->answer.p_body = NULL;
-                    cl->answer.i_body = 0;
-                    cl->i_state = HTTPD_CLIENT_SENDING;
-                }
+            p_tls = vlc_tls_ServerSessionCreate(host->p_tls, fd, alpn);
+        }
+        else
+            p_tls = NULL;
+
+        httpd_client_t *cl = httpd_ClientNew(fd, p_tls, now);
+        if (unlikely(cl == NULL)) {
+            if (p_tls != NULL)
+                vlc_tls_Close(p_tls);
+            else
+                net_Close(fd);
+            continue;
+        }
+
+        /* Only the first worker accepts, no need for locking here */
+        httpd_worker_t *w = &host->worker[host->i_next_worker];
+        if (++host->i_next_worker >= host->i_worker)
+            host->i_next_worker = 0;
+
+        vlc_mutex_lock(&w->lock);
+#ifdef HTTPD_EPOLL
+        struct epoll_event ev = {
+            .events = (cl->i_state == HTTPD_CLIENT_TLS_HS_OUT) ? EPOLLOUT
+                                                               : EPOLLIN,
+            .data.ptr = cl,
+        };
+
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+            vlc_mutex_unlock(&w->lock);
+            msg_Err(host, "cannot poll HTTP client: %s",
+                    vlc_strerror_c(errno));
+            httpd_ClientDestroy(cl);
+            continue;
+        }
+        cl->i_poll_events = (ev.events & EPOLLOUT) ? POLLOUT : POLLIN;
+#endif
+        TAB_APPEND(w->i_client, w->client, cl);
+        vlc_mutex_unlock(&w->lock);
+    }
+}
+
+static void httpdWaitUrl(httpd_host_t *host)
+{
+    /* do not serve anything until an url is registered */
+    vlc_mutex_lock(&host->lock);
+    mutex_cleanup_push(&host->lock);
+    while (host->i_url <= 0)
+        vlc_cond_wait(&host->wait, &host->lock);
+    vlc_cleanup_pop();
+    vlc_mutex_unlock(&host->lock);
+}
+
+#ifdef HTTPD_EPOLL
+static void httpdLoop(httpd_worker_t *w)
+{
+    httpd_host_t *host = w->host;
+    struct epoll_event ev[64];
+    bool b_low_delay = false;
+    bool b_accept = false;
+
+    httpdWaitUrl(host);
+
+    int canc = vlc_savecancel();
+    vlc_mutex_lock(&w->lock);
+
+    mtime_t now = mdate();
+    for (int i_client = 0; i_client < w->i_client; i_client++) {
+        httpd_client_t *cl = w->client[i_client];
+        int events = httpd_ClientPrepare(w, cl, now);
+
+        if (events < 0) {
+            i_client--;
+            continue;
+        }
+        if (events == 0)
+            b_low_delay = true;
+
+        /* Clients stay registered, only update what they wait for */
+        if (events != cl->i_poll_events) {
+            struct epoll_event cev = {
+                .events = ((events & POLLIN) ? EPOLLIN : 0)
+                        | ((events & POLLOUT) ? EPOLLOUT : 0),
+                .data.ptr = cl,
+            };
+
+            epoll_ctl(w->epfd, EPOLL_CTL_MOD, cl->fd, &cev);
+            cl->i_poll_events = events;
+        }
+    }
+    vlc_mutex_unlock(&w->lock);
+    vlc_restorecancel(canc);
+
+    /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
+    int ret = epoll_wait(w->epfd, ev, ARRAY_SIZE(ev), b_low_delay ? 20 : -1);
+
+    canc = vlc_savecancel();
+    if (ret == -1) {
+        if (errno != EINTR) {
+            /* Kernel on low memory or a bug: pace */
+            msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
+            msleep(100000);
+        }
+        vlc_restorecancel(canc);
+        return;
+    }
+
+    vlc_mutex_lock(&w->lock);
+    now = mdate();
+    for (int i = 0; i < ret; i++) {
+        if (ev[i].data.ptr == w) {
+            eventfd_t dummy;
+            eventfd_read(w->evfd, &dummy);
+            continue;
+        }
+        if (ev[i].data.ptr == host) {
+            b_accept = true;
+            continue;
+        }
+
+        httpd_client_t *cl = ev[i].data.ptr;
+
+        if (cl->i_poll_events == 0) {
+            /* Errors and hang-ups are reported regardless of the events */
+            if (ev[i].events & (EPOLLERR | EPOLLHUP))
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            continue;
+        }
+        httpd_ClientProcess(host, cl, now);
+    }
+    vlc_mutex_unlock(&w->lock);
+
+    /* Handle server sockets (accept new connections) */
+    if (b_accept)
+        for (unsigned i = 0; i < host->nfd; i++)
+            httpd_HostAccept(host, host->fds[i], now);
+
+    vlc_restorecancel(canc);
+}
+
+#else
+static void httpdLoop(httpd_worker_t *w)
+{
+    httpd_host_t *host = w->host;
+
+    httpdWaitUrl(host);
+
+    int canc = vlc_savecancel();
+    vlc_mutex_lock(&w->lock);
+
+    struct pollfd ufd[host->nfd + w->i_client];
+    unsigned nfd;
+    for (nfd = 0; nfd < host->nfd; nfd++) {
+        ufd[nfd].fd = host->fds[nfd];
+        ufd[nfd].events = POLLIN;
+        ufd[nfd].revents = 0;
+    }
+
+    /* add all socket that should be read/write and close dead connection */
+    mtime_t now = mdate();
+    bool b_low_delay = false;
+
+    for (int i_client = 0; i_client < w->i_client; i_client++) {
+        httpd_client_t *cl = w->client[i_client];
+        int events = httpd_ClientPrepare(w, cl, now);
+
+        if (events < 0) {
+            i_client--;
+            continue;
         }
 
-        if (pufd->events != 0)
+        if (events != 0) {
+            struct pollfd *pufd = ufd + nfd;
+            assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
+
+            pufd->fd = cl->fd;
+            pufd->events = events;
+            pufd->revents = 0;
             nfd++;
-        else
+        } else
             b_low_delay = true;
+        cl->i_poll_events = events;
     }
-    vlc_mutex_unlock(&host->lock);
+    vlc_mutex_unlock(&w->lock);
     vlc_restorecancel(canc);
 
     /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
     int ret = poll(ufd, nfd, b_low_delay ? 20 : -1);
 
     canc = vlc_savecancel();
-    vlc_mutex_lock(&host->lock);
     switch(ret) {
         case -1:
             if (errno != EINTR) {
@@ -1992,78 +2693,45 @@ static void httpdLoop(httpd_host_t *host)
     }
 
     /* Handle client sockets */
+    vlc_mutex_lock(&w->lock);
     now = mdate();
     nfd = host->nfd;
 
-    for (int i_client = 0; i_client < host->i_client; i_client++) {
-        httpd_client_t *cl = host->client[i_client];
+    for (int i_client = 0; i_client < w->i_client; i_client++) {
+        httpd_client_t *cl = w->client[i_client];
         const struct pollfd *pufd = &ufd[nfd];
 
         assert(pufd < &ufd[sizeof(ufd) / sizeof(ufd[0])]);
 
-        if (cl->fd != pufd->fd)
+        if (cl->i_poll_events == 0 || cl->fd != pufd->fd)
             continue; // we were not waiting for this client
         ++nfd;
         if (pufd->revents == 0)
             continue; // no event received
 
-        cl->i_activity_date = now;
-
-        switch (cl->i_state) {
-            case HTTPD_CLIENT_RECEIVING: httpd_ClientRecv(cl); break;
-            case HTTPD_CLIENT_SENDING:   httpd_ClientSend(cl); break;
-            case HTTPD_CLIENT_TLS_HS_IN:
-            case HTTPD_CLIENT_TLS_HS_OUT:
-                httpd_ClientTlsHandshake(host, cl);
-                break;
-        }
+        httpd_ClientProcess(host, cl, now);
     }
+    vlc_mutex_unlock(&w->lock);
 
     /* Handle server sockets (accept new connections) */
     for (nfd = 0; nfd < host->nfd; nfd++) {
-        httpd_client_t *cl;
-        int fd = ufd[nfd].fd;
-
-        assert (fd == host->fds[nfd]);
-
-        if (ufd[nfd].revents == 0)
-            continue;
-
-        /* */
-        fd = vlc_accept (fd, NULL, NULL, true);
-        if (fd == -1)
-            continue;
-        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                &(int){ 1 }, sizeof(int));
-
-        vlc_tls_t *p_tls;
-
-        if (host->p_tls != NULL)
-        {
-            const char *alpn[] = { "http/1.1", NULL };
-
-            p_tls = vlc_tls_ServerSessionCreate(host->p_tls, fd, alpn);
-        }
-        else
-            p_tls = NULL;
-
-        cl = httpd_ClientNew(fd, p_tls, now);
+        assert (ufd[nfd].fd == host->fds[nfd]);
 
-        TAB_APPEND(host->i_client, host->client, cl);
+        if (ufd[nfd].revents != 0)
+            httpd_HostAccept(host, ufd[nfd].fd, now);
     }
 
     vlc_restorecancel(canc);
 }
+#endif
 
-static void* httpd_HostThread(void *data)
+static void* httpd_WorkerThread(void *data)
 {
-    httpd_host_t *host = data;
+    httpd_worker_t *w = data;
 
-    vlc_mutex_lock(&host->lock);
-    while (host->i_ref > 0)
-        httpdLoop(host);
-    vlc_mutex_unlock(&host->lock);
-    return NULL;
+    for (;;)
+        httpdLoop(w);
+    vlc_assert_unreachable();
 }
 
 int httpd_StreamSetHTTPHeaders(httpd_stream_t * p_stream, httpd_header * p_headers, size_t i_headers)
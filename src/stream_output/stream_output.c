@@ -478,7 +478,7 @@ sout_input_t *sout_MuxAddStream( sout_mux_t *p_mux, const es_format_t *p_fmt )
     es_format_Copy( &p_input->fmt, p_fmt );
     p_input->p_fmt = &p_input->fmt;
 
-    p_input->p_fifo = block_FifoNew();
+    p_input->p_fifo = block_FifoNewSPSC();
     p_input->p_sys  = NULL;
 
     TAB_APPEND( p_mux->i_nb_inputs, p_mux->pp_inputs, p_input );
@@ -86,11 +86,169 @@ static void test_block (void)
     //assert (block == NULL);
 }
 
+static void test_block_cache (void)
+{
+    static const size_t sizes[] = { 188, 1316, 4096, 65536, 65537 };
+    vlc_block_cache_stats_t before, after;
+
+    vlc_block_cache_Enable ();
+    vlc_block_cache_GetStats (&before);
+
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        block_t *block = block_Alloc (sizes[i]);
+        assert (block != NULL);
+        assert (block->i_buffer == sizes[i]);
+        assert (((uintptr_t)block->p_buffer % 32) == 0);
+        memset (block->p_buffer, 0xAA, block->i_buffer);
+        block_Release (block);
+
+        /* Same size class, same thread: the block is recycled */
+        block = block_Alloc (sizes[i]);
+        assert (block != NULL);
+        assert (block->i_buffer == sizes[i]);
+        assert (block->i_pts == VLC_TS_INVALID && block->i_flags == 0);
+        memset (block->p_buffer, 0x55, block->i_buffer);
+
+        /* Growing beyond the class moves to another block */
+        block = block_Realloc (block, 0, sizes[i] + 100000);
+        assert (block != NULL);
+        block_Release (block);
+    }
+
+    vlc_block_cache_GetStats (&after);
+    /* 65537 bytes and the realloc'ed blocks are too big to be cached */
+    assert (after.hits - before.hits == ARRAY_SIZE(sizes) - 1);
+    assert (after.recycled - before.recycled == 2 * (ARRAY_SIZE(sizes) - 1));
+
+    vlc_block_cache_Disable ();
+
+    /* Disabled: nothing more is accounted */
+    block_Release (block_Alloc (188));
+    vlc_block_cache_GetStats (&before);
+    assert (before.hits == after.hits && before.misses == after.misses);
+}
+
+static void test_block_Share (void)
+{
+    block_t *block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    memcpy (block->p_buffer, text, sizeof (text));
+    block->i_pts = 42;
+
+    block = block_Shareable (block);
+    assert (block != NULL);
+    assert (block_Shareable (block) == block);
+
+    block_t *copy = block_Share (block);
+    assert (copy != NULL);
+    assert (copy->p_buffer == block->p_buffer);
+    assert (copy->i_buffer == block->i_buffer && copy->i_pts == 42);
+
+    /* Properties and bounds are per block */
+    copy->i_pts = 43;
+    copy->p_buffer += 5;
+    copy->i_buffer -= 5;
+    assert (block->i_pts == 42 && block->i_buffer == sizeof (text));
+
+    /* Writers get their own payload */
+    block_t *other = block_Share (block);
+    assert (other != NULL);
+    other = block_Writable (other);
+    assert (other != NULL);
+    assert (other->p_buffer != block->p_buffer);
+    memset (other->p_buffer, 'A', other->i_buffer);
+    block_Release (other);
+
+    copy = block_Realloc (copy, 5, sizeof (text));
+    assert (copy != NULL);
+    assert (copy->p_buffer != block->p_buffer);
+    memset (copy->p_buffer, 'B', 5);
+    assert (!memcmp (copy->p_buffer + 5, text + 5, sizeof (text) - 5));
+    assert (!memcmp (block->p_buffer, text, sizeof (text)));
+    block_Release (copy);
+
+    /* The last reference can write in place */
+    uint8_t *buf = block->p_buffer;
+    block = block_Writable (block);
+    assert (block != NULL && block->p_buffer == buf);
+    block_Release (block);
+
+    /* Blocks that were not made shareable are copied */
+    block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    copy = block_Share (block);
+    assert (copy != NULL && copy->p_buffer != block->p_buffer);
+    block_Release (copy);
+    block_Release (block);
+}
+
+#define HANDOFF_BLOCKS 64
+
+static void *test_block_cache_consumer (void *data)
+{
+    block_t **blocks = data;
+
+    for (unsigned i = 0; i < HANDOFF_BLOCKS; i++)
+        block_Release (blocks[i]);
+    return NULL;
+}
+
+static void test_block_cache_handoff (void)
+{
+    block_t *blocks[HANDOFF_BLOCKS];
+    vlc_block_cache_stats_t before, after;
+    vlc_thread_t th;
+
+    vlc_block_cache_Enable ();
+
+    /* Prime the cache of this thread, as a producer would */
+    for (unsigned i = 0; i < HANDOFF_BLOCKS; i++)
+        blocks[i] = block_Alloc (1316);
+    for (unsigned i = 0; i < HANDOFF_BLOCKS; i++)
+        block_Release (blocks[i]);
+
+    for (unsigned round = 0; round < 4; round++)
+    {
+        vlc_block_cache_GetStats (&before);
+
+        for (unsigned i = 0; i < HANDOFF_BLOCKS; i++)
+        {
+            blocks[i] = block_Alloc (1316);
+            assert (blocks[i] != NULL);
+            memset (blocks[i]->p_buffer, i, blocks[i]->i_buffer);
+        }
+
+        /* The consumer releases what the producer allocated */
+        if (vlc_clone (&th, test_block_cache_consumer, blocks,
+                       VLC_THREAD_PRIORITY_LOW))
+            abort ();
+        vlc_join (th, NULL);
+
+        vlc_block_cache_GetStats (&after);
+        /* Blocks came back to the producer rather than the consumer */
+        assert (after.hits - before.hits == HANDOFF_BLOCKS);
+        assert (after.misses == before.misses);
+    }
+
+    /* Blocks released after the producer cache is gone are freed */
+    for (unsigned i = 0; i < HANDOFF_BLOCKS; i++)
+        blocks[i] = block_Alloc (1316);
+    vlc_block_cache_Disable ();
+    if (vlc_clone (&th, test_block_cache_consumer, blocks,
+                   VLC_THREAD_PRIORITY_LOW))
+        abort ();
+    vlc_join (th, NULL);
+}
+
 int main (void)
 {
     test_block_File(false);
     test_block_File(true);
     test_block ();
+    test_block_cache ();
+    test_block_cache_handoff ();
+    test_block_Share ();
     return 0;
 }
 
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ * fifo.c: block_fifo_t single consumer test
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#define BLOCKS 100000
+
+static void *producer(void *data)
+{
+    block_fifo_t *fifo = data;
+
+    for (unsigned i = 0; i < BLOCKS; i += 2)
+    {
+        block_t *a = block_Alloc(i % 100);
+        block_t *b = block_Alloc((i + 1) % 100);
+        assert(a != NULL && b != NULL);
+
+        a->i_pts = i;
+        b->i_pts = i + 1;
+        if (i % 4)
+        {   /* Queue as a chain */
+            a->p_next = b;
+            block_FifoPut(fifo, a);
+        }
+        else
+        {
+            block_FifoPut(fifo, a);
+            block_FifoPut(fifo, b);
+        }
+    }
+    return NULL;
+}
+
+static void test_fifo(block_fifo_t *fifo)
+{
+    vlc_thread_t th;
+
+    if (vlc_clone(&th, producer, fifo, VLC_THREAD_PRIORITY_LOW))
+        abort();
+
+    for (unsigned i = 0; i < BLOCKS; i++)
+    {
+        block_t *block;
+
+        if (i % 3 == 1)
+        {   /* Consumer going by the count: announced blocks must be there */
+            vlc_fifo_Lock(fifo);
+            while (vlc_fifo_GetCount(fifo) == 0)
+                vlc_fifo_Wait(fifo);
+            vlc_fifo_Unlock(fifo);
+
+            assert(block_FifoShow(fifo)->i_pts == (mtime_t)i);
+            block = block_FifoGet(fifo);
+        }
+        else if (i % 3)
+            block = block_FifoGet(fifo);
+        else
+        {   /* Locked consumer */
+            vlc_fifo_Lock(fifo);
+            while ((block = vlc_fifo_DequeueUnlocked(fifo)) == NULL)
+                vlc_fifo_Wait(fifo);
+            vlc_fifo_Unlock(fifo);
+        }
+
+        assert(block->i_pts == (mtime_t)i);
+        assert(block->i_buffer == i % 100);
+        assert(block->p_next == NULL);
+        block_Release(block);
+    }
+
+    vlc_join(th, NULL);
+    assert(vlc_fifo_GetCount(fifo) == 0);
+    assert(vlc_fifo_GetBytes(fifo) == 0);
+
+    /* Accounting and order, single thread */
+    for (unsigned i = 0; i < 10; i++)
+    {
+        block_t *block = block_Alloc(i);
+        assert(block != NULL);
+        block->i_pts = i;
+        block_FifoPut(fifo, block);
+    }
+    assert(vlc_fifo_GetCount(fifo) == 10);
+    assert(vlc_fifo_GetBytes(fifo) == 45);
+    assert(block_FifoShow(fifo)->i_pts == 0);
+
+    block_t *block = block_FifoGet(fifo);
+    assert(block->i_pts == 0);
+    block_Release(block);
+    block_FifoPut(fifo, block_Alloc(100));
+
+    vlc_fifo_Lock(fifo);
+    block = vlc_fifo_DequeueAllUnlocked(fifo);
+    assert(vlc_fifo_IsEmpty(fifo));
+    assert(vlc_fifo_GetBytes(fifo) == 0);
+    vlc_fifo_Unlock(fifo);
+
+    unsigned count = 0;
+    for (block_t *b = block; b != NULL; b = b->p_next)
+        count++;
+    assert(count == 10);
+    assert(block->i_pts == 1);
+    block_ChainRelease(block);
+
+    block_FifoPut(fifo, block_Alloc(1));
+    block_FifoRelease(fifo);
+}
+
+int main(void)
+{
+    test_fifo(block_FifoNew());
+    test_fifo(block_FifoNewSPSC());
+    return 0;
+}
@@ -106,6 +106,63 @@ static void test(bool zombie)
             picture_Release(pics[i]);
 }
 
+static void test_reset(void)
+{
+    picture_t *pics[PICTURES];
+
+    pool = picture_pool_NewFromFormat(&fmt, PICTURES);
+    assert(pool != NULL);
+
+    for (unsigned i = 0; i < PICTURES; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+    }
+
+    for (unsigned i = 1; i < PICTURES; i++)
+        picture_Release(pics[i]);
+
+    /* The first clone is still held across the reset */
+    picture_t *held = pics[0];
+    void *plane = held->p[0].p_pixels;
+    picture_t *pic = NULL;
+
+    assert(picture_pool_Reset(pool) == 1);
+
+    for (unsigned i = 0; i < PICTURES; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+        assert(pics[i] != held);
+        if (pics[i]->p[0].p_pixels == plane)
+            pic = pics[i];
+    }
+    assert(pic != NULL);
+    assert(picture_pool_Get(pool) == NULL);
+
+    /* The late release must neither give back the slot nor alter the clone
+     * that reuses it */
+    assert(held->p[0].p_pixels == plane);
+    picture_Release(held);
+    assert(picture_pool_Get(pool) == NULL);
+    assert(pic->p[0].p_pixels == plane);
+
+    for (unsigned i = 0; i < PICTURES; i++)
+        picture_Release(pics[i]);
+
+    assert(picture_pool_Reset(pool) == 0);
+
+    for (unsigned i = 0; i < PICTURES; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+    }
+
+    /* A reset while clones are held, then released after the pool */
+    assert(picture_pool_Reset(pool) == PICTURES);
+    picture_pool_Release(pool);
+
+    for (unsigned i = 0; i < PICTURES; i++)
+        picture_Release(pics[i]);
+}
+
 int main(void)
 {
     video_format_Setup(&fmt, VLC_CODEC_I420, 320, 200, 320, 200, 1, 1);
@@ -122,6 +179,7 @@ int main(void)
 
     test(false);
     test(true);
+    test_reset();
 
     return 0;
 }
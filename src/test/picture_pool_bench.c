@@ -0,0 +1,107 @@
+/*****************************************************************************
+ * picture_pool_bench.c: picture_pool_t get/release throughput
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_es.h>
+#include <vlc_picture_pool.h>
+
+#define PICTURES 16
+#define MAX_THREADS 8
+
+static picture_pool_t *pool;
+static unsigned iterations = 200000;
+
+static void *worker(void *data)
+{
+    unsigned *count = data;
+
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        picture_t *pic = picture_pool_Get(pool);
+        if (pic == NULL)
+            continue; /* all pictures held by other threads */
+
+        assert(pic->p[0].p_pixels != NULL);
+        picture_Release(pic);
+        (*count)++;
+    }
+    return NULL;
+}
+
+static void bench(unsigned threads)
+{
+    vlc_thread_t th[MAX_THREADS];
+    unsigned counts[MAX_THREADS] = { 0 };
+    unsigned total = 0;
+
+    mtime_t start = mdate();
+    for (unsigned i = 0; i < threads; i++)
+        if (vlc_clone(&th[i], worker, &counts[i], VLC_THREAD_PRIORITY_LOW))
+            abort();
+    for (unsigned i = 0; i < threads; i++)
+    {
+        vlc_join(th[i], NULL);
+        total += counts[i];
+    }
+    mtime_t duration = mdate() - start;
+
+    /* Nothing is left out of the pool */
+    picture_t *pics[PICTURES];
+    for (unsigned i = 0; i < PICTURES; i++)
+    {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+    }
+    assert(picture_pool_Get(pool) == NULL);
+    for (unsigned i = 0; i < PICTURES; i++)
+        picture_Release(pics[i]);
+
+    printf("%u thread(s): %u get/release in %"PRId64" us, %.0f per second\n",
+           threads, total, duration,
+           duration > 0 ? total * (double)CLOCK_FREQ / duration : 0.);
+}
+
+int main(void)
+{
+    video_format_t fmt;
+    const char *env = getenv("VLC_BENCH_ITERATIONS");
+
+    if (env != NULL)
+        iterations = strtoul(env, NULL, 10);
+
+    video_format_Setup(&fmt, VLC_CODEC_I420, 320, 200, 320, 200, 1, 1);
+    pool = picture_pool_NewFromFormat(&fmt, PICTURES);
+    assert(pool != NULL);
+
+    for (unsigned threads = 1; threads <= MAX_THREADS; threads *= 2)
+        bench(threads);
+
+    picture_pool_Release(pool);
+    return 0;
+}
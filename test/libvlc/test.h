@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 
 
@@ -71,4 +72,17 @@ static inline void test_init (void)
     setenv( "VLC_PLUGIN_PATH", "../modules", 1 );
 }
 
+/* Reproducible pseudo-random numbers (15 bits), for a given seed */
+static inline unsigned test_rand (unsigned *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+/* Reproducible test data: the byte at a given offset of a stream */
+static inline uint8_t test_pattern (uint64_t offset)
+{
+    return (offset * UINT64_C(2654435761)) >> 13;
+}
+
 #endif /* TEST_H */
@@ -0,0 +1,611 @@
+/*****************************************************************************
+ * adaptive_h2.c: adaptive streaming over a loopback HTTP/2 server
+ *****************************************************************************
+ * Copyright © 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* This serves HLS playlists and ADTS segments over cleartext HTTP/2 from a
+ * loopback socket, and plays them to a dummy stream output.
+ *
+ * It checks that the segments are all fetched over a single connection, with
+ * concurrent streams. It doubles as an offline benchmark:
+ *   ADAPTIVE_H2_SEGMENTS   number of segments (default 8)
+ *   ADAPTIVE_H2_DELAY      server latency per request in ms (default 20)
+ * e.g. ADAPTIVE_H2_SEGMENTS=100 ADAPTIVE_H2_DELAY=200 ./test_..._adaptive_h2
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include "../modules/access/http/hpack.c"
+#include "../modules/access/http/hpackenc.c"
+#include "../modules/access/http/h2frame.c"
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+#define ADTS_FRAME_SIZE 307 /* see adts_header */
+#define SEGMENT_FRAMES 43 /* 1024 samples each at 44.1 kHz: about 1 second */
+#define SEGMENT_SIZE (ADTS_FRAME_SIZE * SEGMENT_FRAMES)
+#define MAX_CONNS 8
+#define MAX_STREAMS 256
+
+static const uint8_t adts_header[7] =
+    { 0xFF, 0xF1, 0x50, 0x80, 0x26, 0x7F, 0xFC };
+
+static unsigned segments;
+static mtime_t delay;
+
+struct server_conn;
+
+struct server_stream
+{
+    struct server_conn *conn;
+    uint_fast32_t id;
+    char *path;
+    char *range;
+    bool has_thread;
+    vlc_thread_t thread;
+};
+
+struct server_conn
+{
+    int fd;
+    vlc_thread_t thread;
+    vlc_mutex_t lock; /* serializes output frames and counters */
+    struct server_stream streams[MAX_STREAMS];
+    unsigned stream_count;
+    unsigned segment_requests;
+    unsigned ranged_requests;
+    unsigned inflight;
+    unsigned peak_inflight;
+};
+
+static struct
+{
+    int fd;
+    unsigned port;
+    vlc_thread_t thread;
+    struct server_conn conns[MAX_CONNS];
+    unsigned conn_count;
+} server;
+
+static void conn_send(struct server_conn *conn, struct vlc_h2_frame *f)
+{
+    assert(f != NULL);
+
+    size_t len = vlc_h2_frame_size(f);
+    /* The client may have gone away already: ignore errors */
+    ssize_t val = send(conn->fd, f->data, len, MSG_NOSIGNAL);
+    (void) val;
+    free(f);
+}
+
+static int conn_recv(int fd, void *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t val = recv(fd, buf, len, 0);
+        if (val <= 0)
+            return -1;
+        buf = (char *)buf + val;
+        len -= val;
+    }
+    return 0;
+}
+
+static struct vlc_h2_frame *conn_recv_frame(int fd)
+{
+    uint8_t header[9];
+
+    if (conn_recv(fd, header, sizeof (header)))
+        return NULL;
+
+    size_t len = (header[0] << 16) | (header[1] << 8) | header[2];
+    struct vlc_h2_frame *f = malloc(sizeof (*f) + sizeof (header) + len);
+    assert(f != NULL);
+
+    f->next = NULL;
+    memcpy(f->data, header, sizeof (header));
+    if (conn_recv(fd, f->data + sizeof (header), len))
+    {
+        free(f);
+        return NULL;
+    }
+    return f;
+}
+
+/*** Content ***/
+static char *make_playlist(bool ranged, bool moved)
+{
+    char *str;
+    size_t len;
+    FILE *stream = open_memstream(&str, &len);
+    assert(stream != NULL);
+
+    fprintf(stream, "#EXTM3U\n#EXT-X-VERSION:%d\n#EXT-X-TARGETDURATION:1\n"
+            "#EXT-X-MEDIA-SEQUENCE:0\n", ranged ? 4 : 3);
+    for (unsigned i = 0; i < segments; i++)
+    {
+        fprintf(stream, "#EXTINF:1.0,\n");
+        if (ranged)
+            fprintf(stream, "#EXT-X-BYTERANGE:%u@%u\nall.aac\n",
+                    SEGMENT_SIZE, i * SEGMENT_SIZE);
+        else
+            fprintf(stream, "%s%u.aac\n", moved ? "old" : "seg", i);
+    }
+    fprintf(stream, "#EXT-X-ENDLIST\n");
+    fclose(stream);
+    return str;
+}
+
+static uint8_t *make_segments(unsigned count)
+{
+    uint8_t *buf = calloc(count * SEGMENT_FRAMES, ADTS_FRAME_SIZE);
+    assert(buf != NULL);
+
+    for (unsigned i = 0; i < count * SEGMENT_FRAMES; i++)
+        memcpy(buf + i * ADTS_FRAME_SIZE, adts_header, sizeof (adts_header));
+    return buf;
+}
+
+static void respond(struct server_stream *s, const char *status,
+                    const char *type, const void *data, size_t len,
+                    const char *range)
+{
+    struct server_conn *conn = s->conn;
+    char lenstr[24];
+    const char *headers[4][2] = {
+        { ":status", status },
+        { "content-length", lenstr },
+        { "content-type", type },
+        { "content-range", range },
+    };
+
+    snprintf(lenstr, sizeof (lenstr), "%zu", len);
+
+    vlc_mutex_lock(&conn->lock);
+    conn_send(conn, vlc_h2_frame_headers(s->id, VLC_H2_DEFAULT_MAX_FRAME,
+                                         len == 0, range ? 4 : 3, headers));
+    vlc_mutex_unlock(&conn->lock);
+
+    while (len > 0)
+    {
+        size_t size = len;
+        if (size > VLC_H2_DEFAULT_MAX_FRAME)
+            size = VLC_H2_DEFAULT_MAX_FRAME;
+
+        vlc_mutex_lock(&conn->lock);
+        conn_send(conn, vlc_h2_frame_data(s->id, data, size, size == len));
+        vlc_mutex_unlock(&conn->lock);
+        data = (const uint8_t *)data + size;
+        len -= size;
+    }
+}
+
+static void redirect(struct server_stream *s, const char *location)
+{
+    struct server_conn *conn = s->conn;
+    const char *headers[3][2] = {
+        { ":status", "302" },
+        { "content-length", "0" },
+        { "location", location },
+    };
+
+    vlc_mutex_lock(&conn->lock);
+    conn_send(conn, vlc_h2_frame_headers(s->id, VLC_H2_DEFAULT_MAX_FRAME,
+                                         true, 3, headers));
+    vlc_mutex_unlock(&conn->lock);
+}
+
+static void *responder(void *data)
+{
+    struct server_stream *s = data;
+    struct server_conn *conn = s->conn;
+    unsigned idx;
+
+    msleep(delay);
+
+    if (!strcmp(s->path, "/index.m3u8") || !strcmp(s->path, "/ranged.m3u8")
+     || !strcmp(s->path, "/moved.m3u8"))
+    {
+        char *playlist = make_playlist(!strcmp(s->path, "/ranged.m3u8"),
+                                       !strcmp(s->path, "/moved.m3u8"));
+        respond(s, "200", "application/vnd.apple.mpegurl", playlist,
+                strlen(playlist), NULL);
+        free(playlist);
+    }
+    else if (sscanf(s->path, "/seg%u.aac", &idx) == 1 && idx < segments)
+    {
+        uint8_t *buf = make_segments(1);
+        respond(s, "200", "audio/aac", buf, SEGMENT_SIZE, NULL);
+        free(buf);
+    }
+    else if (sscanf(s->path, "/old%u.aac", &idx) == 1 && idx < segments)
+    {
+        char location[32];
+
+        snprintf(location, sizeof (location), "/seg%u.aac", idx);
+        redirect(s, location);
+    }
+    else if (!strcmp(s->path, "/all.aac"))
+    {
+        const size_t total = segments * SEGMENT_SIZE;
+        uintmax_t start = 0, end = total - 1;
+        uint8_t *buf = make_segments(segments);
+
+        if (s->range != NULL)
+        {
+            char crange[64];
+
+            assert(sscanf(s->range, "bytes=%ju-%ju", &start, &end) == 2);
+            assert(start <= end && end < total);
+            snprintf(crange, sizeof (crange), "bytes %ju-%ju/%zu",
+                     start, end, total);
+            respond(s, "206", "audio/aac", buf + start, end - start + 1,
+                    crange);
+        }
+        else
+            respond(s, "200", "audio/aac", buf, total, NULL);
+        free(buf);
+    }
+    else
+        respond(s, "404", "text/plain", NULL, 0, NULL);
+
+    vlc_mutex_lock(&conn->lock);
+    conn->inflight--;
+    vlc_mutex_unlock(&conn->lock);
+    return NULL;
+}
+
+/*** HTTP/2 parser callbacks ***/
+static void server_setting(void *ctx, uint_fast16_t id, uint_fast32_t value)
+{
+    (void) ctx; (void) id; (void) value;
+}
+
+static int server_settings_done(void *ctx)
+{
+    struct server_conn *conn = ctx;
+
+    vlc_mutex_lock(&conn->lock);
+    conn_send(conn, vlc_h2_frame_settings_ack());
+    vlc_mutex_unlock(&conn->lock);
+    return 0;
+}
+
+static int server_ping(void *ctx, uint_fast64_t opaque)
+{
+    struct server_conn *conn = ctx;
+
+    vlc_mutex_lock(&conn->lock);
+    conn_send(conn, vlc_h2_frame_pong(opaque));
+    vlc_mutex_unlock(&conn->lock);
+    return 0;
+}
+
+static void server_error(void *ctx, uint_fast32_t code)
+{
+    (void) ctx;
+    fprintf(stderr, "server connection error: %s\n", vlc_h2_strerror(code));
+}
+
+static int server_reset(void *ctx, uint_fast32_t last_seq, uint_fast32_t code)
+{
+    (void) ctx; (void) last_seq; (void) code;
+    return 0;
+}
+
+static void server_window_status(void *ctx, uint32_t *rcwd)
+{
+    (void) ctx;
+    *rcwd = UINT32_C(1) << 30; /* requests have no body */
+}
+
+static void *server_stream_lookup(void *ctx, uint_fast32_t id)
+{
+    struct server_conn *conn = ctx;
+
+    for (unsigned i = 0; i < conn->stream_count; i++)
+        if (conn->streams[i].id == id)
+            return &conn->streams[i];
+
+    assert(conn->stream_count < MAX_STREAMS);
+
+    struct server_stream *s = &conn->streams[conn->stream_count++];
+    s->conn = conn;
+    s->id = id;
+    s->path = NULL;
+    s->range = NULL;
+    s->has_thread = false;
+    return s;
+}
+
+static int server_stream_error(void *ctx, uint_fast32_t id, uint_fast32_t code)
+{
+    struct server_conn *conn = ctx;
+
+    vlc_mutex_lock(&conn->lock);
+    conn_send(conn, vlc_h2_frame_rst_stream(id, code));
+    vlc_mutex_unlock(&conn->lock);
+    return 0;
+}
+
+static void server_stream_headers(void *ctx, unsigned count,
+                                  const char *const hdrs[][2])
+{
+    struct server_stream *s = ctx;
+
+    for (unsigned i = 0; i < count; i++)
+        if (!strcmp(hdrs[i][0], ":path"))
+            s->path = strdup(hdrs[i][1]);
+        else if (!strcmp(hdrs[i][0], "range"))
+            s->range = strdup(hdrs[i][1]);
+}
+
+static int server_stream_data(void *ctx, struct vlc_h2_frame *f)
+{
+    (void) ctx;
+    free(f);
+    return 0;
+}
+
+static void server_stream_end(void *ctx)
+{
+    struct server_stream *s = ctx;
+    struct server_conn *conn = s->conn;
+
+    assert(s->path != NULL);
+    assert(!s->has_thread);
+
+    vlc_mutex_lock(&conn->lock);
+    if (strstr(s->path, ".aac") != NULL)
+        conn->segment_requests++;
+    if (s->range != NULL)
+        conn->ranged_requests++;
+    if (++conn->inflight > conn->peak_inflight)
+        conn->peak_inflight = conn->inflight;
+    vlc_mutex_unlock(&conn->lock);
+
+    if (vlc_clone(&s->thread, responder, s, VLC_THREAD_PRIORITY_LOW))
+        abort();
+    s->has_thread = true;
+}
+
+static int server_stream_reset(void *ctx, uint_fast32_t code)
+{
+    (void) ctx; (void) code;
+    return 0;
+}
+
+static const struct vlc_h2_parser_cbs server_callbacks =
+{
+    server_setting,
+    server_settings_done,
+    server_ping,
+    server_error,
+    server_reset,
+    server_window_status,
+    server_stream_lookup,
+    server_stream_error,
+    server_stream_headers,
+    server_stream_data,
+    server_stream_end,
+    server_stream_reset,
+};
+
+/*** Server threads ***/
+static void *server_conn_thread(void *data)
+{
+    struct server_conn *conn = data;
+    static const char preface[24] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    char buf[sizeof (preface)];
+
+    if (conn_recv(conn->fd, buf, sizeof (buf))
+     || memcmp(buf, preface, sizeof (buf)))
+        return NULL; /* not an HTTP/2 prior knowledge client */
+
+    vlc_mutex_lock(&conn->lock);
+    conn_send(conn, vlc_h2_frame_settings());
+    vlc_mutex_unlock(&conn->lock);
+
+    struct vlc_h2_parser *parser = vlc_h2_parse_init(conn, &server_callbacks);
+    assert(parser != NULL);
+
+    struct vlc_h2_frame *f;
+    while ((f = conn_recv_frame(conn->fd)) != NULL)
+        if (vlc_h2_parse(parser, f))
+            break;
+
+    vlc_h2_parse_destroy(parser);
+
+    for (unsigned i = 0; i < conn->stream_count; i++)
+    {
+        struct server_stream *s = &conn->streams[i];
+
+        if (s->has_thread)
+            vlc_join(s->thread, NULL);
+        free(s->range);
+        free(s->path);
+    }
+    return NULL;
+}
+
+static void *server_thread(void *data)
+{
+    int fd;
+
+    (void) data;
+    while ((fd = accept(server.fd, NULL, NULL)) >= 0)
+    {
+        assert(server.conn_count < MAX_CONNS);
+
+        struct server_conn *conn = &server.conns[server.conn_count];
+        memset(conn, 0, sizeof (*conn));
+        conn->fd = fd;
+        vlc_mutex_init(&conn->lock);
+        if (vlc_clone(&conn->thread, server_conn_thread, conn,
+                      VLC_THREAD_PRIORITY_LOW))
+            abort();
+        server.conn_count++;
+    }
+    return NULL;
+}
+
+static void server_start(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof (addr);
+
+    memset(&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    server.fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(server.fd >= 0);
+    assert(bind(server.fd, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+    assert(listen(server.fd, MAX_CONNS) == 0);
+    assert(getsockname(server.fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    server.port = ntohs(addr.sin_port);
+    server.conn_count = 0;
+
+    if (vlc_clone(&server.thread, server_thread, NULL,
+                  VLC_THREAD_PRIORITY_LOW))
+        abort();
+}
+
+static void server_stop(void)
+{
+    shutdown(server.fd, SHUT_RDWR);
+    vlc_join(server.thread, NULL);
+    close(server.fd);
+
+    for (unsigned i = 0; i < server.conn_count; i++)
+    {
+        struct server_conn *conn = &server.conns[i];
+
+        shutdown(conn->fd, SHUT_RDWR);
+        vlc_join(conn->thread, NULL);
+        close(conn->fd);
+        vlc_mutex_destroy(&conn->lock);
+    }
+}
+
+/*** Client ***/
+static void player_event(const libvlc_event_t *event, void *data)
+{
+    (void) event;
+    vlc_sem_post(data);
+}
+
+static void test_playlist(const char *name, bool ranged, bool moved)
+{
+    static const char *const argv[] = {
+        "--http2", "--adaptive-http2",
+        "--adaptive-downloads=4", "--adaptive-prefetch=3",
+    };
+    char url[64];
+    vlc_sem_t done;
+
+    server_start();
+    snprintf(url, sizeof (url), "http://127.0.0.1:%u/%s", server.port, name);
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    libvlc_media_t *media = libvlc_media_new_location(vlc, url);
+    assert(media != NULL);
+    libvlc_media_add_option(media, ":sout=#dummy");
+
+    libvlc_media_player_t *mp = libvlc_media_player_new_from_media(media);
+    assert(mp != NULL);
+
+    libvlc_event_manager_t *em = libvlc_media_player_event_manager(mp);
+    vlc_sem_init(&done, 0);
+    libvlc_event_attach(em, libvlc_MediaPlayerEndReached, player_event, &done);
+    libvlc_event_attach(em, libvlc_MediaPlayerEncounteredError, player_event,
+                        &done);
+
+    mtime_t start = mdate();
+    assert(libvlc_media_player_play(mp) == 0);
+    vlc_sem_wait(&done);
+    mtime_t elapsed = mdate() - start;
+
+    assert(libvlc_media_player_get_state(mp) == libvlc_Ended);
+    libvlc_media_player_release(mp);
+    libvlc_media_release(media);
+    libvlc_release(vlc);
+    vlc_sem_destroy(&done);
+
+    server_stop();
+
+    /* The playlist and the segments are fetched by distinct managers */
+    unsigned segment_conns = 0, peak = 0;
+    for (unsigned i = 0; i < server.conn_count; i++)
+    {
+        const struct server_conn *conn = &server.conns[i];
+
+        if (conn->segment_requests == 0)
+            continue;
+        segment_conns++;
+        /* Moved segments are requested twice: at the old and new URLs */
+        assert(conn->segment_requests == (moved ? 2 : 1) * segments);
+        assert(conn->ranged_requests == (ranged ? segments : 0));
+        peak = conn->peak_inflight;
+    }
+    assert(segment_conns == 1);
+    assert(segments < 2 || peak > 1);
+
+    log("%s: %u segments in %"PRId64" ms, up to %u concurrent streams\n",
+        name, segments, elapsed / 1000, peak);
+}
+
+int main(void)
+{
+    const char *str;
+
+    test_init();
+
+    str = getenv("ADAPTIVE_H2_SEGMENTS");
+    segments = (str != NULL) ? strtoul(str, NULL, 10) : 8;
+    str = getenv("ADAPTIVE_H2_DELAY");
+    delay = ((str != NULL) ? strtoul(str, NULL, 10) : 20) * 1000;
+    if (getenv("ADAPTIVE_H2_SEGMENTS") || getenv("ADAPTIVE_H2_DELAY"))
+        alarm(0); /* benchmarking: no time limit */
+    assert(segments > 0 && segments <= MAX_STREAMS - 2);
+
+    test_playlist("index.m3u8", false, false);
+    test_playlist("ranged.m3u8", true, false);
+    test_playlist("moved.m3u8", false, true);
+    return 0;
+}
@@ -0,0 +1,400 @@
+/*****************************************************************************
+ * mkv_nocues.c: Matroska seeking without cues test
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Writes a file with one video track, no cues and no seek head, with
+ * clusters of SimpleBlocks and of BlockGroups and key frames at random
+ * intervals. The mkv demuxer seeks in it three times: searching the
+ * clusters itself, with the background index, then with the index loaded
+ * from the cache. After each seek, the first block must be the last key
+ * frame before the target, followed by all the next frames.
+ *
+ * Usage: test_modules_demux_mkv_nocues [file]
+ * writes the file without running the test, for manual checks.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_block.h>
+#include <vlc_modules.h>
+#include <vlc_stream.h>
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+#define FRAMES         1500
+#define FRAME_DURATION 40 /* ms, with the default timecode scale */
+
+static bool keyframes[FRAMES];
+static uint8_t segment_uid[16];
+
+/* EBML writer, master elements get their size patched at the end */
+static void ebml_id(FILE *f, uint32_t id)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        if ((id >> shift) != 0)
+            fputc(id >> shift, f);
+}
+
+static void ebml_size(FILE *f, uint64_t size)
+{
+    fputc(0x01, f);
+    for (int shift = 48; shift >= 0; shift -= 8)
+        fputc(size >> shift, f);
+}
+
+static long ebml_start(FILE *f, uint32_t id)
+{
+    ebml_id(f, id);
+    long offset = ftell(f);
+    ebml_size(f, 0);
+    return offset;
+}
+
+static void ebml_end(FILE *f, long offset)
+{
+    long end = ftell(f);
+    fseek(f, offset, SEEK_SET);
+    ebml_size(f, end - offset - 8);
+    fseek(f, end, SEEK_SET);
+}
+
+static void ebml_data(FILE *f, uint32_t id, const void *data, size_t size)
+{
+    assert(size < 0x7f);
+    ebml_id(f, id);
+    fputc(0x80 | size, f);
+    fwrite(data, 1, size, f);
+}
+
+static void ebml_uint(FILE *f, uint32_t id, uint64_t value)
+{
+    uint8_t buf[8];
+    size_t size = 1;
+
+    while (size < 8 && (value >> (8 * size)) != 0)
+        size++;
+    for (size_t i = 0; i < size; i++)
+        buf[i] = value >> (8 * (size - 1 - i));
+    ebml_data(f, id, buf, size);
+}
+
+static void ebml_float(FILE *f, uint32_t id, double value)
+{
+    union { double d; uint64_t u; } u = { .d = value };
+    uint8_t buf[8];
+
+    SetQWBE(buf, u.u);
+    ebml_data(f, id, buf, 8);
+}
+
+static void ebml_string(FILE *f, uint32_t id, const char *str)
+{
+    ebml_data(f, id, str, strlen(str));
+}
+
+/* Blocks of track 1, carrying their frame number */
+static void WriteBlock(FILE *f, uint32_t id, unsigned frame, int16_t timecode,
+                       uint8_t flags)
+{
+    uint8_t buf[8];
+
+    buf[0] = 0x81;
+    SetWBE(&buf[1], timecode);
+    buf[3] = flags;
+    SetDWBE(&buf[4], frame);
+    ebml_data(f, id, buf, 8);
+}
+
+static void WriteFile(FILE *f)
+{
+    unsigned seed = 1;
+
+    for (unsigned i = 0; i < FRAMES; i += 1 + test_rand(&seed) % 30)
+        keyframes[i] = true;
+    for (size_t i = 0; i < sizeof (segment_uid); i++)
+        segment_uid[i] = test_rand(&seed);
+
+    long ebml = ebml_start(f, 0x1A45DFA3);
+    ebml_uint(f, 0x4286, 1); /* EBMLVersion */
+    ebml_uint(f, 0x42F7, 1); /* EBMLReadVersion */
+    ebml_uint(f, 0x42F2, 4); /* EBMLMaxIDLength */
+    ebml_uint(f, 0x42F3, 8); /* EBMLMaxSizeLength */
+    ebml_string(f, 0x4282, "matroska");
+    ebml_uint(f, 0x4287, 2); /* DocTypeVersion */
+    ebml_uint(f, 0x4285, 2); /* DocTypeReadVersion */
+    ebml_end(f, ebml);
+
+    long segment = ebml_start(f, 0x18538067);
+
+    long info = ebml_start(f, 0x1549A966);
+    ebml_uint(f, 0x2AD7B1, 1000000); /* TimecodeScale */
+    ebml_float(f, 0x4489, FRAMES * FRAME_DURATION); /* Duration */
+    ebml_data(f, 0x73A4, segment_uid, sizeof (segment_uid));
+    ebml_string(f, 0x4D80, "VLC test"); /* MuxingApp */
+    ebml_string(f, 0x5741, "VLC test"); /* WritingApp */
+    ebml_end(f, info);
+
+    long tracks = ebml_start(f, 0x1654AE6B);
+    long entry = ebml_start(f, 0xAE);
+    ebml_uint(f, 0xD7, 1); /* TrackNumber */
+    ebml_uint(f, 0x73C5, 1); /* TrackUID */
+    ebml_uint(f, 0x83, 1); /* TrackType: video */
+    ebml_string(f, 0x86, "V_MJPEG");
+    long video = ebml_start(f, 0xE0);
+    ebml_uint(f, 0xB0, 64); /* PixelWidth */
+    ebml_uint(f, 0xBA, 48); /* PixelHeight */
+    ebml_end(f, video);
+    ebml_end(f, entry);
+    ebml_end(f, tracks);
+
+    for (unsigned i = 0, n = 0; i < FRAMES; n++)
+    {
+        unsigned count = __MIN(10 + test_rand(&seed) % 40, FRAMES - i);
+        long cluster = ebml_start(f, 0x1F43B675);
+
+        ebml_uint(f, 0xE7, i * FRAME_DURATION); /* Timecode */
+        for (unsigned j = 0; j < count; j++, i++)
+        {
+            int16_t timecode = j * FRAME_DURATION;
+
+            if (n % 2 == 0)
+                WriteBlock(f, 0xA3, i, timecode, keyframes[i] ? 0x80 : 0);
+            else
+            {
+                long group = ebml_start(f, 0xA0);
+                WriteBlock(f, 0xA1, i, timecode, 0);
+                if (!keyframes[i])
+                {   /* ReferenceBlock: the previous frame */
+                    uint8_t ref = -FRAME_DURATION;
+                    ebml_data(f, 0xFB, &ref, 1);
+                }
+                ebml_end(f, group);
+            }
+        }
+        ebml_end(f, cluster);
+    }
+
+    ebml_end(f, segment);
+}
+
+struct es_out_id_t
+{
+    int dummy;
+};
+
+static struct
+{
+    unsigned next; /* expected frame */
+    unsigned count; /* blocks since the last seek */
+} output;
+
+static es_out_id_t *EsOutAdd(es_out_t *out, const es_format_t *fmt)
+{
+    (void) out;
+    assert(fmt->i_cat == VIDEO_ES);
+
+    es_out_id_t *id = malloc(sizeof (*id));
+    assert(id != NULL);
+    return id;
+}
+
+static int EsOutSend(es_out_t *out, es_out_id_t *id, block_t *block)
+{
+    (void) out; (void) id;
+
+    assert(block->i_buffer == 4);
+    unsigned frame = GetDWBE(block->p_buffer);
+
+    if (frame != output.next)
+    {
+        fprintf(stderr, "got frame %u, expected %u\n", frame, output.next);
+        abort();
+    }
+    assert(block->i_pts == VLC_TS_0 + frame * FRAME_DURATION * INT64_C(1000));
+
+    output.next = frame + 1;
+    output.count++;
+    block_Release(block);
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel(es_out_t *out, es_out_id_t *id)
+{
+    (void) out;
+    free(id);
+}
+
+static int EsOutControl(es_out_t *out, int query, va_list ap)
+{
+    (void) out;
+
+    switch (query)
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg(ap, es_out_id_t *);
+            *va_arg(ap, bool *) = true;
+            return VLC_SUCCESS;
+        case ES_OUT_SET_PCR:
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static void Seek(demux_t *demux, mtime_t time)
+{
+    unsigned frame = time / (FRAME_DURATION * 1000);
+
+    while (!keyframes[frame])
+        frame--;
+    output.next = frame;
+    output.count = 0;
+
+    assert(demux_Control(demux, DEMUX_SET_TIME, (int64_t)time,
+                         true) == VLC_SUCCESS);
+    while (output.count < 10)
+        assert(demux_Demux(demux) == VLC_DEMUXER_SUCCESS);
+}
+
+/* Seeks in the file, once the index cache exists if one is given */
+static void test_seek(vlc_object_t *parent, const char *url,
+                      const char *cache)
+{
+    stream_t *s = vlc_stream_NewMRL(parent, url);
+    assert(s != NULL);
+
+    es_out_t out = {
+        .pf_add = EsOutAdd,
+        .pf_send = EsOutSend,
+        .pf_del = EsOutDel,
+        .pf_control = EsOutControl,
+    };
+    demux_t *demux = demux_New(parent, "mkv", "", s, &out);
+    assert(demux != NULL);
+
+    if (cache != NULL)
+    {   /* the indexer writes the cache when it is done */
+        mtime_t deadline = mdate() + 10 * CLOCK_FREQ;
+
+        while (access(cache, F_OK) && mdate() < deadline)
+            mwait(mdate() + CLOCK_FREQ / 10);
+        assert(access(cache, F_OK) == 0);
+    }
+
+    /* far forward first, so that nothing was searched on the way */
+    const mtime_t end = (FRAMES - 20) * FRAME_DURATION * INT64_C(1000);
+    static const mtime_t times[] = {
+        60 * CLOCK_FREQ + 17000, CLOCK_FREQ / 2, 0, 30 * CLOCK_FREQ,
+        30 * CLOCK_FREQ - 1, 30 * CLOCK_FREQ + 40000,
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(times); i++)
+        Seek(demux, times[i]);
+    Seek(demux, end);
+
+    unsigned seed = 42;
+    for (unsigned i = 0; i < 100; i++)
+        Seek(demux, (mtime_t)test_rand(&seed) * end / 32768);
+
+    demux_Delete(demux);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *const args[] = { "--verbose=0" };
+
+    if (argc > 1)
+    {
+        FILE *f = fopen(argv[1], "wb");
+        if (f == NULL)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+        WriteFile(f);
+        fclose(f);
+        return 0;
+    }
+
+    char dir[] = "/tmp/vlc-mkv-XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    /* keep the index cache out of the user's */
+    setenv("XDG_CACHE_HOME", dir, 1);
+
+    char path[sizeof (dir) + 16], url[sizeof (path) + 8];
+    char cache[sizeof (dir) + 64];
+    snprintf(path, sizeof (path), "%s/nocues.mkv", dir);
+    snprintf(url, sizeof (url), "file://%s", path);
+
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    WriteFile(f);
+    fclose(f);
+
+    int n = snprintf(cache, sizeof (cache), "%s/vlc/mkv/", dir);
+    for (size_t i = 0; i < sizeof (segment_uid); i++)
+        n += snprintf(&cache[n], sizeof (cache) - n, "%02x", segment_uid[i]);
+    strcat(cache, ".idx");
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+    int ret = 0;
+
+    if (module_exists("mkv"))
+    {
+        var_Create(obj, "mkv-background-index", VLC_VAR_BOOL);
+        test_seek(obj, url, NULL);
+        assert(access(cache, F_OK) != 0);
+
+        var_SetBool(obj, "mkv-background-index", true);
+        test_seek(obj, url, cache);
+        test_seek(obj, url, NULL);
+    }
+    else
+        ret = 77;
+
+    libvlc_release(vlc);
+
+    unlink(cache);
+    *strrchr(cache, '/') = '\0';
+    rmdir(cache);
+    *strrchr(cache, '/') = '\0';
+    rmdir(cache);
+    unlink(path);
+    rmdir(dir);
+    return ret;
+}
@@ -0,0 +1,411 @@
+/*****************************************************************************
+ * mp4_boxes.c: MP4 box tree lazy parsing test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Without arguments, builds a file with large seek tables and cover art,
+ * parses it both eagerly and lazily, and checks the lazily parsed boxes end
+ * up identical once requested. MP4 files can be passed as arguments to
+ * compare the box tree parsing time and the amount of data read.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../../modules/demux/mp4/libmp4.c"
+
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+#include "mp4_writer.h"
+
+#include <vlc/vlc.h>
+
+#define ITERATIONS 10
+
+#define STSS_COUNT  16384
+#define SDTP_COUNT  65536
+#define SBGP_COUNT  4096
+#define COVR_SIZE   (1 << 20)
+
+/* Memory source counting what is actually read */
+static struct
+{
+    uint8_t *p_data;
+    size_t i_size;
+    uint64_t i_offset;
+    uint64_t i_read;
+} source;
+
+static ssize_t SourceRead(stream_t *s, void *buf, size_t len)
+{
+    (void) s;
+
+    if (source.i_offset >= source.i_size)
+        return 0;
+    if (len > source.i_size - source.i_offset)
+        len = source.i_size - source.i_offset;
+
+    if (buf != NULL)
+        memcpy(buf, &source.p_data[source.i_offset], len);
+    source.i_offset += len;
+    source.i_read += len;
+    return len;
+}
+
+static int SourceSeek(stream_t *s, uint64_t offset)
+{
+    (void) s;
+    source.i_offset = offset;
+    return VLC_SUCCESS;
+}
+
+static int SourceControl(stream_t *s, int query, va_list ap)
+{
+    (void) s;
+
+    switch (query)
+    {
+        case STREAM_CAN_SEEK:
+        case STREAM_CAN_FASTSEEK:
+        case STREAM_CAN_PAUSE:
+        case STREAM_CAN_CONTROL_PACE:
+            *va_arg(ap, bool *) = true;
+            break;
+        case STREAM_GET_SIZE:
+            *va_arg(ap, uint64_t *) = source.i_size;
+            break;
+        case STREAM_GET_PTS_DELAY:
+            *va_arg(ap, int64_t *) = DEFAULT_PTS_DELAY;
+            break;
+        default:
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+static void SourceDestroy(stream_t *s)
+{
+    (void) s;
+}
+
+static stream_t *source_open(vlc_object_t *parent)
+{
+    source.i_offset = source.i_read = 0;
+
+    stream_t *s = vlc_stream_CommonNew(parent, SourceDestroy);
+    assert(s != NULL);
+    s->pf_read = SourceRead;
+    s->pf_seek = SourceSeek;
+    s->pf_control = SourceControl;
+    return s;
+}
+
+static void build_file(writer_t *w)
+{
+    size_t ftyp = box_start(w, "ftyp");
+    put(w, "isom", 4);
+    put32(w, 0);
+    put(w, "isommp41", 8);
+    box_end(w, ftyp);
+
+    size_t moov = box_start(w, "moov");
+    size_t trak = box_start(w, "trak");
+    size_t mdia = box_start(w, "mdia");
+    size_t minf = box_start(w, "minf");
+    size_t stbl = box_start(w, "stbl");
+
+    size_t stss = box_start(w, "stss");
+    put32(w, 0);
+    put32(w, STSS_COUNT);
+    for (uint32_t i = 0; i < STSS_COUNT; i++)
+        put32(w, 1 + 24 * i);
+    box_end(w, stss);
+
+    size_t sdtp = box_start(w, "sdtp");
+    put32(w, 0);
+    for (uint32_t i = 0; i < SDTP_COUNT; i++)
+        put(w, (uint8_t[]) { i % 24 ? 0x18 : 0x20 }, 1);
+    box_end(w, sdtp);
+
+    /* invalid flags: dropped by the eager parser, unusable once loaded */
+    size_t sbgp = box_start(w, "sbgp");
+    put32(w, 1);
+    put(w, "roll", 4);
+    put32(w, 0);
+    box_end(w, sbgp);
+
+    static const char *const groupings[] = { "roll", "rap " };
+    for (size_t i = 0; i < ARRAY_SIZE(groupings); i++)
+    {
+        sbgp = box_start(w, "sbgp");
+        put32(w, 0);
+        put(w, groupings[i], 4);
+        put32(w, SBGP_COUNT);
+        for (uint32_t j = 0; j < SBGP_COUNT; j++)
+        {
+            put32(w, 1 + j % 7);
+            put32(w, (j + i) % 2);
+        }
+        box_end(w, sbgp);
+    }
+
+    box_end(w, stbl);
+    box_end(w, minf);
+    box_end(w, mdia);
+    box_end(w, trak);
+
+    size_t udta = box_start(w, "udta");
+    size_t meta = box_start(w, "meta");
+    put32(w, 0);
+    size_t hdlr = box_start(w, "hdlr");
+    put32(w, 0);
+    put32(w, 0);
+    put(w, "mdir", 4);
+    put(w, NULL, 12 + 1);
+    box_end(w, hdlr);
+    size_t ilst = box_start(w, "ilst");
+
+    size_t nam = box_start(w, "\xa9nam");
+    size_t data = box_start(w, "data");
+    put32(w, 1);
+    put32(w, 0);
+    put(w, "Lazy", 4);
+    box_end(w, data);
+    box_end(w, nam);
+
+    size_t covr = box_start(w, "covr");
+    data = box_start(w, "data");
+    put32(w, 13);
+    put32(w, 0);
+    for (uint32_t i = 0; i < COVR_SIZE; i++)
+        put(w, (uint8_t[]) { test_pattern(i) }, 1);
+    box_end(w, data);
+    box_end(w, covr);
+
+    box_end(w, ilst);
+    box_end(w, meta);
+    box_end(w, udta);
+    box_end(w, moov);
+
+    size_t mdat = box_start(w, "mdat");
+    put(w, NULL, 4096);
+    box_end(w, mdat);
+}
+
+static const MP4_Box_t *get_box(MP4_Box_t *root, const char *path)
+{
+    const MP4_Box_t *p_box = MP4_BoxLoad(root, "%s", path);
+    assert(p_box != NULL);
+    assert(p_box->data.p_payload != NULL);
+    return p_box;
+}
+
+static void check_same(MP4_Box_t *eager, MP4_Box_t *lazy, stream_t *s)
+{
+    static const char stbl[] = "/moov/trak/mdia/minf/stbl";
+    const uint64_t i_pos = vlc_stream_Tell(s);
+
+    const MP4_Box_data_stss_t *p_stss[2] = {
+        get_box(eager, "/moov/trak/mdia/minf/stbl/stss")->data.p_stss,
+        get_box(lazy, "/moov/trak/mdia/minf/stbl/stss")->data.p_stss,
+    };
+    assert(p_stss[0]->i_entry_count == STSS_COUNT);
+    assert(p_stss[1]->i_entry_count == STSS_COUNT);
+    assert(!memcmp(p_stss[0]->i_sample_number, p_stss[1]->i_sample_number,
+                   STSS_COUNT * sizeof (uint32_t)));
+
+    const MP4_Box_data_sdtp_t *p_sdtp[2] = {
+        get_box(eager, "/moov/trak/mdia/minf/stbl/sdtp")->data.p_sdtp,
+        get_box(lazy, "/moov/trak/mdia/minf/stbl/sdtp")->data.p_sdtp,
+    };
+    assert(!memcmp(p_sdtp[0]->p_sample_table, p_sdtp[1]->p_sample_table,
+                   SDTP_COUNT));
+
+    /* the unusable box must not be counted */
+    for (unsigned i = 0; i < 2; i++)
+    {
+        const MP4_Box_t *p_eager = MP4_BoxGet(eager, "%s/sbgp[%u]", stbl, i);
+        const MP4_Box_t *p_lazy = MP4_BoxLoad(lazy, "%s/sbgp[%u]", stbl, i);
+        assert(p_eager != NULL && p_lazy != NULL);
+
+        const MP4_Box_data_sbgp_t *p_sbgp[2] = {
+            p_eager->data.p_sbgp, p_lazy->data.p_sbgp,
+        };
+        assert(p_sbgp[0]->i_grouping_type == p_sbgp[1]->i_grouping_type);
+        assert(p_sbgp[1]->i_entry_count == SBGP_COUNT);
+        assert(!memcmp(p_sbgp[0]->entries.pi_sample_count,
+                       p_sbgp[1]->entries.pi_sample_count,
+                       SBGP_COUNT * sizeof (uint32_t)));
+        assert(!memcmp(p_sbgp[0]->entries.pi_group_description_index,
+                       p_sbgp[1]->entries.pi_group_description_index,
+                       SBGP_COUNT * sizeof (uint32_t)));
+    }
+    assert(MP4_BoxGet(eager, "%s/sbgp[2]", stbl) == NULL);
+    assert(MP4_BoxLoad(lazy, "%s/sbgp[2]", stbl) == NULL);
+    assert(MP4_BoxGet(lazy, "%s/sbgp", stbl)->data.p_sbgp->i_grouping_type ==
+           VLC_FOURCC('r','o','l','l'));
+
+    const MP4_Box_data_data_t *p_data[2] = {
+        get_box(eager, "/moov/udta/meta/ilst/covr/data")->data.p_data,
+        get_box(lazy, "/moov/udta/meta/ilst/covr/data")->data.p_data,
+    };
+    assert(p_data[0]->i_blob == COVR_SIZE);
+    assert(p_data[1]->i_blob == COVR_SIZE);
+    assert(!memcmp(p_data[0]->p_blob, p_data[1]->p_blob, COVR_SIZE));
+
+    const MP4_Box_t *p_ilst = MP4_BoxGet(lazy, "/moov/udta/meta/ilst");
+    assert(p_ilst != NULL);
+    assert(p_ilst->i_handler == HANDLER_mdir);
+    assert(MP4_BoxCount(lazy, "/moov/udta/meta/ilst/covr/data") == 1);
+
+    /* loading must not disturb the demuxer reading position */
+    assert((uint64_t) vlc_stream_Tell(s) == i_pos);
+}
+
+static void test_synthetic(vlc_object_t *parent)
+{
+    writer_t w = { NULL, 0, 0 };
+    build_file(&w);
+    source.p_data = w.p;
+    source.i_size = w.i_size;
+
+    stream_t *s_eager = source_open(parent);
+    MP4_Box_t *eager = MP4_BoxGetRoot(s_eager, false);
+    assert(eager != NULL);
+    const uint64_t i_eager = source.i_read;
+
+    stream_t *s_lazy = source_open(parent);
+    MP4_Box_t *lazy = MP4_BoxGetRoot(s_lazy, true);
+    assert(lazy != NULL);
+    const uint64_t i_lazy = source.i_read;
+
+    printf("%-24s %10"PRIu64" bytes eager %10"PRIu64" bytes lazy\n",
+           "synthetic", i_eager, i_lazy);
+    assert(i_lazy < i_eager / 8);
+
+    const MP4_Box_t *p_stss = MP4_BoxGet(lazy, "/moov/trak/mdia/minf/stbl");
+    assert(p_stss != NULL);
+    for (p_stss = p_stss->p_first; p_stss->i_type != ATOM_stss; )
+        p_stss = p_stss->p_next;
+    assert(p_stss->e_flags & BOX_FLAG_LAZY);
+    assert(p_stss->data.p_payload == NULL);
+
+    /* only MP4_BoxLoad() parses */
+    assert(MP4_BoxGet(lazy, "/moov/trak/mdia/minf/stbl/stss") == NULL);
+    assert(MP4_BoxCount(lazy, "/moov/udta/meta") == 0);
+    assert(p_stss->e_flags & BOX_FLAG_LAZY);
+
+    /* move away as a demuxer would, then request the boxes */
+    assert(MP4_Seek(s_lazy, 4) == VLC_SUCCESS);
+    check_same(eager, lazy, s_lazy);
+    assert(!(p_stss->e_flags & BOX_FLAG_LAZY));
+
+    MP4_BoxFree(lazy);
+    vlc_stream_Delete(s_lazy);
+    MP4_BoxFree(eager);
+    vlc_stream_Delete(s_eager);
+    free(w.p);
+}
+
+static int bench_file(vlc_object_t *parent, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    writer_t w = { NULL, 0, 0 };
+    char buf[65536];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof (buf), file)) > 0)
+        put(&w, buf, len);
+    fclose(file);
+
+    source.p_data = w.p;
+    source.i_size = w.i_size;
+
+    for (int lazy = 0; lazy < 2; lazy++)
+    {
+        mtime_t best = INT64_MAX;
+        uint64_t i_read = 0;
+
+        for (unsigned i = 0; i < ITERATIONS; i++)
+        {
+            stream_t *s = source_open(parent);
+            mtime_t start = mdate();
+            MP4_Box_t *root = MP4_BoxGetRoot(s, lazy);
+            mtime_t duration = mdate() - start;
+            if (root == NULL)
+            {
+                fprintf(stderr, "%s: not a valid MP4 file\n", path);
+                vlc_stream_Delete(s);
+                free(w.p);
+                return -1;
+            }
+            if (duration < best)
+                best = duration;
+            i_read = source.i_read;
+            MP4_BoxFree(root);
+            vlc_stream_Delete(s);
+        }
+
+        printf("%-24s %-5s %10"PRIu64" bytes %8.2f ms\n", path,
+               lazy ? "lazy" : "eager", i_read, best / 1000.);
+    }
+
+    free(w.p);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *const args[] = { "--verbose=0" };
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+
+    vlc_object_t *parent = VLC_OBJECT(vlc->p_libvlc_int);
+
+    int ret = 0;
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+            if (bench_file(parent, argv[i]))
+                ret = 1;
+    }
+    else
+        test_synthetic(parent);
+
+    libvlc_release(vlc);
+    return ret;
+}
@@ -0,0 +1,600 @@
+/*****************************************************************************
+ * mp4_samples.c: MP4 sample tables lookup test
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Builds a file with two interleaved tracks with many time-to-sample,
+ * composition offset and sample-to-chunk runs, one with a media time edit
+ * and one starting with an empty edit. The mp4 demuxer plays it, then seeks
+ * backward and forward, and every block it sends is checked against a
+ * linear walk of the sample tables: sample number, file offset, DTS and PTS.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_block.h>
+#include <vlc_stream.h>
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+#include "mp4_writer.h"
+
+#include <vlc/vlc.h>
+
+#define TRACKS   2
+#define SAMPLES  4000
+
+#define MOVIE_TIMESCALE 1000
+
+static struct track
+{
+    uint32_t i_timescale;
+    /* edit list: optional empty edit (movie timescale), then media time */
+    uint32_t i_empty;
+    uint32_t i_media_time;
+    uint64_t i_duration;
+
+    uint32_t i_stts_count;
+    uint32_t stts_count[SAMPLES];
+    uint32_t stts_delta[SAMPLES];
+
+    uint32_t i_ctts_count;
+    uint32_t ctts_count[SAMPLES];
+    uint32_t ctts_offset[SAMPLES];
+
+    uint32_t i_stsc_count;
+    uint32_t stsc_first[SAMPLES];
+    uint32_t stsc_samples[SAMPLES];
+
+    uint32_t i_chunk_count;
+    uint32_t chunk_samples[SAMPLES];
+    uint32_t chunk_offset[SAMPLES];
+
+    uint32_t i_stss_count;
+    uint32_t stss[SAMPLES];
+
+    uint32_t size[SAMPLES];
+} tracks[TRACKS];
+
+/* Sample tables with short runs, so that lookups cross many checkpoints */
+static void GenerateTables(struct track *tk, uint32_t timescale, unsigned seed)
+{
+    tk->i_timescale = timescale;
+
+    tk->i_duration = 0;
+    tk->i_stts_count = 0;
+    for (uint32_t i = 0; i < SAMPLES; )
+    {
+        uint32_t count = __MIN(1 + test_rand(&seed) % 16, SAMPLES - i);
+        uint32_t delta = timescale / 100 + test_rand(&seed) % (timescale / 25);
+
+        tk->stts_count[tk->i_stts_count] = count;
+        tk->stts_delta[tk->i_stts_count++] = delta;
+        tk->i_duration += (uint64_t)count * delta;
+        i += count;
+    }
+
+    tk->i_ctts_count = 0;
+    for (uint32_t i = 0; i < SAMPLES; )
+    {
+        uint32_t count = __MIN(1 + test_rand(&seed) % 4, SAMPLES - i);
+
+        tk->ctts_count[tk->i_ctts_count] = count;
+        tk->ctts_offset[tk->i_ctts_count++] =
+            test_rand(&seed) % (3 * timescale / 25);
+        i += count;
+    }
+
+    tk->i_stss_count = 0;
+    for (uint32_t i = 0; i < SAMPLES; i += 1 + test_rand(&seed) % 48)
+        tk->stss[tk->i_stss_count++] = i;
+
+    for (uint32_t i = 0; i < SAMPLES; i++)
+        tk->size[i] = 12 + test_rand(&seed) % 52;
+
+    tk->i_stsc_count = tk->i_chunk_count = 0;
+    for (uint32_t i = 0; i < SAMPLES; )
+    {
+        uint32_t chunks = 1 + test_rand(&seed) % 8;
+        uint32_t count = 1 + test_rand(&seed) % 12;
+
+        tk->stsc_first[tk->i_stsc_count] = tk->i_chunk_count;
+        tk->stsc_samples[tk->i_stsc_count++] = count;
+        while (chunks-- > 0 && i < SAMPLES)
+        {
+            if (SAMPLES - i < count)
+            {   /* shorter last chunk */
+                count = SAMPLES - i;
+                tk->stsc_first[tk->i_stsc_count] = tk->i_chunk_count;
+                tk->stsc_samples[tk->i_stsc_count++] = count;
+            }
+            tk->chunk_samples[tk->i_chunk_count++] = count;
+            i += count;
+        }
+    }
+}
+
+/* Reference lookups, walking the tables from the first entry */
+static int64_t RefDecodingTime(const struct track *tk, uint32_t sample)
+{
+    int64_t time = 0;
+
+    for (uint32_t i = 0; i < tk->i_stts_count; i++)
+    {
+        if (sample < tk->stts_count[i])
+            return time + (int64_t)sample * tk->stts_delta[i];
+        time += (int64_t)tk->stts_count[i] * tk->stts_delta[i];
+        sample -= tk->stts_count[i];
+    }
+    return time;
+}
+
+static uint32_t RefCompositionOffset(const struct track *tk, uint32_t sample)
+{
+    for (uint32_t i = 0; i < tk->i_ctts_count; i++)
+    {
+        if (sample < tk->ctts_count[i])
+            return tk->ctts_offset[i];
+        sample -= tk->ctts_count[i];
+    }
+    abort();
+}
+
+static uint64_t RefOffset(const struct track *tk, uint32_t sample)
+{
+    uint32_t first = 0;
+
+    for (uint32_t i = 0; i < tk->i_stsc_count; i++)
+    {
+        uint32_t last = (i + 1 < tk->i_stsc_count) ? tk->stsc_first[i + 1]
+                                                   : tk->i_chunk_count;
+
+        for (uint32_t chunk = tk->stsc_first[i]; chunk < last; chunk++)
+        {
+            if (sample < first + tk->stsc_samples[i])
+            {
+                uint64_t offset = tk->chunk_offset[chunk];
+                for (uint32_t j = first; j < sample; j++)
+                    offset += tk->size[j];
+                return offset;
+            }
+            first += tk->stsc_samples[i];
+        }
+    }
+    abort();
+}
+
+static mtime_t RefDTS(const struct track *tk, uint32_t sample)
+{
+    int64_t dts = RefDecodingTime(tk, sample) - tk->i_media_time
+                + (int64_t)tk->i_empty * tk->i_timescale / MOVIE_TIMESCALE;
+    if (dts < 0)
+        dts = 0;
+    return VLC_TS_0 + CLOCK_FREQ * dts / tk->i_timescale;
+}
+
+static mtime_t RefPTS(const struct track *tk, uint32_t sample)
+{
+    return RefDTS(tk, sample) + (int64_t)RefCompositionOffset(tk, sample)
+                                * CLOCK_FREQ / tk->i_timescale;
+}
+
+/* First sample sent after seeking to the given movie time */
+static uint32_t RefSeek(const struct track *tk, mtime_t time)
+{
+    time -= (int64_t)tk->i_empty * CLOCK_FREQ / MOVIE_TIMESCALE;
+    if (time < 0)
+        return 0;
+
+    int64_t media_time = time * tk->i_timescale / CLOCK_FREQ + tk->i_media_time;
+    int64_t next = 0;
+    uint32_t sample = 0, sync = 0;
+    for (uint32_t i = 0; i < tk->i_stts_count; i++)
+        for (uint32_t j = 0; j < tk->stts_count[i]; j++)
+        {
+            next += tk->stts_delta[i];
+            if (next > media_time)
+                goto found;
+            sample++;
+        }
+found:
+    for (uint32_t i = 0; i < tk->i_stss_count && tk->stss[i] <= sample; i++)
+        sync = tk->stss[i];
+    return sync;
+}
+
+static void WriteTrack(writer_t *w, unsigned id, const struct track *tk)
+{
+    uint64_t duration = (tk->i_duration - tk->i_media_time) * MOVIE_TIMESCALE
+                      / tk->i_timescale;
+
+    size_t trak = box_start(w, "trak");
+
+    size_t tkhd = fullbox_start(w, "tkhd", 0x000007);
+    put32(w, 0);
+    put32(w, 0);
+    put32(w, id);
+    put32(w, 0);
+    put32(w, tk->i_empty + duration);
+    put(w, NULL, 8 + 2 + 2 + 2 + 2);
+    static const uint32_t matrix[9] = {
+        0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000 };
+    for (unsigned i = 0; i < 9; i++)
+        put32(w, matrix[i]);
+    put32(w, 64 << 16);
+    put32(w, 48 << 16);
+    box_end(w, tkhd);
+
+    size_t edts = box_start(w, "edts");
+    size_t elst = fullbox_start(w, "elst", 0);
+    put32(w, tk->i_empty ? 2 : 1);
+    if (tk->i_empty)
+    {
+        put32(w, tk->i_empty);
+        put32(w, -1);
+        put32(w, 0x10000);
+    }
+    put32(w, duration);
+    put32(w, tk->i_media_time);
+    put32(w, 0x10000);
+    box_end(w, elst);
+    box_end(w, edts);
+
+    size_t mdia = box_start(w, "mdia");
+
+    size_t mdhd = fullbox_start(w, "mdhd", 0);
+    put32(w, 0);
+    put32(w, 0);
+    put32(w, tk->i_timescale);
+    put32(w, tk->i_duration);
+    put16(w, 0x55c4); /* und */
+    put16(w, 0);
+    box_end(w, mdhd);
+
+    size_t hdlr = fullbox_start(w, "hdlr", 0);
+    put32(w, 0);
+    put(w, "vide", 4);
+    put(w, NULL, 12 + 1);
+    box_end(w, hdlr);
+
+    size_t minf = box_start(w, "minf");
+    size_t vmhd = fullbox_start(w, "vmhd", 1);
+    put(w, NULL, 8);
+    box_end(w, vmhd);
+
+    size_t stbl = box_start(w, "stbl");
+
+    size_t stsd = fullbox_start(w, "stsd", 0);
+    put32(w, 1);
+    size_t jpeg = box_start(w, "jpeg");
+    put(w, NULL, 6);
+    put16(w, 1);
+    put(w, NULL, 16);
+    put16(w, 64);
+    put16(w, 48);
+    put32(w, 72 << 16);
+    put32(w, 72 << 16);
+    put32(w, 0);
+    put16(w, 1);
+    put(w, NULL, 32);
+    put16(w, 24);
+    put16(w, 0xffff);
+    box_end(w, jpeg);
+    box_end(w, stsd);
+
+    size_t stts = fullbox_start(w, "stts", 0);
+    put32(w, tk->i_stts_count);
+    for (uint32_t i = 0; i < tk->i_stts_count; i++)
+    {
+        put32(w, tk->stts_count[i]);
+        put32(w, tk->stts_delta[i]);
+    }
+    box_end(w, stts);
+
+    size_t ctts = fullbox_start(w, "ctts", 0);
+    put32(w, tk->i_ctts_count);
+    for (uint32_t i = 0; i < tk->i_ctts_count; i++)
+    {
+        put32(w, tk->ctts_count[i]);
+        put32(w, tk->ctts_offset[i]);
+    }
+    box_end(w, ctts);
+
+    size_t stss = fullbox_start(w, "stss", 0);
+    put32(w, tk->i_stss_count);
+    for (uint32_t i = 0; i < tk->i_stss_count; i++)
+        put32(w, tk->stss[i] + 1);
+    box_end(w, stss);
+
+    size_t stsc = fullbox_start(w, "stsc", 0);
+    put32(w, tk->i_stsc_count);
+    for (uint32_t i = 0; i < tk->i_stsc_count; i++)
+    {
+        put32(w, tk->stsc_first[i] + 1);
+        put32(w, tk->stsc_samples[i]);
+        put32(w, 1);
+    }
+    box_end(w, stsc);
+
+    size_t stsz = fullbox_start(w, "stsz", 0);
+    put32(w, 0);
+    put32(w, SAMPLES);
+    for (uint32_t i = 0; i < SAMPLES; i++)
+        put32(w, tk->size[i]);
+    box_end(w, stsz);
+
+    size_t stco = fullbox_start(w, "stco", 0);
+    put32(w, tk->i_chunk_count);
+    for (uint32_t i = 0; i < tk->i_chunk_count; i++)
+        put32(w, tk->chunk_offset[i]);
+    box_end(w, stco);
+
+    box_end(w, stbl);
+    box_end(w, minf);
+    box_end(w, mdia);
+    box_end(w, trak);
+}
+
+/* Every sample starts with its offset, track and number */
+static void WriteSample(writer_t *w, unsigned track, uint32_t sample)
+{
+    uint32_t size = tracks[track].size[sample];
+    uint64_t offset = w->i_size;
+
+    put32(w, offset);
+    put32(w, track);
+    put32(w, sample);
+    for (uint32_t i = 12; i < size; i++)
+        put(w, (uint8_t[]) { test_pattern(offset + i) }, 1);
+}
+
+static void BuildFile(writer_t *w)
+{
+    GenerateTables(&tracks[0], 90000, 1);
+    tracks[0].i_media_time = 5000;
+    GenerateTables(&tracks[1], 25000, 2);
+    tracks[1].i_empty = 1500;
+
+    size_t ftyp = box_start(w, "ftyp");
+    put(w, "isom", 4);
+    put32(w, 0);
+    put(w, "isommp41", 8);
+    box_end(w, ftyp);
+
+    /* interleaved chunks, before the sample tables which point to them */
+    size_t mdat = box_start(w, "mdat");
+    uint32_t chunk[TRACKS] = { 0 }, sample[TRACKS] = { 0 };
+    for (bool done = false; !done; )
+    {
+        done = true;
+        for (unsigned t = 0; t < TRACKS; t++)
+        {
+            struct track *tk = &tracks[t];
+            if (chunk[t] >= tk->i_chunk_count)
+                continue;
+
+            tk->chunk_offset[chunk[t]] = w->i_size;
+            for (uint32_t i = 0; i < tk->chunk_samples[chunk[t]]; i++)
+                WriteSample(w, t, sample[t]++);
+            chunk[t]++;
+            done = false;
+        }
+    }
+    box_end(w, mdat);
+
+    uint64_t duration = 0;
+    for (unsigned t = 0; t < TRACKS; t++)
+        duration = __MAX(duration, tracks[t].i_empty + tracks[t].i_duration
+                                   * MOVIE_TIMESCALE / tracks[t].i_timescale);
+
+    size_t moov = box_start(w, "moov");
+    size_t mvhd = fullbox_start(w, "mvhd", 0);
+    put32(w, 0);
+    put32(w, 0);
+    put32(w, MOVIE_TIMESCALE);
+    put32(w, duration);
+    put32(w, 0x10000);
+    put16(w, 0x100);
+    put(w, NULL, 10);
+    static const uint32_t matrix[9] = {
+        0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000 };
+    for (unsigned i = 0; i < 9; i++)
+        put32(w, matrix[i]);
+    put(w, NULL, 24);
+    put32(w, TRACKS + 1);
+    box_end(w, mvhd);
+
+    for (unsigned t = 0; t < TRACKS; t++)
+        WriteTrack(w, t + 1, &tracks[t]);
+    box_end(w, moov);
+}
+
+/* Output checking every block against the reference */
+struct es_out_id_t
+{
+    unsigned i_track;
+};
+
+static struct
+{
+    unsigned i_es;
+    uint32_t next[TRACKS]; /* expected sample */
+    unsigned count[TRACKS]; /* blocks since the last seek */
+} output;
+
+static es_out_id_t *EsOutAdd(es_out_t *out, const es_format_t *fmt)
+{
+    (void) out;
+    assert(fmt->i_cat == VIDEO_ES);
+    assert(output.i_es < TRACKS);
+
+    es_out_id_t *id = malloc(sizeof (*id));
+    assert(id != NULL);
+    id->i_track = output.i_es++;
+    return id;
+}
+
+static int EsOutSend(es_out_t *out, es_out_id_t *id, block_t *block)
+{
+    (void) out;
+    const unsigned t = id->i_track;
+    const struct track *tk = &tracks[t];
+
+    assert(block->i_buffer >= 12);
+    uint64_t offset = GetDWBE(&block->p_buffer[0]);
+    uint32_t sample = GetDWBE(&block->p_buffer[8]);
+
+    assert(GetDWBE(&block->p_buffer[4]) == t);
+    if (sample != output.next[t])
+    {
+        fprintf(stderr, "track %u: got sample %"PRIu32", expected %"PRIu32
+                "\n", t, sample, output.next[t]);
+        abort();
+    }
+    assert(offset == RefOffset(tk, sample));
+    assert(block->i_buffer == tk->size[sample]);
+    assert(block->i_dts == RefDTS(tk, sample));
+    assert(block->i_pts == RefPTS(tk, sample));
+
+    output.next[t] = sample + 1;
+    output.count[t]++;
+    block_Release(block);
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel(es_out_t *out, es_out_id_t *id)
+{
+    (void) out;
+    free(id);
+}
+
+static int EsOutControl(es_out_t *out, int query, va_list ap)
+{
+    (void) out;
+
+    switch (query)
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg(ap, es_out_id_t *);
+            *va_arg(ap, bool *) = true;
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static void Play(demux_t *demux, unsigned min_count)
+{
+    for (unsigned t = 0; t < TRACKS; t++)
+        output.count[t] = 0;
+
+    for (;;)
+    {
+        bool done = true;
+        for (unsigned t = 0; t < TRACKS; t++)
+            if (output.count[t] < min_count)
+                done = false;
+        if (done || demux_Demux(demux) != VLC_DEMUXER_SUCCESS)
+            break;
+    }
+
+    for (unsigned t = 0; t < TRACKS; t++)
+        assert(output.count[t] >= __MIN(min_count, SAMPLES));
+}
+
+static void Seek(demux_t *demux, mtime_t time)
+{
+    for (unsigned t = 0; t < TRACKS; t++)
+        output.next[t] = RefSeek(&tracks[t], time);
+
+    assert(demux_Control(demux, DEMUX_SET_TIME, (int64_t)time) == VLC_SUCCESS);
+    Play(demux, 100);
+}
+
+static void test_samples(vlc_object_t *parent)
+{
+    writer_t w = { NULL, 0, 0 };
+    BuildFile(&w);
+
+    stream_t *s = vlc_stream_MemoryNew(parent, w.p, w.i_size, true);
+    assert(s != NULL);
+
+    es_out_t out = {
+        .pf_add = EsOutAdd,
+        .pf_send = EsOutSend,
+        .pf_del = EsOutDel,
+        .pf_control = EsOutControl,
+    };
+    demux_t *demux = demux_New(parent, "mp4", "", s, &out);
+    assert(demux != NULL);
+    assert(output.i_es == TRACKS);
+
+    /* sequential access */
+    Play(demux, SAMPLES);
+    for (unsigned t = 0; t < TRACKS; t++)
+        assert(output.next[t] == SAMPLES);
+
+    /* random access, around checkpoints and in the empty edit */
+    mtime_t length;
+    assert(demux_Control(demux, DEMUX_GET_LENGTH, &length) == VLC_SUCCESS);
+    mtime_t end = length * 8 / 10;
+
+    static const mtime_t times[] = {
+        CLOCK_FREQ / 2, CLOCK_FREQ, 0, 12 * CLOCK_FREQ, 11 * CLOCK_FREQ,
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(times); i++)
+        Seek(demux, times[i]);
+
+    Seek(demux, end);
+    Seek(demux, end / 2);
+    Seek(demux, end / 2 + CLOCK_FREQ / 10);
+    Seek(demux, end / 2 - CLOCK_FREQ / 10);
+
+    unsigned seed = 42;
+    for (unsigned i = 0; i < 100; i++)
+        Seek(demux, (mtime_t)test_rand(&seed) * end / 32768);
+
+    demux_Delete(demux);
+    free(w.p);
+}
+
+int main(void)
+{
+    static const char *const args[] = { "--verbose=0" };
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+
+    test_samples(VLC_OBJECT(vlc->p_libvlc_int));
+
+    libvlc_release(vlc);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ * mp4_writer.h: MP4 box writer for the demux tests
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_TEST_MP4_WRITER_H
+#define VLC_TEST_MP4_WRITER_H
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+
+/* Growing buffer, boxes are written with their size patched at the end */
+typedef struct
+{
+    uint8_t *p;
+    size_t i_size;
+    size_t i_alloc;
+} writer_t;
+
+static inline void put(writer_t *w, const void *data, size_t len)
+{
+    if (w->i_size + len > w->i_alloc)
+    {
+        w->i_alloc = (w->i_size + len) * 2;
+        w->p = realloc(w->p, w->i_alloc);
+        assert(w->p != NULL);
+    }
+    if (data != NULL)
+        memcpy(&w->p[w->i_size], data, len);
+    else
+        memset(&w->p[w->i_size], 0, len);
+    w->i_size += len;
+}
+
+static inline void put16(writer_t *w, uint16_t value)
+{
+    uint8_t buf[2];
+    SetWBE(buf, value);
+    put(w, buf, 2);
+}
+
+static inline void put32(writer_t *w, uint32_t value)
+{
+    uint8_t buf[4];
+    SetDWBE(buf, value);
+    put(w, buf, 4);
+}
+
+static inline size_t box_start(writer_t *w, const char type[4])
+{
+    size_t offset = w->i_size;
+    put32(w, 0);
+    put(w, type, 4);
+    return offset;
+}
+
+/* Starts a box with version and flags */
+static inline size_t fullbox_start(writer_t *w, const char type[4],
+                                   uint32_t flags)
+{
+    size_t offset = box_start(w, type);
+    put32(w, flags);
+    return offset;
+}
+
+static inline void box_end(writer_t *w, size_t offset)
+{
+    SetDWBE(&w->p[offset], w->i_size - offset);
+}
+
+#endif
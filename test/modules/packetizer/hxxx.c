@@ -85,13 +85,28 @@ static void testannexbin( const uint8_t *p_data, size_t i_data,
         printf("0x%.2x, ", p_data[j] );
     printf("\n");
 
-    for( unsigned int i=0; i<3; i++)
+    /* Second pass converts blocks sharing their payload */
+    for( unsigned int k=0; k<6; k++)
     {
+        const unsigned i = k % 3;
         block_t *p_block = block_Alloc( i_data );
+        block_t *p_shared = NULL;
         memcpy( p_block->p_buffer, p_data, i_data );
+        if( k >= 3 )
+        {
+            p_block = block_Shareable( p_block );
+            p_shared = block_Share( p_block );
+            assert( p_shared );
+        }
 
         p_block = hxxx_AnnexB_to_xVC( p_block, 1 << i );
         printf("DUMP prefix %d: ", 1 << i);
+        if( p_shared )
+        {
+            assert( p_shared->i_buffer == i_data );
+            assert( memcmp( p_shared->p_buffer, p_data, i_data ) == 0 );
+            block_Release( p_shared );
+        }
         if( p_block )
         {
             for(size_t j=0; j<p_block->i_buffer; j++)
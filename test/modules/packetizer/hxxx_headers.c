@@ -0,0 +1,450 @@
+/*****************************************************************************
+ * hxxx_headers.c: H.264/HEVC header parsing tests and benchmark
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Without arguments, parses the embedded encoder headers and checks the
+ * results. Annex B elementary streams (.264/.h264/.265/.hevc) can be passed
+ * as arguments to benchmark against a larger corpus. */
+
+#ifdef NDEBUG
+ #undef NDEBUG
+#endif
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vlc_common.h>
+#include <vlc_bits.h>
+#include "../modules/packetizer/hxxx_nal.c"
+#include "../modules/packetizer/hxxx_sei.c"
+#include "../modules/packetizer/h264_nal.c"
+#include "../modules/packetizer/hevc_nal.c"
+#include "../../libvlc/test.h"
+
+#define ITERATIONS 20000
+
+/* x264, 1280x720 High@3.1 */
+static const uint8_t h264_sps[] = {
+    0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50, 0x05, 0xbb, 0x01, 0x10,
+    0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xc0, 0xf1, 0x83,
+    0x19, 0x60,
+};
+static const uint8_t h264_pps[] = {
+    0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+};
+/* recovery point, frame count 0 */
+static const uint8_t h264_sei_recovery[] = {
+    0x06, 0x06, 0x01, 0xc4, 0x80,
+};
+/* ATSC A/53 captions */
+static const uint8_t h264_sei_cc[] = {
+    0x06, 0x04, 0x11, 0xb5, 0x00, 0x31, 0x47, 0x41, 0x39, 0x34, 0x03, 0xc2,
+    0xff, 0xfc, 0x94, 0x20, 0xfd, 0x80, 0x80, 0xff, 0x80,
+};
+
+/* x265, 1920x1080 Main@4 30fps */
+static const uint8_t hevc_vps[] = {
+    0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00,
+    0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x78, 0x95, 0x98, 0x09,
+};
+static const uint8_t hevc_sps[] = {
+    0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+    0x03, 0x00, 0x00, 0x03, 0x00, 0x78, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe5,
+    0x96, 0x56, 0x69, 0x24, 0xca, 0xe0, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10,
+    0x00, 0x00, 0x03, 0x01, 0xe0, 0x80,
+};
+static const uint8_t hevc_pps[] = {
+    0x44, 0x01, 0xc1, 0x72, 0xb4, 0x62, 0x40,
+};
+
+struct stats
+{
+    const char *psz_name;
+    unsigned i_count;
+    unsigned i_failed;
+    mtime_t i_time;
+};
+
+enum
+{
+    STAT_H264_SPS,
+    STAT_H264_PPS,
+    STAT_H264_SEI,
+    STAT_HEVC_VPS,
+    STAT_HEVC_SPS,
+    STAT_HEVC_PPS,
+    STAT_HEVC_SEI,
+    STAT_HEVC_SLICE,
+    STAT_COUNT
+};
+
+static struct stats stats[STAT_COUNT] = {
+    [STAT_H264_SPS]   = { "H.264 SPS", 0, 0, 0 },
+    [STAT_H264_PPS]   = { "H.264 PPS", 0, 0, 0 },
+    [STAT_H264_SEI]   = { "H.264 SEI", 0, 0, 0 },
+    [STAT_HEVC_VPS]   = { "HEVC VPS", 0, 0, 0 },
+    [STAT_HEVC_SPS]   = { "HEVC SPS", 0, 0, 0 },
+    [STAT_HEVC_PPS]   = { "HEVC PPS", 0, 0, 0 },
+    [STAT_HEVC_SEI]   = { "HEVC SEI", 0, 0, 0 },
+    [STAT_HEVC_SLICE] = { "HEVC slice header", 0, 0, 0 },
+};
+
+static unsigned i_sei_seen;
+
+static bool sei_callback( const hxxx_sei_data_t *p_sei, void *priv )
+{
+    VLC_UNUSED(priv);
+    if( p_sei->i_type == HXXX_SEI_USER_DATA_REGISTERED_ITU_T_T35 ||
+        p_sei->i_type == HXXX_SEI_RECOVERY_POINT )
+        i_sei_seen++;
+    return true;
+}
+
+/* Parses a single escaped NAL, as the packetizers do, accounting the time */
+static void parse_h264_nal( const uint8_t *p_nal, size_t i_nal, unsigned i_iterations )
+{
+    if( i_nal < 2 )
+        return;
+
+    struct stats *p_stats;
+    const mtime_t i_start = mdate();
+    bool b_ok = true;
+
+    switch( p_nal[0] & 0x1f )
+    {
+        case H264_NAL_SPS:
+            p_stats = &stats[STAT_H264_SPS];
+            for( unsigned i=0; i<i_iterations && b_ok; i++ )
+            {
+                h264_sequence_parameter_set_t *p_sps = h264_decode_sps( p_nal, i_nal, true );
+                b_ok = p_sps != NULL;
+                if( p_sps )
+                    h264_release_sps( p_sps );
+            }
+            break;
+        case H264_NAL_PPS:
+            p_stats = &stats[STAT_H264_PPS];
+            for( unsigned i=0; i<i_iterations && b_ok; i++ )
+            {
+                h264_picture_parameter_set_t *p_pps = h264_decode_pps( p_nal, i_nal, true );
+                b_ok = p_pps != NULL;
+                if( p_pps )
+                    h264_release_pps( p_pps );
+            }
+            break;
+        case H264_NAL_SEI:
+            p_stats = &stats[STAT_H264_SEI];
+            for( unsigned i=0; i<i_iterations; i++ )
+                HxxxParseSEI( p_nal, i_nal, 1, sei_callback, NULL );
+            break;
+        default:
+            return;
+    }
+
+    p_stats->i_time += mdate() - i_start;
+    p_stats->i_count += i_iterations;
+    if( !b_ok )
+        p_stats->i_failed++;
+}
+
+struct hevc_sets
+{
+    hevc_sequence_parameter_set_t *sps[HEVC_SPS_ID_MAX + 1];
+    hevc_picture_parameter_set_t *pps[HEVC_PPS_ID_MAX + 1];
+};
+
+static void hevc_sets_store( struct hevc_sets *p_sets, const uint8_t *p_nal, size_t i_nal )
+{
+    uint8_t i_id;
+    if( !hevc_get_xps_id( p_nal, i_nal, &i_id ) )
+        return;
+
+    if( hevc_getNALType( p_nal ) == HEVC_NAL_SPS )
+    {
+        hevc_sequence_parameter_set_t *p_sps = hevc_decode_sps( p_nal, i_nal, true );
+        if( p_sps && i_id <= HEVC_SPS_ID_MAX )
+        {
+            if( p_sets->sps[i_id] )
+                hevc_rbsp_release_sps( p_sets->sps[i_id] );
+            p_sets->sps[i_id] = p_sps;
+        }
+        else if( p_sps )
+            hevc_rbsp_release_sps( p_sps );
+    }
+    else
+    {
+        hevc_picture_parameter_set_t *p_pps = hevc_decode_pps( p_nal, i_nal, true );
+        if( p_pps && i_id <= HEVC_PPS_ID_MAX )
+        {
+            if( p_sets->pps[i_id] )
+                hevc_rbsp_release_pps( p_sets->pps[i_id] );
+            p_sets->pps[i_id] = p_pps;
+        }
+        else if( p_pps )
+            hevc_rbsp_release_pps( p_pps );
+    }
+}
+
+static void hevc_sets_release( struct hevc_sets *p_sets )
+{
+    for( size_t i=0; i<ARRAY_SIZE(p_sets->sps); i++ )
+        if( p_sets->sps[i] )
+            hevc_rbsp_release_sps( p_sets->sps[i] );
+    for( size_t i=0; i<ARRAY_SIZE(p_sets->pps); i++ )
+        if( p_sets->pps[i] )
+            hevc_rbsp_release_pps( p_sets->pps[i] );
+}
+
+static void parse_hevc_nal( struct hevc_sets *p_sets,
+                            const uint8_t *p_nal, size_t i_nal, unsigned i_iterations )
+{
+    if( i_nal < 3 )
+        return;
+
+    struct stats *p_stats;
+    const mtime_t i_start = mdate();
+    bool b_ok = true;
+    const uint8_t i_type = hevc_getNALType( p_nal );
+
+    if( i_type <= HEVC_NAL_IRAP_VCL23 )
+    {
+        p_stats = &stats[STAT_HEVC_SLICE];
+        for( unsigned i=0; i<i_iterations && b_ok; i++ )
+        {
+            hevc_slice_segment_header_t *p_sh =
+                    hevc_decode_slice_header( p_nal, i_nal, true, p_sets->sps, p_sets->pps );
+            b_ok = p_sh != NULL;
+            if( p_sh )
+                hevc_rbsp_release_slice_header( p_sh );
+        }
+    }
+    else switch( i_type )
+    {
+        case HEVC_NAL_VPS:
+            p_stats = &stats[STAT_HEVC_VPS];
+            for( unsigned i=0; i<i_iterations && b_ok; i++ )
+            {
+                hevc_video_parameter_set_t *p_vps = hevc_decode_vps( p_nal, i_nal, true );
+                b_ok = p_vps != NULL;
+                if( p_vps )
+                    hevc_rbsp_release_vps( p_vps );
+            }
+            break;
+        case HEVC_NAL_SPS:
+            p_stats = &stats[STAT_HEVC_SPS];
+            for( unsigned i=0; i<i_iterations && b_ok; i++ )
+            {
+                hevc_sequence_parameter_set_t *p_sps = hevc_decode_sps( p_nal, i_nal, true );
+                b_ok = p_sps != NULL;
+                if( p_sps )
+                    hevc_rbsp_release_sps( p_sps );
+            }
+            break;
+        case HEVC_NAL_PPS:
+            p_stats = &stats[STAT_HEVC_PPS];
+            for( unsigned i=0; i<i_iterations && b_ok; i++ )
+            {
+                hevc_picture_parameter_set_t *p_pps = hevc_decode_pps( p_nal, i_nal, true );
+                b_ok = p_pps != NULL;
+                if( p_pps )
+                    hevc_rbsp_release_pps( p_pps );
+            }
+            break;
+        case HEVC_NAL_PREF_SEI:
+        case HEVC_NAL_SUFF_SEI:
+            p_stats = &stats[STAT_HEVC_SEI];
+            for( unsigned i=0; i<i_iterations; i++ )
+                HxxxParseSEI( p_nal, i_nal, 2, sei_callback, NULL );
+            break;
+        default:
+            return;
+    }
+
+    p_stats->i_time += mdate() - i_start;
+    p_stats->i_count += i_iterations;
+    if( !b_ok )
+        p_stats->i_failed++;
+
+    /* slices need the active parameter sets */
+    if( i_type == HEVC_NAL_SPS || i_type == HEVC_NAL_PPS )
+        hevc_sets_store( p_sets, p_nal, i_nal );
+}
+
+static void print_stats( void )
+{
+    for( size_t i=0; i<STAT_COUNT; i++ )
+    {
+        const struct stats *p_stats = &stats[i];
+        if( !p_stats->i_count )
+            continue;
+        printf( "%-18s %9u parses %6.1f ns/parse %u failed\n", p_stats->psz_name,
+                p_stats->i_count, 1000.0 * p_stats->i_time / p_stats->i_count,
+                p_stats->i_failed );
+    }
+}
+
+static void test_embedded( void )
+{
+    unsigned w, h, vw, vh, num, den;
+
+    h264_sequence_parameter_set_t *p_sps = h264_decode_sps( h264_sps, sizeof(h264_sps), true );
+    assert( p_sps );
+    assert( h264_get_picture_size( p_sps, &w, &h, &vw, &vh ) );
+    assert( vw == 1280 && vh == 720 );
+    h264_release_sps( p_sps );
+
+    hevc_sequence_parameter_set_t *p_hsps = hevc_decode_sps( hevc_sps, sizeof(hevc_sps), true );
+    assert( p_hsps );
+    assert( hevc_get_picture_size( p_hsps, &w, &h, &vw, &vh ) );
+    assert( vw == 1920 && vh == 1080 );
+    assert( hevc_get_frame_rate( p_hsps, NULL, &num, &den ) );
+    assert( num == 30 && den == 1 );
+    hevc_rbsp_release_sps( p_hsps );
+
+    i_sei_seen = 0;
+    HxxxParseSEI( h264_sei_recovery, sizeof(h264_sei_recovery), 1, sei_callback, NULL );
+    HxxxParseSEI( h264_sei_cc, sizeof(h264_sei_cc), 1, sei_callback, NULL );
+    assert( i_sei_seen == 2 );
+
+    parse_h264_nal( h264_sps, sizeof(h264_sps), ITERATIONS );
+    parse_h264_nal( h264_pps, sizeof(h264_pps), ITERATIONS );
+    parse_h264_nal( h264_sei_recovery, sizeof(h264_sei_recovery), ITERATIONS );
+    parse_h264_nal( h264_sei_cc, sizeof(h264_sei_cc), ITERATIONS );
+
+    struct hevc_sets sets = { { NULL }, { NULL } };
+    parse_hevc_nal( &sets, hevc_vps, sizeof(hevc_vps), ITERATIONS );
+    parse_hevc_nal( &sets, hevc_sps, sizeof(hevc_sps), ITERATIONS );
+    parse_hevc_nal( &sets, hevc_pps, sizeof(hevc_pps), ITERATIONS );
+    hevc_sets_release( &sets );
+
+    for( size_t i=0; i<STAT_COUNT; i++ )
+        assert( stats[i].i_failed == 0 );
+}
+
+static int test_file( const char *psz_file, unsigned i_iterations )
+{
+    FILE *p_file = fopen( psz_file, "rb" );
+    if( !p_file )
+    {
+        perror( psz_file );
+        return -1;
+    }
+
+    uint8_t *p_data = NULL;
+    size_t i_data = 0;
+    for( ;; )
+    {
+        uint8_t *p_realloc = realloc( p_data, i_data + 65536 );
+        if( !p_realloc )
+            break;
+        p_data = p_realloc;
+        size_t i_read = fread( &p_data[i_data], 1, 65536, p_file );
+        i_data += i_read;
+        if( i_read < 65536 )
+            break;
+    }
+    fclose( p_file );
+
+    const char *psz_ext = strrchr( psz_file, '.' );
+    const bool b_hevc = psz_ext && ( !strcasecmp( psz_ext, ".265" ) ||
+                                     !strcasecmp( psz_ext, ".h265" ) ||
+                                     !strcasecmp( psz_ext, ".hevc" ) );
+
+    struct hevc_sets sets = { { NULL }, { NULL } };
+    hxxx_iterator_ctx_t it;
+    hxxx_iterator_init( &it, p_data, i_data, 0 );
+
+    const uint8_t *p_nal;
+    size_t i_nal;
+    while( hxxx_annexb_iterate_next( &it, &p_nal, &i_nal ) )
+    {
+        if( b_hevc )
+            parse_hevc_nal( &sets, p_nal, i_nal, i_iterations );
+        else
+            parse_h264_nal( p_nal, i_nal, i_iterations );
+    }
+
+    hevc_sets_release( &sets );
+    free( p_data );
+    return 0;
+}
+
+/* Exp-Golomb decoding alone, against the byte by byte reader */
+static uint8_t *forward_identity( uint8_t *p, uint8_t *p_end, void *priv, size_t i_count )
+{
+    VLC_UNUSED(p_end); VLC_UNUSED(priv);
+    return p + i_count;
+}
+
+static void bench_ue( void )
+{
+    enum { CODES = 1 << 16 };
+    uint8_t *p_buf = malloc( CODES * 4 );
+    assert( p_buf );
+
+    bs_t bs;
+    bs_write_init( &bs, p_buf, CODES * 4 );
+    unsigned seed = 1;
+    for( unsigned i=0; i<CODES; i++ )
+    {
+        /* mostly small values, as in parameter sets */
+        const uint32_t i_val = test_rand( &seed ) >> ( 14 - i % 12 );
+        const unsigned i_len = 32 - clz32( i_val + 1 );
+        bs_write( &bs, i_len - 1, 0 );
+        bs_write( &bs, i_len, i_val + 1 );
+    }
+    const size_t i_buf = bs.p - bs.p_start + 1;
+
+    for( int j=0; j<2; j++ )
+    {
+        uint64_t i_sum = 0;
+        const mtime_t i_start = mdate();
+        for( unsigned k=0; k<64; k++ )
+        {
+            bs_init( &bs, p_buf, i_buf );
+            if( j )
+                bs.pf_forward = forward_identity;
+            for( unsigned i=0; i<CODES; i++ )
+                i_sum += bs_read_ue( &bs );
+        }
+        const mtime_t i_time = mdate() - i_start;
+        printf( "%-18s %9u codes  %6.2f ns/code (sum %"PRIu64")\n",
+                j ? "ue(v) byte reader" : "ue(v) cached",
+                64 * CODES, 1000.0 * i_time / ( 64 * CODES ), i_sum );
+    }
+
+    free( p_buf );
+}
+
+int main( int argc, char **argv )
+{
+    if( argc < 2 )
+    {
+        test_embedded();
+        print_stats();
+        bench_ue();
+        return 0;
+    }
+
+    for( int i=1; i<argc; i++ )
+        if( test_file( argv[i], 100 ) )
+            return 1;
+    print_stats();
+    return 0;
+}
@@ -0,0 +1,328 @@
+/*****************************************************************************
+ * cache_read.c: byte stream cache replay benchmark
+ *****************************************************************************
+ * Copyright © 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Replays read traces through the cache_read stream filter, on top of a
+ * seekable (but not fast seeking) source, and reports how much data the
+ * filter had to read more than once from the source.
+ *
+ * Without arguments, synthetic traces of typical demuxer access patterns are
+ * replayed. Otherwise, each argument is a recorded trace file, with one
+ * "<offset> <length>" read request per line.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+#define SOURCE_SIZE (64 << 20)
+
+typedef struct
+{
+    uint64_t offset;
+    uint32_t length;
+} trace_op_t;
+
+typedef struct
+{
+    trace_op_t *ops;
+    size_t count;
+    size_t size;
+} trace_t;
+
+static struct
+{
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t reread;
+    uint64_t seeks;
+    uint8_t *seen;
+} source;
+
+static ssize_t SourceRead(stream_t *s, void *buf, size_t len)
+{
+    unsigned char *p = buf;
+    (void) s;
+
+    if (source.offset >= SOURCE_SIZE)
+        return 0;
+    if (len > SOURCE_SIZE - source.offset)
+        len = SOURCE_SIZE - source.offset;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        uint64_t offset = source.offset + i;
+        uint8_t bit = 1 << (offset & 7);
+
+        if (source.seen[offset >> 3] & bit)
+            source.reread++;
+        source.seen[offset >> 3] |= bit;
+        p[i] = test_pattern(offset);
+    }
+
+    source.offset += len;
+    source.bytes += len;
+    return len;
+}
+
+static int SourceSeek(stream_t *s, uint64_t offset)
+{
+    (void) s;
+    source.offset = offset;
+    source.seeks++;
+    return VLC_SUCCESS;
+}
+
+static int SourceControl(stream_t *s, int query, va_list ap)
+{
+    (void) s;
+
+    switch (query)
+    {
+        case STREAM_CAN_SEEK:
+        case STREAM_CAN_PAUSE:
+        case STREAM_CAN_CONTROL_PACE:
+            *va_arg(ap, bool *) = true;
+            break;
+        case STREAM_CAN_FASTSEEK:
+            *va_arg(ap, bool *) = false;
+            break;
+        case STREAM_GET_SIZE:
+            *va_arg(ap, uint64_t *) = SOURCE_SIZE;
+            break;
+        case STREAM_GET_PTS_DELAY:
+            *va_arg(ap, int64_t *) = DEFAULT_PTS_DELAY;
+            break;
+        default:
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+static void SourceDestroy(stream_t *s)
+{
+    (void) s;
+}
+
+static void trace_add(trace_t *trace, uint64_t offset, uint32_t length)
+{
+    if (offset >= SOURCE_SIZE)
+        return;
+    if (length > SOURCE_SIZE - offset)
+        length = SOURCE_SIZE - offset;
+
+    if (trace->count == trace->size)
+    {
+        trace->size = trace->size ? 2 * trace->size : 1024;
+        trace->ops = realloc(trace->ops, trace->size * sizeof (*trace->ops));
+        assert(trace->ops != NULL);
+    }
+    trace->ops[trace->count].offset = offset;
+    trace->ops[trace->count].length = length;
+    trace->count++;
+}
+
+/* Demuxer reading a well-interleaved file from start to end */
+static void trace_sequential(trace_t *trace)
+{
+    for (uint64_t offset = 0; offset < SOURCE_SIZE; offset += 4096)
+        trace_add(trace, offset, 4096);
+}
+
+/* MP4 demuxer reading the chunks of badly interleaved tracks, one after the
+ * other (each track stored in its own part of the file) */
+static void trace_interleaved(trace_t *trace, unsigned tracks)
+{
+    const uint64_t part = SOURCE_SIZE / tracks;
+    const uint32_t chunk = 64 << 10;
+
+    for (uint64_t offset = 0; offset + chunk <= part; offset += chunk)
+        for (unsigned i = 0; i < tracks; i++)
+            for (uint32_t sample = 0; sample < chunk; sample += 16384)
+                trace_add(trace, i * part + offset + sample, 16384);
+}
+
+/* Demuxer reading the header, the index at the end of the file, then the
+ * data with regular backward seeks (e.g. resynchronization or key frames) */
+static void trace_index(trace_t *trace)
+{
+    trace_add(trace, 0, 1024);
+    for (uint64_t offset = SOURCE_SIZE - (1 << 20); offset < SOURCE_SIZE;
+         offset += 8192)
+        trace_add(trace, offset, 8192);
+
+    for (uint64_t offset = 1024; offset < SOURCE_SIZE - (1 << 20);
+         offset += 8192)
+    {
+        trace_add(trace, offset, 8192);
+        if ((offset >> 13) % 64 == 63)
+            trace_add(trace, offset - (256 << 10), 8192);
+    }
+}
+
+static int trace_load(trace_t *trace, const char *path)
+{
+    FILE *stream = fopen(path, "rt");
+    if (stream == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    uint64_t offset;
+    uint32_t length;
+
+    while (fscanf(stream, "%"SCNu64" %"SCNu32, &offset, &length) == 2)
+        trace_add(trace, offset, length);
+    fclose(stream);
+    return 0;
+}
+
+static void replay(vlc_object_t *parent, const char *name,
+                   const trace_t *trace)
+{
+    uint64_t requested = 0;
+    unsigned char *buf = NULL;
+    size_t bufsize = 0;
+
+    memset(source.seen, 0, SOURCE_SIZE / 8);
+    source.offset = source.bytes = source.reread = source.seeks = 0;
+
+    stream_t *src = vlc_stream_CommonNew(parent, SourceDestroy);
+    assert(src != NULL);
+    src->pf_read = SourceRead;
+    src->pf_seek = SourceSeek;
+    src->pf_control = SourceControl;
+
+    stream_t *s = vlc_stream_FilterNew(src, "cache_read");
+    assert(s != NULL);
+
+    mtime_t start = mdate();
+
+    for (size_t i = 0; i < trace->count; i++)
+    {
+        const trace_op_t *op = &trace->ops[i];
+
+        if (op->length > bufsize)
+        {
+            bufsize = op->length;
+            buf = realloc(buf, bufsize);
+            assert(buf != NULL);
+        }
+
+        if (vlc_stream_Tell(s) != op->offset)
+            assert(vlc_stream_Seek(s, op->offset) == VLC_SUCCESS);
+
+        ssize_t val = vlc_stream_Read(s, buf, op->length);
+        assert(val == (ssize_t)op->length);
+
+        for (size_t j = 0; j < op->length; j++)
+            assert(buf[j] == test_pattern(op->offset + j));
+        requested += op->length;
+    }
+
+    mtime_t duration = mdate() - start;
+
+    vlc_stream_Delete(s);
+    free(buf);
+
+    printf("%-16s %10"PRIu64" %10"PRIu64" %10"PRIu64" %8"PRIu64
+           " %8"PRId64"\n", name, requested, source.bytes, source.reread,
+           source.seeks, duration / 1000);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *const args[] = { "--verbose=0" };
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+
+    vlc_object_t *parent = VLC_OBJECT(vlc->p_libvlc_int);
+
+    source.seen = malloc(SOURCE_SIZE / 8);
+    assert(source.seen != NULL);
+
+    printf("%-16s %10s %10s %10s %8s %8s\n", "trace", "requested", "read",
+           "re-read", "seeks", "ms");
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            trace_t trace = { NULL, 0, 0 };
+
+            if (trace_load(&trace, argv[i]) == 0)
+                replay(parent, argv[i], &trace);
+            free(trace.ops);
+        }
+    }
+    else
+    {
+        static const struct
+        {
+            const char *name;
+            void (*build)(trace_t *);
+        } traces[] = {
+            { "sequential", trace_sequential },
+            { "index", trace_index },
+        };
+
+        for (size_t i = 0; i < ARRAY_SIZE(traces); i++)
+        {
+            trace_t trace = { NULL, 0, 0 };
+
+            traces[i].build(&trace);
+            replay(parent, traces[i].name, &trace);
+            free(trace.ops);
+        }
+
+        for (unsigned tracks = 2; tracks <= 8; tracks *= 2)
+        {
+            trace_t trace = { NULL, 0, 0 };
+            char name[16];
+
+            trace_interleaved(&trace, tracks);
+            snprintf(name, sizeof (name), "interleaved-%u", tracks);
+            replay(parent, name, &trace);
+            free(trace.ops);
+        }
+    }
+
+    free(source.seen);
+    libvlc_release(vlc);
+    return 0;
+}
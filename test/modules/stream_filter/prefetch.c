@@ -0,0 +1,168 @@
+/*****************************************************************************
+ * prefetch.c: prefetch stream filter unit test
+ *****************************************************************************
+ * Copyright © 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+#define TOTAL_SIZE (8 << 20)
+#define HELD_BLOCKS 8
+
+static void check(uint64_t offset, const unsigned char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        assert(buf[i] == test_pattern(offset + i));
+}
+
+static void *Writer(void *data)
+{
+    stream_t *fifo = data;
+    unsigned char buf[32768];
+    uint64_t offset = 0;
+    unsigned seed = 1;
+
+    while (offset < TOTAL_SIZE)
+    {
+        size_t len = 1 + test_rand(&seed) % sizeof (buf);
+
+        if (len > TOTAL_SIZE - offset)
+            len = TOTAL_SIZE - offset;
+        for (size_t i = 0; i < len; i++)
+            buf[i] = test_pattern(offset + i);
+
+        ssize_t val = vlc_stream_fifo_Write(fifo, buf, len);
+        assert(val == (ssize_t)len);
+        offset += len;
+    }
+
+    vlc_stream_fifo_Close(fifo);
+    return NULL;
+}
+
+static void test_prefetch(int argc, const char *const *argv)
+{
+    libvlc_instance_t *vlc = libvlc_new(argc, argv);
+    assert(vlc != NULL);
+
+    stream_t *fifo = vlc_stream_fifo_New(VLC_OBJECT(vlc->p_libvlc_int));
+    assert(fifo != NULL);
+
+    stream_t *s = vlc_stream_FilterNew(fifo, "prefetch");
+    assert(s != NULL);
+
+    vlc_thread_t th;
+    if (vlc_clone(&th, Writer, fifo, VLC_THREAD_PRIORITY_LOW))
+        abort();
+
+    block_t *held[HELD_BLOCKS] = { NULL };
+    unsigned char buf[65536];
+    const unsigned char *peek;
+    uint64_t offset = 0;
+    unsigned seed = 2, step = 0;
+
+    while (offset < TOTAL_SIZE)
+    {
+        size_t len = 1 + test_rand(&seed) % sizeof (buf);
+        ssize_t val;
+
+        switch (step++ % 4)
+        {
+            case 0:
+                val = vlc_stream_Read(s, buf, len);
+                assert(val > 0);
+                check(offset, buf, val);
+                offset += val;
+                break;
+
+            case 1:
+            {   /* Keep a few blocks around, so that the buffer wraps */
+                block_t *block = vlc_stream_ReadBlock(s);
+
+                assert(block != NULL);
+                check(offset, block->p_buffer, block->i_buffer);
+                offset += block->i_buffer;
+
+                if (held[step % HELD_BLOCKS] != NULL)
+                    block_Release(held[step % HELD_BLOCKS]);
+                held[step % HELD_BLOCKS] = block;
+                break;
+            }
+
+            case 2:
+                val = vlc_stream_Peek(s, &peek, len);
+                assert(val > 0);
+                check(offset, peek, val);
+                break;
+
+            case 3:
+                if (len > TOTAL_SIZE - offset)
+                    len = TOTAL_SIZE - offset;
+                val = vlc_stream_Read(s, NULL, len);
+                assert(val == (ssize_t)len);
+                offset += len;
+                break;
+        }
+        assert(vlc_stream_Tell(s) == offset);
+    }
+
+    assert(offset == TOTAL_SIZE);
+    assert(vlc_stream_Read(s, buf, sizeof (buf)) == 0);
+    assert(vlc_stream_ReadBlock(s) == NULL);
+    assert(vlc_stream_Eof(s));
+
+    /* Blocks must remain valid after the stream is gone */
+    vlc_join(th, NULL);
+    vlc_stream_Delete(s);
+
+    for (unsigned i = 0; i < HELD_BLOCKS; i++)
+        if (held[i] != NULL)
+        {
+            volatile unsigned char c = held[i]->p_buffer[0];
+            (void) c;
+            block_Release(held[i]);
+        }
+
+    libvlc_release(vlc);
+}
+
+int main(void)
+{
+    static const char *const small_argv[] = {
+        "--prefetch-buffer-size=64", "--prefetch-read-size=4096",
+    };
+
+    test_init();
+
+    test_prefetch(0, NULL);
+    test_prefetch(ARRAY_SIZE(small_argv), small_argv);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*****************************************************************************
+ * blend.cpp: blend module SIMD kernels test
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Blends random pictures through each SSE2 blending function and through the
+ * generic one for the same chroma pair, and checks they are identical. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#define MODULE_STRING "blend"
+#include "../../../modules/video_filter/blend.cpp"
+
+#include <string.h>
+#include "../../libvlc/test.h"
+
+#ifdef HAVE_SSE2_INTRINSICS
+/* Noise, with transparent and opaque areas as subtitles have */
+static picture_t *NewImage(const video_format_t *fmt, unsigned *seed)
+{
+    picture_t *pic = picture_NewFromFormat(fmt);
+    assert(pic != NULL);
+
+    for (int i = 0; i < pic->i_planes; i++)
+    {
+        plane_t *p = &pic->p[i];
+
+        for (int y = 0; y < p->i_lines; y++)
+            for (int x = 0; x < p->i_pitch; x++)
+                p->p_pixels[y * p->i_pitch + x] = test_rand(seed);
+    }
+
+    if (fmt->i_chroma == VLC_CODEC_YUVA || fmt->i_chroma == VLC_CODEC_RGBA)
+    {
+        plane_t *p = &pic->p[fmt->i_chroma == VLC_CODEC_YUVA ? A_PLANE : 0];
+        const int pixel = fmt->i_chroma == VLC_CODEC_YUVA ? 1 : 4;
+        const int offset = fmt->i_chroma == VLC_CODEC_YUVA ? 0 : 3;
+
+        for (int y = 0; y < p->i_visible_lines; y++)
+            for (int x = 0; x < p->i_visible_pitch / pixel; x++)
+            {
+                uint8_t *a = &p->p_pixels[y * p->i_pitch + x * pixel + offset];
+
+                if (y < p->i_visible_lines / 3)
+                    *a = 0;
+                else if (y < 2 * p->i_visible_lines / 3)
+                    *a = 255;
+            }
+    }
+    return pic;
+}
+
+static void Check(vlc_fourcc_t dst_chroma, vlc_fourcc_t src_chroma,
+                  blend_function_t simd, blend_function_t generic)
+{
+    static const unsigned sizes[][2] = { { 64, 32 }, { 37, 21 } };
+    static const int alphas[] = { 255, 128, 1 };
+    unsigned seed = dst_chroma ^ src_chroma;
+
+    for (size_t s = 0; s < ARRAY_SIZE(sizes); s++)
+    {
+        const unsigned width = sizes[s][0], height = sizes[s][1];
+        video_format_t dst_fmt, src_fmt;
+
+        video_format_Init(&dst_fmt, dst_chroma);
+        video_format_Setup(&dst_fmt, dst_chroma, 2 * width, 2 * height,
+                           2 * width, 2 * height, 1, 1);
+        video_format_FixRgb(&dst_fmt);
+        video_format_Init(&src_fmt, src_chroma);
+        video_format_Setup(&src_fmt, src_chroma, width, height,
+                           width, height, 1, 1);
+        video_format_FixRgb(&src_fmt);
+
+        picture_t *src = NewImage(&src_fmt, &seed);
+        picture_t *dst = NewImage(&dst_fmt, &seed);
+        picture_t *ref = picture_NewFromFormat(&dst_fmt);
+        assert(ref != NULL);
+
+        for (size_t a = 0; a < ARRAY_SIZE(alphas); a++)
+        {
+            /* Even and odd offsets, as 4:2:0 pictures blend by pairs */
+            const unsigned x = 2 * a + 1, y = a & 1;
+
+            for (int i = 0; i < dst->i_planes; i++)
+                memcpy(ref->p[i].p_pixels, dst->p[i].p_pixels,
+                       dst->p[i].i_pitch * dst->p[i].i_lines);
+
+            simd(CPicture(dst, &dst_fmt, x, y), CPicture(src, &src_fmt, 0, 0),
+                 width, height, alphas[a]);
+            generic(CPicture(ref, &dst_fmt, x, y),
+                    CPicture(src, &src_fmt, 0, 0), width, height, alphas[a]);
+
+            for (int i = 0; i < dst->i_planes; i++)
+                if (memcmp(dst->p[i].p_pixels, ref->p[i].p_pixels,
+                           dst->p[i].i_pitch * dst->p[i].i_lines))
+                {
+                    fprintf(stderr, "%4.4s -> %4.4s %ux%u alpha %d: "
+                            "plane %d differs\n", (const char *)&src_chroma,
+                            (const char *)&dst_chroma, width, height,
+                            alphas[a], i);
+                    abort();
+                }
+        }
+
+        picture_Release(ref);
+        picture_Release(dst);
+        picture_Release(src);
+    }
+}
+#endif
+
+int main(void)
+{
+#ifdef HAVE_SSE2_INTRINSICS
+    if (!vlc_CPU_SSE2())
+        return 77;
+
+    for (size_t i = 0; i < ARRAY_SIZE(blends_sse2); i++)
+    {
+        blend_function_t generic = NULL;
+
+        for (size_t j = 0; j < ARRAY_SIZE(blends); j++)
+            if (blends[j].dst == blends_sse2[i].dst
+             && blends[j].src == blends_sse2[i].src)
+                generic = blends[j].blend;
+        assert(generic != NULL);
+
+        Check(blends_sse2[i].dst, blends_sse2[i].src,
+              blends_sse2[i].blend, generic);
+    }
+    return 0;
+#else
+    return 77;
+#endif
+}
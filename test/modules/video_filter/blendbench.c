@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * blendbench.c: blend module benchmark
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Blends synthetic images for every chroma pair supported by the blend
+ * module, and prints the throughput of each pair.
+ *
+ * Usage: test_modules_video_filter_blendbench [width [height [loops]]]
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+#include <vlc_picture.h>
+#include "../../../modules/video_filter/blend.h"
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+#define CHROMA(csp, picture, cvt) csp,
+static const vlc_fourcc_t base_chromas[] = {
+    BLEND_CHROMAS(CHROMA, CHROMA)
+};
+#undef CHROMA
+
+static const vlc_fourcc_t blend_chromas[] = {
+    VLC_CODEC_YUVA, VLC_CODEC_RGBA, VLC_CODEC_YUVP,
+};
+
+/* Noise, with transparent and opaque areas as subtitles have */
+static picture_t *NewImage(vlc_fourcc_t chroma, unsigned width,
+                           unsigned height, video_palette_t *palette)
+{
+    video_format_t fmt;
+    unsigned seed = chroma;
+
+    video_format_Init(&fmt, chroma);
+    video_format_Setup(&fmt, chroma, width, height, width, height, 1, 1);
+    video_format_FixRgb(&fmt);
+    if (chroma == VLC_CODEC_YUVP)
+    {
+        palette->i_entries = 256;
+        for (unsigned i = 0; i < 256; i++)
+            for (unsigned j = 0; j < 4; j++)
+                palette->palette[i][j] = test_rand(&seed);
+        fmt.p_palette = palette;
+    }
+
+    picture_t *pic = picture_NewFromFormat(&fmt);
+    if (pic == NULL)
+        return NULL;
+
+    for (int i = 0; i < pic->i_planes; i++)
+    {
+        plane_t *p = &pic->p[i];
+
+        for (int y = 0; y < p->i_lines; y++)
+        {
+            uint8_t *row = &p->p_pixels[y * p->i_pitch];
+
+            for (int x = 0; x < p->i_pitch; x++)
+            {
+                row[x] = test_rand(&seed);
+                if ((y / 32) % 3 == 0)
+                    row[x] &= 0x0f;
+                else if ((y / 32) % 3 == 2)
+                    row[x] = 0xff;
+            }
+        }
+    }
+    return pic;
+}
+
+/* Returns the duration of the given number of blends, or -1 if the pair
+ * is not supported */
+static mtime_t Run(vlc_object_t *obj, picture_t *base, picture_t *blended,
+                   unsigned loops)
+{
+    filter_t *blend = vlc_object_create(obj, sizeof (*blend));
+    if (blend == NULL)
+        return -1;
+
+    blend->fmt_out.video = base->format;
+    blend->fmt_in.video = blended->format;
+    blend->p_module = module_need(blend, "video blending", NULL, false);
+    if (blend->p_module == NULL)
+    {
+        vlc_object_release(blend);
+        return -1;
+    }
+
+    mtime_t time = mdate();
+    for (unsigned i = 0; i < loops; i++)
+        blend->pf_video_blend(blend, base, blended, 0, 0, 128);
+    time = mdate() - time;
+
+    module_unneed(blend, blend->p_module);
+    vlc_object_release(blend);
+    return time;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned width = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1920;
+    unsigned height = (argc > 2) ? strtoul(argv[2], NULL, 0) : 1080;
+    unsigned loops = (argc > 3) ? strtoul(argv[3], NULL, 0) : 100;
+    static const char *const args[] = { "--quiet" };
+
+    if (width == 0 || height == 0 || loops == 0)
+    {
+        fprintf(stderr, "Usage: %s [width [height [loops]]]\n", argv[0]);
+        return 1;
+    }
+
+    setenv("VLC_PLUGIN_PATH", "../modules", 1);
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    if (vlc == NULL)
+        return 1;
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    printf("Blending %u images of %ux%u\n", loops, width, height);
+    printf("src  dst  ms/image Mpixels/s\n");
+
+    for (size_t j = 0; j < ARRAY_SIZE(blend_chromas); j++)
+    {
+        video_palette_t palette;
+        picture_t *blended = NewImage(blend_chromas[j], width, height,
+                                      &palette);
+        if (blended == NULL)
+            continue;
+
+        for (size_t i = 0; i < ARRAY_SIZE(base_chromas); i++)
+        {
+            picture_t *base = NewImage(base_chromas[i], width, height, NULL);
+            if (base == NULL)
+                continue;
+
+            mtime_t time = Run(obj, base, blended, loops);
+
+            printf("%4.4s %4.4s ", (const char *)&blend_chromas[j],
+                   (const char *)&base_chromas[i]);
+            if (time < 0)
+                printf("unsupported\n");
+            else
+                printf("%8.3f %9.1f\n", time / 1000. / loops,
+                       (double)loops * width * height / (time ? time : 1));
+            picture_Release(base);
+        }
+        picture_Release(blended);
+    }
+
+    libvlc_release(vlc);
+    return 0;
+}
@@ -37,6 +37,131 @@ static uint8_t *skip1( uint8_t *p, uint8_t *end, void *priv, size_t i_count )
     return p;
 }
 
+/* Byte per byte reading, through the forward modifier */
+static uint8_t *forward1( uint8_t *p, uint8_t *end, void *priv, size_t i_count )
+{
+    (void) end; (void) priv;
+    return p + i_count;
+}
+
+/* Random payload, zero rich, escaped the way encoders do */
+static size_t make_payload( unsigned *seed, uint8_t *payload, size_t i_payload,
+                            uint8_t *escaped, size_t *pi_offsets )
+{
+    size_t i_escaped = 0;
+    unsigned i_zeros = 0;
+    for( size_t i=0; i<i_payload; i++ )
+    {
+        uint8_t v = (test_rand( seed ) % 3) ? test_rand( seed ) % 4 : test_rand( seed );
+        if( i > 1 && !payload[i-1] && !payload[i-2] && !v )
+            v = 0x80; /* no three zeros in a row */
+        payload[i] = v;
+        if( i_zeros >= 2 && v <= 3 )
+        {
+            escaped[i_escaped++] = 0x03;
+            i_zeros = 0;
+        }
+        pi_offsets[i] = i_escaped;
+        escaped[i_escaped++] = v;
+        i_zeros = v ? 0 : i_zeros + 1;
+    }
+    pi_offsets[i_payload] = i_escaped;
+    return i_escaped;
+}
+
+/* Same operations on the cached reader and on the byte reader, or on the
+ * unescaped payload when discarding emulation prevention */
+static void test_random( unsigned seed, bool b_ep3b )
+{
+    uint8_t payload[300], escaped[450];
+    size_t offsets[301];
+    const size_t i_escaped = make_payload( &seed, payload, sizeof(payload),
+                                           escaped, offsets );
+
+    bs_t a, b, p;
+    bs_init( &p, payload, sizeof(payload) );
+    if( b_ep3b )
+    {
+        bs_init( &a, escaped, i_escaped );
+        a.b_ep3b = true;
+    }
+    else
+    {
+        bs_init( &a, payload, sizeof(payload) );
+    }
+    bs_init( &b, payload, sizeof(payload) );
+    b.pf_forward = forward1;
+
+    while( !bs_eof( &p ) )
+    {
+        const unsigned i_op = test_rand( &seed ) % 7;
+        const int i_count = 1 + test_rand( &seed ) % 32;
+        switch( i_op )
+        {
+            case 0:
+            {
+                const uint32_t v = bs_read( &a, i_count );
+                assert( v == bs_read( &p, i_count ) );
+                assert( v == bs_read( &b, i_count ) );
+                break;
+            }
+            case 1:
+            {
+                const uint32_t v = bs_read1( &a );
+                assert( v == bs_read1( &p ) );
+                assert( v == bs_read1( &b ) );
+                break;
+            }
+            case 2:
+            {
+                const int i_skip = test_rand( &seed ) % (bs_remain( &p ) + 1);
+                bs_skip( &a, i_skip );
+                bs_skip( &b, i_skip );
+                bs_skip( &p, i_skip );
+                break;
+            }
+            case 3:
+                assert( bs_show( &a, i_count ) == bs_show( &b, i_count ) );
+                break;
+            case 4:
+            {
+                const uint32_t v = bs_read_ue( &a );
+                assert( v == bs_read_ue( &p ) );
+                assert( v == bs_read_ue( &b ) );
+                break;
+            }
+            case 5:
+            {
+                const int32_t v = bs_read_se( &a );
+                assert( v == bs_read_se( &p ) );
+                assert( v == bs_read_se( &b ) );
+                break;
+            }
+            case 6:
+                assert( bs_aligned( &a ) == bs_aligned( &b ) );
+                bs_align( &a );
+                bs_align( &b );
+                bs_align( &p );
+                break;
+        }
+
+        if( b_ep3b )
+        {
+            /* discarded bytes are accounted up to the reading position */
+            const int i_pos = bs_pos( &p );
+            const int i_raw = 8 * offsets[i_pos / 8] + i_pos % 8;
+            assert( bs_pos( &a ) == i_raw );
+            assert( bs_remain( &a ) == (int) (8 * i_escaped) - i_raw );
+        }
+        else
+        {
+            assert( bs_pos( &a ) == bs_pos( &b ) );
+            assert( bs_remain( &a ) == bs_remain( &b ) );
+        }
+        assert( bs_eof( &a ) == bs_eof( &p ) );
+    }
+}
+
 int main( void )
 {
     test_init();
@@ -127,5 +252,37 @@ int main( void )
         work[i] = bs_read( &bs, 8 );
     assert(!memcmp( &work, &ok, 6 ));
 
+    /* Emulation prevention is discarded, but still part of the position */
+    const uint8_t ep[8] = { 0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00 };
+    bs_init( &bs, &ep, 8 );
+    bs.b_ep3b = true;
+    assert( bs_read( &bs, 24 ) == 0x000001 );
+    assert( bs_pos( &bs ) == 32 );
+    assert( bs_read( &bs, 16 ) == 0x0000 );
+    assert( bs_pos( &bs ) == 56 );
+    assert( bs_remain( &bs ) == 8 );
+    assert( bs_read( &bs, 8 ) == 0x00 );
+    assert( bs_eof( &bs ) );
+
+    /* but not when it ends the buffer */
+    bs_init( &bs, &ep, 7 );
+    bs.b_ep3b = true;
+    bs_skip( &bs, 40 );
+    assert( bs_read( &bs, 8 ) == 0x03 );
+    assert( bs_eof( &bs ) );
+
+    /* Exp-Golomb codes up to 32 bits */
+    const uint8_t ue[9] = { 0x00, 0x00, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFE, 0x80 };
+    bs_init( &bs, &ue, 9 );
+    assert( bs_read_ue( &bs ) == UINT32_MAX - 1 );
+    assert( bs_read_ue( &bs ) == 1 );
+    assert( bs_remain( &bs ) == 6 );
+
+    for( unsigned i=0; i<200; i++ )
+    {
+        test_random( i, false );
+        test_random( i, true );
+    }
+
     return 0;
 }
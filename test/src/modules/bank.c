@@ -0,0 +1,75 @@
+/*****************************************************************************
+ * bank.c: modules bank unit test
+ *****************************************************************************
+ * Copyright (C) 2018 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_modules.h>
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+/* Reference lookup: the first module of that name in the modules list */
+static module_t *find_linear(module_t *const *tab, size_t n, const char *name)
+{
+    for (size_t i = 0; i < n; i++)
+        if (strcmp(module_get_object(tab[i]), name) == 0)
+            return tab[i];
+    return NULL;
+}
+
+int main(void)
+{
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new(test_defaults_nargs,
+                                        test_defaults_args);
+    assert(vlc != NULL);
+
+    size_t n;
+    module_t **tab = module_list_get(&n);
+    assert(tab != NULL);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const char *name = module_get_object(tab[i]);
+
+        assert(module_find(name) == find_linear(tab, n, name));
+    }
+    module_list_free(tab);
+
+    assert(module_find("core") != NULL);
+    assert(module_is_main(module_find("core")));
+    assert(module_find("no such module, really") == NULL);
+
+    /* Submodules share the name of the main module, which must be found */
+    if (module_exists("logo"))
+        assert(module_provides(module_find("logo"), "sub source"));
+
+    libvlc_release(vlc);
+    return 0;
+}
@@ -0,0 +1,479 @@
+/*****************************************************************************
+ * httpd.c: HTTP server load test
+ *****************************************************************************
+ * Copyright (C) 2017 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks files served from disk, with byte ranges. Then opens many
+ * concurrent keep-alive connections to a local httpd host, and issues
+ * requests on all of them round after round. Then as many clients read a
+ * live stream at once. The load can be scaled with the
+ * VLC_BENCH_CLIENTS, VLC_BENCH_REQUESTS and VLC_BENCH_THREADS environment
+ * variables. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <vlc_common.h>
+#include <vlc_atomic.h>
+#include <vlc_block.h>
+#include <vlc_httpd.h>
+#include <vlc_rand.h>
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+#define MAX_DRIVERS 16
+#define STREAM_BLOCK 1316
+#define STREAM_BYTES_PER_REQUEST 65536
+#define PATH_SIZE (3 << 20)
+
+static const char body[] = "VLC httpd load test\n";
+
+static unsigned clients = 256;
+static unsigned requests = 16;
+static unsigned drivers = 4;
+static unsigned port;
+static httpd_stream_t *stream;
+static atomic_bool streaming;
+
+static int Fill(httpd_file_sys_t *sys, httpd_file_t *file, uint8_t *request,
+                uint8_t **data, int *len)
+{
+    (void) sys; (void) file; (void) request;
+    *data = malloc(sizeof (body) - 1);
+    assert(*data != NULL);
+    memcpy(*data, body, sizeof (body) - 1);
+    *len = sizeof (body) - 1;
+    return VLC_SUCCESS;
+}
+
+static int Connect(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd != -1);
+
+    int val = connect(fd, (struct sockaddr *)&addr, sizeof (addr));
+    assert(val == 0);
+    return fd;
+}
+
+/* Reads and checks one whole response */
+static void ReadAnswer(int fd)
+{
+    char buf[4096];
+    size_t len = 0, total = 0;
+
+    for (;;)
+    {
+        ssize_t val = recv(fd, buf + len, sizeof (buf) - 1 - len, 0);
+        assert(val > 0);
+        len += val;
+        buf[len] = '\0';
+
+        if (total == 0)
+        {
+            char *end = strstr(buf, "\r\n\r\n");
+            if (end == NULL)
+                continue;
+
+            assert(!strncmp(buf, "HTTP/1.1 200 ", 13));
+            char *cl = strstr(buf, "Content-Length: ");
+            assert(cl != NULL && cl < end);
+            total = (end + 4 - buf) + strtoul(cl + 16, NULL, 10);
+        }
+        if (len >= total)
+            break;
+    }
+    assert(len == total);
+    assert(!memcmp(buf + len - (sizeof (body) - 1), body, sizeof (body) - 1));
+}
+
+static void *Driver(void *data)
+{
+    unsigned n = *(unsigned *)data;
+    int *fds = malloc(n * sizeof (*fds));
+    static const char request[] =
+        "GET /bench HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    assert(fds != NULL);
+    for (unsigned i = 0; i < n; i++)
+        fds[i] = Connect();
+
+    for (unsigned r = 0; r < requests; r++)
+    {
+        /* All clients have a request in flight at once */
+        for (unsigned i = 0; i < n; i++)
+        {
+            ssize_t val = send(fds[i], request, sizeof (request) - 1,
+                               MSG_NOSIGNAL);
+            assert(val == sizeof (request) - 1);
+        }
+        for (unsigned i = 0; i < n; i++)
+            ReadAnswer(fds[i]);
+    }
+
+    for (unsigned i = 0; i < n; i++)
+        close(fds[i]);
+    free(fds);
+    return NULL;
+}
+
+/* Sends one request on its own connection, returns the answer length */
+static size_t Request(const char *request, char *buf, size_t size)
+{
+    int fd = Connect();
+    size_t len = 0;
+    ssize_t val;
+
+    val = send(fd, request, strlen(request), MSG_NOSIGNAL);
+    assert(val == (ssize_t)strlen(request));
+
+    while ((val = recv(fd, buf + len, size - 1 - len, 0)) > 0)
+        len += val;
+    assert(val == 0);
+    close(fd);
+    buf[len] = '\0';
+    return len;
+}
+
+static void CheckAnswer(const char *range, const char *status,
+                        const char *content_range, const uint8_t *data,
+                        size_t offset, size_t length, char *buf, size_t size)
+{
+    char request[256];
+
+    snprintf(request, sizeof (request), "GET /path HTTP/1.1\r\n"
+             "Host: localhost\r\nConnection: close\r\n%s\r\n", range);
+    size_t len = Request(request, buf, size);
+
+    assert(!strncmp(buf, status, strlen(status)));
+    char *end = strstr(buf, "\r\n\r\n");
+    assert(end != NULL);
+    *end = '\0';
+    end += 4;
+
+    char *cl = strstr(buf, "Content-Length: ");
+    assert(cl != NULL && strtoul(cl + 16, NULL, 10) == length);
+    assert(len - (end - buf) == length);
+    assert(!memcmp(end, data + offset, length));
+    if (content_range != NULL)
+        assert(strstr(buf, content_range) != NULL);
+}
+
+static void test_path(httpd_host_t *host)
+{
+    char path[] = "/tmp/vlc-httpd-XXXXXX";
+    uint8_t *data = malloc(PATH_SIZE);
+    char *buf = malloc(PATH_SIZE + 4096);
+    char range[64];
+
+    assert(data != NULL && buf != NULL);
+    for (size_t i = 0; i < PATH_SIZE; i++)
+        data[i] = vlc_mrand48();
+
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    assert(write(fd, data, PATH_SIZE) == PATH_SIZE);
+    close(fd);
+
+    httpd_file_t *file = httpd_FileNewPath(host, "/path", "video/MP2T",
+                                           NULL, NULL, path);
+    assert(file != NULL);
+
+    CheckAnswer("", "HTTP/1.1 200 ", NULL, data, 0, PATH_SIZE,
+                buf, PATH_SIZE + 4096);
+    CheckAnswer("Range: bytes=100-199\r\n", "HTTP/1.1 206 ",
+                "Content-Range: bytes 100-199/3145728", data, 100, 100,
+                buf, PATH_SIZE + 4096);
+    CheckAnswer("Range: bytes=3145000-\r\n", "HTTP/1.1 206 ",
+                "Content-Range: bytes 3145000-3145727/3145728", data,
+                3145000, PATH_SIZE - 3145000, buf, PATH_SIZE + 4096);
+    CheckAnswer("Range: bytes=-10\r\n", "HTTP/1.1 206 ", NULL, data,
+                PATH_SIZE - 10, 10, buf, PATH_SIZE + 4096);
+    snprintf(range, sizeof (range), "Range: bytes=%u-\r\n", PATH_SIZE);
+    CheckAnswer(range, "HTTP/1.1 416 ", "Content-Range: bytes */3145728",
+                data, 0, 0, buf, PATH_SIZE + 4096);
+    /* Multiple ranges are not supported, the whole file is sent */
+    CheckAnswer("Range: bytes=0-1,5-6\r\n", "HTTP/1.1 200 ", NULL, data, 0,
+                PATH_SIZE, buf, PATH_SIZE + 4096);
+
+    Request("HEAD /path HTTP/1.1\r\nConnection: close\r\n\r\n",
+            buf, PATH_SIZE + 4096);
+    assert(!strncmp(buf, "HTTP/1.1 200 ", 13));
+    assert(strstr(buf, "Content-Length: 3145728\r\n") != NULL);
+    assert(!strcmp(strstr(buf, "\r\n\r\n"), "\r\n\r\n"));
+
+    /* No range of an empty file can be satisfied */
+    assert(truncate(path, 0) == 0);
+    CheckAnswer("Range: bytes=-10\r\n", "HTTP/1.1 416 ",
+                "Content-Range: bytes */0", data, 0, 0, buf, PATH_SIZE + 4096);
+    CheckAnswer("Range: bytes=0-\r\n", "HTTP/1.1 416 ",
+                "Content-Range: bytes */0", data, 0, 0, buf, PATH_SIZE + 4096);
+    CheckAnswer("", "HTTP/1.1 200 ", NULL, data, 0, 0, buf, PATH_SIZE + 4096);
+
+    unlink(path);
+    Request("GET /path HTTP/1.1\r\nConnection: close\r\n\r\n",
+            buf, PATH_SIZE + 4096);
+    assert(!strncmp(buf, "HTTP/1.1 404 ", 13));
+
+    httpd_FileDelete(file);
+    free(buf);
+    free(data);
+}
+
+static void *Feeder(void *data)
+{
+    mtime_t deadline = mdate();
+    unsigned seq = 0;
+
+    (void) data;
+    while (atomic_load(&streaming))
+    {
+        for (unsigned i = 0; i < 64; i++)
+        {
+            block_t *block = block_Alloc(STREAM_BLOCK);
+            assert(block != NULL);
+            memset(block->p_buffer, seq++ & 0xff, STREAM_BLOCK);
+            httpd_StreamSend(stream, block);
+        }
+        deadline += CLOCK_FREQ / 100;
+        mwait(deadline);
+    }
+    return NULL;
+}
+
+typedef struct
+{
+    int fd;
+    bool header;
+    size_t length;
+    size_t received;
+    uint8_t value;
+} viewer_t;
+
+/* Checks that whole blocks are received, possibly skipping some */
+static void CheckStream(viewer_t *v, const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i < len; i++, v->received++)
+    {
+        if (v->received % STREAM_BLOCK == 0)
+            v->value = p[i];
+        assert(p[i] == v->value);
+    }
+}
+
+static void *Viewer(void *data)
+{
+    unsigned n = *(unsigned *)data;
+    viewer_t *viewers = malloc(n * sizeof (*viewers));
+    const size_t total = requests * STREAM_BYTES_PER_REQUEST;
+    static const char request[] =
+        "GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    assert(viewers != NULL);
+    for (unsigned i = 0; i < n; i++)
+    {
+        viewers[i].fd = Connect();
+        viewers[i].header = false;
+        viewers[i].length = 0;
+        viewers[i].received = 0;
+
+        ssize_t val = send(viewers[i].fd, request, sizeof (request) - 1,
+                           MSG_NOSIGNAL);
+        assert(val == sizeof (request) - 1);
+    }
+
+    for (unsigned done = 0; done < n;)
+        for (unsigned i = 0; i < n; i++)
+        {
+            viewer_t *v = &viewers[i];
+            char buf[65536];
+
+            if (v->received >= total)
+                continue;
+
+            if (!v->header)
+            {   /* Read the answer header byte per byte */
+                ssize_t val = recv(v->fd, buf, 1, 0);
+                assert(val == 1);
+                if (buf[0] == "\r\n\r\n"[v->length])
+                    v->length++;
+                else
+                    v->length = buf[0] == '\r';
+                v->header = v->length == 4;
+                continue;
+            }
+
+            ssize_t val = recv(v->fd, buf, sizeof (buf), 0);
+            assert(val > 0);
+            CheckStream(v, (uint8_t *)buf, val);
+            if (v->received >= total)
+                done++;
+        }
+
+    for (unsigned i = 0; i < n; i++)
+        close(viewers[i].fd);
+    free(viewers);
+    return NULL;
+}
+
+static void bench_stream(httpd_host_t *host, unsigned threads)
+{
+    stream = httpd_StreamNew(host, "/stream", "application/octet-stream",
+                             NULL, NULL);
+    assert(stream != NULL);
+
+    vlc_thread_t feeder, th[MAX_DRIVERS];
+    unsigned counts[MAX_DRIVERS];
+
+    atomic_init(&streaming, true);
+    if (vlc_clone(&feeder, Feeder, NULL, VLC_THREAD_PRIORITY_LOW))
+        abort();
+
+    mtime_t start = mdate();
+    for (unsigned i = 0; i < drivers; i++)
+    {
+        counts[i] = clients / drivers + (i < clients % drivers);
+        if (vlc_clone(&th[i], Viewer, &counts[i], VLC_THREAD_PRIORITY_LOW))
+            abort();
+    }
+    for (unsigned i = 0; i < drivers; i++)
+        vlc_join(th[i], NULL);
+    mtime_t duration = mdate() - start;
+
+    atomic_store(&streaming, false);
+    vlc_join(feeder, NULL);
+
+    double bytes = (double)clients * requests * STREAM_BYTES_PER_REQUEST;
+    printf("%u thread(s): %u viewers, %.0f MiB in %"PRId64" us, "
+           "%.0f MiB per second\n", threads, clients, bytes / 1048576.,
+           duration, duration > 0
+           ? bytes * CLOCK_FREQ / duration / 1048576. : 0.);
+
+    httpd_StreamDelete(stream);
+}
+
+static void bench(unsigned threads)
+{
+    char portarg[32], threadsarg[32];
+    const char *argv[] = {
+        "-v", "--http-host=127.0.0.1", portarg, threadsarg,
+    };
+
+    snprintf(portarg, sizeof (portarg), "--http-port=%u", port);
+    snprintf(threadsarg, sizeof (threadsarg), "--http-threads=%u", threads);
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+    httpd_host_t *host = vlc_http_HostNew(obj);
+    if (host == NULL)
+    {
+        libvlc_release(vlc);
+        exit(77); /* port in use? */
+    }
+
+    test_path(host);
+
+    httpd_file_t *file = httpd_FileNew(host, "/bench", "text/plain",
+                                       NULL, NULL, Fill, NULL);
+    assert(file != NULL);
+
+    vlc_thread_t th[MAX_DRIVERS];
+    unsigned counts[MAX_DRIVERS];
+
+    mtime_t start = mdate();
+    for (unsigned i = 0; i < drivers; i++)
+    {
+        counts[i] = clients / drivers + (i < clients % drivers);
+        if (vlc_clone(&th[i], Driver, &counts[i], VLC_THREAD_PRIORITY_LOW))
+            abort();
+    }
+    for (unsigned i = 0; i < drivers; i++)
+        vlc_join(th[i], NULL);
+    mtime_t duration = mdate() - start;
+
+    printf("%u thread(s): %u clients, %u requests in %"PRId64" us, "
+           "%.0f per second\n", threads, clients, clients * requests,
+           duration, duration > 0
+           ? clients * requests * (double)CLOCK_FREQ / duration : 0.);
+
+    httpd_FileDelete(file);
+    bench_stream(host, threads);
+    httpd_HostDelete(host);
+    libvlc_release(vlc);
+}
+
+int main(void)
+{
+    const char *env;
+    struct rlimit lim;
+
+    test_init();
+
+    if ((env = getenv("VLC_BENCH_CLIENTS")) != NULL)
+        clients = strtoul(env, NULL, 10);
+    if ((env = getenv("VLC_BENCH_REQUESTS")) != NULL)
+        requests = strtoul(env, NULL, 10);
+    if ((env = getenv("VLC_BENCH_THREADS")) != NULL)
+        drivers = strtoul(env, NULL, 10);
+    if (getenv("VLC_BENCH_CLIENTS") != NULL
+     || getenv("VLC_BENCH_REQUESTS") != NULL)
+        alarm(0); /* user-defined load, may take long */
+
+    if (drivers < 1 || drivers > MAX_DRIVERS)
+        drivers = MAX_DRIVERS;
+    if (clients < drivers)
+        clients = drivers;
+
+    /* Both ends of each connection live in this process */
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0)
+    {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        if (lim.rlim_cur != RLIM_INFINITY && 2 * clients + 64 > lim.rlim_cur)
+        {
+            clients = (lim.rlim_cur - 64) / 2;
+            printf("clients limited to %u by file descriptors\n", clients);
+        }
+    }
+
+    port = 18000 + (getpid() % 1000);
+
+    for (unsigned threads = 1; threads <= 4; threads *= 2)
+        bench(threads);
+    return 0;
+}